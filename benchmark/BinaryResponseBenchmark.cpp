@@ -0,0 +1,165 @@
+#include "BinaryResponse.h"
+#include "utils/Random.h"
+
+#include <jsoncpp/json/json.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct Measurement {
+  double encode = 0;  // building the response and rendering it
+  double decode = 0;  // parsing the JSON text, as the client has to
+  size_t bytes = 0;   // JSON text and binary frames sent
+};
+
+// Size of a frame of the WebSocket transport named "response" with a one
+// word header: name length, name, type, header length, header, data length.
+size_t frameBytes(size_t elements) {
+  return sizeof(int) * (1 + 2 + 1 + 1 + 1 + 1) + 4 * elements;
+}
+
+/**
+ * Builds a response with fill, renders it with the writer the server uses
+ * and parses it back. Binary frames are copied once, as wst_sendData does.
+ * Freeing the response counts towards encoding, as it does in the server.
+ */
+Measurement measure(bool binaryEnabled, std::function<void(BinaryResponse&, Json::Value&)> fill) {
+  Measurement measurement;
+  std::string text;
+  auto start = std::chrono::steady_clock::now();
+  {
+    BinaryResponse binary(binaryEnabled);
+    Json::Value response(Json::objectValue);
+    response["id"] = 1;
+    fill(binary, response);
+    binary.describe(response);
+    std::vector<char> message;
+    for (size_t elements : { binary.getFloats().size(), binary.getInts().size() }) {
+      if (elements > 0) {
+        message.resize(frameBytes(elements));
+        std::memcpy(message.data(), elements == binary.getFloats().size() ?
+                    static_cast<const void*>(binary.getFloats().data()) :
+                    static_cast<const void*>(binary.getInts().data()), 4 * elements);
+        measurement.bytes += message.size();
+      }
+    }
+    Json::StyledWriter writer;
+    text = writer.write(response);
+  }
+  measurement.encode = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  measurement.bytes += text.size();
+
+  start = std::chrono::steady_clock::now();
+  {
+    Json::Reader reader;
+    Json::Value parsed;
+    reader.parse(text, parsed);
+  }
+  measurement.decode = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return measurement;
+}
+
+void report(const std::string &name, std::function<void(BinaryResponse&, Json::Value&)> fill) {
+  Measurement json = measure(false, fill);
+  Measurement binary = measure(true, fill);
+  std::cout << std::setw(22) << std::left << name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(11) << json.bytes / (1024.0 * 1024.0)
+            << std::setw(11) << binary.bytes / (1024.0 * 1024.0)
+            << std::setprecision(4)
+            << std::setw(11) << json.encode << std::setw(11) << binary.encode
+            << std::setw(11) << json.decode << std::setw(11) << binary.decode << std::endl;
+}
+
+} // namespace
+
+/**
+ * Compares bulk responses sent as JSON arrays with the same responses sent
+ * as binary frames plus JSON metadata, for the shapes of the responses of
+ * fetchSingleEmbedding, fetchKNeighbors, fetchQoi and
+ * fetchMorseSmaleDecomposition. Parsing the text on the server stands in for
+ * JSON.parse in the client.
+ *
+ * Usage: BinaryResponseBenchmark [N] [k]
+ *   N  Number of samples (default 50000).
+ *   k  Number of nearest neighbors (default 15).
+ */
+int main(int argc, char **argv) {
+  unsigned int n = argc > 1 ? std::atoi(argv[1]) : 50000;
+  unsigned int k = argc > 2 ? std::atoi(argv[2]) : 15;
+
+  Random<double> random;
+  std::vector<double> layout(2 * n), colors(3 * n), qoi(n);
+  std::vector<int> knn(k * n);
+  std::vector<unsigned int> crystals(n);
+  for (unsigned int i = 0; i < n; i++) {
+    layout[2 * i] = random.Uniform() - 0.5;
+    layout[2 * i + 1] = random.Uniform() - 0.5;
+    for (unsigned int c = 0; c < 3; c++) {
+      colors[3 * i + c] = random.Uniform();
+    }
+    qoi[i] = random.Uniform() * 100;
+    knn[k * i] = i;
+    for (unsigned int j = 1; j < k; j++) {
+      knn[k * i + j] = std::rand() % n;
+    }
+    crystals[i] = std::rand() % n;
+  }
+  std::vector<std::pair<int, int>> adjacency;
+  for (unsigned int i = 0; i < n; i++) {
+    for (unsigned int j = 1; j < k; j++) {
+      adjacency.push_back({int(i), knn[k * i + j]});
+    }
+  }
+
+  std::cout << "N = " << n << ", k = " << k << std::endl;
+  std::cout << std::setw(22) << std::left << "response" << std::right
+            << std::setw(11) << "JSON (MB)" << std::setw(11) << "bin (MB)"
+            << std::setw(11) << "JSON enc" << std::setw(11) << "bin enc"
+            << std::setw(11) << "JSON dec" << std::setw(11) << "bin dec" << std::endl;
+
+  report("fetchSingleEmbedding", [&](BinaryResponse &binary, Json::Value &response) {
+    response["embedding"]["name"] = "layout";
+    binary.setMatrix(response["embedding"]["layout"], n, 2,
+                     [&](unsigned int i, unsigned int j) { return layout[2 * i + j]; });
+    binary.setMatrix(response["embedding"]["adjacency"], adjacency.size(), 2,
+        [&](unsigned int i, unsigned int j) { return j == 0 ? adjacency[i].first : adjacency[i].second; });
+    binary.setMatrix(response["colors"], n, 3,
+                     [&](unsigned int i, unsigned int j) { return colors[3 * i + j]; });
+  });
+  report("fetchKNeighbors", [&](BinaryResponse &binary, Json::Value &response) {
+    response["k"] = k;
+    binary.setMatrix(response["graph"], k, n,
+                     [&](unsigned int i, unsigned int j) { return knn[k * j + i]; });
+  });
+  report("fetchQoi", [&](BinaryResponse &binary, Json::Value &response) {
+    response["qoiName"] = "qoi";
+    binary.setVector(response["qoi"], n, [&](unsigned int i) { return qoi[i]; });
+  });
+  // 20 persistence levels of 1 to 20 crystals, each crystal listing its share
+  // of the samples.
+  report("fetchMorseSmaleDecomp.", [&](BinaryResponse &binary, Json::Value &response) {
+    for (unsigned int level = 0; level < 20; level++) {
+      Json::Value complex(Json::objectValue);
+      unsigned int count = 20 - level;
+      for (unsigned int c = 0; c < count; c++) {
+        Json::Value crystal(Json::objectValue);
+        unsigned int first = n * c / count;
+        unsigned int last = n * (c + 1) / count;
+        binary.setVector(crystal["sampleIndexes"], last - first,
+                         [&](unsigned int i) { return crystals[first + i]; });
+        complex["crystals"].append(crystal);
+      }
+      response["complexes"].append(complex);
+    }
+  });
+  return 0;
+}
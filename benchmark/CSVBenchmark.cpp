@@ -0,0 +1,157 @@
+#include "csv/csv.h"
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseVector.h"
+#include "utils/loaders.h"
+#include "utils/Random.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// The loaders as they were before the single pass reader, for comparison.
+FortranLinalg::DenseMatrix<double> legacyLoadCSVMatrix(std::string filename) {
+  std::ifstream fstream(filename);
+  std::string line;
+  std::string token;
+
+  std::vector<std::vector<double>> matrix;
+  while (std::getline(fstream, line)) {
+    std::istringstream ss(line);
+    std::vector<double> row;
+    while (std::getline(ss, token, ',')) {
+      row.push_back(std::stod(token));
+    }
+    matrix.push_back(row);
+  }
+
+  FortranLinalg::DenseMatrix<double> m(matrix.size(), matrix[0].size());
+  for (unsigned int i = 0; i < matrix.size(); i++) {
+    for (unsigned int j = 0; j < matrix[0].size(); j++) {
+      m(i, j) = matrix[i][j];
+    }
+  }
+  return m;
+}
+
+FortranLinalg::DenseVector<double> legacyLoadCSVColumn(std::string filename, std::string columnName) {
+  io::CSVReader<1> in(filename.c_str());
+  in.read_header(io::ignore_extra_column, columnName);
+  double value;
+  std::vector<double> vec;
+  while (in.read_row(value)) {
+    vec.push_back(value);
+  }
+
+  FortranLinalg::DenseVector<double> v(vec.size());
+  for (unsigned int i = 0; i < vec.size(); i++) {
+    v(i) = vec[i];
+  }
+  return v;
+}
+
+template <typename F>
+double seconds(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+double relativeDifference(double a, double b) {
+  return a == b ? 0 : std::fabs(a - b) / std::max(std::fabs(a), std::fabs(b));
+}
+
+void report(const std::string &name, double legacy, double single, double difference) {
+  std::cout << std::setw(28) << std::left << name << std::right << std::setw(14) << legacy
+            << std::setw(14) << single << std::setw(10) << legacy / single
+            << std::setw(16) << difference << std::endl;
+}
+
+} // namespace
+
+/**
+ * Compares the single pass CSV reader with the previous loaders on a
+ * generated design parameter file read column by column, and on a distance
+ * matrix read as a whole.
+ *
+ * Usage: CSVBenchmark [distance matrix csv] [rows] [columns]
+ *   distance matrix csv  Defaults to examples/grain/NewdistanceMatrix_aug7.csv.
+ *   rows, columns        Size of the parameter file (default 20000 x 200).
+ */
+int main(int argc, char **argv) {
+  std::string distancesFile = argc > 1 ? argv[1] : "examples/grain/NewdistanceMatrix_aug7.csv";
+  unsigned int rows = argc > 2 ? std::atoi(argv[2]) : 20000;
+  unsigned int cols = argc > 3 ? std::atoi(argv[3]) : 200;
+
+  std::string parametersFile = "CSVBenchmark_parameters.csv";
+  {
+    Random<double> random;
+    std::ofstream out(parametersFile);
+    for (unsigned int j = 0; j < cols; j++) {
+      out << (j ? "," : "") << "p" << j;
+    }
+    out << "\n";
+    for (unsigned int i = 0; i < rows; i++) {
+      for (unsigned int j = 0; j < cols; j++) {
+        out << (j ? "," : "") << random.Uniform() * 100;
+      }
+      out << "\n";
+    }
+  }
+
+  std::cout << std::setw(28) << std::left << "file" << std::right << std::setw(14) << "legacy (s)"
+            << std::setw(14) << "single (s)" << std::setw(10) << "speedup" << std::setw(16)
+            << "max rel. diff" << std::endl;
+
+  std::vector<FortranLinalg::DenseVector<double>> legacyColumns;
+  double legacy = seconds([&]() {
+    for (const std::string &name : HDProcess::loadCSVColumnNames(parametersFile)) {
+      legacyColumns.push_back(legacyLoadCSVColumn(parametersFile, name));
+    }
+  });
+  std::vector<std::pair<std::string, FortranLinalg::DenseVector<double>>> columns;
+  double single = seconds([&]() { columns = HDProcess::loadCSVColumns(parametersFile); });
+  // csv.h parses floats itself and may differ from strtod in the last bit.
+  double difference = 0;
+  for (unsigned int j = 0; j < columns.size(); j++) {
+    for (unsigned int i = 0; i < rows; i++) {
+      difference = std::max(difference, relativeDifference(columns[j].second(i), legacyColumns[j](i)));
+    }
+    columns[j].second.deallocate();
+    legacyColumns[j].deallocate();
+  }
+  std::ostringstream name;
+  name << rows << "x" << cols << " parameters";
+  report(name.str(), legacy, single, difference);
+  std::remove(parametersFile.c_str());
+
+  std::ifstream exists(distancesFile);
+  if (!exists) {
+    std::cout << "Distance matrix " << distancesFile << " not found." << std::endl;
+    return 0;
+  }
+  FortranLinalg::DenseMatrix<double> legacyMatrix, matrix;
+  legacy = seconds([&]() { legacyMatrix = legacyLoadCSVMatrix(distancesFile); });
+  single = seconds([&]() { matrix = HDProcess::loadCSVMatrix(distancesFile); });
+  difference = 0;
+  for (unsigned int j = 0; j < matrix.N(); j++) {
+    for (unsigned int i = 0; i < matrix.M(); i++) {
+      difference = std::max(difference, relativeDifference(matrix(i, j), legacyMatrix(i, j)));
+    }
+  }
+  name.str("");
+  name << matrix.M() << "x" << matrix.N() << " distances";
+  report(name.str(), legacy, single, difference);
+  legacyMatrix.deallocate();
+  matrix.deallocate();
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "flinalg/DenseMatrix.h"
+#include "metrics/BlockedDistance.h"
+#include "metrics/Distance.h"
+#include "metrics/EuclideanMetric.h"
+#include "utils/Random.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+/**
+ * Compares the per-pair metric loop of Distance::computeDistances with the
+ * blocked GEMM distance engine.
+ *
+ * Usage: DistanceBenchmark [maxMemoryGB] [maxNaivePairDims] [threads]
+ *   maxMemoryGB      Skip configurations whose samples and distances exceed
+ *                    this much memory (default 8).
+ *   maxNaivePairDims Skip the per-pair loop once N*N/2*D exceeds this
+ *                    (default 2e11).
+ *   threads          Threads of the blocked engine; 0 uses all (default 0).
+ */
+int main(int argc, char **argv) {
+  double maxMemoryGB = argc > 1 ? std::atof(argv[1]) : 8;
+  double maxNaivePairDims = argc > 2 ? std::atof(argv[2]) : 2e11;
+  unsigned int threads = argc > 3 ? std::atoi(argv[3]) : 0;
+
+  const unsigned int counts[] = {1000, 5000, 20000};
+  const unsigned int dimensions[] = {10, 1000, 100000};
+
+  std::cout << std::setw(8) << "N" << std::setw(10) << "D"
+            << std::setw(14) << "loop (s)" << std::setw(14) << "blocked (s)"
+            << std::setw(10) << "speedup" << std::setw(14) << "max error" << std::endl;
+
+  Random<double> random;
+  for (unsigned int n : counts) {
+    for (unsigned int d : dimensions) {
+      double bytes = 8.0 * n * d + 2 * 8.0 * n * n;
+      std::cout << std::setw(8) << n << std::setw(10) << d;
+      if (bytes > maxMemoryGB * 1e9) {
+        std::cout << "  skipped, needs " << bytes / 1e9 << " GB" << std::endl;
+        continue;
+      }
+
+      FortranLinalg::DenseMatrix<double> samples(d, n);
+      for (unsigned int j = 0; j < n; j++) {
+        for (unsigned int i = 0; i < d; i++) {
+          samples(i, j) = random.Uniform();
+        }
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      FortranLinalg::DenseMatrix<double> blocked =
+          BlockedDistance<double>::computeEuclidean(samples, threads);
+      double blockedTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      if (0.5 * n * n * d > maxNaivePairDims) {
+        std::cout << std::setw(14) << "skipped" << std::setw(14) << blockedTime << std::endl;
+      }
+      else {
+        EuclideanMetric<double> metric;
+        start = std::chrono::steady_clock::now();
+        FortranLinalg::DenseMatrix<double> loop = Distance<double>::computeDistances(samples, metric);
+        double loopTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        double maxError = 0;
+        for (unsigned int j = 0; j < n; j++) {
+          for (unsigned int i = 0; i < n; i++) {
+            maxError = std::max(maxError, std::fabs(loop(i, j) - blocked(i, j)));
+          }
+        }
+        std::cout << std::setw(14) << loopTime << std::setw(14) << blockedTime
+                  << std::setw(10) << loopTime / blockedTime << std::setw(14) << maxError << std::endl;
+        loop.deallocate();
+      }
+
+      blocked.deallocate();
+      samples.deallocate();
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,210 @@
+#include "BinaryResponse.h"
+#include "JsonWriter.h"
+#include "utils/Random.h"
+
+#include <jsoncpp/json/json.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using DomFill = std::function<void(BinaryResponse&, Json::Value&)>;
+using StreamFill = std::function<void(BinaryResponse&, JsonWriter&)>;
+
+struct Measurement {
+  double seconds = 0;
+  size_t bytes = 0;
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Builds the response as a Json::Value and renders it with writer, which is
+ * how the server answered every command before. Freeing the response counts,
+ * as it does in the server.
+ */
+template<typename Writer>
+Measurement measureDom(const DomFill &fill) {
+  Measurement measurement;
+  auto start = std::chrono::steady_clock::now();
+  std::string text;
+  {
+    BinaryResponse binary;
+    Json::Value response(Json::objectValue);
+    response["id"] = 1;
+    fill(binary, response);
+    Writer writer;
+    text = writer.write(response);
+  }
+  measurement.seconds = secondsSince(start);
+  measurement.bytes = text.size();
+  return measurement;
+}
+
+/**
+ * Writes the same response straight into text, which is reused from the
+ * previous run the way each worker thread of the server reuses its buffer.
+ */
+Measurement measureStream(const StreamFill &fill, std::string &text) {
+  Measurement measurement;
+  auto start = std::chrono::steady_clock::now();
+  text.clear();
+  BinaryResponse binary;
+  JsonWriter writer(text);
+  writer.beginObject();
+  writer.key("id").value(1);
+  fill(binary, writer);
+  writer.endObject();
+  measurement.seconds = secondsSince(start);
+  measurement.bytes = text.size();
+  return measurement;
+}
+
+void report(const std::string &name, const DomFill &dom, const StreamFill &stream) {
+  Measurement styled = measureDom<Json::StyledWriter>(dom);
+  Measurement fast = measureDom<Json::FastWriter>(dom);
+  std::string text;
+  Measurement cold = measureStream(stream, text);
+  Measurement warm = measureStream(stream, text);
+  std::cout << std::setw(22) << std::left << name << std::right << std::fixed << std::setprecision(2)
+            << std::setw(11) << styled.bytes / (1024.0 * 1024.0)
+            << std::setw(11) << fast.bytes / (1024.0 * 1024.0)
+            << std::setw(11) << warm.bytes / (1024.0 * 1024.0)
+            << std::setprecision(4)
+            << std::setw(11) << styled.seconds << std::setw(11) << fast.seconds
+            << std::setw(11) << cold.seconds << std::setw(11) << warm.seconds << std::endl;
+}
+
+} // namespace
+
+/**
+ * Compares the JSON text responses of the heaviest commands built as a
+ * Json::Value and rendered with the StyledWriter the server used, or with a
+ * FastWriter, against the same responses written with a JsonWriter, into a
+ * new buffer (cold) and into the buffer of the previous response (warm).
+ *
+ * Usage: JsonWriterBenchmark [N] [k]
+ *   N  Number of samples (default 50000).
+ *   k  Number of nearest neighbors (default 15).
+ */
+int main(int argc, char **argv) {
+  unsigned int n = argc > 1 ? std::atoi(argv[1]) : 50000;
+  unsigned int k = argc > 2 ? std::atoi(argv[2]) : 15;
+
+  Random<double> random;
+  std::vector<double> layout(2 * n), colors(3 * n), qoi(n);
+  std::vector<int> knn(k * n);
+  std::vector<unsigned int> crystals(n);
+  for (unsigned int i = 0; i < n; i++) {
+    layout[2 * i] = random.Uniform() - 0.5;
+    layout[2 * i + 1] = random.Uniform() - 0.5;
+    for (unsigned int c = 0; c < 3; c++) {
+      colors[3 * i + c] = random.Uniform();
+    }
+    qoi[i] = random.Uniform() * 100;
+    knn[k * i] = i;
+    for (unsigned int j = 1; j < k; j++) {
+      knn[k * i + j] = std::rand() % n;
+    }
+    crystals[i] = std::rand() % n;
+  }
+  std::vector<std::pair<int, int>> adjacency;
+  for (unsigned int i = 0; i < n; i++) {
+    for (unsigned int j = 1; j < k; j++) {
+      adjacency.push_back({int(i), knn[k * i + j]});
+    }
+  }
+  auto layoutAt = [&](unsigned int i, unsigned int j) { return layout[2 * i + j]; };
+  auto adjacencyAt = [&](unsigned int i, unsigned int j) {
+    return j == 0 ? adjacency[i].first : adjacency[i].second;
+  };
+  auto colorAt = [&](unsigned int i, unsigned int j) { return colors[3 * i + j]; };
+  auto knnAt = [&](unsigned int i, unsigned int j) { return knn[k * j + i]; };
+  auto qoiAt = [&](unsigned int i) { return qoi[i]; };
+
+  std::cout << "N = " << n << ", k = " << k << std::endl;
+  std::cout << std::setw(22) << std::left << "response" << std::right
+            << std::setw(11) << "styled MB" << std::setw(11) << "fast MB"
+            << std::setw(11) << "writer MB"
+            << std::setw(11) << "styled s" << std::setw(11) << "fast s"
+            << std::setw(11) << "cold s" << std::setw(11) << "warm s" << std::endl;
+
+  report("fetchSingleEmbedding",
+    [&](BinaryResponse &binary, Json::Value &response) {
+      response["embedding"]["name"] = "layout";
+      binary.setMatrix(response["embedding"]["layout"], n, 2, layoutAt);
+      binary.setMatrix(response["embedding"]["adjacency"], adjacency.size(), 2, adjacencyAt);
+      binary.setMatrix(response["colors"], n, 3, colorAt);
+    },
+    [&](BinaryResponse &binary, JsonWriter &writer) {
+      writer.key("embedding").beginObject();
+      writer.key("name").value("layout");
+      binary.writeMatrix(writer.key("layout"), n, 2, layoutAt);
+      binary.writeMatrix(writer.key("adjacency"), adjacency.size(), 2, adjacencyAt);
+      writer.endObject();
+      binary.writeMatrix(writer.key("colors"), n, 3, colorAt);
+    });
+  report("fetchKNeighbors",
+    [&](BinaryResponse &binary, Json::Value &response) {
+      response["k"] = k;
+      binary.setMatrix(response["graph"], k, n, knnAt);
+    },
+    [&](BinaryResponse &binary, JsonWriter &writer) {
+      writer.key("k").value(k);
+      binary.writeMatrix(writer.key("graph"), k, n, knnAt);
+    });
+  report("fetchQoi",
+    [&](BinaryResponse &binary, Json::Value &response) {
+      response["qoiName"] = "qoi";
+      binary.setVector(response["qoi"], n, qoiAt);
+    },
+    [&](BinaryResponse &binary, JsonWriter &writer) {
+      writer.key("qoiName").value("qoi");
+      binary.writeVector(writer.key("qoi"), n, qoiAt);
+    });
+  // 20 persistence levels of 1 to 20 crystals, each crystal listing its share
+  // of the samples.
+  report("fetchMorseSmaleDecomp.",
+    [&](BinaryResponse &binary, Json::Value &response) {
+      for (unsigned int level = 0; level < 20; level++) {
+        Json::Value complex(Json::objectValue);
+        unsigned int count = 20 - level;
+        for (unsigned int c = 0; c < count; c++) {
+          Json::Value crystal(Json::objectValue);
+          unsigned int first = n * c / count;
+          unsigned int last = n * (c + 1) / count;
+          binary.setVector(crystal["sampleIndexes"], last - first,
+                           [&](unsigned int i) { return crystals[first + i]; });
+          complex["crystals"].append(crystal);
+        }
+        response["complexes"].append(complex);
+      }
+    },
+    [&](BinaryResponse &binary, JsonWriter &writer) {
+      writer.key("complexes").beginArray();
+      for (unsigned int level = 0; level < 20; level++) {
+        writer.beginObject().key("crystals").beginArray();
+        unsigned int count = 20 - level;
+        for (unsigned int c = 0; c < count; c++) {
+          unsigned int first = n * c / count;
+          unsigned int last = n * (c + 1) / count;
+          writer.beginObject();
+          binary.writeVector(writer.key("sampleIndexes"), last - first,
+                             [&](unsigned int i) { return crystals[first + i]; });
+          writer.endObject();
+        }
+        writer.endArray().endObject();
+      }
+      writer.endArray();
+    });
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include "flinalg/DenseMatrix.h"
+#include "graph/KNNBackend.h"
+#include "utils/Random.h"
+#include "utils/ThreadPool.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+
+/**
+ * Times the nearest neighbor graph of random samples with each KNN backend,
+ * exactly and with an error bound for the trees, and reports the recall of
+ * each against brute force on 1000 of the samples.
+ *
+ * Usage: KNNBackendBenchmark [N] [dimension] [k] [eps] [threads]
+ *   N          Number of samples (default 100000).
+ *   dimension  Coordinates per sample (default 5).
+ *   k          Number of nearest neighbors (default 15).
+ *   eps        Error bound of the approximate trees (default 0.5).
+ *   threads    Threads of the search; 0 uses all (default 0).
+ */
+int main(int argc, char **argv) {
+  unsigned int n = argc > 1 ? std::atoi(argv[1]) : 100000;
+  unsigned int dimension = argc > 2 ? std::atoi(argv[2]) : 5;
+  unsigned int k = argc > 3 ? std::atoi(argv[3]) : 15;
+  double eps = argc > 4 ? std::atof(argv[4]) : 0.5;
+  unsigned int threads = argc > 5 ? std::atoi(argv[5]) : 0;
+
+  Random<double> random;
+  FortranLinalg::DenseMatrix<double> samples(dimension, n);
+  for (unsigned int j = 0; j < n; j++) {
+    for (unsigned int i = 0; i < dimension; i++) {
+      samples(i, j) = random.Uniform();
+    }
+  }
+
+  std::cout << "N = " << n << ", dimension = " << dimension << ", k = " << k
+            << ", threads = " << ThreadPool::resolveThreadCount(threads) << std::endl;
+  std::cout << std::setw(10) << "backend" << std::setw(8) << "eps" << std::setw(14) << "graph (s)"
+            << std::setw(10) << "recall" << std::endl;
+  FortranLinalg::DenseMatrix<int> knn(k, n);
+  FortranLinalg::DenseMatrix<double> dists(k, n);
+  for (std::string name : {"brute", "kdtree", "bdtree"}) {
+    for (double e : {0.0, eps}) {
+      if (name == "brute" && e > 0) {
+        continue;
+      }
+      std::unique_ptr<KNNBackend<double>> backend = KNNBackend<double>::create(name, threads, e);
+      auto start = std::chrono::steady_clock::now();
+      backend->findKNN(samples, knn, dists, false);
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      std::cout << std::setw(10) << name << std::setw(8) << e << std::setw(14) << seconds
+                << std::setw(10) << backend->recall(samples, k) << std::endl;
+    }
+  }
+
+  knn.deallocate();
+  dists.deallocate();
+  samples.deallocate();
+  return 0;
+}
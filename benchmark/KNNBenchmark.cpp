@@ -0,0 +1,68 @@
+#include "flinalg/DenseMatrix.h"
+#include "metrics/BlockedDistance.h"
+#include "metrics/Distance.h"
+#include "utils/Random.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+/**
+ * Compares the full-heap Distance::findKNN with the in-place top-k selection
+ * on a distance matrix of random samples.
+ *
+ * Usage: KNNBenchmark [N] [threads]
+ *   N        Number of samples (default 20000).
+ *   threads  Threads of the top-k selection; 0 uses all (default 0).
+ */
+int main(int argc, char **argv) {
+  unsigned int n = argc > 1 ? std::atoi(argv[1]) : 20000;
+  unsigned int threads = argc > 2 ? std::atoi(argv[2]) : 0;
+  const unsigned int dimension = 10;
+  const unsigned int ks[] = {15, 50, 200};
+
+  Random<double> random;
+  FortranLinalg::DenseMatrix<double> samples(dimension, n);
+  for (unsigned int j = 0; j < n; j++) {
+    for (unsigned int i = 0; i < dimension; i++) {
+      samples(i, j) = random.Uniform();
+    }
+  }
+  FortranLinalg::DenseMatrix<double> distances = BlockedDistance<double>::computeEuclidean(samples);
+  samples.deallocate();
+
+  std::cout << "N = " << n << std::endl;
+  std::cout << std::setw(6) << "k" << std::setw(14) << "heap (s)" << std::setw(14) << "top-k (s)"
+            << std::setw(10) << "speedup" << std::setw(12) << "identical" << std::endl;
+  for (unsigned int k : ks) {
+    FortranLinalg::DenseMatrix<int> heapKNN(k, n), knn(k, n);
+    FortranLinalg::DenseMatrix<double> heapDists(k, n), dists(k, n);
+
+    FortranLinalg::Matrix<double> &heapInput = distances;
+    auto start = std::chrono::steady_clock::now();
+    Distance<double>::findKNN(heapInput, heapKNN, heapDists);
+    double heapTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    Distance<double>::findKNN(distances, knn, dists, threads);
+    double selectTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    bool identical = true;
+    for (unsigned int i = 0; i < n; i++) {
+      for (unsigned int j = 0; j < k; j++) {
+        identical = identical && heapKNN(j, i) == knn(j, i) && heapDists(j, i) == dists(j, i);
+      }
+    }
+    std::cout << std::setw(6) << k << std::setw(14) << heapTime << std::setw(14) << selectTime
+              << std::setw(10) << heapTime / selectTime << std::setw(12) << (identical ? "yes" : "NO")
+              << std::endl;
+
+    heapKNN.deallocate();
+    knn.deallocate();
+    heapDists.deallocate();
+    dists.deallocate();
+  }
+  distances.deallocate();
+  return 0;
+}
@@ -0,0 +1,178 @@
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseVector.h"
+#include "morsesmale/FlatNNMSComplex.h"
+#include "morsesmale/NNMSComplex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Samples on a jittered square grid with a wavy function plus noise, which
+ * gives large crystals and many small extrema. Computing exact neighbors of a
+ * million samples would dominate the benchmark, so the neighbors of each sample
+ * are the k closest of the grid cells around it, sorted by squared distance,
+ * the sample itself first.
+ */
+void createSamples(unsigned int n, unsigned int k, FortranLinalg::DenseMatrix<int> &knn,
+                   FortranLinalg::DenseMatrix<double> &knnDists,
+                   FortranLinalg::DenseVector<double> &y) {
+  int side = std::ceil(std::sqrt(double(n)));
+  // Even a corner sample has (radius + 1)^2 cells around it.
+  int radius = 1;
+  while ((radius + 1) * (radius + 1) < int(k)) {
+    radius++;
+  }
+  std::mt19937 random(11);
+  std::uniform_real_distribution<double> jitter(-0.3, 0.3);
+  std::vector<double> px(n), py(n);
+  for (unsigned int i = 0; i < n; i++) {
+    px[i] = i % side + jitter(random);
+    py[i] = i / side + jitter(random);
+    y(i) = std::sin(px[i] / 50) * std::cos(py[i] / 40) + jitter(random);
+  }
+
+  std::vector<std::pair<double, int>> candidates;
+  for (unsigned int i = 0; i < n; i++) {
+    int cx = i % side;
+    int cy = i / side;
+    candidates.clear();
+    for (int dy = -radius; dy <= radius; dy++) {
+      for (int dx = -radius; dx <= radius; dx++) {
+        int x = cx + dx;
+        int j = (cy + dy) * side + x;
+        if (x < 0 || x >= side || cy + dy < 0 || j >= int(n)) {
+          continue;
+        }
+        double ex = px[j] - px[i];
+        double ey = py[j] - py[i];
+        candidates.push_back(std::make_pair(j == int(i) ? -1.0 : ex * ex + ey * ey, j));
+      }
+    }
+    std::partial_sort(candidates.begin(), candidates.begin() + k, candidates.end());
+    for (unsigned int c = 0; c < k; c++) {
+      knn(c, i) = candidates[c].second;
+      knnDists(c, i) = std::max(0.0, candidates[c].first);
+    }
+  }
+}
+
+/**
+ * Seconds to merge the complex at each of the given levels and partition the
+ * samples, and the partitions at the last one.
+ */
+template<typename Complex>
+double timeLevels(Complex &complex, const std::vector<double> &levels,
+                  std::vector<int> &partitions) {
+  typename Complex::MergeState state;
+  auto start = std::chrono::steady_clock::now();
+  for (double level : levels) {
+    complex.mergePersistence(level, state);
+    FortranLinalg::DenseVector<int> crys = complex.getPartitions(state);
+    partitions.assign(crys.data(), crys.data() + crys.N());
+    crys.deallocate();
+  }
+  double seconds = secondsSince(start);
+  state.cleanup();
+  return seconds;
+}
+
+} // namespace
+
+/**
+ * Compares building the Morse-Smale complex from precomputed nearest
+ * neighbors with NNMSComplex and with FlatNNMSComplex, and merging each at
+ * ten persistence levels, and checks that both agree. Also times the
+ * hierarchy of the coarsest levels of FlatNNMSComplex. They only differ where
+ * saddles or merges of NNMSComplex have exactly the same persistence, which
+ * the strong noise of the samples makes likely at large N.
+ *
+ * Usage: MSComplexBenchmark [N] [k] [legacy] [threads]
+ *   N        Number of samples (default 1000000).
+ *   k        Number of nearest neighbors (default 50).
+ *   legacy   0 skips NNMSComplex (default 1).
+ *   threads  Threads of FlatNNMSComplex, 0 for all hardware threads (default 0).
+ */
+int main(int argc, char **argv) {
+  unsigned int n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  unsigned int k = argc > 2 ? std::atoi(argv[2]) : 50;
+  bool legacy = argc > 3 ? std::atoi(argv[3]) != 0 : true;
+  unsigned int threads = argc > 4 ? std::atoi(argv[4]) : 0;
+
+  FortranLinalg::DenseMatrix<int> knn(k, n);
+  FortranLinalg::DenseMatrix<double> knnDists(k, n);
+  FortranLinalg::DenseVector<double> y(n);
+  createSamples(n, k, knn, knnDists, y);
+
+  auto start = std::chrono::steady_clock::now();
+  FlatNNMSComplex<double> flat(knn, knnDists, y, false, 0, threads);
+  double flatSeconds = secondsSince(start);
+  FortranLinalg::DenseVector<double> persistence = flat.getPersistence();
+  std::vector<double> levels;
+  for (unsigned int i = 0; i < 10; i++) {
+    levels.push_back(persistence((persistence.N() - 1) * i / 9));
+  }
+  std::vector<int> flatPartitions;
+  double flatLevelSeconds = timeLevels(flat, levels, flatPartitions);
+
+  std::cout << "N = " << n << ", k = " << k << ", threads = "
+            << ThreadPool::resolveThreadCount(threads) << ", extrema = " << flat.getNAllExtrema()
+            << ", crystals = " << flat.getNBaseCrystals()
+            << ", levels = " << persistence.N() << std::endl;
+  std::cout << std::setw(16) << std::left << "complex" << std::right
+            << std::setw(12) << "build s" << std::setw(12) << "10 levels s" << std::endl;
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << std::setw(16) << std::left << "FlatNNMSComplex" << std::right
+            << std::setw(12) << flatSeconds << std::setw(12) << flatLevelSeconds << std::endl;
+
+  // The relabel tables of the hierarchy grow with levels times crystals, so
+  // only the coarsest levels are kept, as the server does when asked for a
+  // number of persistence levels.
+  unsigned int hierarchyLevels = std::min(1000u, (unsigned int) persistence.N());
+  start = std::chrono::steady_clock::now();
+  MSHierarchy hierarchy = flat.getHierarchy(persistence.N() - hierarchyLevels);
+  std::cout << "hierarchy of " << hierarchyLevels << " levels: " << secondsSince(start) << " s, "
+            << hierarchy.byteSize() / (1024 * 1024) << " MiB" << std::endl;
+
+  if (legacy) {
+    start = std::chrono::steady_clock::now();
+    NNMSComplex<double> complex(knn, knnDists, y);
+    double seconds = secondsSince(start);
+    std::vector<int> partitions;
+    double levelSeconds = timeLevels(complex, levels, partitions);
+    std::cout << std::setw(16) << std::left << "NNMSComplex" << std::right
+              << std::setw(12) << seconds << std::setw(12) << levelSeconds << std::endl;
+
+    FortranLinalg::DenseVector<double> expected = complex.getPersistence();
+    bool same = expected.N() == persistence.N() && partitions == flatPartitions;
+    for (unsigned int i = 0; same && i < expected.N(); i++) {
+      same = expected(i) == persistence(i);
+    }
+    if (same) {
+      std::cout << "identical persistence levels and partitions" << std::endl;
+    } else {
+      // NNMSComplex keeps one of several saddles or merges of equal persistence.
+      std::cout << "different, NNMSComplex has " << expected.N() << " levels" << std::endl;
+    }
+    expected.deallocate();
+    complex.cleanup();
+  }
+
+  persistence.deallocate();
+  knn.deallocate();
+  knnDists.deallocate();
+  y.deallocate();
+  return 0;
+}
@@ -0,0 +1,105 @@
+#include "dspacex/Precision.h"
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseVector.h"
+#include "hdprocess/HDProcessor.h"
+#include "metrics/BlockedDistance.h"
+#include "utils/loaders.h"
+#include "utils/Random.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/resource.h>
+
+namespace {
+
+double peakResidentMB() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+} // namespace
+
+/**
+ * Reports the peak resident set size while processing several fields of the
+ * same random samples one after the other, the way the server processes the
+ * fields of a dataset. Each result is freed before the next field is
+ * processed, so growth of the peak across fields shows memory held on to by
+ * the pipeline. With samples, the fields are processed from the samples
+ * matrix without computing the distance matrix, as the server does for
+ * datasets without one. Given the grain example instead of N, its distance
+ * matrix is processed, with its QoI as every field, from the repository root.
+ *
+ * Usage: ProcessorMemoryBenchmark [N | grain] [fields] [samples]
+ *   N        Number of samples (default 2000).
+ *   grain    Process examples/grain/NewdistanceMatrix_aug7.csv and QOI_400.csv.
+ *   fields   Number of fields processed in turn (default 4).
+ *   samples  1 processes the samples matrix instead of distances (default 0).
+ */
+int main(int argc, char **argv) {
+  bool grain = argc > 1 && std::string(argv[1]) == "grain";
+  unsigned int n = argc > 1 && !grain ? std::atoi(argv[1]) : 2000;
+  unsigned int fields = argc > 2 ? std::atoi(argv[2]) : 4;
+  bool fromSamples = !grain && argc > 3 ? std::atoi(argv[3]) != 0 : false;
+  const unsigned int dimension = 5;
+
+  FortranLinalg::DenseMatrix<Precision> samples;
+  FortranLinalg::DenseMatrix<Precision> distances;
+  FortranLinalg::DenseVector<Precision> grainQoi;
+  if (grain) {
+    distances = HDProcess::loadCSVMatrix("examples/grain/NewdistanceMatrix_aug7.csv");
+    grainQoi = HDProcess::loadCSVColumn("examples/grain/QOI_400.csv");
+    n = distances.N();
+  } else {
+    Random<Precision> random;
+    samples = FortranLinalg::DenseMatrix<Precision>(dimension, n);
+    for (unsigned int j = 0; j < n; j++) {
+      for (unsigned int i = 0; i < dimension; i++) {
+        samples(i, j) = random.Uniform();
+      }
+    }
+    if (!fromSamples) {
+      distances = BlockedDistance<Precision>::computeEuclidean(samples);
+    }
+  }
+
+  std::cout << "N = " << n << ", distances "
+            << (fromSamples ? 0 : sizeof(Precision) * n * n / (1024.0 * 1024.0)) << " MB"
+            << std::endl;
+  std::cout << "before processing: peak RSS " << peakResidentMB() << " MB" << std::endl;
+  std::cout << std::setw(6) << "field" << std::setw(12) << "time (s)" << std::setw(14)
+            << "result (MB)" << std::setw(16) << "peak RSS (MB)" << std::endl;
+  for (unsigned int field = 0; field < fields; field++) {
+    FortranLinalg::DenseVector<Precision> qoi(n);
+    for (unsigned int j = 0; j < n; j++) {
+      qoi(j) = grain ? grainQoi(j) :
+          std::sin((field + 2) * samples(0, j)) * std::cos(3 * samples(1, j)) + 1e-6 * j;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    HDProcessor processor;
+    HDProcessResult *result = fromSamples ?
+        processor.processOnSamples(samples, qoi,
+            15 /* knn */, 50 /* nSamples */, 10 /* persistence */, false /* random */,
+            0.25 /* sigma */, 0 /* sigmaSmooth */) :
+        processor.processOnMetric(distances, qoi,
+            15 /* knn */, 50 /* nSamples */, 10 /* persistence */, false /* random */,
+            0.25 /* sigma */, 0 /* sigmaSmooth */);
+    double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::setw(6) << field << std::setw(12) << time << std::setw(14)
+              << result->byteSize() / (1024.0 * 1024.0) << std::setw(16) << peakResidentMB()
+              << std::endl;
+    result->deallocate();
+    delete result;
+    qoi.deallocate();
+  }
+  samples.deallocate();
+  distances.deallocate();
+  grainQoi.deallocate();
+  return 0;
+}
@@ -18,6 +18,15 @@ class Client {
     this._initializeEventHandling();
 
     this.commandResponseMap = {};
+
+    // Whether the server pairs the binary socket with the text socket, so
+    // that bulk arrays of responses can arrive as binary frames.
+    this.dataSocketBound = false;
+
+    // Binary frames by message id and buffer type, and responses that are
+    // still waiting for some of their frames.
+    this.binaryFrames = {};
+    this.binaryResponses = {};
   }
 
   /**
@@ -48,10 +57,11 @@ class Client {
   /**
    * Constructs and dispatches an event with the eventName provided.
    * @param {string} eventName
+   * @param {object} detail optional payload, passed as event.detail
    */
-  _dispatch(eventName) {
-    let event = document.createEvent('Event');
-    event.initEvent(eventName, true, true);
+  _dispatch(eventName, detail) {
+    let event = document.createEvent('CustomEvent');
+    event.initCustomEvent(eventName, true, true, detail);
     this.dispatchEvent(event);
   }
 
@@ -89,12 +99,48 @@ class Client {
   _maybeUpdateState() {
     if (this.socketBd.readyState === WebSocket.OPEN &&
         this.socketUt.readyState === WebSocket.OPEN) {
+      this._bindDataSocket();
       this._dispatch('connected');
     } else {
 
     }
   }
 
+  /**
+   * Registers the binary socket with the server under a random token and
+   * asks the server to pair it with the text socket. Until the pairing is
+   * done all responses come back as plain JSON.
+   * @param {number} attempts
+   */
+  _bindDataSocket(attempts = 3) {
+    const token = Math.floor(Math.random() * 0x7fffffff);
+    const name = 'registerDataSocket';
+    const nameWords = Math.ceil(name.length / 4);
+    const TYPE_INT32 = 5;
+
+    // The frame layout of the WebSocket transport: name length, name padded
+    // to whole words, type, header length, header, data length and data.
+    let frame = new Int32Array(1 + nameWords + 5);
+    frame[0] = name.length;
+    new Uint8Array(frame.buffer, 4, name.length).set(
+      Array.from(name, (c) => c.charCodeAt(0)));
+    frame.set([TYPE_INT32, 1, token, 1, token], 1 + nameWords);
+    this.socketBd.send(frame.buffer);
+
+    this._createCommandPromise({
+      name: 'bindDataSocket',
+      token: token,
+    }).then((response) => {
+      if (response.bound) {
+        this.dataSocketBound = true;
+      } else if (attempts > 1) {
+        this._bindDataSocket(attempts - 1);
+      } else {
+        this._log(' Binary responses unavailable: ' + response.error_msg);
+      }
+    });
+  }
+
   /**
    * Logging wrapper.
    * @param {string} message
@@ -127,7 +173,10 @@ class Client {
       this._sendCommand(command, function(response, error) {
         if (error) {
           reject(error);
-        } else {
+        } else if (!response.cancelled) {
+          // A cancelled request was superseded by a later one on its
+          // channel; its promise is left pending so stale results are
+          // never applied.
           resolve(response);
         }
         this._dispatch('networkInactive');
@@ -170,6 +219,7 @@ class Client {
       name: 'fetchKNeighbors',
       datasetId: datasetId,
       k: k,
+      binary: this.dataSocketBound,
     };
     return this._createCommandPromise(command);
   }
@@ -190,6 +240,7 @@ class Client {
       category: category,
       fieldname: fieldname,
       k: k,
+      binary: this.dataSocketBound,
     };
     return this._createCommandPromise(command);
   }
@@ -197,6 +248,10 @@ class Client {
   /**
    * Compute Morse-Smale Decomposition, return
    * only the persistence range (i.e. min and max).
+   * The server answers as soon as the range is known and computes the levels
+   * in the background, coarsest first. Levels still being computed have a
+   * complex size of 0; a 'persistenceLevelReady' event announces each level
+   * as it completes.
    * @param {string} datasetId
    * @param {string} category design parameter or qoi
    * @param {string} fieldname
@@ -211,6 +266,7 @@ class Client {
       category: category,
       fieldname: fieldname,
       k: k,
+      stream: true,
     };
     return this._createCommandPromise(command);
   }
@@ -232,6 +288,7 @@ class Client {
       fieldname: fieldname,
       k: k,
       persistenceLevel: persistenceLevel,
+      channel: 'persistenceLevel',
     };
     return this._createCommandPromise(command);
   }
@@ -300,6 +357,7 @@ class Client {
       persistenceLevel: persistenceLevel,
       category: category,
       fieldName: fieldName,
+      binary: this.dataSocketBound,
     };
     return this._createCommandPromise(command);
   }
@@ -370,6 +428,7 @@ class Client {
       fieldname: fieldname,
       k: k,
       persistenceLevel: persistenceLevel,
+      channel: 'morseSmaleRegression',
     };
     return this._createCommandPromise(command);
   }
@@ -391,6 +450,7 @@ class Client {
       fieldname: fieldname,
       k: k,
       persistenceLevel: persistenceLevel,
+      channel: 'morseSmaleExtrema',
     };
     return this._createCommandPromise(command);
   }
@@ -423,6 +483,7 @@ class Client {
       name: 'fetchParameter',
       datasetId: datasetId,
       parameterName: parameterName,
+      binary: this.dataSocketBound,
     };
     return this._createCommandPromise(command);
   }
@@ -438,6 +499,7 @@ class Client {
       name: 'fetchQoi',
       datasetId: datasetId,
       qoiName: qoiName,
+      binary: this.dataSocketBound,
     };
     return this._createCommandPromise(command);
   }
@@ -455,6 +517,26 @@ class Client {
     return this._createCommandPromise(command);
   }
 
+  /**
+   * Grab count thumbnails of the given dataset starting at offset. Over the
+   * binary socket each rawData is a Uint8Array of the PNG file, otherwise a
+   * base64 string of it.
+   * @param {string} datasetId
+   * @param {number} offset
+   * @param {number} count
+   * @return {Promise}
+   */
+  fetchThumbnailRange(datasetId, offset, count) {
+    let command = {
+      name: 'fetchThumbnailRange',
+      datasetId: datasetId,
+      offset: offset,
+      count: count,
+      binary: this.dataSocketBound,
+    };
+    return this._createCommandPromise(command);
+  }
+
   /**
    * Text Socket onOpen event callback.
    * @param {Event} event
@@ -480,10 +562,67 @@ class Client {
    */
   _onSocketUtMessage(event) {
     let response = JSON.parse(event.data);
+    // Messages without an id are events the server pushes on its own.
+    if (response.event) {
+      this._dispatch(response.event, response);
+      return;
+    }
+    if (response.binaryBuffers) {
+      this.binaryResponses[response.id] = response;
+      this._maybeCompleteBinaryResponse(response.id);
+      return;
+    }
     this.commandResponseMap[response.id](response);
     delete this.commandResponseMap[response.id];
   }
 
+  /**
+   * Hands a response to its callback once all of its binary frames are in,
+   * replacing each buffer reference by a view of the frame.
+   * @param {number} id message id
+   */
+  _maybeCompleteBinaryResponse(id) {
+    let response = this.binaryResponses[id];
+    let frames = this.binaryFrames[id] || {};
+    if (!response || !response.binaryBuffers.every((type) => frames[type])) {
+      return;
+    }
+    delete this.binaryResponses[id];
+    delete this.binaryFrames[id];
+    delete response.binaryBuffers;
+    this._resolveBufferReferences(response, frames);
+    this.commandResponseMap[id](response);
+    delete this.commandResponseMap[id];
+  }
+
+  /**
+   * Replaces every buffer reference below value by a typed array view, or by
+   * an array of row views for matrices.
+   * @param {object} value
+   * @param {object} frames typed arrays by buffer type
+   */
+  _resolveBufferReferences(value, frames) {
+    for (let key of Object.keys(value)) {
+      let child = value[key];
+      if (!child || typeof child !== 'object') {
+        continue;
+      }
+      if (child.bufferType === undefined) {
+        this._resolveBufferReferences(child, frames);
+        continue;
+      }
+      let [rows, cols] = child.shape;
+      let start = child.offset;
+      let array = frames[child.bufferType];
+      if (cols === undefined) {
+        value[key] = array.subarray(start, start + rows);
+      } else {
+        value[key] = Array.from({ length: rows }, (_, i) =>
+          array.subarray(start + i * cols, start + (i + 1) * cols));
+      }
+    }
+  }
+
   /**
    * Text Socket onError event callback.
    * @param {Event} event
@@ -515,7 +654,40 @@ class Client {
    * @param {Event} event
    */
   _onSocketBdMessage(event) {
+    const TYPE_UINT8 = 1;
+    const TYPE_INT32 = 5;
+    const TYPE_FLOAT32 = 7;
+    const TYPE_FLOAT64 = 8;
+
+    let words = new Int32Array(event.data, 0, 1);
+    let nameLength = words[0];
+    let nameWords = Math.ceil(nameLength / 4);
+    let name = String.fromCharCode(...new Uint8Array(event.data, 4, nameLength));
+    let ioff = 1 + nameWords;
+    let [type, hlen] = new Int32Array(event.data, 4 * ioff, 2);
+    ioff += 2;
+    let header = new Int32Array(event.data, 4 * ioff, hlen);
+    ioff += hlen;
+    let length = new Int32Array(event.data, 4 * ioff, 1)[0];
+    ioff += 1;
+    if (type === TYPE_FLOAT64 && (nameWords + 4 + hlen) % 2 === 1) {
+      ioff += 1;
+    }
 
+    if (name !== 'response') {
+      this._log(' Unexpected binary frame: ' + name);
+      return;
+    }
+    let id = header[0];
+    let frames = this.binaryFrames[id] = this.binaryFrames[id] || {};
+    if (type === TYPE_FLOAT32) {
+      frames.float32 = new Float32Array(event.data, 4 * ioff, length);
+    } else if (type === TYPE_INT32) {
+      frames.int32 = new Int32Array(event.data, 4 * ioff, length);
+    } else if (type === TYPE_UINT8) {
+      frames.uint8 = new Uint8Array(event.data, 4 * ioff, length);
+    }
+    this._maybeCompleteBinaryResponse(id);
   }
 
   /**
@@ -44,6 +44,8 @@ class DecompositionPanel extends React.Component {
         this._getDecompositionFieldMenuItems.bind(this);
     this.decompositionConfigValid = this.decompositionConfigValid.bind(this);
     this.fetchDecomposition = this.fetchDecomposition.bind(this);
+    this.handlePersistenceLevelReady =
+        this.handlePersistenceLevelReady.bind(this);
 
     this.state = {
       decompositionMode: 'Morse-Smale',
@@ -58,6 +60,90 @@ class DecompositionPanel extends React.Component {
     };
 
     this.client = this.props.dsxContext.client;
+
+    // Crystal counts of levels the server announced as ready, by level, for
+    // the decomposition in readyLevelsKey. Events can arrive before the
+    // persistence reply, so they are kept until it does.
+    this.readyLevelsKey = null;
+    this.readyLevels = {};
+  }
+
+  /**
+   * Callback invoked immediately after the component is mounted.
+   */
+  componentDidMount() {
+    this.client.addEventListener('persistenceLevelReady',
+        this.handlePersistenceLevelReady);
+  }
+
+  /**
+   * Callback invoked immediately before the component is unmounted.
+   */
+  componentWillUnmount() {
+    this.client.removeEventListener('persistenceLevelReady',
+        this.handlePersistenceLevelReady);
+  }
+
+  /**
+   * Returns a key identifying a Morse-Smale decomposition.
+   * @param {number} datasetId
+   * @param {string} category
+   * @param {string} field
+   * @param {number} k
+   * @return {string}
+   */
+  _decompositionKey(datasetId, category, field, k) {
+    return [datasetId, category, field, k].join('/');
+  }
+
+  /**
+   * Starts collecting the levels that become ready for a decomposition.
+   * @param {string} key
+   */
+  _resetReadyLevels(key) {
+    if (this.readyLevelsKey !== key) {
+      this.readyLevelsKey = key;
+      this.readyLevels = {};
+    }
+  }
+
+  /**
+   * Fills the crystal counts of levels that became ready into complexSizes.
+   * @param {Array<number>} complexSizes
+   * @param {number} minPersistence
+   * @return {Array<number>}
+   */
+  _mergeReadyLevels(complexSizes, minPersistence) {
+    let sizes = complexSizes.slice();
+    for (let level in this.readyLevels) {
+      if (this.readyLevels.hasOwnProperty(level)) {
+        let index = level - minPersistence;
+        if (index >= 0 && index < sizes.length) {
+          sizes[index] = this.readyLevels[level];
+        }
+      }
+    }
+    return sizes;
+  }
+
+  /**
+   * Handles a persistence level of the current decomposition becoming ready
+   * while the server is still computing the others.
+   * @param {Event} event
+   */
+  handlePersistenceLevelReady(event) {
+    let level = event.detail;
+    if (!this.props.dataset || this.readyLevelsKey !==
+        this._decompositionKey(level.datasetId, level.category, level.fieldname, level.k)) {
+      return;
+    }
+    this.readyLevels[level.persistenceLevel] = level.crystalCount;
+    if (this.state.minPersistence !== null && this.state.complexSizes.length > 0) {
+      this.setState({
+        complexSizes: this._mergeReadyLevels(
+            this.state.complexSizes, this.state.minPersistence),
+      });
+    }
   }
 
   /**
@@ -93,11 +179,13 @@ class DecompositionPanel extends React.Component {
     let datasetId = this.props.dataset.datasetId;
     let category = this.state.decompositionCategory;
     let field = this.state.decompositionField;
+    this._resetReadyLevels(this._decompositionKey(datasetId, category, field, k));
     let result = await this.client.fetchMorseSmalePersistence(datasetId, category, field, k);
     this.setState({
       minPersistence: result.minPersistenceLevel,
       maxPersistence: result.maxPersistenceLevel,
-      complexSizes: result.complexSizes,
+      complexSizes: this._mergeReadyLevels(result.complexSizes,
+          result.minPersistenceLevel),
       sliderPersistence: result.maxPersistenceLevel,
       persistenceLevel: ('' + result.maxPersistenceLevel),
     });
@@ -141,12 +229,14 @@ class DecompositionPanel extends React.Component {
       let datasetId = this.props.dataset.datasetId;
       let category = this.state.decompositionCategory;
       let field = this.state.decompositionField;
+      this._resetReadyLevels(this._decompositionKey(datasetId, category, field, k));
       this.client.fetchMorseSmalePersistence(datasetId, category, field, k)
         .then(function(result) {
           this.setState({
             minPersistence: result.minPersistenceLevel,
             maxPersistence: result.maxPersistenceLevel,
-            complexSizes: result.complexSizes,
+            complexSizes: this._mergeReadyLevels(result.complexSizes,
+                result.minPersistenceLevel),
             sliderPersistence: result.maxPersistenceLevel,
             persistenceLevel: ('' + result.maxPersistenceLevel),
           });
@@ -18,8 +18,16 @@ class GalleryWindow extends Component {
     this.client = this.props.dsxContext.client;
     this.dataHelper = this.props.dsxContext.dataHelper;
 
+    // Thumbnails are fetched a page at a time as the gallery is scrolled,
+    // so opening it costs the same however many samples there are.
+    this.pageSize = 40;
+    this.loading = false;
+    this.scrollContainer = React.createRef();
+    this.handleScroll = this.handleScroll.bind(this);
+
     this.state = {
       thumbnails: [],
+      total: null,
     };
   }
 
@@ -28,19 +36,7 @@ class GalleryWindow extends Component {
    * TODO this needs to be extracted and managed by a data manager
    */
   componentDidMount() {
-    let { datasetId } = this.props.dataset;
-
-    // Get Thumbnails
-    this.client.fetchThumbnails(datasetId)
-      .then((result) => {
-        const thumbnails = result.thumbnails.map((thumbnail, i) => {
-          return {
-            img: thumbnail,
-            id: i,
-          };
-        });
-        this.setState({ thumbnails });
-      });
+    this.loadNextPage();
   }
 
   /**
@@ -54,22 +50,88 @@ class GalleryWindow extends Component {
 
     // Only loads new data if the dataset has changed
     if (prevProps.dataset.datasetId !== datasetId) {
-      // Get Thumbnails
-      this.client.fetchThumbnails(datasetId)
-        .then((result) => {
-          const thumbnails = result.thumbnails.map((thumbnail, i) => {
-            return {
-              img: thumbnail,
-              id: i,
-            };
-          });
-          this.setState({ thumbnails });
+      this.releaseThumbnails(this.state.thumbnails);
+      this.loading = false;
+      this.setState({ thumbnails:[], total:null, filters:[] }, () => this.loadNextPage());
+    } else if (prevState.thumbnails !== this.state.thumbnails) {
+      // Keep loading while the thumbnails shown don't fill the window yet.
+      this.handleScroll();
+    }
+  }
+
+  /**
+   * Releases the object URLs of the thumbnails.
+   */
+  componentWillUnmount() {
+    this.releaseThumbnails(this.state.thumbnails);
+  }
+
+  /**
+   * Fetches the next page of thumbnails unless all are loaded or a page is
+   * on its way.
+   */
+  loadNextPage() {
+    let { datasetId } = this.props.dataset;
+    let { thumbnails, total } = this.state;
+    if (this.loading || (total !== null && thumbnails.length >= total)) {
+      return;
+    }
+    this.loading = true;
+    this.client.fetchThumbnailRange(datasetId, thumbnails.length, this.pageSize)
+      .then((result) => {
+        if (datasetId !== this.props.dataset.datasetId) {
+          return;
+        }
+        this.loading = false;
+        const page = result.thumbnails.map((thumbnail) => {
+          return {
+            src: this.thumbnailSource(thumbnail.rawData),
+            id: thumbnail.index,
+          };
         });
+        this.setState((state) => ({
+          thumbnails: state.thumbnails.concat(page),
+          total: result.total,
+        }));
+      });
+  }
 
-      this.setState({ filters:[]});
+  /**
+   * Loads more thumbnails when the gallery is scrolled close to its end.
+   */
+  handleScroll() {
+    const container = this.scrollContainer.current;
+    if (container &&
+        container.scrollTop + container.clientHeight >= container.scrollHeight - 200) {
+      this.loadNextPage();
     }
   }
 
+  /**
+   * Returns an image source for the PNG data of a thumbnail, which is a
+   * Uint8Array when it came as a binary frame and base64 text otherwise.
+   * @param {Uint8Array|string} rawData
+   * @return {string}
+   */
+  thumbnailSource(rawData) {
+    if (typeof rawData === 'string') {
+      return 'data:image/png;base64, ' + rawData;
+    }
+    return URL.createObjectURL(new Blob([rawData], { type:'image/png' }));
+  }
+
+  /**
+   * Frees the object URLs created for thumbnails.
+   * @param {Array} thumbnails
+   */
+  releaseThumbnails(thumbnails) {
+    thumbnails.forEach((thumbnail) => {
+      if (thumbnail.src.startsWith('blob:')) {
+        URL.revokeObjectURL(thumbnail.src);
+      }
+    });
+  }
+
   /**
    *  Renders the Gallery Window
    * @return {jsx}
@@ -77,22 +139,25 @@ class GalleryWindow extends Component {
   render() {
     const { activeDesigns, selectedDesigns } = this.props;
     return (
-      <Paper style={{ overflow:'hidden auto', border:'1px solid gray' }}>
-        <Grid container
-          justify={'center'}
-          spacing={8}
-          style={{ margin:'5px 0px 0px 0px' }}>
-          {this.state.thumbnails.length > 0
-          && this.state.thumbnails.map((thumbnail, i) =>
-            activeDesigns.has(i) && <Grid key={i} item>
-              <Paper
-                style={{ backgroundColor:selectedDesigns.has(thumbnail.id) ? '#FFA500' : '#D3D3D3' }}>
-                <img alt={'Image:' + i} onClick={(e) => this.props.onDesignSelection(e, thumbnail.id)} height='75'
-                  style={{ margin:'5px 5px 5px 5px' }}
-                  src={'data:image/png;base64, ' + thumbnail.img.rawData}/>
-              </Paper>
-            </Grid>)}
-        </Grid>
+      <Paper style={{ overflow:'hidden', border:'1px solid gray' }}>
+        <div ref={this.scrollContainer} onScroll={this.handleScroll}
+          style={{ overflow:'hidden auto', height:'100%' }}>
+          <Grid container
+            justify={'center'}
+            spacing={8}
+            style={{ margin:'5px 0px 0px 0px' }}>
+            {this.state.thumbnails.length > 0
+            && this.state.thumbnails.map((thumbnail) =>
+              activeDesigns.has(thumbnail.id) && <Grid key={thumbnail.id} item>
+                <Paper
+                  style={{ backgroundColor:selectedDesigns.has(thumbnail.id) ? '#FFA500' : '#D3D3D3' }}>
+                  <img alt={'Image:' + thumbnail.id} onClick={(e) => this.props.onDesignSelection(e, thumbnail.id)} height='75'
+                    style={{ margin:'5px 5px 5px 5px' }}
+                    src={thumbnail.src}/>
+                </Paper>
+              </Grid>)}
+          </Grid>
+        </div>
       </Paper>
     );
   }
@@ -1,10 +1,8 @@
 #ifndef ANNWRAPPER_H
 #define ANNWRAPPER_H
 
-#include "DenseMatrix.h"
-#include "DenseVector.h"
-
-#include "ANN/ANN.h"
+#include "flinalg/DenseMatrix.h"
+#include "graph/KNNBackend.h"
 
 
 template <typename TPrecision>
@@ -12,24 +10,13 @@ class ANNWrapper{
   
   public:
  
-    static void computeANN(FortranLinalg::DenseMatrix<double> &data,
-        FortranLinalg::DenseMatrix<int> &knn, FortranLinalg::DenseMatrix<double>
-        &dists, double eps){
-
-      ANNpointArray pts= data.getColumnAccessor();
-
-      ANNkd_tree *annTree = new ANNkd_tree( pts, data.N(), data.M()); 
-     
-      int **knnData = knn.getColumnAccessor();
-      double **distData = dists.getColumnAccessor();
-
-      for(unsigned int i = 0; i < data.N(); i++){
-        annTree->annkSearch( pts[i], knn.M(), knnData[i], distData[i], eps);
-      }
-    
-      delete annTree;
-      annClose(); // done with ANN
-
+    // Squared distances of the k = knn.M() approximate nearest neighbors from a
+    // kd-tree, searched on up to threadCount threads.
+    static void computeANN(FortranLinalg::DenseMatrix<TPrecision> &data,
+        FortranLinalg::DenseMatrix<int> &knn, FortranLinalg::DenseMatrix<TPrecision>
+        &dists, double eps, unsigned int threadCount = 1){
+      ANNKNNBackend<TPrecision> backend(false, threadCount, eps);
+      backend.findKNN(data, knn, dists, true);
     };  
 
  
@@ -33,6 +33,8 @@
 #include "kd_util.h"					// kd-tree utilities
 #include <ANN/ANNperf.h>				// performance evaluation
 
+#include <mutex>
+
 //----------------------------------------------------------------------
 //	Global data
 //
@@ -223,10 +225,15 @@ ANNkd_tree::~ANNkd_tree()				// tree destructor
 
 //----------------------------------------------------------------------
 //	This is called with all use of ANN is finished.  It eliminates the
-//	minor memory leak caused by the allocation of KD_TRIVIAL.
+//	minor memory leak caused by the allocation of KD_TRIVIAL.  Trees
+//	share KD_TRIVIAL, so this must not be called while any tree is
+//	still in use, on any thread.
 //----------------------------------------------------------------------
+static std::mutex		KD_TRIVIAL_MUTEX;		// guards KD_TRIVIAL
+
 void annClose()				// close use of ANN
 {
+	std::lock_guard<std::mutex> lock(KD_TRIVIAL_MUTEX);
 	if (KD_TRIVIAL != NULL) {
 		delete KD_TRIVIAL;
 		KD_TRIVIAL = NULL;
@@ -273,6 +280,7 @@ void ANNkd_tree::SkeletonTree(			// construct skeleton tree
 	}
 
 	bnd_box_lo = bnd_box_hi = NULL;		// bounding box is nonexistent
+	std::lock_guard<std::mutex> lock(KD_TRIVIAL_MUTEX);	// trees may be built concurrently
 	if (KD_TRIVIAL == NULL)				// no trivial leaf node yet?
 		KD_TRIVIAL = new ANNkd_leaf(0, IDX_TRIVIAL);	// allocate it
 }
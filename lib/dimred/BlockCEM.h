@@ -53,6 +53,7 @@ class BlockCEM{
     FortranLinalg::DenseMatrix<TPrecision> Yp;
 
     ANNkd_tree *annTree; 
+    std::vector<TPrecision *> annPoints;
     FortranLinalg::DenseVector<TPrecision> xMin;
     FortranLinalg::DenseVector<TPrecision> xMax; 
 
@@ -1028,8 +1029,8 @@ class BlockCEM{
         delete annTree;
       }
 
-      ANNpointArray pts= Yp.getColumnAccessor();
-      annTree = new ANNkd_tree( pts, Yp.N(), Yp.M());
+      annPoints = Yp.getColumnPointers();
+      annTree = new ANNkd_tree( annPoints.data(), Yp.N(), Yp.M());
    
     };
 
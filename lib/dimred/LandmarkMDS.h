@@ -0,0 +1,229 @@
+#ifndef LANDMARKMDS_H
+#define LANDMARKMDS_H
+
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseMatrixView.h"
+#include "flinalg/DenseVector.h"
+#include "flinalg/Linalg.h"
+#include "dimred/MetricMDS.h"
+#include "metrics/BlockedDistance.h"
+#include "utils/WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+// Classical MDS of the columns of a sample matrix without the distance matrix
+// of all samples (de Silva and Tenenbaum, "Sparse multidimensional scaling
+// using landmark points"). Landmarks are picked by maxmin, each the sample
+// farthest from the ones picked before, and embedded by MetricMDS. All
+// samples are then placed by triangulation from their squared distances to
+// the landmarks, which reproduces the landmarks' own coordinates. Distances
+// to the landmarks are only kept for one block of samples at a time. Up to
+// landmarkCount samples are embedded exactly from their full distance matrix,
+// as MetricMDS would.
+template <typename TPrecision>
+class LandmarkMDS {
+  public:
+    LandmarkMDS(unsigned int landmarkCount = DefaultLandmarkCount,
+                unsigned int threadCount = 0) :
+        m_landmarkCount(std::max(landmarkCount, 2u)), m_threadCount(threadCount) {};
+
+    // Embedding of the columns of data, ndims x data.N()
+    FortranLinalg::DenseMatrix<TPrecision> embed(
+        FortranLinalg::DenseMatrix<TPrecision> &data, unsigned int ndims){
+      using namespace FortranLinalg;
+
+      unsigned int n = data.N();
+      if (n <= m_landmarkCount) {
+        DenseMatrix<TPrecision> distances =
+            BlockedDistance<TPrecision>::computeEuclidean(data, m_threadCount);
+        MetricMDS<TPrecision> mds;
+        DenseMatrix<TPrecision> result = mds.embed(distances, ndims);
+        distances.deallocate();
+        return result;
+      }
+
+      std::vector<unsigned int> landmarks;
+      DenseMatrix<TPrecision> landmarkDistances(m_landmarkCount, m_landmarkCount);
+      selectLandmarks(data, landmarks, landmarkDistances);
+
+      // Mean squared distance to each landmark among the landmarks
+      DenseVector<TPrecision> mean(m_landmarkCount);
+      for (unsigned int l = 0; l < m_landmarkCount; l++) {
+        TPrecision sum = 0;
+        for (unsigned int m = 0; m < m_landmarkCount; m++) {
+          sum += landmarkDistances(m, l) * landmarkDistances(m, l);
+        }
+        mean(l) = sum / m_landmarkCount;
+      }
+
+      MetricMDS<TPrecision> mds;
+      DenseMatrix<TPrecision> coords = mds.embed(landmarkDistances, ndims);
+      landmarkDistances.deallocate();
+
+      // Pseudoinverse transpose of the landmark coordinates: each row is an
+      // eigenvector scaled by one over the square root of its eigenvalue,
+      // which is the row over its squared norm. Directions without spread
+      // are left out.
+      DenseMatrix<TPrecision> pinv(ndims, m_landmarkCount);
+      TPrecision largest = 0;
+      std::vector<TPrecision> eigenvalues(ndims);
+      for (unsigned int i = 0; i < ndims; i++) {
+        TPrecision sum = 0;
+        for (unsigned int l = 0; l < m_landmarkCount; l++) {
+          sum += coords(i, l) * coords(i, l);
+        }
+        eigenvalues[i] = sum;
+        largest = std::max(largest, sum);
+      }
+      for (unsigned int i = 0; i < ndims; i++) {
+        bool flat = eigenvalues[i] <= largest * std::numeric_limits<TPrecision>::epsilon();
+        for (unsigned int l = 0; l < m_landmarkCount; l++) {
+          pinv(i, l) = flat ? 0 : -0.5 * coords(i, l) / eigenvalues[i];
+        }
+      }
+      coords.deallocate();
+
+      DenseMatrix<TPrecision> result(ndims, n);
+      triangulate(data, landmarks, mean, pinv, result);
+      mean.deallocate();
+      pinv.deallocate();
+      return result;
+    };
+
+    static const unsigned int DefaultLandmarkCount = 1000;
+
+  private:
+    static const unsigned int ChunkSize = 16384;
+    static const unsigned int BlockSize = 1024;
+
+    // Maxmin landmarks starting from the first sample, and the distances
+    // among them. Each step computes the distances of the new landmark to all
+    // samples, in chunks spread across threads.
+    void selectLandmarks(FortranLinalg::DenseMatrix<TPrecision> &data,
+                         std::vector<unsigned int> &landmarks,
+                         FortranLinalg::DenseMatrix<TPrecision> &landmarkDistances) {
+      unsigned int n = data.N();
+      unsigned int dim = data.M();
+      std::vector<TPrecision> minDistance(n, std::numeric_limits<TPrecision>::max());
+      std::vector<TPrecision> distance(n);
+
+      unsigned int nChunks = (n + ChunkSize - 1) / ChunkSize;
+      std::vector<unsigned int> order(nChunks);
+      for (unsigned int i = 0; i < nChunks; i++) {
+        order[i] = i;
+      }
+      // Farthest sample of each chunk from the landmarks so far
+      std::vector<unsigned int> farthest(nChunks);
+
+      WorkStealingScheduler scheduler(m_threadCount);
+      unsigned int next = 0;
+      for (unsigned int l = 0; l < m_landmarkCount; l++) {
+        landmarks.push_back(next);
+        const TPrecision *x = data.data() + (size_t) next * dim;
+        scheduler.run(order, [&](unsigned int chunk, unsigned int) {
+          unsigned int begin = chunk * ChunkSize;
+          unsigned int end = std::min(n, begin + ChunkSize);
+          unsigned int best = begin;
+          for (unsigned int i = begin; i < end; i++) {
+            const TPrecision *y = data.data() + (size_t) i * dim;
+            TPrecision sum = 0;
+            for (unsigned int d = 0; d < dim; d++) {
+              TPrecision e = x[d] - y[d];
+              sum += e * e;
+            }
+            distance[i] = std::sqrt(sum);
+            minDistance[i] = std::min(minDistance[i], distance[i]);
+            if (minDistance[i] > minDistance[best]) {
+              best = i;
+            }
+          }
+          farthest[chunk] = best;
+        });
+
+        for (unsigned int m = 0; m < l; m++) {
+          landmarkDistances(m, l) = distance[landmarks[m]];
+          landmarkDistances(l, m) = distance[landmarks[m]];
+        }
+        landmarkDistances(l, l) = 0;
+
+        next = farthest[0];
+        for (unsigned int chunk = 1; chunk < nChunks; chunk++) {
+          if (minDistance[farthest[chunk]] > minDistance[next]) {
+            next = farthest[chunk];
+          }
+        }
+      }
+    };
+
+    // Places blocks of samples from the Gram matrix of the landmarks and the
+    // block: x = pinv (d^2 - mean), with pinv already scaled by -1/2.
+    void triangulate(FortranLinalg::DenseMatrix<TPrecision> &data,
+                     const std::vector<unsigned int> &landmarks,
+                     FortranLinalg::DenseVector<TPrecision> &mean,
+                     FortranLinalg::DenseMatrix<TPrecision> &pinv,
+                     FortranLinalg::DenseMatrix<TPrecision> &result) {
+      using namespace FortranLinalg;
+
+      unsigned int n = data.N();
+      unsigned int dim = data.M();
+      unsigned int nl = landmarks.size();
+      DenseMatrix<TPrecision> L(dim, nl);
+      DenseVector<TPrecision> landmarkNorms(nl);
+      for (unsigned int l = 0; l < nl; l++) {
+        TPrecision sum = 0;
+        for (unsigned int d = 0; d < dim; d++) {
+          L(d, l) = data(d, landmarks[l]);
+          sum += L(d, l) * L(d, l);
+        }
+        landmarkNorms(l) = sum;
+      }
+
+      unsigned int blockSize = BlockSize;
+      unsigned int nBlocks = (n + blockSize - 1) / blockSize;
+      std::vector<unsigned int> order(nBlocks);
+      for (unsigned int i = 0; i < nBlocks; i++) {
+        order[i] = i;
+      }
+      WorkStealingScheduler scheduler(m_threadCount);
+      std::vector<DenseMatrix<TPrecision>> grams(scheduler.threadCount());
+      for (unsigned int i = 0; i < grams.size(); i++) {
+        grams[i] = DenseMatrix<TPrecision>(nl, BlockSize);
+      }
+
+      scheduler.run(order, [&](unsigned int block, unsigned int worker) {
+        unsigned int a0 = block * blockSize;
+        unsigned int na = std::min(blockSize, n - a0);
+        DenseMatrixView<TPrecision> samples(data, a0, na);
+        DenseMatrixView<TPrecision> gram(nl, na, grams[worker].data());
+        Linalg<TPrecision>::Multiply(L, samples, gram, true, false);
+        for (unsigned int a = 0; a < na; a++) {
+          const TPrecision *y = data.data() + (size_t) (a0 + a) * dim;
+          TPrecision norm = 0;
+          for (unsigned int d = 0; d < dim; d++) {
+            norm += y[d] * y[d];
+          }
+          for (unsigned int l = 0; l < nl; l++) {
+            TPrecision d2 = landmarkNorms(l) + norm - 2 * gram(l, a);
+            gram(l, a) = std::max(d2, (TPrecision) 0) - mean(l);
+          }
+        }
+        DenseMatrixView<TPrecision> out(result, a0, na);
+        Linalg<TPrecision>::Multiply(pinv, gram, out);
+      });
+
+      for (unsigned int i = 0; i < grams.size(); i++) {
+        grams[i].deallocate();
+      }
+      L.deallocate();
+      landmarkNorms.deallocate();
+    };
+
+    unsigned int m_landmarkCount;
+    unsigned int m_threadCount;
+};
+
+#endif
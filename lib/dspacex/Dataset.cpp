@@ -1,7 +1,25 @@
 #include "Dataset.h"
 
+#include <utility>
+
 using namespace dspacex;
 
+/**
+ * The dataset owns the matrices it was built with.
+ */
+Dataset::~Dataset()
+{
+  std::cerr << "Dataset::~Dataset()\n";
+  m_samplesMatrix.deallocate();
+  m_distanceMatrix.deallocate();
+  for (auto &qoi : m_qois)
+    qoi.deallocate();
+  for (auto &parameter : m_parameters)
+    parameter.deallocate();
+  for (auto &embedding : m_embeddings)
+    embedding.deallocate();
+}
+
 bool Dataset::valid() const
 {
   // TODO:  Add validation that sample counts match array sizes.
@@ -10,6 +28,22 @@ bool Dataset::valid() const
   return true;
 }
 
+size_t Dataset::byteSize()
+{
+  size_t bytes = sizeof(Precision) * ((size_t) m_samplesMatrix.M() * m_samplesMatrix.N() +
+                                      (size_t) m_distanceMatrix.M() * m_distanceMatrix.N());
+  for (auto &qoi : m_qois)
+    bytes += sizeof(Precision) * qoi.N();
+  for (auto &parameter : m_parameters)
+    bytes += sizeof(Precision) * parameter.N();
+  for (auto &embedding : m_embeddings)
+    bytes += sizeof(Precision) * embedding.M() * embedding.N();
+  // Decoded images take at least a byte per pixel besides their encoded data.
+  for (auto &thumbnail : m_thumbnails)
+    bytes += thumbnail.getConstRawData().size() + (size_t) thumbnail.getWidth() * thumbnail.getHeight();
+  return bytes;
+}
+
 const Image& Dataset::getThumbnail(unsigned idx) const
 {
   if (idx >= m_thumbnails.size())
@@ -97,7 +131,7 @@ Dataset::Builder& Dataset::Builder::withName(std::string name) {
 }
 
 Dataset::Builder& Dataset::Builder::withThumbnails(std::vector<Image> thumbnails) {
-  m_dataset->m_thumbnails = thumbnails;
+  m_dataset->m_thumbnails = std::move(thumbnails);
   return (*this);
 }
 
@@ -6,16 +6,20 @@
 #include "imageutils/Image.h"
 #include "pmodels/MorseSmale.h"
 
+#include <memory>
 #include <vector>
 
 namespace dspacex {
 
 class Dataset {
  public:
-  ~Dataset() { std::cerr << "Dataset::~Dataset()\n"; }
+  ~Dataset();
 
   bool valid() const;
 
+  // Estimated bytes held by the dataset's matrices and thumbnails.
+  size_t byteSize();
+
   int numberOfSamples() {
     return m_sampleCount;
   }
@@ -72,10 +76,15 @@ class Dataset {
     return m_name;
   }
 
-  std::vector<Image> getThumbnails() {
+  // Thumbnails are only handed out by reference, their PNG data is large.
+  const std::vector<Image>& getThumbnails() const {
     return m_thumbnails;
   }
 
+  int numberOfThumbnails() const {
+    return m_thumbnails.size();
+  }
+
   std::vector<MSComplex>& getMSModels() {
     return m_msModels;
   }
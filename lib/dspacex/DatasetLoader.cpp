@@ -4,7 +4,10 @@
 #include "yaml-cpp/yaml.h"
 #include "utils/StringUtils.h"
 #include "utils/IO.h"
+#include "utils/ThreadPool.h"
 
+#include <algorithm>
+#include <future>
 #include <memory>
 #include <iomanip>
 #include <sstream>
@@ -12,6 +15,10 @@
 
 using namespace dspacex;
 
+// Threads reading the thumbnails of a dataset. Reading files mostly waits
+// for the disk, so this doesn't depend on the number of cores.
+const unsigned int kThumbnailReadThreads = 8;
+
 struct InputFormat
 {
   enum Type { CSV, JSON, LINALG_DENSEMATRIX, LINALG_DENSEVECTOR };
@@ -179,12 +186,9 @@ std::vector<ParameterNameValuePair> DatasetLoader::parseParameters(
     // TODO: Factor out some file format reading handler.
     //       Fileformat could be a key for map to loading function.
     std::cout << "Loading " << format << " from " << path + filename << std::endl;
-    auto columnNames = HDProcess::loadCSVColumnNames(path + filename);
-
-    for (auto name : columnNames) {
-      std::cout << "Loading QOI: " << name << std::endl;
-      auto parameter = HDProcess::loadCSVColumn(path + filename, name);
-      parameters.push_back(ParameterNameValuePair(name, parameter));
+    for (auto column : HDProcess::loadCSVColumns(path + filename)) {
+      std::cout << "Loaded parameter: " << column.first << std::endl;
+      parameters.push_back(ParameterNameValuePair(column.first, column.second));
     }
   }
 
@@ -265,12 +269,9 @@ std::vector<QoiNameValuePair> DatasetLoader::parseQois(
     // TODO: Factor out some file format reading handler.
     //       Fileformat could be a key for map to loading function.
     std::cout << "Loading " << format << " from " << path + filename << std::endl;
-    auto columnNames = HDProcess::loadCSVColumnNames(path + filename);
-
-    for (auto name : columnNames) {
-      std::cout << "Loading QOI: " << name << std::endl;
-      auto qoi = HDProcess::loadCSVColumn(path + filename, name);
-      qois.push_back(QoiNameValuePair(name, qoi));
+    for (auto column : HDProcess::loadCSVColumns(path + filename)) {
+      std::cout << "Loaded QOI: " << column.first << std::endl;
+      qois.push_back(QoiNameValuePair(column.first, column.second));
     }
   }
 
@@ -384,8 +385,8 @@ EmbeddingPair DatasetLoader::parseEmbedding(
   return EmbeddingPair(name, embedding);
 }
 
-// There is a model for each crystal of each persistence level of a M-S complex... maybe too
-// much to read all at once, so only read them on demand? Anyway, for now just read them all.
+// There is a model for each crystal of each persistence level of a M-S complex... too much to
+// read all at once, so only their locations are read here and the models themselves on demand.
 //
 // This was the addition to the config.yaml for the dataset:
 //
@@ -505,8 +506,9 @@ MSModelsPair DatasetLoader::parseMSModelsForField(const YAML::Node &modelNode, c
   std::cout << "There are " << npersistences << " persistence levels of the M-S complex computed from "
             << nsamples << " samples." << std::endl;
 
-  // Now read all the models
+  // Now locate all the models
   MSComplex ms_of_models(fieldname, nsamples, npersistences);
+  ms_of_models.setModelReader(&DatasetLoader::parseModel);
   for (unsigned persistence = 0; persistence < npersistences; /*persistence+=10)//*/persistence++) //<ctc> hack to load just a couple lvls for testing
   {
     unsigned persistence_idx = persistence;
@@ -531,15 +533,13 @@ MSModelsPair DatasetLoader::parseMSModelsForField(const YAML::Node &modelNode, c
     std::string persistencePath(persistencesBasePath + persistenceIndexStr);
     P.setGlobalEmbeddings(IO::readCSVMatrix<double>(persistencePath + '/' + embeddings));
     
-    // read the model for each crystal at this persistence level
+    // locate the model for each crystal at this persistence level (they're read when first used)
     std::string modelPath;
     for (unsigned crystal = 0; crystal < ncrystals; crystal++)
     {
       std::string crystalIndexStr(shouldPadZeroes ? paddedIndexString(crystal, crystalIndexPadding) : std::to_string(crystal));
       std::string crystalPath(persistencePath + '/' + crystalsBasename + crystalIndexStr);
-      dspacex::MSCrystal &c = P.getCrystal(crystal);
-      c.getModel().setFieldname(fieldname); // <ctc> see TODOs in dspacex::Model
-      parseModel(crystalPath, c.getModel());
+      P.getCrystal(crystal).setModelPath(crystalPath);
 
       modelPath = crystalPath;  // outside this scope because we need to use it to read crystalIds
     }
@@ -691,17 +691,30 @@ std::vector<Image> DatasetLoader::parseThumbnails(
     indexOffset = thumbnailsNode["offset"].as<int>();
   }
 
+  // The files are only read here, on several threads since reading them is
+  // what takes the time. Their pixels are decoded once something needs them,
+  // which the server mostly doesn't, it sends the PNG files as they are.
   ImageLoader imageLoader;
   unsigned int thumbnailCount = parseSampleCount(config);
-  std::vector<Image> thumbnails;
-  for (int i = 0; i < thumbnailCount; i++) {
-    std::string path = createThumbnailPath(imageBasePath, i+indexOffset,
-      imageSuffix, indexOffset, shouldPadZeroes, thumbnailCount);
-    std::cout << "Loading image: " << path << std::endl;
-    Image image = imageLoader.loadImage(path, ImageLoader::Format::PNG);
-    thumbnails.push_back(image);
+  std::cout << "Loading " << thumbnailCount << " images: " << imageBasePath << "?" << imageSuffix << std::endl;
+  std::vector<std::future<Image>> reads;
+  reads.reserve(thumbnailCount);
+  {
+    ThreadPool pool(std::min(kThumbnailReadThreads, std::max(1u, thumbnailCount)));
+    for (unsigned int i = 0; i < thumbnailCount; i++) {
+      std::string path = createThumbnailPath(imageBasePath, i+indexOffset,
+        imageSuffix, indexOffset, shouldPadZeroes, thumbnailCount);
+      reads.push_back(pool.submit([&imageLoader, path]() {
+        return imageLoader.loadImage(path, ImageLoader::Format::RAW_PNG);
+      }));
+    }
   }
 
+  std::vector<Image> thumbnails;
+  thumbnails.reserve(thumbnailCount);
+  for (auto &read : reads) {
+    thumbnails.push_back(read.get());
+  }
   return thumbnails;
 }
 
@@ -2,6 +2,7 @@
 #define DENSEMATRIX_H
 
 #include <cstddef>
+#include <vector>
 #include "Matrix.h"
 
 namespace FortranLinalg {
@@ -17,7 +18,6 @@ namespace FortranLinalg {
         DenseMatrix() {
             m = n = 0;
             a = NULL;
-            fastAccess = NULL;
         };
 
 
@@ -31,13 +31,11 @@ namespace FortranLinalg {
             if (a == NULL) {
                 a = new TPrecision[l];
             }
-            createFastAccess();
-            setupFastAccess();
         };
 
         virtual TPrecision &operator()(unsigned int row_index, unsigned int column_index) {
             //if(i >= m || j >= n) throw "Out of bounds";
-            return fastAccess[column_index][row_index];
+            return a[(size_t) column_index * m + row_index];
         };
 
         unsigned int M() {
@@ -54,43 +52,32 @@ namespace FortranLinalg {
 
         void setDataPointer(TPrecision *data) {
             a = data;
-            setupFastAccess();
         };
 
         void deallocate() {
             if (a != NULL) {
                 delete[] a;
-                delete[] fastAccess;
-                fastAccess = NULL;
                 a = NULL;
             }
         };
 
-        TPrecision **getColumnAccessor() {
-            return fastAccess;
+        // Pointers to the start of each column, e.g. for ANN point arrays.
+        // Built on request, so wrapping existing storage allocates nothing.
+        std::vector<TPrecision *> getColumnPointers() {
+            std::vector<TPrecision *> columns(n);
+            for (unsigned int i = 0; i < n; i++) {
+                columns[i] = &a[(size_t) i * m];
+            }
+            return columns;
         };
 
 
     protected:
         //Access to data array
         TPrecision *a;
-        TPrecision **fastAccess;
         //M ros, N cols
         unsigned int m, n;
 
-
-    private:
-        void createFastAccess() {
-            fastAccess = new TPrecision *[n];
-        };
-
-
-        void setupFastAccess() {
-            for (unsigned int i = 0; i < n; i++) {
-                fastAccess[i] = &a[i * m];
-            }
-        };
-
     };
 }
 
@@ -0,0 +1,67 @@
+#ifndef DENSEMATRIXVIEW_H
+#define DENSEMATRIXVIEW_H
+
+#include <cstddef>
+#include "DenseMatrix.h"
+#include "DenseVector.h"
+
+namespace FortranLinalg {
+
+
+    // Matrix over column-major storage owned by someone else, e.g. another
+    // matrix, an Eigen matrix or a memory mapped file. Creating a view
+    // allocates nothing and deallocate() only detaches it from the storage.
+    // Views can be passed wherever a DenseMatrix is expected, but a copy
+    // sliced to DenseMatrix must not be deallocated.
+    template<typename TPrecision>
+    class DenseMatrixView : public DenseMatrix<TPrecision> {
+
+    public:
+        DenseMatrixView() {};
+
+        DenseMatrixView(unsigned int nrows, unsigned int ncols, TPrecision *data) {
+            this->m = nrows;
+            this->n = ncols;
+            this->a = data;
+        };
+
+        // View of ncols consecutive columns of a matrix starting at column first.
+        DenseMatrixView(DenseMatrix<TPrecision> &matrix, unsigned int first, unsigned int ncols) {
+            this->m = matrix.M();
+            this->n = ncols;
+            this->a = matrix.data() + (size_t) first * matrix.M();
+        };
+
+        void deallocate() {
+            this->a = NULL;
+            this->m = this->n = 0;
+        };
+    };
+
+
+    // Vector over storage owned by someone else, see DenseMatrixView.
+    template<typename TPrecision>
+    class DenseVectorView : public DenseVector<TPrecision> {
+
+    public:
+        DenseVectorView() {};
+
+        DenseVectorView(unsigned int nrows, TPrecision *data) {
+            this->n = nrows;
+            this->a = data;
+        };
+
+        // View of column j of a matrix.
+        DenseVectorView(DenseMatrix<TPrecision> &matrix, unsigned int j) {
+            this->n = matrix.M();
+            this->a = matrix.data() + (size_t) j * matrix.M();
+        };
+
+        void deallocate() {
+            this->a = NULL;
+            this->n = 0;
+        };
+    };
+}
+
+#endif
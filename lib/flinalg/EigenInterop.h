@@ -0,0 +1,54 @@
+#ifndef EIGENINTEROP_H
+#define EIGENINTEROP_H
+
+#include "DenseMatrix.h"
+#include "DenseVector.h"
+#include "DenseMatrixView.h"
+
+#include <Eigen/Core>
+
+namespace FortranLinalg {
+
+    // Zero-copy conversions between DenseMatrix / DenseVector and Eigen. Both
+    // store matrices column-major, so each side can wrap the other's storage.
+    // The results are views and do not own the storage.
+
+    template<typename TPrecision>
+    using EigenMatrix = Eigen::Matrix<TPrecision, Eigen::Dynamic, Eigen::Dynamic>;
+
+    template<typename TPrecision>
+    using EigenVector = Eigen::Matrix<TPrecision, Eigen::Dynamic, 1>;
+
+
+    template<typename TPrecision>
+    Eigen::Map<EigenMatrix<TPrecision>> asEigen(DenseMatrix<TPrecision> &matrix) {
+        return Eigen::Map<EigenMatrix<TPrecision>>(matrix.data(), matrix.M(), matrix.N());
+    };
+
+    template<typename TPrecision>
+    Eigen::Map<EigenVector<TPrecision>> asEigen(DenseVector<TPrecision> &vector) {
+        return Eigen::Map<EigenVector<TPrecision>>(vector.data(), vector.N());
+    };
+
+    template<typename TPrecision>
+    DenseMatrixView<TPrecision> asDense(EigenMatrix<TPrecision> &matrix) {
+        return DenseMatrixView<TPrecision>(matrix.rows(), matrix.cols(), matrix.data());
+    };
+
+    template<typename TPrecision>
+    DenseMatrixView<TPrecision> asDense(Eigen::Map<EigenMatrix<TPrecision>> &matrix) {
+        return DenseMatrixView<TPrecision>(matrix.rows(), matrix.cols(), matrix.data());
+    };
+
+    template<typename TPrecision>
+    DenseVectorView<TPrecision> asDense(EigenVector<TPrecision> &vector) {
+        return DenseVectorView<TPrecision>(vector.size(), vector.data());
+    };
+
+    template<typename TPrecision>
+    DenseVectorView<TPrecision> asDense(Eigen::Map<EigenVector<TPrecision>> &vector) {
+        return DenseVectorView<TPrecision>(vector.size(), vector.data());
+    };
+}
+
+#endif
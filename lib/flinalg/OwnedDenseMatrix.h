@@ -0,0 +1,153 @@
+#ifndef OWNEDDENSEMATRIX_H
+#define OWNEDDENSEMATRIX_H
+
+#include "DenseMatrix.h"
+#include "DenseVector.h"
+
+namespace FortranLinalg {
+
+
+    // Owning handle of a DenseMatrix that frees the storage when it goes out
+    // of scope. Handles are moved, never copied. release() hands the storage
+    // over to code that manages DenseMatrix lifetimes by hand, e.g. a result
+    // object, without copying it.
+    template<typename TPrecision>
+    class OwnedDenseMatrix {
+
+    public:
+        OwnedDenseMatrix() {};
+
+        OwnedDenseMatrix(unsigned int nrows, unsigned int ncols) : matrix(nrows, ncols) {};
+
+        // Takes ownership of the storage of an allocated matrix.
+        explicit OwnedDenseMatrix(DenseMatrix<TPrecision> adopted) : matrix(adopted) {};
+
+        OwnedDenseMatrix(OwnedDenseMatrix &&other) : matrix(other.release()) {};
+
+        OwnedDenseMatrix &operator=(OwnedDenseMatrix &&other) {
+            if (this != &other) {
+                reset(other.release());
+            }
+            return *this;
+        };
+
+        OwnedDenseMatrix(const OwnedDenseMatrix &) = delete;
+        OwnedDenseMatrix &operator=(const OwnedDenseMatrix &) = delete;
+
+        ~OwnedDenseMatrix() {
+            matrix.deallocate();
+        };
+
+        TPrecision &operator()(unsigned int row_index, unsigned int column_index) {
+            return matrix(row_index, column_index);
+        };
+
+        unsigned int M() {
+            return matrix.M();
+        };
+
+        unsigned int N() {
+            return matrix.N();
+        };
+
+        TPrecision *data() {
+            return matrix.data();
+        };
+
+        DenseMatrix<TPrecision> &get() {
+            return matrix;
+        };
+
+        operator DenseMatrix<TPrecision> &() {
+            return matrix;
+        };
+
+        // Gives up ownership and returns the matrix, which the caller has to
+        // deallocate.
+        DenseMatrix<TPrecision> release() {
+            DenseMatrix<TPrecision> released = matrix;
+            matrix = DenseMatrix<TPrecision>();
+            return released;
+        };
+
+        // Frees the current storage and takes ownership of another matrix.
+        void reset(DenseMatrix<TPrecision> adopted = DenseMatrix<TPrecision>()) {
+            matrix.deallocate();
+            matrix = adopted;
+        };
+
+
+    private:
+        DenseMatrix<TPrecision> matrix;
+    };
+
+
+    // Owning handle of a DenseVector, see OwnedDenseMatrix.
+    template<typename TPrecision>
+    class OwnedDenseVector {
+
+    public:
+        OwnedDenseVector() {};
+
+        explicit OwnedDenseVector(unsigned int nrows) : vector(nrows) {};
+
+        // Takes ownership of the storage of an allocated vector.
+        explicit OwnedDenseVector(DenseVector<TPrecision> adopted) : vector(adopted) {};
+
+        OwnedDenseVector(OwnedDenseVector &&other) : vector(other.release()) {};
+
+        OwnedDenseVector &operator=(OwnedDenseVector &&other) {
+            if (this != &other) {
+                reset(other.release());
+            }
+            return *this;
+        };
+
+        OwnedDenseVector(const OwnedDenseVector &) = delete;
+        OwnedDenseVector &operator=(const OwnedDenseVector &) = delete;
+
+        ~OwnedDenseVector() {
+            vector.deallocate();
+        };
+
+        TPrecision &operator()(unsigned int i) {
+            return vector(i);
+        };
+
+        unsigned int N() {
+            return vector.N();
+        };
+
+        TPrecision *data() {
+            return vector.data();
+        };
+
+        DenseVector<TPrecision> &get() {
+            return vector;
+        };
+
+        operator DenseVector<TPrecision> &() {
+            return vector;
+        };
+
+        // Gives up ownership and returns the vector, which the caller has to
+        // deallocate.
+        DenseVector<TPrecision> release() {
+            DenseVector<TPrecision> released = vector;
+            vector = DenseVector<TPrecision>();
+            return released;
+        };
+
+        // Frees the current storage and takes ownership of another vector.
+        void reset(DenseVector<TPrecision> adopted = DenseVector<TPrecision>()) {
+            vector.deallocate();
+            vector = adopted;
+        };
+
+
+    private:
+        DenseVector<TPrecision> vector;
+    };
+}
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef KNNBACKEND_H
+#define KNNBACKEND_H
+
+#include "flinalg/DenseMatrix.h"
+#include "metrics/BlockedDistance.h"
+#include "utils/WorkStealingScheduler.h"
+
+#include "ANN/ANN.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// Nearest neighbor search structure over the columns of a sample matrix,
+// which must outlive it. Queries don't modify the index, so any number of
+// threads may query it at once.
+template <typename TPrecision>
+class KNNIndex {
+  public:
+    virtual ~KNNIndex() {};
+
+    // The k nearest columns to a point with one coordinate per row of the
+    // samples, sorted by distance, and their squared Euclidean distances.
+    // k is at most the number of samples.
+    virtual void query(const TPrecision *point, unsigned int k, int *knn,
+                       TPrecision *squaredDists) const = 0;
+};
+
+
+// A way of finding the nearest neighbors of samples, selected by name:
+//   brute   all distances, computed in tiles through BLAS (exact)
+//   kdtree  ANN kd-tree search
+//   bdtree  ANN box decomposition tree search, for clustered samples
+// The trees are exact for eps = 0 and otherwise return neighbors within a
+// factor 1 + eps of the true distances. A backend only holds settings, so one
+// backend may serve several threads and datasets.
+template <typename TPrecision>
+class KNNBackend {
+  public:
+    virtual ~KNNBackend() {};
+
+    virtual std::string getName() const = 0;
+
+    // Approximation factor of the neighbors found, 0 if exact
+    virtual double getEpsilon() const {
+      return 0;
+    };
+
+    unsigned int getThreadCount() const {
+      return m_threadCount;
+    };
+
+    virtual std::unique_ptr<KNNIndex<TPrecision>> buildIndex(
+        FortranLinalg::DenseMatrix<TPrecision> &data) const = 0;
+
+    // Fill the k = knn.M() nearest neighbors of every column of data and their
+    // Euclidean distances, or squared ones, sorted by distance, each column
+    // being one of its own neighbors. Blocks of columns are queried on up to
+    // getThreadCount() threads.
+    virtual void findKNN(FortranLinalg::DenseMatrix<TPrecision> &data,
+                         FortranLinalg::Matrix<int> &knn, FortranLinalg::Matrix<TPrecision> &dists,
+                         bool squared) const {
+      unsigned int n = data.N();
+      unsigned int k = knn.M();
+      if (n == 0 || k == 0) {
+        return;
+      }
+      std::unique_ptr<KNNIndex<TPrecision>> index = buildIndex(data);
+
+      unsigned int nBlocks = (n + QueryBlockSize - 1) / QueryBlockSize;
+      std::vector<unsigned int> order(nBlocks);
+      for (unsigned int i = 0; i < nBlocks; i++) {
+        order[i] = i;
+      }
+      WorkStealingScheduler scheduler(m_threadCount);
+      std::vector<std::vector<int>> neighbors(scheduler.threadCount(), std::vector<int>(k));
+      std::vector<std::vector<TPrecision>> distances(scheduler.threadCount(),
+                                                     std::vector<TPrecision>(k));
+      scheduler.run(order, [&](unsigned int block, unsigned int worker) {
+        unsigned int end = std::min(n, (block + 1) * QueryBlockSize);
+        for (unsigned int i = block * QueryBlockSize; i < end; i++) {
+          index->query(data.data() + (size_t) i * data.M(), k, neighbors[worker].data(),
+                       distances[worker].data());
+          for (unsigned int j = 0; j < k; j++) {
+            knn(j, i) = neighbors[worker][j];
+            dists(j, i) = squared ? distances[worker][j] : std::sqrt(distances[worker][j]);
+          }
+        }
+      });
+    };
+
+    // Fraction of the true k nearest neighbors this backend finds for up to
+    // sampleCount columns of data spread over all of them, compared against
+    // a scan of all samples. A neighbor found counts if it is no farther than
+    // the true k-th nearest neighbor, so that ties are not counted as misses.
+    double recall(FortranLinalg::DenseMatrix<TPrecision> &data, unsigned int k,
+                  unsigned int sampleCount = 1000) const;
+
+    // Backend of the given name, which throws std::invalid_argument for
+    // unknown names.
+    static std::unique_ptr<KNNBackend<TPrecision>> create(const std::string &name,
+        unsigned int threadCount = 0, double eps = 0);
+
+  protected:
+    explicit KNNBackend(unsigned int threadCount) : m_threadCount(threadCount) {};
+
+    static const unsigned int QueryBlockSize = 256;
+
+    unsigned int m_threadCount;
+};
+
+
+// Scans all samples for each query, keeping the k closest in a bounded heap;
+// equal distances are ordered by index.
+template <typename TPrecision>
+class BruteForceKNNIndex : public KNNIndex<TPrecision> {
+  public:
+    explicit BruteForceKNNIndex(FortranLinalg::DenseMatrix<TPrecision> &data) :
+        m_data(data.data()), m_dimension(data.M()), m_count(data.N()) {};
+
+    void query(const TPrecision *point, unsigned int k, int *knn,
+               TPrecision *squaredDists) const override {
+      std::vector<std::pair<TPrecision, int>> best;
+      best.reserve(k);
+      for (unsigned int i = 0; i < m_count; i++) {
+        std::pair<TPrecision, int> candidate(
+            squaredDistance(point, m_data + (size_t) i * m_dimension, m_dimension), i);
+        if (best.size() < k) {
+          best.push_back(candidate);
+          std::push_heap(best.begin(), best.end());
+        } else if (candidate < best.front()) {
+          std::pop_heap(best.begin(), best.end());
+          best.back() = candidate;
+          std::push_heap(best.begin(), best.end());
+        }
+      }
+      std::sort_heap(best.begin(), best.end());
+      for (unsigned int j = 0; j < best.size(); j++) {
+        knn[j] = best[j].second;
+        squaredDists[j] = best[j].first;
+      }
+    };
+
+    static TPrecision squaredDistance(const TPrecision *x, const TPrecision *y,
+                                      unsigned int dimension) {
+      TPrecision sum = 0;
+      for (unsigned int d = 0; d < dimension; d++) {
+        TPrecision e = x[d] - y[d];
+        sum += e * e;
+      }
+      return sum;
+    };
+
+  private:
+    const TPrecision *m_data;
+    unsigned int m_dimension;
+    unsigned int m_count;
+};
+
+
+template <typename TPrecision>
+class BruteForceKNNBackend : public KNNBackend<TPrecision> {
+  public:
+    explicit BruteForceKNNBackend(unsigned int threadCount = 0) :
+        KNNBackend<TPrecision>(threadCount) {};
+
+    std::string getName() const override {
+      return "brute";
+    };
+
+    std::unique_ptr<KNNIndex<TPrecision>> buildIndex(
+        FortranLinalg::DenseMatrix<TPrecision> &data) const override {
+      return std::unique_ptr<KNNIndex<TPrecision>>(new BruteForceKNNIndex<TPrecision>(data));
+    };
+
+    // The graph of all samples comes from tiles of the Gram matrix, see
+    // BlockedDistance::findKNN.
+    void findKNN(FortranLinalg::DenseMatrix<TPrecision> &data,
+                 FortranLinalg::Matrix<int> &knn, FortranLinalg::Matrix<TPrecision> &dists,
+                 bool squared) const override {
+      BlockedDistance<TPrecision>::findKNN(data, knn, dists, this->m_threadCount,
+          BlockedDistance<TPrecision>::DefaultBlockSize, squared);
+    };
+};
+
+
+// ANN tree over a copy of the samples in ANN's coordinate type. Searches
+// keep their state per thread, so threads may search the tree at once.
+template <typename TPrecision>
+class ANNKNNIndex : public KNNIndex<TPrecision> {
+  public:
+    ANNKNNIndex(FortranLinalg::DenseMatrix<TPrecision> &data, bool boxDecomposition, double eps) :
+        m_dimension(data.M()), m_eps(eps),
+        m_coords(data.data(), data.data() + (size_t) data.M() * data.N()),
+        m_points(data.N()) {
+      for (unsigned int i = 0; i < data.N(); i++) {
+        m_points[i] = m_coords.data() + (size_t) i * m_dimension;
+      }
+      if (boxDecomposition) {
+        m_tree.reset(new ANNbd_tree(m_points.data(), data.N(), m_dimension));
+      } else {
+        m_tree.reset(new ANNkd_tree(m_points.data(), data.N(), m_dimension));
+      }
+    };
+
+    void query(const TPrecision *point, unsigned int k, int *knn,
+               TPrecision *squaredDists) const override {
+      std::vector<ANNcoord> q(point, point + m_dimension);
+      std::vector<ANNdist> dists(k);
+      m_tree->annkSearch(q.data(), k, knn, dists.data(), m_eps);
+      std::copy(dists.begin(), dists.end(), squaredDists);
+    };
+
+  private:
+    unsigned int m_dimension;
+    double m_eps;
+    std::vector<ANNcoord> m_coords;
+    std::vector<ANNpoint> m_points;
+    std::unique_ptr<ANNkd_tree> m_tree;
+};
+
+
+template <typename TPrecision>
+class ANNKNNBackend : public KNNBackend<TPrecision> {
+  public:
+    ANNKNNBackend(bool boxDecomposition, unsigned int threadCount = 0, double eps = 0) :
+        KNNBackend<TPrecision>(threadCount), m_boxDecomposition(boxDecomposition), m_eps(eps) {};
+
+    std::string getName() const override {
+      return m_boxDecomposition ? "bdtree" : "kdtree";
+    };
+
+    double getEpsilon() const override {
+      return m_eps;
+    };
+
+    std::unique_ptr<KNNIndex<TPrecision>> buildIndex(
+        FortranLinalg::DenseMatrix<TPrecision> &data) const override {
+      return std::unique_ptr<KNNIndex<TPrecision>>(
+          new ANNKNNIndex<TPrecision>(data, m_boxDecomposition, m_eps));
+    };
+
+  private:
+    bool m_boxDecomposition;
+    double m_eps;
+};
+
+
+template <typename TPrecision>
+double KNNBackend<TPrecision>::recall(FortranLinalg::DenseMatrix<TPrecision> &data,
+                                      unsigned int k, unsigned int sampleCount) const {
+  unsigned int n = data.N();
+  k = std::min(k, n);
+  sampleCount = std::min(sampleCount, n);
+  if (k == 0 || sampleCount == 0) {
+    return 1;
+  }
+  std::unique_ptr<KNNIndex<TPrecision>> index = buildIndex(data);
+  BruteForceKNNIndex<TPrecision> exact(data);
+
+  std::vector<unsigned int> order(sampleCount);
+  for (unsigned int s = 0; s < sampleCount; s++) {
+    order[s] = s;
+  }
+  WorkStealingScheduler scheduler(m_threadCount);
+  std::vector<unsigned int> found(scheduler.threadCount(), 0);
+  std::vector<std::vector<int>> neighbors(scheduler.threadCount(), std::vector<int>(k));
+  std::vector<std::vector<TPrecision>> distances(scheduler.threadCount(),
+                                                 std::vector<TPrecision>(k));
+  scheduler.run(order, [&](unsigned int s, unsigned int worker) {
+    const TPrecision *point = data.data() + (size_t) ((size_t) s * n / sampleCount) * data.M();
+    std::vector<int> &knn = neighbors[worker];
+    std::vector<TPrecision> &dists = distances[worker];
+    exact.query(point, k, knn.data(), dists.data());
+    TPrecision kth = dists[k - 1];
+    index->query(point, k, knn.data(), dists.data());
+    for (unsigned int j = 0; j < k; j++) {
+      // Distances are recomputed as the scan computes them.
+      const TPrecision *neighbor = data.data() + (size_t) knn[j] * data.M();
+      if (BruteForceKNNIndex<TPrecision>::squaredDistance(point, neighbor, data.M()) <= kth) {
+        found[worker]++;
+      }
+    }
+  });
+
+  size_t total = 0;
+  for (unsigned int count : found) {
+    total += count;
+  }
+  return double(total) / (double(sampleCount) * k);
+}
+
+template <typename TPrecision>
+std::unique_ptr<KNNBackend<TPrecision>> KNNBackend<TPrecision>::create(
+    const std::string &name, unsigned int threadCount, double eps) {
+  if (name == "brute") {
+    return std::unique_ptr<KNNBackend<TPrecision>>(
+        new BruteForceKNNBackend<TPrecision>(threadCount));
+  }
+  if (name == "kdtree" || name == "bdtree") {
+    return std::unique_ptr<KNNBackend<TPrecision>>(
+        new ANNKNNBackend<TPrecision>(name == "bdtree", threadCount, eps));
+  }
+  throw std::invalid_argument("Unknown nearest neighbor backend '" + name +
+                              "', expected brute, kdtree or bdtree.");
+}
+
+#endif
@@ -0,0 +1,145 @@
+#ifndef KNNGRAPHCACHE_H
+#define KNNGRAPHCACHE_H
+
+#include "flinalg/DenseMatrix.h"
+#include "graph/KNNBackend.h"
+#include "metrics/BlockedDistance.h"
+#include "metrics/Distance.h"
+
+#include <mutex>
+#include <string>
+
+
+// Keeps the k nearest neighbor graph of a dataset's distance matrix, or of
+// its samples, so that repeated requests don't search neighbors again. Only
+// the graph with the largest k computed so far is kept; since neighbors are
+// sorted by distance with a fixed tie order, any smaller k is a prefix of its
+// rows. That doesn't hold for an approximate search, whose graph is only
+// reused for the same k, nor across ways of searching, so the graph of one
+// way isn't reused by another.
+template <typename TPrecision>
+class KNNGraphCache {
+  public:
+    ~KNNGraphCache(){
+      clear();
+    };
+
+    // Fill the k = knn.M() nearest neighbors and distances of every column of
+    // the distance matrix of the given dataset, as Distance::findKNN does.
+    void findKNN(int datasetId, FortranLinalg::DenseMatrix<TPrecision> &distances,
+        FortranLinalg::Matrix<int> &knn, FortranLinalg::Matrix<TPrecision> &knnDists) {
+      find(datasetId, distances.N(), "distances", true, knn, knnDists,
+          [&](FortranLinalg::DenseMatrix<int> &graph, FortranLinalg::DenseMatrix<TPrecision> &dists) {
+        Distance<TPrecision>::findKNN(distances, graph, dists);
+      });
+    };
+
+    // Same as above for a dataset given by its samples matrix, one sample per
+    // column, without computing its distance matrix; see
+    // BlockedDistance::findKNN. A backend, if given, searches the samples
+    // instead on its own threads.
+    void findSampleKNN(int datasetId, FortranLinalg::DenseMatrix<TPrecision> &samples,
+        FortranLinalg::Matrix<int> &knn, FortranLinalg::Matrix<TPrecision> &knnDists,
+        unsigned int threadCount = 0, const KNNBackend<TPrecision> *backend = nullptr) {
+      std::string search = "samples";
+      bool exact = true;
+      if (backend != nullptr) {
+        search = backend->getName() + " " + std::to_string(backend->getEpsilon());
+        exact = backend->getEpsilon() == 0;
+      }
+      find(datasetId, samples.N(), search, exact, knn, knnDists,
+          [&](FortranLinalg::DenseMatrix<int> &graph, FortranLinalg::DenseMatrix<TPrecision> &dists) {
+        if (backend != nullptr) {
+          backend->findKNN(samples, graph, dists, false);
+        } else {
+          BlockedDistance<TPrecision>::findKNN(samples, graph, dists, threadCount);
+        }
+      });
+    };
+
+    // Largest k currently cached, 0 if none
+    unsigned int size() {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_knn.M();
+    };
+
+    void clear(){
+      std::lock_guard<std::mutex> lock(m_mutex);
+      release();
+      m_datasetId = -1;
+    };
+
+  private:
+    // A graph missing from the cache is computed without holding the lock,
+    // so that searches of other sessions aren't held up by it, and is only
+    // kept once it is complete; if compute throws, nothing is cached.
+    template <typename Compute>
+    void find(int datasetId, unsigned int n, const std::string &search, bool exact,
+        FortranLinalg::Matrix<int> &knn, FortranLinalg::Matrix<TPrecision> &knnDists,
+        Compute &&compute) {
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (cached(datasetId, n, search, exact, knn.M())) {
+          copy(m_knn, m_knnDists, knn, knnDists);
+          return;
+        }
+      }
+
+      FortranLinalg::DenseMatrix<int> graph(knn.M(), n);
+      FortranLinalg::DenseMatrix<TPrecision> dists(knn.M(), n);
+      try {
+        compute(graph, dists);
+      } catch (...) {
+        graph.deallocate();
+        dists.deallocate();
+        throw;
+      }
+      copy(graph, dists, knn, knnDists);
+
+      // Another session may have cached a graph as large in the meantime.
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (cached(datasetId, n, search, exact, knn.M())) {
+        graph.deallocate();
+        dists.deallocate();
+        return;
+      }
+      release();
+      m_datasetId = datasetId;
+      m_search = search;
+      m_knn = graph;
+      m_knnDists = dists;
+    };
+
+    // Whether the cached graph answers k neighbors searched the given way
+    bool cached(int datasetId, unsigned int n, const std::string &search, bool exact,
+        unsigned int k) {
+      return datasetId == m_datasetId && m_knn.N() == n && search == m_search &&
+          (exact ? m_knn.M() >= k : m_knn.M() == k);
+    };
+
+    static void copy(FortranLinalg::DenseMatrix<int> &graph,
+        FortranLinalg::DenseMatrix<TPrecision> &dists, FortranLinalg::Matrix<int> &knn,
+        FortranLinalg::Matrix<TPrecision> &knnDists) {
+      for (unsigned int i = 0; i < knn.N(); i++) {
+        for (unsigned int j = 0; j < knn.M(); j++) {
+          knn(j, i) = graph(j, i);
+          knnDists(j, i) = dists(j, i);
+        }
+      }
+    };
+
+    void release(){
+      m_knn.deallocate();
+      m_knnDists.deallocate();
+      m_knn = FortranLinalg::DenseMatrix<int>();
+      m_knnDists = FortranLinalg::DenseMatrix<TPrecision>();
+    };
+
+    int m_datasetId = -1;
+    std::string m_search;
+    FortranLinalg::DenseMatrix<int> m_knn;
+    FortranLinalg::DenseMatrix<TPrecision> m_knnDists;
+    std::mutex m_mutex;
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef KNNNEIGHBORHOOD_H
 #define KNNNEIGHBORHOOD_H
 
+#include "graph/KNNBackend.h"
 #include "graph/Neighborhood.h"
 #include "flinalg/SparseMatrix.h"
 #include "metrics/Distance.h"
@@ -10,8 +11,11 @@
 template <typename TPrecision>
 class KNNNeighborhood : public Neighborhood<TPrecision> {
   public:    
-    KNNNeighborhood(unsigned int k, TPrecision value = std::numeric_limits<TPrecision>::max()) : 
-                               knn(k), val(value){};
+    // A backend finds the neighbors of dense data, other data are searched
+    // with the Euclidean metric.
+    KNNNeighborhood(unsigned int k, TPrecision value = std::numeric_limits<TPrecision>::max(),
+                    const KNNBackend<TPrecision> *b = nullptr) :
+                               knn(k), val(value), backend(b){};
    
     FortranLinalg::SparseMatrix<TPrecision> generateNeighborhood(
         FortranLinalg::Matrix<TPrecision> &data){
@@ -23,7 +27,12 @@ class KNNNeighborhood : public Neighborhood<TPrecision> {
       //knn 
       DenseMatrix<int> knns(knn, data.N());
       DenseMatrix<TPrecision> knnDists(knn, data.N());
-      Distance<TPrecision>::computeKNN(data, knns, knnDists, euclideanMetric);  
+      DenseMatrix<TPrecision> *dense = dynamic_cast<DenseMatrix<TPrecision> *>(&data);
+      if (backend != nullptr && dense != nullptr) {
+        backend->findKNN(*dense, knns, knnDists, false);
+      } else {
+        Distance<TPrecision>::computeKNN(data, knns, knnDists, euclideanMetric);  
+      }
 
       //complete adjancy matrix
       SparseMatrix<TPrecision> adj(data.N(), data.N(), val);
@@ -46,6 +55,7 @@ class KNNNeighborhood : public Neighborhood<TPrecision> {
   private:
     unsigned int knn;
     TPrecision val;
+    const KNNBackend<TPrecision> *backend;
     EuclideanMetric<TPrecision> euclideanMetric;                                         
 };
 
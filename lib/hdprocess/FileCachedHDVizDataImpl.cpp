@@ -1,10 +1,12 @@
 #include "FileCachedHDVizDataImpl.h"
+#include "HDProcessResultSerializer.h"
 #include <stdexcept>
 
 const std::string k_defaultPath = "./";
-const std::string k_defaultPersistenceDataHeaderFilename = "Persistence.data.hdr";
-const std::string k_defaultPersistenceStartHeaderFilename = "PersistenceStart.data.hdr";
-const std::string k_defaultGeomDataHeaderFilename = "Geom.data.hdr";
+const std::string k_defaultPersistenceDataHeaderFilename = "Persistence";
+const std::string k_defaultPersistenceStartHeaderFilename = "PersistenceStart";
+const std::string k_defaultGeomDataHeaderFilename = "Geom";
+const std::string k_headerFileExtension = ".data.hdr";
 const std::string k_defaultParameterNamesFilename = "names.txt";
 const int k_defaultSamplesCount = 50;
 
@@ -18,17 +20,22 @@ FileCachedHDVizDataImpl::FileCachedHDVizDataImpl(std::string path) {
   std::string geomDataHeaderFilename = k_defaultGeomDataHeaderFilename;
   std::string parameterNamesFilename = k_defaultParameterNamesFilename;
   m_path = path.empty() ? k_defaultPath : path;
+  if (*m_path.rbegin() != '/') {
+    m_path += '/';
+  }
+  if (MatrixArchive::isArchive(m_path + HDProcessResultSerializer::ArchiveFilename)) {
+    m_archive.reset(new MatrixArchive(m_path + HDProcessResultSerializer::ArchiveFilename));
+  }
 
-
-  m_knn = FortranLinalg::LinalgIO<int>::readMatrix(m_path + "KNN.data.hdr");
-  pSorted = FortranLinalg::LinalgIO<Precision>::readVector(m_path + persistenceDataHeaderFilename);
+  m_knn = readMatrix<int>("KNN");
+  pSorted = readVector<Precision>(persistenceDataHeaderFilename);
   maxLevel = pSorted.N() - 1;      
   FortranLinalg::DenseVector<Precision> tmp = 
-      FortranLinalg::LinalgIO<Precision>::readVector(m_path + persistenceStartHeaderFilename);
+      readVector<Precision>(persistenceStartHeaderFilename);
   minLevel = tmp(0);
 
   FortranLinalg::DenseMatrix<Precision> G = 
-      FortranLinalg::LinalgIO<Precision>::readMatrix(m_path + geomDataHeaderFilename);
+      readMatrix<Precision>(geomDataHeaderFilename);
   Rmin = FortranLinalg::Linalg<Precision>::RowMin(G);
   Rmax = FortranLinalg::Linalg<Precision>::RowMax(G);
   
@@ -255,18 +262,15 @@ void FileCachedHDVizDataImpl::setLayout(HDVizLayout layout, int level) {
   Lmax.deallocate();
   switch (layout) {
     case HDVizLayout::ISOMAP:
-      loadLayout("_isolayout.data.hdr", "IsoExtremaLayout", 
-          m_path + "IsoMin.data.hdr", m_path + "IsoMax.data.hdr", level);
+      loadLayout("_isolayout", "IsoExtremaLayout", "IsoMin", "IsoMax", level);
       break;
 
     case HDVizLayout::PCA:
-      loadLayout("_layout.data.hdr", "ExtremaLayout", 
-          m_path + "PCAMin.data.hdr", m_path + "PCAMax.data.hdr", level);  
+      loadLayout("_layout", "ExtremaLayout", "PCAMin", "PCAMax", level);
       break;    
 
     case HDVizLayout::PCA2:
-      loadLayout("_pca2layout.data.hdr", "PCA2ExtremaLayout",
-          m_path + "PCA2Min.data.hdr", m_path + "PCA2Max.data.hdr", level);
+      loadLayout("_pca2layout", "PCA2ExtremaLayout", "PCA2Min", "PCA2Max", level);
       break;
 
     default:  
@@ -278,19 +282,19 @@ void FileCachedHDVizDataImpl::setLayout(HDVizLayout layout, int level) {
 
 void FileCachedHDVizDataImpl::loadLayout(std::string type, std::string extFile, 
     std::string minFile, std::string maxFile, int level) {
-  Lmin = FortranLinalg::LinalgIO<Precision>::readVector(minFile);
-  Lmax = FortranLinalg::LinalgIO<Precision>::readVector(maxFile);
+  Lmin = readVector<Precision>(minFile);
+  Lmax = readVector<Precision>(maxFile);
 
   for (unsigned int i = 0; i < edges.N(); i++) {
     std::string filename = "ps_" + std::to_string(level) + "_crystal_" + std::to_string(i) + type;
     L[i].deallocate();
-    L[i] = FortranLinalg::LinalgIO<Precision>::readMatrix(m_path + filename);
+    L[i] = readMatrix<Precision>(filename);
   }
   // Extrema layout 
   eL.deallocate();
-  std::string eL_Filename = extFile + "_" + std::to_string(level) + ".data.hdr";
+  std::string eL_Filename = extFile + "_" + std::to_string(level);
 
-  eL = FortranLinalg::LinalgIO<Precision>::readMatrix(m_path + eL_Filename);  
+  eL = readMatrix<Precision>(eL_Filename);  
 
  
   FortranLinalg::DenseVector<Precision> diff = FortranLinalg::Linalg<Precision>::Subtract(Lmax, Lmin);
@@ -326,8 +330,8 @@ void FileCachedHDVizDataImpl::loadData(int level) {
 
   // Edges
   edges.deallocate(); 
-  std::string crystalsFilename = "Crystals_" + std::to_string(level) + ".data.hdr";
-  edges = FortranLinalg::LinalgIO<int>::readMatrix(m_path + crystalsFilename);
+  std::string crystalsFilename = "Crystals_" + std::to_string(level);
+  edges = readMatrix<int>(crystalsFilename);
 
 
   // Read layout information matrices.
@@ -342,8 +346,8 @@ void FileCachedHDVizDataImpl::loadData(int level) {
 
   // Extrema function values
   ef.deallocate();      
-  std::string extremaValuesFilename = "ExtremaValues_" + std::to_string(level) + ".data.hdr";
-  ef = FortranLinalg::LinalgIO<Precision>::readVector(m_path + extremaValuesFilename);
+  std::string extremaValuesFilename = "ExtremaValues_" + std::to_string(level);
+  ef = readVector<Precision>(extremaValuesFilename);
   
   // Create Normalized Extrema Values
   ez.deallocate();
@@ -353,9 +357,9 @@ void FileCachedHDVizDataImpl::loadData(int level) {
   FortranLinalg::Linalg<Precision>::Subtract(ef, efmin, ez);
   FortranLinalg::Linalg<Precision>::Scale(ez, 1.f/(efmax-efmin), ez);
   
-  std::string extremaWidthsFilename = "ExtremaWidths_" + std::to_string(level) + ".data.hdr";
+  std::string extremaWidthsFilename = "ExtremaWidths_" + std::to_string(level);
   ew.deallocate();
-  ew = FortranLinalg::LinalgIO<Precision>::readVector(m_path + extremaWidthsFilename);
+  ew = readVector<Precision>(extremaWidthsFilename);
 
 
   // Load color and width informations.
@@ -364,9 +368,9 @@ void FileCachedHDVizDataImpl::loadData(int level) {
   yw = std::vector<FortranLinalg::DenseVector<Precision>>(edges.N());
   yd = std::vector<FortranLinalg::DenseVector<Precision>>(edges.N());
 
-  loadColorValues("_fmean.data.hdr", level);
-  loadWidthValues("_mdists.data.hdr", level);
-  loadDensityValues("_spdf.data.hdr", level);
+  loadColorValues("_fmean", level);
+  loadWidthValues("_mdists", level);
+  loadDensityValues("_spdf", level);
 };
 
 
@@ -374,7 +378,7 @@ void FileCachedHDVizDataImpl::loadColorValues(std::string type, int level){
   for(unsigned int i=0; i<edges.N(); i++){
     std::string filename = "ps_" + std::to_string(level) + "_crystal_" + std::to_string(i) + type;
     yc[i].deallocate();
-    yc[i] = FortranLinalg::LinalgIO<Precision>::readVector(m_path + filename);
+    yc[i] = readVector<Precision>(filename);
     z[i] = FortranLinalg::DenseVector<Precision>(yc[i].N());
     FortranLinalg::Linalg<Precision>::Subtract(yc[i], efmin, z[i]);
     FortranLinalg::Linalg<Precision>::Scale(z[i], 1.f/(efmax-efmin), z[i]);
@@ -394,7 +398,7 @@ void FileCachedHDVizDataImpl::loadWidthValues(std::string type, int level){
   for(unsigned int i = 0; i < edges.N(); i++){
     std::string filename = "ps_" + std::to_string(level) + "_crystal_" + std::to_string(i) + type;
     yw[i].deallocate();
-    yw[i] = FortranLinalg::LinalgIO<Precision>::readVector(m_path + filename);    
+    yw[i] = readVector<Precision>(filename);
 
     for(unsigned int k=0; k< yw[i].N(); k++){
       if(yw[i](k) < widthMin){
@@ -423,7 +427,7 @@ void FileCachedHDVizDataImpl::loadDensityValues(std::string type, int level) {
   for(unsigned int i=0; i<edges.N(); i++){
     std::string filename = "ps_" + std::to_string(level) + "_crystal_" + std::to_string(i) + type;
     yd[i].deallocate();
-    yd[i] = FortranLinalg::LinalgIO<Precision>::readVector(m_path + filename);    
+    yd[i] = readVector<Precision>(filename);
 
     for(unsigned int k=0; k< yd[i].N(); k++){
       if(yd[i](k) < densityMin){
@@ -441,14 +445,14 @@ void FileCachedHDVizDataImpl::loadDensityValues(std::string type, int level) {
 void FileCachedHDVizDataImpl::loadReconstructions(int level){
   for(unsigned int i=0; i< edges.N(); i++){
     std::string baseFilename = "ps_" + std::to_string(level) + "_crystal_" + std::to_string(i);
-    std::string rFilename = baseFilename + "_Rs.data.hdr";
-    R[i] = FortranLinalg::LinalgIO<Precision>::readMatrix(m_path + rFilename);
+    std::string rFilename = baseFilename + "_Rs";
+    R[i] = readMatrix<Precision>(rFilename);
 
-    std::string gradrFilename = baseFilename + "_gradRs.data.hdr";
-    gradR[i] = FortranLinalg::LinalgIO<Precision>::readMatrix(m_path + gradrFilename);
+    std::string gradrFilename = baseFilename + "_gradRs";
+    gradR[i] = readMatrix<Precision>(gradrFilename);
 
-    std::string svarFilename = baseFilename + "_Svar.data.hdr";
-    Rvar[i] = FortranLinalg::LinalgIO<Precision>::readMatrix(m_path + svarFilename);
+    std::string svarFilename = baseFilename + "_Svar";
+    Rvar[i] = readMatrix<Precision>(svarFilename);
   }
 
   // Rmin = FortranLinalg::Linalg<Precision>::ExtractColumn(R[0], 0);
@@ -511,4 +515,29 @@ void FileCachedHDVizDataImpl::maybeSwapLayoutCache(HDVizLayout layout) {
   }
 }
 
+/**
+ * Reads a matrix from the archive if the directory has one, otherwise from
+ * its .data.hdr file. Archive sections are copied, since the level caches
+ * are rescaled in place and deallocated on level swaps.
+ */
+template <typename T>
+FortranLinalg::DenseMatrix<T> FileCachedHDVizDataImpl::readMatrix(const std::string &name) {
+  if (!m_archive) {
+    return FortranLinalg::LinalgIO<T>::readMatrix(m_path + name + k_headerFileExtension);
+  }
+  FortranLinalg::DenseMatrixView<T> view = m_archive->getMatrix<T>(name);
+  return FortranLinalg::Linalg<T>::Copy(view);
+}
 
+/**
+ * Reads a vector from the archive if the directory has one, otherwise from
+ * its .data.hdr file.
+ */
+template <typename T>
+FortranLinalg::DenseVector<T> FileCachedHDVizDataImpl::readVector(const std::string &name) {
+  if (!m_archive) {
+    return FortranLinalg::LinalgIO<T>::readVector(m_path + name + k_headerFileExtension);
+  }
+  FortranLinalg::DenseVectorView<T> view = m_archive->getVector<T>(name);
+  return FortranLinalg::Linalg<T>::Copy(view);
+}
@@ -6,7 +6,9 @@
 #include "flinalg/Linalg.h"
 #include "HDVizData.h"
 #include "dspacex/Precision.h"
+#include "utils/MatrixArchive.h"
 
+#include <memory>
 #include <string>
 
 class FileCachedHDVizDataImpl : public HDVizData {
@@ -81,6 +83,11 @@ class FileCachedHDVizDataImpl : public HDVizData {
     void loadReconstructions(int level);
     void maybeSwapLevelCache(int level);
     void maybeSwapLayoutCache(HDVizLayout layout);
+
+    template <typename T>
+    FortranLinalg::DenseMatrix<T> readMatrix(const std::string &name);
+    template <typename T>
+    FortranLinalg::DenseVector<T> readVector(const std::string &name);
     
     FortranLinalg::DenseMatrix<int> m_knn;      
     FortranLinalg::DenseVector<Precision> pSorted;  //  Persistence.data.hdr
@@ -105,6 +112,7 @@ class FileCachedHDVizDataImpl : public HDVizData {
 
     // filenames
     std::string m_path;
+    std::unique_ptr<MatrixArchive> m_archive; // single-file result, if present
 
     // Cell Reconstruction
     std::vector<FortranLinalg::DenseMatrix<Precision>> R;      // mean
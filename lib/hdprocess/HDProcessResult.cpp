@@ -0,0 +1,76 @@
+#include "HDProcessResult.h"
+#include "MatrixMemory.h"
+
+namespace {
+
+/**
+ * Calls f for every matrix, vector and list of them held by the result,
+ * except for the parameter names.
+ */
+template <typename F>
+void forEachArray(HDProcessResult &result, F f) {
+  f(result.knn);
+  f(result.scaledPersistence);
+  f(result.minLevel);
+  f(result.X);
+  f(result.Y);
+  f(result.regressionSampleCount);
+  f(result.crystals);
+  f(result.crystalPartitions);
+  f(result.extremaValues);
+  f(result.extremaWidths);
+  f(result.LminPCA);
+  f(result.LmaxPCA);
+  f(result.PCAExtremaLayout);
+  f(result.PCALayout);
+  f(result.LminPCA2);
+  f(result.LmaxPCA2);
+  f(result.PCA2ExtremaLayout);
+  f(result.PCA2Layout);
+  f(result.LminIso);
+  f(result.LmaxIso);
+  f(result.IsoExtremaLayout);
+  f(result.IsoLayout);
+  f(result.fmean);
+  f(result.mdists);
+  f(result.spdf);
+  f(result.R);
+  f(result.gradR);
+  f(result.Rvar);
+}
+
+} // namespace
+
+/**
+ * Sum of the storage of all matrices and vectors of the result, used to
+ * account the result against a memory budget.
+ */
+size_t HDProcessResult::byteSize() {
+  size_t bytes = HDProcess::byteSize(names);
+  if (hierarchy) {
+    bytes += hierarchy->byteSize();
+  }
+  forEachArray(*this, [&bytes](auto &arrays) {
+    bytes += HDProcess::byteSize(arrays);
+  });
+  return bytes;
+}
+
+/**
+ * Free all matrices and vectors of the result. Views of an archive are
+ * released and the archive is unmapped once no other result refers to it.
+ */
+void HDProcessResult::deallocate() {
+  if (archive) {
+    forEachArray(*this, [](auto &arrays) {
+      HDProcess::release(arrays);
+    });
+    archive.reset();
+  } else {
+    forEachArray(*this, [](auto &arrays) {
+      HDProcess::deallocate(arrays);
+    });
+  }
+  names.deallocate();
+  hierarchy.reset();
+}
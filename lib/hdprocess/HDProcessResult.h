@@ -2,6 +2,10 @@
 
 #include "flinalg/Linalg.h"
 #include "dspacex/Precision.h"
+#include "morsesmale/MSHierarchy.h"
+#include "utils/MatrixArchive.h"
+#include <cstddef>
+#include <memory>
 #include <vector>
 
 
@@ -51,6 +55,19 @@ struct HDProcessResult {
   std::vector<std::vector<FortranLinalg::DenseMatrix<Precision>>> gradR; // ps_[level]_crystal_[i]_gradRs.data.hdr";
   std::vector<std::vector<FortranLinalg::DenseMatrix<Precision>>> Rvar;  // ps_[level]_crystal_[i]_Svar.data.hdr"; 
 
+  // Crystals of every sample at each level from minLevel on
+  std::shared_ptr<MSHierarchy> hierarchy;
+
   // parameter names
   FortranLinalg::DenseVector<std::string> names;
+
+  // Mapped file holding the matrices and vectors, if they are views of an archive
+  std::shared_ptr<MatrixArchive> archive;
+
+  // Number of bytes held by all matrices and vectors of the result.
+  size_t byteSize();
+
+  // Free all matrices and vectors of the result, or release them if they are
+  // views of an archive.
+  void deallocate();
 };
@@ -5,7 +5,9 @@
 #include "flinalg/DenseMatrix.h"
 #include "flinalg/DenseVector.h"
 #include "dspacex/Precision.h"
+#include "utils/MatrixArchive.h"
 
+#include <fstream>
 #include <string>
 
 using namespace FortranLinalg;
@@ -16,10 +18,166 @@ const std::string k_defaultGeomDataHeaderFilename = "Geom.data.hdr";
 const std::string k_defaultFunctionDataHeaderFilename = "Function.data.hdr";
 const std::string k_defaultParameterNamesFilename = "names.txt";
 
-HDProcessResult* HDProcessResultSerializer::read(std::string path) {
+const std::string HDProcessResultSerializer::ArchiveFilename = "HDProcessResult.dsx";
+
+namespace {
+
+bool fileExists(const std::string &filename) {
+  return std::ifstream(filename).good();
+}
+
+std::string directoryPath(std::string path) {
   if (!path.empty() && *path.rbegin() != '/') {
      path += '/';
   } 
+  return path;
+}
+
+/**
+ * Visits every array of a result under the name of its per-array file. Lists
+ * are sized from the arrays visited before them, so a visitor that reads the
+ * arrays fills in an empty result.
+ */
+template <typename Visitor>
+void visitArrays(HDProcessResult &result, Visitor &visitor) {
+  visitor.matrix("Geom", result.X);
+  visitor.vector("Function", result.Y);
+  visitor.matrix("KNN", result.knn);
+  visitor.vector("Persistence", result.scaledPersistence);
+  visitor.vector("PersistenceStart", result.minLevel);
+
+  unsigned int levels = result.scaledPersistence.N();
+  result.crystals.resize(levels);
+  result.crystalPartitions.resize(levels);
+  result.extremaValues.resize(levels);
+  result.extremaWidths.resize(levels);
+  result.R.resize(levels);
+  result.gradR.resize(levels);
+  result.Rvar.resize(levels);
+  result.mdists.resize(levels);
+  result.fmean.resize(levels);
+  result.spdf.resize(levels);
+  result.PCAExtremaLayout.resize(levels);
+  result.PCALayout.resize(levels);
+  result.PCA2ExtremaLayout.resize(levels);
+  result.PCA2Layout.resize(levels);
+  result.IsoExtremaLayout.resize(levels);
+  result.IsoLayout.resize(levels);
+
+  for (unsigned int level = result.minLevel(0); level < levels; level++) {
+    std::string suffix = "_" + std::to_string(level);
+    visitor.matrix("Crystals" + suffix, result.crystals[level]);
+    visitor.vector("CrystalPartitions" + suffix, result.crystalPartitions[level]);
+    visitor.vector("ExtremaValues" + suffix, result.extremaValues[level]);
+    visitor.vector("ExtremaWidths" + suffix, result.extremaWidths[level]);
+
+    unsigned int crystalCount = result.crystals[level].N();
+    result.R[level].resize(crystalCount);
+    result.gradR[level].resize(crystalCount);
+    result.Rvar[level].resize(crystalCount);
+    result.mdists[level].resize(crystalCount);
+    result.fmean[level].resize(crystalCount);
+    result.spdf[level].resize(crystalCount);
+    for (unsigned int crystalIndex = 0; crystalIndex < crystalCount; crystalIndex++) {
+      std::string prefix = "ps_" + std::to_string(level) + "_crystal_" + std::to_string(crystalIndex);
+      visitor.matrix(prefix + "_Rs", result.R[level][crystalIndex]);
+      visitor.matrix(prefix + "_gradRs", result.gradR[level][crystalIndex]);
+      visitor.matrix(prefix + "_Svar", result.Rvar[level][crystalIndex]);
+      visitor.vector(prefix + "_mdists", result.mdists[level][crystalIndex]);
+      visitor.vector(prefix + "_fmean", result.fmean[level][crystalIndex]);
+      visitor.vector(prefix + "_spdf", result.spdf[level][crystalIndex]);
+    }
+  }
+
+  // Layout Data
+  visitor.vector("PCAMin", result.LminPCA);
+  visitor.vector("PCAMax", result.LmaxPCA);
+  visitor.vector("PCA2Min", result.LminPCA2);
+  visitor.vector("PCA2Max", result.LmaxPCA2);
+  visitor.vector("IsoMin", result.LminIso);
+  visitor.vector("IsoMax", result.LmaxIso);
+
+  for (unsigned int level = result.minLevel(0); level < levels; level++) {
+    std::string suffix = "_" + std::to_string(level);
+    visitor.matrix("ExtremaLayout" + suffix, result.PCAExtremaLayout[level]);
+    visitor.matrix("PCA2ExtremaLayout" + suffix, result.PCA2ExtremaLayout[level]);
+    visitor.matrix("IsoExtremaLayout" + suffix, result.IsoExtremaLayout[level]);
+
+    unsigned int crystalCount = result.crystals[level].N();
+    result.PCALayout[level].resize(crystalCount);
+    result.PCA2Layout[level].resize(crystalCount);
+    result.IsoLayout[level].resize(crystalCount);
+    for (unsigned int crystalIndex = 0; crystalIndex < crystalCount; crystalIndex++) {
+      std::string prefix = "ps_" + std::to_string(level) + "_crystal_" + std::to_string(crystalIndex);
+      visitor.matrix(prefix + "_layout", result.PCALayout[level][crystalIndex]);
+      visitor.matrix(prefix + "_pca2layout", result.PCA2Layout[level][crystalIndex]);
+      visitor.matrix(prefix + "_isolayout", result.IsoLayout[level][crystalIndex]);
+    }
+  }
+}
+
+struct ArchiveWriteVisitor {
+  MatrixArchiveWriter writer;
+
+  template <typename T>
+  void matrix(const std::string &name, DenseMatrix<T> &matrix) {
+    writer.addMatrix(name, matrix);
+  }
+
+  template <typename T>
+  void vector(const std::string &name, DenseVector<T> &vector) {
+    writer.addVector(name, vector);
+  }
+};
+
+struct ArchiveReadVisitor {
+  MatrixArchive &archive;
+
+  template <typename T>
+  void matrix(const std::string &name, DenseMatrix<T> &matrix) {
+    matrix = archive.getMatrix<T>(name);
+  }
+
+  template <typename T>
+  void vector(const std::string &name, DenseVector<T> &vector) {
+    vector = archive.getVector<T>(name);
+  }
+};
+
+} // namespace
+
+/**
+ * Reads the archive as views of its mapping; the result keeps the archive
+ * mapped until it is deallocated.
+ */
+HDProcessResult* HDProcessResultSerializer::read(std::string path) {
+  path = directoryPath(path);
+  if (!MatrixArchive::isArchive(path + ArchiveFilename)) {
+    return readFiles(path);
+  }
+
+  HDProcessResult *result = new HDProcessResult();
+  result->archive = std::make_shared<MatrixArchive>(path + ArchiveFilename);
+  ArchiveReadVisitor visitor{*result->archive};
+  try {
+    visitArrays(*result, visitor);
+  } catch (...) {
+    result->deallocate();
+    delete result;
+    throw;
+  }
+  result->names = FortranLinalg::DenseVector<std::string>(result->X.M());
+  return result;
+}
+
+void HDProcessResultSerializer::write(HDProcessResult *result, std::string path) {
+  ArchiveWriteVisitor visitor;
+  visitArrays(*result, visitor);
+  visitor.writer.write(directoryPath(path) + ArchiveFilename);
+}
+
+HDProcessResult* HDProcessResultSerializer::readFiles(std::string path) {
+  path = directoryPath(path);
 
   HDProcessResult *result = new HDProcessResult();
   
@@ -34,6 +192,7 @@ HDProcessResult* HDProcessResultSerializer::read(std::string path) {
 
   // Resize Stores for Persistence Level information
   result->crystals.resize(result->scaledPersistence.N());
+  result->crystalPartitions.resize(result->scaledPersistence.N());
   result->extremaValues.resize(result->scaledPersistence.N());  
   result->extremaWidths.resize(result->scaledPersistence.N());
   result->R.resize(result->scaledPersistence.N());
@@ -53,6 +212,12 @@ HDProcessResult* HDProcessResultSerializer::read(std::string path) {
     std::string crystalsFilename = "Crystals_" + std::to_string(level) + ".data.hdr";
     result->crystals[level] = LinalgIO<int>::readMatrix(path + crystalsFilename);
 
+    // Partitions are missing from output written by older versions.
+    std::string partitionsFilename = "CrystalPartitions_" + std::to_string(level) + ".data.hdr";
+    if (fileExists(path + partitionsFilename)) {
+      result->crystalPartitions[level] = LinalgIO<int>::readVector(path + partitionsFilename);
+    }
+
     std::string ExtremaValuesFilename = "ExtremaValues_" + std::to_string(level) + ".data.hdr";
     result->extremaValues[level] = LinalgIO<Precision>::readVector(path + ExtremaValuesFilename);
 
@@ -132,10 +297,8 @@ HDProcessResult* HDProcessResultSerializer::read(std::string path) {
   return result;
 } 
 
-void HDProcessResultSerializer::write(HDProcessResult *result, std::string path) {
-  if (!path.empty() && *path.rbegin() != '/') {
-     path += '/';
-  } 
+void HDProcessResultSerializer::writeFiles(HDProcessResult *result, std::string path) {
+  path = directoryPath(path);
 
   LinalgIO<Precision>::writeMatrix(path + "Geom.data", result->X);   
   LinalgIO<Precision>::writeVector(path + "Function.data", result->Y);   
@@ -146,6 +309,9 @@ void HDProcessResultSerializer::write(HDProcessResult *result, std::string path)
     std::string crystalsFilename = "Crystals_" + std::to_string(level) + ".data";
     LinalgIO<int>::writeMatrix(path + crystalsFilename, result->crystals[level]);
 
+    std::string partitionsFilename = "CrystalPartitions_" + std::to_string(level) + ".data";
+    LinalgIO<int>::writeVector(path + partitionsFilename, result->crystalPartitions[level]);
+
     std::string ExtremaValuesFilename = "ExtremaValues_" + std::to_string(level) + ".data";
     LinalgIO<Precision>::writeVector(path + ExtremaValuesFilename, result->extremaValues[level]);      
 
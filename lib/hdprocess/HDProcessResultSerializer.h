@@ -5,6 +5,16 @@
 
 class HDProcessResultSerializer {
 public:
+  // Reads the result in the directory path, from its archive if there is one
+  // and otherwise from the per-array files.
   static HDProcessResult* read(std::string path);
+
+  // Writes the result into the directory path as a single archive file.
   static void write(HDProcessResult *result, std::string path);
-};
\ No newline at end of file
+
+  // Per-array .data/.hdr files, as written by earlier versions.
+  static HDProcessResult* readFiles(std::string path);
+  static void writeFiles(HDProcessResult *result, std::string path);
+
+  static const std::string ArchiveFilename;
+};
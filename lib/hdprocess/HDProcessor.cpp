@@ -1,15 +1,69 @@
 #include "HDProcessor.h"
 #include "utils/DataExport.h"
 
-Precision MAX = std::numeric_limits<Precision>::max();
+#include <future>
 
-//coordinate center
-int globalMin = -1;
+Precision MAX = std::numeric_limits<Precision>::max();
 
 using namespace FortranLinalg;
 
 HDProcessor::HDProcessor() = default;
 
+/**
+ * Set the number of threads used to compute persistence levels concurrently.
+ * @param[in] threadCount Number of threads; 0 uses all hardware threads and
+ *                        1 computes the levels serially.
+ */
+void HDProcessor::setThreadCount(unsigned int threadCount) {
+  m_threadCount = threadCount;
+}
+
+
+/**
+ * Provide precomputed nearest neighbors for the next call to processOnMetric
+ * or processOnSamples, which use them instead of searching the samples if they
+ * match the requested number of neighbors. The matrices are not copied and must stay
+ * valid during processing.
+ * @param[in] knn Indices of the nearest neighbors of each sample (k x n).
+ * @param[in] knnDists Distances to the nearest neighbors of each sample (k x n).
+ */
+void HDProcessor::setNearestNeighbors(DenseMatrix<int> &knn, DenseMatrix<Precision> &knnDists) {
+  m_knn = knn;
+  m_knnDists = knnDists;
+}
+
+/**
+ * Choose how nearest neighbors are searched: those of the samples given to
+ * processOnSamples, unless precomputed, and those of the points of regression
+ * curves, which otherwise are found by computing all distances.
+ * @param[in] backend Backend that must stay valid during processing, or null
+ *                    to compute distances blockwise.
+ */
+void HDProcessor::setKNNBackend(const KNNBackend<Precision> *backend) {
+  m_knnBackend = backend;
+}
+
+/**
+ * Provide a token that stops processOnMetric between persistence levels and
+ * between crystals once it is cancelled. processOnMetric then frees its
+ * partial result, or hands it to the observer, and throws OperationCancelled.
+ * @param[in] cancellation Token that must stay valid during processing, or
+ *                         null to process uninterrupted.
+ */
+void HDProcessor::setCancellationToken(const CancellationToken *cancellation) {
+  m_cancellation = cancellation;
+}
+
+/**
+ * Provide an observer that processOnMetric notifies as each persistence level
+ * is complete. With an observer, the coarsest levels, which have the fewest
+ * crystals, are computed right after the start level rather than last.
+ * @param[in] observer Observer that must stay valid during processing, or
+ *                     null to process without notifications.
+ */
+void HDProcessor::setObserver(HDProcessorObserver *observer) {
+  m_observer = observer;
+}
 
 /**
  * Process the input data and generate all data files necessary for visualization.
@@ -31,14 +85,20 @@ HDProcessResult* HDProcessor::processOnMetric(
   // Initialize processing result output object.
   m_result = new HDProcessResult();
 
+  // Reset alignment reference left over from a previous run.
+  m_globalMin = -1;
+  extsOrig.clear();
+
   // Embed Distance Metric into 3D space
   EuclideanMetric<Precision> metric;
   MetricMDS<Precision> mds;
   // Store input data as member variables.
   std::cout << "knn = " << knn << std::endl;
-  // make copy of distances so embedder won't trash data.
-  auto dd = Linalg<Precision>::Copy(d);
-  Xall = mds.embed(dd, 3); // TODO why 3?
+  // make copy of distances so embedder won't trash data, freed once embedded.
+  {
+    OwnedDenseMatrix<Precision> dd(Linalg<Precision>::Copy(d));
+    Xall = mds.embed(dd, 3); // TODO why 3?
+  }
   yall = qoi;
   
   // Add noise to yall in case of equivalent values 
@@ -46,9 +106,85 @@ HDProcessResult* HDProcessor::processOnMetric(
     addNoise(yall);
   }
      
-  // Compute Morse-Smale complex    
-  NNMSComplex<Precision> msComplex(d, qoi, knn, sigmaSmooth > 0, sigmaSmooth*sigmaSmooth, true);
-  
+  // Compute Morse-Smale complex, reusing nearest neighbors given to the processor
+  std::unique_ptr<FlatNNMSComplex<Precision>> msComplexPtr;
+  if (m_knn.N() == d.N() && (int) m_knn.M() == std::min(knn, (int) d.N())) {
+    msComplexPtr.reset(new FlatNNMSComplex<Precision>(m_knn, m_knnDists, qoi,
+        sigmaSmooth > 0, sigmaSmooth*sigmaSmooth, m_threadCount));
+  } else {
+    msComplexPtr.reset(new FlatNNMSComplex<Precision>(d, qoi, knn,
+        sigmaSmooth > 0, sigmaSmooth*sigmaSmooth, true, m_threadCount));
+  }
+
+  return processComplex(*msComplexPtr, nSamples, persistenceArg, sigmaArg);
+}
+
+/**
+ * Process samples given as columns of a matrix, without the matrix of all
+ * pairwise distances, and generate all data files necessary for visualization.
+ * Nearest neighbors are found by the backend set with setKNNBackend, or else by
+ * streaming blocks of distances, and the samples are embedded into 3D space by
+ * landmark MDS, which for datasets of up to LandmarkMDS::DefaultLandmarkCount
+ * samples is exactly the embedding of processOnMetric on their Euclidean
+ * distances.
+ * @param[in] x Matrix containing one sample per column.
+ * @param[in] qoi Vector containing quantity of interest values for each sample.
+ * @param[in] knn Number of nearest nieghbor for Morse-Samle complex computation.
+ * @param[in] nSamples Number of samples for regression curve. 
+ * @param[in] persistence Number of persistence levels to compute.
+ * @param[in] randdom Whether to apply random noise to input function.
+ * @param[in] sigma Bandwidth for inverse regression.
+ * @param[in] sigmaSmooth Bandwidth for inverse regression. (diff?)
+ */
+HDProcessResult* HDProcessor::processOnSamples(
+    DenseMatrix<Precision> x, DenseVector<Precision> qoi,
+    int knn, int nSamples, int persistenceArg, bool random,
+    Precision sigmaArg, Precision sigmaSmooth) {
+  m_result = new HDProcessResult();
+  m_globalMin = -1;
+  extsOrig.clear();
+
+  LandmarkMDS<Precision> mds(LandmarkMDS<Precision>::DefaultLandmarkCount, m_threadCount);
+  Xall = mds.embed(x, 3);
+  yall = qoi;
+
+  // Add noise to yall in case of equivalent values 
+  if (random) {
+    addNoise(yall);
+  }
+
+  // Compute Morse-Smale complex, reusing nearest neighbors given to the processor
+  int k = std::min(knn, (int) x.N());
+  std::unique_ptr<FlatNNMSComplex<Precision>> msComplexPtr;
+  if (m_knn.N() == x.N() && (int) m_knn.M() == k) {
+    msComplexPtr.reset(new FlatNNMSComplex<Precision>(m_knn, m_knnDists, qoi,
+        sigmaSmooth > 0, sigmaSmooth*sigmaSmooth, m_threadCount));
+  } else {
+    OwnedDenseMatrix<int> neighbors(k, x.N());
+    OwnedDenseMatrix<Precision> neighborDists(k, x.N());
+    if (m_knnBackend != nullptr) {
+      m_knnBackend->findKNN(x, neighbors.get(), neighborDists.get(), false);
+    } else {
+      BlockedDistance<Precision>::findKNN(x, neighbors.get(), neighborDists.get(), m_threadCount);
+    }
+    msComplexPtr.reset(new FlatNNMSComplex<Precision>(neighbors.get(), neighborDists.get(), qoi,
+        sigmaSmooth > 0, sigmaSmooth*sigmaSmooth, m_threadCount));
+  }
+
+  return processComplex(*msComplexPtr, nSamples, persistenceArg, sigmaArg);
+}
+
+/**
+ * Compute persistence levels and the analysis of all requested levels of a
+ * Morse-Smale complex of the embedded samples Xall and values yall, and
+ * detach the result started by processOnMetric or processOnSamples.
+ * @param[in] msComplex Morse-Smale complex of the samples.
+ * @param[in] nSamples Number of samples for regression curve.
+ * @param[in] persistenceArg Number of persistence levels to compute.
+ * @param[in] sigmaArg Bandwidth for inverse regression.
+ */
+HDProcessResult* HDProcessor::processComplex(FlatNNMSComplex<Precision> &msComplex,
+    int nSamples, int persistenceArg, Precision sigmaArg) {
   // Store persistence levels
   persistence = msComplex.getPersistence();
 
@@ -56,8 +192,9 @@ HDProcessResult* HDProcessor::processOnMetric(
   m_result->knn = msComplex.getNearestNeighbors();
   
   
-  // Save QoI function values  
-  m_result->X = Linalg<Precision>::Copy(Xall);
+  // Save QoI function values. The embedding is moved into the result, the
+  // function values belong to the caller and are copied.
+  m_result->X = Xall;
   m_result->Y = Linalg<Precision>::Copy(yall);  
 
   // Scale persistence to be in [0,1]
@@ -71,7 +208,7 @@ HDProcessResult* HDProcessor::processOnMetric(
   pScaled(pScaled.N()-1) = 1;                // set to 1 because the max value returned by the mscomplex is huge
   
   // Store Scled Persistence Data
-  m_result->scaledPersistence = Linalg<Precision>::Copy(pScaled);
+  m_result->scaledPersistence = pScaled;
 
   // Read number of persistence levels to compute visualization for
   int nlevels = persistenceArg;
@@ -90,10 +227,10 @@ HDProcessResult* HDProcessor::processOnMetric(
   // Save number of requested regression samples
   DenseVector<int> regressionSampleCount(1);
   regressionSampleCount(0) = nSamples;
-  m_result->regressionSampleCount = Linalg<int>::Copy(regressionSampleCount);
+  m_result->regressionSampleCount = regressionSampleCount;
 
   // Store Min Level (Starting Level)
-  m_result->minLevel = Linalg<Precision>::Copy(pStart);
+  m_result->minLevel = pStart;
 
   // Resize Stores for Saving Persistence Level information
   m_result->crystals.resize(persistence.N());
@@ -118,9 +255,26 @@ HDProcessResult* HDProcessor::processOnMetric(
   m_result->IsoLayout.resize(persistence.N());
 
   
+  // Crystals of all levels from the start on, so that each level is a lookup
+  m_result->hierarchy = std::make_shared<MSHierarchy>(msComplex.getHierarchy(start));
+
   // Compute inverse regression curves and additional information for each crystal
-  for (unsigned int persistenceLevel = start; persistenceLevel < persistence.N(); persistenceLevel++){
-    computeAnalysisForLevel(msComplex, persistenceLevel, nSamples, sigmaArg, true /*computeRegression*/);
+  try {
+    if (m_observer) {
+      m_observer->persistenceComputed(*m_result);
+    }
+    computeAnalysisForLevels(*m_result->hierarchy, start, nSamples, sigmaArg);
+  } catch (...) {
+    if (m_observer) {
+      m_observer->processingFailed(m_result);
+    } else {
+      m_result->deallocate();
+      delete m_result;
+    }
+    m_result = nullptr;
+    Xall = DenseMatrix<Precision>();
+    crystalIDs = DenseVector<int>();
+    throw;
   }
 
   // Export crystal partitions for shapeodds
@@ -131,12 +285,107 @@ HDProcessResult* HDProcessor::processOnMetric(
       DataExport::exportCrystalPartitions(m_result->crystalPartitions, start, partitionsName);
   }
   
-  // detach and return processed result
+  // detach and return processed result along with the arrays it owns
   HDProcessResult *result = m_result;
   m_result = nullptr;
+  Xall = DenseMatrix<Precision>();
+  crystalIDs = DenseVector<int>();
   return result;
 }
 
+/**
+ * Compute analysis for all persistence levels from start to the last level.
+ * The start level is computed first since it fixes the global minimum and the
+ * extrema layouts all other levels are aligned to. The remaining levels only
+ * read that state and are computed concurrently, each on its own level worker.
+ * The observer, if any, is notified after each level.
+ * @param[in] hierarchy Crystals of the Morse-Smale complex at all levels.
+ * @param[in] start The first persistence level to compute.
+ * @param[in] nSamples Number of samples for regression curve.
+ * @param[in] sigma Bandwidth for inverse regression.
+ */
+void HDProcessor::computeAnalysisForLevels(const MSHierarchy &hierarchy,
+    unsigned int start, int nSamples, Precision sigma) {
+  std::mutex observerMutex;
+  auto notify = [&](unsigned int level) {
+    if (m_observer) {
+      std::lock_guard<std::mutex> lock(observerMutex);
+      m_observer->levelComputed(*m_result, level);
+    }
+  };
+
+  CancellationToken::throwIfCancelled(m_cancellation);
+  computeAnalysisForLevel(hierarchy, start, nSamples, sigma);
+  notify(start);
+
+  // The serial path computes the levels in ascending order, which computes
+  // the coarsest levels last. An observer waits for those first, so it always
+  // gets the level workers, even on a single thread.
+  unsigned int remainingLevels = persistence.N() - start - 1;
+  unsigned int threadCount =
+      std::min(ThreadPool::resolveThreadCount(m_threadCount), remainingLevels);
+  if (threadCount <= 1 && !m_observer) {
+    for (unsigned int level = start + 1; level < persistence.N(); level++) {
+      CancellationToken::throwIfCancelled(m_cancellation);
+      computeAnalysisForLevel(hierarchy, level, nSamples, sigma);
+    }
+    return;
+  }
+
+  // Finer levels have more crystals and are submitted first, unless an
+  // observer is waiting for the coarse levels. The threads left over are
+  // shared out among the levels for their crystal regressions.
+  std::vector<unsigned int> order;
+  for (unsigned int level = start + 1; level < persistence.N(); level++) {
+    order.push_back(level);
+  }
+  if (m_observer) {
+    std::reverse(order.begin(), order.end());
+  }
+  threadCount = std::max(1u, threadCount);
+  unsigned int crystalThreadCount =
+      std::max(1u, ThreadPool::resolveThreadCount(m_threadCount) / threadCount);
+  ThreadPool pool(threadCount);
+  std::vector<std::future<void>> levels;
+  for (unsigned int level : order) {
+    levels.push_back(pool.submit([=, &hierarchy, &notify]() {
+      CancellationToken::throwIfCancelled(m_cancellation);
+      HDProcessor worker = createLevelWorker(crystalThreadCount);
+      try {
+        worker.computeAnalysisForLevel(hierarchy, level, nSamples, sigma);
+      } catch (...) {
+        worker.crystals.deallocate();
+        throw;
+      }
+      worker.crystals.deallocate();
+      notify(level);
+    }));
+  }
+  // Rethrows the first failure only after every level has finished.
+  for (auto &level : levels) {
+    level.wait();
+  }
+  for (auto &level : levels) {
+    level.get();
+  }
+}
+
+/**
+ * Create a processor computing a single persistence level alongside others.
+ * It shares the input data, the result object and the alignment reference of
+ * the first level, but owns its crystal state.
+ * @param[in] threadCount Number of threads the worker may use for crystals.
+ */
+HDProcessor HDProcessor::createLevelWorker(unsigned int threadCount) const {
+  HDProcessor worker(*this);
+  worker.m_threadCount = threadCount;
+  worker.crystalIDs = DenseVector<int>();
+  worker.crystals = DenseMatrix<int>();
+  worker.exts.clear();
+  worker.m_observer = nullptr;
+  return worker;
+}
+
 #if 0 //<ctc> this function seems identical to above ::processOnMetric, and both have bugs, so just commenting it out for now, purposely not fixing anything herein.  // NOTE: we think the function above is for distance matrices, and this one is for QoIs and Design Params
 /**
  * Process the input data and generate all data files necessary for visualization.
@@ -254,28 +503,27 @@ HDProcessResult* HDProcessor::process(
 
 /**
  * Compute analysis for a single persistence level.
- * @param[in] msComplex A computed Morse-Smale complex.
+ * @param[in] hierarchy Crystals of the Morse-Smale complex at all levels.
  * @param[in] persistenceLevel The persistence level to regress.
  * @param[in] nSamples Number of samples for regression curve.  
  * @param[in] sigma Bandwidth for inverse regression.
  */
-void HDProcessor::computeAnalysisForLevel(NNMSComplex<Precision> &msComplex,
+void HDProcessor::computeAnalysisForLevel(const MSHierarchy &hierarchy,
     unsigned int persistenceLevel, int nSamples, Precision sigma, bool computeRegression) {
   // Number of extrema in current crystal
   // int nExt = persistence.N() - persistenceLevel + 1;      // jonbronson commented out 8/16/17
-  msComplex.mergePersistence(persistence(persistenceLevel));
-  crystalIDs.deallocate();
-  crystalIDs = msComplex.getPartitions();
+  // The partitions of the previous level were moved into the result.
+  crystalIDs = hierarchy.getPartitions(persistenceLevel);
   crystals.deallocate();
-  crystals = msComplex.getCrystals();
+  crystals = hierarchy.getCrystals(persistenceLevel);
 
   // Find global minimum as refernce point for aligning subsequent persistence levels
-  if (globalMin == -1) {
+  if (m_globalMin == -1) {
     double tmp = std::numeric_limits<Precision>::max();
     for (unsigned int i=0; i < crystals.N(); i++) {
       if (tmp > yall(crystals(1, i))) {
-        globalMin = crystals(1, i);
-        tmp = yall(globalMin);
+        m_globalMin = crystals(1, i);
+        tmp = yall(m_globalMin);
       }
     }
   }      
@@ -306,12 +554,9 @@ void HDProcessor::computeAnalysisForLevel(NNMSComplex<Precision> &msComplex,
   } 
 
   // Store Crystals in Result
-  m_result->crystals[persistenceLevel] = Linalg<int>::Copy(crystalTmp);
+  m_result->crystals[persistenceLevel] = crystalTmp;
   // Store Crystal Partitions in Result (which samples belong to which crystal)
-  m_result->crystalPartitions[persistenceLevel] = Linalg<int>::Copy(crystalIDs);
-
-
-  crystalTmp.deallocate();   
+  m_result->crystalPartitions[persistenceLevel] = crystalIDs;
 
   // Grab and Store Extrema Function Values 
   DenseVector<Precision> Ef(nExt);
@@ -320,8 +565,7 @@ void HDProcessor::computeAnalysisForLevel(NNMSComplex<Precision> &msComplex,
     int eIndex = it->first;    
     Ef(eID) = yall(eIndex);
   }
-  m_result->extremaValues[persistenceLevel] = Linalg<Precision>::Copy(Ef);  
-  Ef.deallocate();
+  m_result->extremaValues[persistenceLevel] = Ef;
 
 
   std::cout << std::endl << "PersistenceLevel: " << persistenceLevel << std::endl;
@@ -437,15 +681,46 @@ void HDProcessor::computeAnalysisForLevel(NNMSComplex<Precision> &msComplex,
   m_result->fmean[persistenceLevel].resize(crystals.N());  
   m_result->spdf[persistenceLevel].resize(crystals.N());  
 
-  // Regression for each crystal of current persistence level.
-  for (unsigned int crystalIndex = 0; crystalIndex < crystals.N(); crystalIndex++) {
-    computeRegressionForCrystal(crystalIndex, persistenceLevel, sigma, nSamples, Xi, yci, ScrystalIDs, S, eWidths);
+  // Regression for each crystal of current persistence level. Crystals are
+  // independent, so they are scheduled largest first across worker threads,
+  // each reusing its own scratch buffers.
+  std::vector<unsigned int> crystalOrder(crystals.N());
+  for (unsigned int i = 0; i < crystalOrder.size(); i++) {
+    crystalOrder[i] = i;
+  }
+  std::stable_sort(crystalOrder.begin(), crystalOrder.end(),
+      [&Xi](unsigned int a, unsigned int b) { return Xi[a].size() > Xi[b].size(); });
+
+  WorkStealingScheduler scheduler(m_threadCount);
+  std::vector<RegressionScratch> scratch;
+  scratch.reserve(scheduler.threadCount());
+  for (unsigned int i = 0; i < scheduler.threadCount(); i++) {
+    scratch.emplace_back(Xall.M(), nSamples);
+  }
+  std::mutex eWidthsMutex;
+  try {
+    scheduler.run(crystalOrder, [&](unsigned int crystalIndex, unsigned int worker) {
+      CancellationToken::throwIfCancelled(m_cancellation);
+      computeRegressionForCrystal(crystalIndex, persistenceLevel, sigma, nSamples, Xi, yci,
+          ScrystalIDs, S, eWidths, eWidthsMutex, scratch[worker]);
+    });
+  } catch (...) {
+    for (auto &buffers : scratch) {
+      buffers.cleanup();
+    }
+    S.deallocate();
+    eWidths.deallocate();
+    for (auto &Xp : XpcrystalIDs) {
+      Xp.deallocate();
+    }
+    throw;
+  }
+  for (auto &buffers : scratch) {
+    buffers.cleanup();
   }
 
   // Store Maximal ExtremaWidths in Result
-  m_result->extremaWidths[persistenceLevel] = Linalg<Precision>::Copy(eWidths);
-
-  eWidths.deallocate();
+  m_result->extremaWidths[persistenceLevel] = eWidths;
 
   // Add extremal points to S for computing layout
   int count = 0;
@@ -485,9 +760,9 @@ void HDProcessor::computeAnalysisForLevel(NNMSComplex<Precision> &msComplex,
   computeIsomapLayout(S, ScrystalIDs, nExt, nSamples, persistenceLevel);     
 
 
+  // The regression curves in ScrystalIDs belong to the result.
   S.deallocate();
   for (unsigned int i=0; i < crystals.N(); i++) { 
-    ScrystalIDs[i].deallocate();
     XpcrystalIDs[i].deallocate();    
   }
 }
@@ -501,14 +776,12 @@ void HDProcessor::computeRegressionForCrystal(
     unsigned int crystalIndex, unsigned int persistenceLevel, Precision sigma, int nSamples, 
     std::vector<std::vector<unsigned int>> &Xi, std::vector<std::vector<Precision>> &yci,
     std::vector<DenseMatrix<Precision>> &ScrystalIDs, DenseMatrix<Precision> &S,
-    DenseVector<Precision> &eWidths) {
+    DenseVector<Precision> &eWidths, std::mutex &eWidthsMutex, RegressionScratch &scratch) {
   // Extract samples and function values from crystalIDs
   DenseMatrix<Precision> X(Xall.M(), Xi[crystalIndex].size());
   DenseMatrix<Precision> y(1, X.N());
-  std::vector<unsigned int> indexes;
   for (unsigned int i=0; i< X.N(); i++){
     unsigned int index = Xi[crystalIndex][i];
-    indexes.push_back(index);
     Linalg<Precision>::SetColumn(X, i, Xall, index);  
     y(0, i) = yci[crystalIndex][i];
   }
@@ -519,7 +792,7 @@ void HDProcessor::computeRegressionForCrystal(
   std::cout << X.N() << " points" << std::endl;
 
   GaussianKernel<Precision> kernel(sigma, 1);
-  FirstOrderKernelRegression<Precision> kr(X, y, kernel, 1000);
+  FirstOrderKernelRegression<Precision> kr(X, y, kernel, 1000, m_knnBackend);
      
   /*      
     //Get locations
@@ -538,20 +811,21 @@ void HDProcessor::computeRegressionForCrystal(
   // Compute min and max function value
   int e1 = crystals(0, crystalIndex);
   int e2 = crystals(1, crystalIndex);
-  int e1ID = exts[e1];
-  int e2ID = exts[e2];
+  int e1ID = exts.find(e1)->second;
+  int e2ID = exts.find(e2)->second;
   Precision zmax = yall(e1);
   Precision zmin = yall(e2);
 
-  // Create samples (regressed in input space) between min and max function values
-  DenseVector<Precision> z(1);
+  // Create samples (regressed in input space) between min and max function values.
+  // Outputs are allocated per crystal and moved into the result.
+  DenseVector<Precision> &z = scratch.z;
   DenseVector<Precision> pdist(nSamples);
-  DenseVector<Precision> tmp(Xall.M());
-  DenseMatrix<Precision> Zp(1, nSamples);
+  DenseVector<Precision> &tmp = scratch.tmp;
+  DenseMatrix<Precision> &Zp = scratch.Zp;
   ScrystalIDs[crystalIndex] = DenseMatrix<Precision>(Xall.M(), nSamples);
-  DenseMatrix<Precision> gStmp(Xall.M(), 1);
+  DenseMatrix<Precision> &gStmp = scratch.gStmp;
   DenseMatrix<Precision> gradS(Xall.M(), nSamples);
-  DenseVector<Precision> sdev( Xall.M() );
+  DenseVector<Precision> &sdev = scratch.sdev;
   DenseMatrix<Precision> Svar(Xall.M(), nSamples);
   for (int k=0; k < nSamples; k++) {
     z(0) = zmin + (zmax-zmin) * ( k/ (nSamples-1.f) );
@@ -569,41 +843,36 @@ void HDProcessor::computeRegressionForCrystal(
     Linalg<Precision>::SetColumn(Svar, k, sdev);
     Linalg<Precision>::SetColumn(gradS, k, gStmp, 0);
   }
-  sdev.deallocate();
-  z.deallocate();
-  tmp.deallocate();
+  kr.cleanup();
   
   // Store Regression Info in Results
-  m_result->R[persistenceLevel][crystalIndex] = Linalg<Precision>::Copy(ScrystalIDs[crystalIndex]);
-  m_result->gradR[persistenceLevel][crystalIndex] = Linalg<Precision>::Copy(gradS);
-  m_result->Rvar[persistenceLevel][crystalIndex] = Linalg<Precision>::Copy(Svar);
-  m_result->mdists[persistenceLevel][crystalIndex] = Linalg<Precision>::Copy(pdist);
-
-  gradS.deallocate(); 
-  Svar.deallocate();
+  m_result->R[persistenceLevel][crystalIndex] = ScrystalIDs[crystalIndex];
+  m_result->gradR[persistenceLevel][crystalIndex] = gradS;
+  m_result->Rvar[persistenceLevel][crystalIndex] = Svar;
+  m_result->mdists[persistenceLevel][crystalIndex] = pdist;
 
   // Compute maximal extrema widths
-  if (eWidths(e2ID) < pdist(0)) {
-    eWidths(e2ID) = pdist(0); 
-  }
-  if (eWidths(e1ID) < pdist(nSamples-1)) {
-    eWidths(e1ID) = pdist(nSamples-1); 
+  {
+    std::lock_guard<std::mutex> lock(eWidthsMutex);
+    if (eWidths(e2ID) < pdist(0)) {
+      eWidths(e2ID) = pdist(0); 
+    }
+    if (eWidths(e1ID) < pdist(nSamples-1)) {
+      eWidths(e1ID) = pdist(nSamples-1); 
+    }
   }
-
-  pdist.deallocate();
   
   // Compute function value mean at sampled locations
-  DenseVector<Precision> fmean(Zp.N());
+  DenseVector<Precision> fmean(nSamples);
   for (unsigned int i=0; i < Zp.N(); i++) {
     fmean(i) = Zp(0, i);
   }
 
   // Store means in result object.
-  m_result->fmean[persistenceLevel][crystalIndex] = Linalg<Precision>::Copy(fmean);
-  fmean.deallocate();
+  m_result->fmean[persistenceLevel][crystalIndex] = fmean;
 
   // Compute sample density.
-  DenseVector<Precision> spdf(Zp.N());
+  DenseVector<Precision> spdf(nSamples);
   for (unsigned int i=0; i < Zp.N(); i++) {
     Precision sum = 0;
     for (unsigned int j=0; j < y.N(); j++) {
@@ -614,15 +883,29 @@ void HDProcessor::computeRegressionForCrystal(
   }
 
   // Store sample density in result object.
-  m_result->spdf[persistenceLevel][crystalIndex] = Linalg<Precision>::Copy(spdf);  
-  spdf.deallocate(); 
+  m_result->spdf[persistenceLevel][crystalIndex] = spdf;
  
 
   X.deallocate();
-  Zp.deallocate();
   y.deallocate();
 }
 
+/**
+ * Allocate the per-worker buffers used while regressing a crystal.
+ * @param[in] dimension Dimension of the input space.
+ * @param[in] nSamples Number of samples for regression curve.
+ */
+HDProcessor::RegressionScratch::RegressionScratch(unsigned int dimension, int nSamples) :
+  z(1), tmp(dimension), sdev(dimension), Zp(1, nSamples), gStmp(dimension, 1) {}
+
+void HDProcessor::RegressionScratch::cleanup() {
+  z.deallocate();
+  tmp.deallocate();
+  sdev.deallocate();
+  Zp.deallocate();
+  gStmp.deallocate();
+}
+
 /**
  * Add small pertubations to data achieve general position / avoid pathological cases.
  */
@@ -643,8 +926,8 @@ void HDProcessor::fit(DenseMatrix<Precision> &E, DenseMatrix<Precision> &Efit) {
   DenseMatrix<Precision> Eorig(exts.size(), 2);
   DenseMatrix<Precision> Enew(exts.size(), 2);
 
-  int e1 = exts[globalMin];
-  int e2 = extsOrig[globalMin];
+  int e1 = exts[m_globalMin];
+  int e2 = extsOrig[m_globalMin];
 
   for( map_i_i_it it = exts.begin(); it != exts.end(); ++it){
     int i1 = it->second;
@@ -706,11 +989,9 @@ void HDProcessor::computePCALayout(DenseMatrix<Precision> &S,
     DenseVector<Precision> Lmin = Linalg<Precision>::RowMin(E);
     DenseVector<Precision> Lmax = Linalg<Precision>::RowMax(E);
     
-    // Copy to results object.
-    m_result->LminPCA = Linalg<Precision>::Copy(Lmin);
-    m_result->LmaxPCA = Linalg<Precision>::Copy(Lmax);
-    Lmin.deallocate();
-    Lmax.deallocate();
+    // Move to results object.
+    m_result->LminPCA = Lmin;
+    m_result->LmaxPCA = Lmax;
   }
 
   // Resize Layout in Results Object
@@ -739,17 +1020,15 @@ void HDProcessor::computePCALayout(DenseMatrix<Precision> &S,
     }
 
     // Store layout information in result object.
-    m_result->PCALayout[persistenceLevel][i] = Linalg<Precision>::Copy(tmp);    
+    m_result->PCALayout[persistenceLevel][i] = tmp;
 
     a.deallocate();
     b.deallocate();
-    tmp.deallocate();
     stretch.deallocate();
   }
 
   // Store ExtremaLayout in Result Object
-  m_result->PCAExtremaLayout[persistenceLevel] = Linalg<Precision>::Copy(E);
-  E.deallocate();
+  m_result->PCAExtremaLayout[persistenceLevel] = E;
 
   pca.cleanup();
   fL.deallocate();      
@@ -796,11 +1075,9 @@ void HDProcessor::computePCAExtremaLayout(DenseMatrix<Precision> &S,
     DenseVector<Precision> Lmin = Linalg<Precision>::RowMin(pca2L);
     DenseVector<Precision> Lmax = Linalg<Precision>::RowMax(pca2L);
 
-    // Copy to results object.
-    m_result->LminPCA2 = Linalg<Precision>::Copy(Lmin);
-    m_result->LmaxPCA2 = Linalg<Precision>::Copy(Lmax);    
-    Lmin.deallocate();
-    Lmax.deallocate();
+    // Move to results object.
+    m_result->LminPCA2 = Lmin;
+    m_result->LmaxPCA2 = Lmax;
   }
 
   // Resize Layout in Results Object
@@ -827,18 +1104,16 @@ void HDProcessor::computePCAExtremaLayout(DenseMatrix<Precision> &S,
     }
 
     // Store layout information in result object.
-    m_result->PCA2Layout[persistenceLevel][i] = Linalg<Precision>::Copy(tmp);    
-    
+    m_result->PCA2Layout[persistenceLevel][i] = tmp;
+
     a.deallocate();
     b.deallocate();
-    tmp.deallocate();
     stretch.deallocate();
     pca.cleanup();
   }
 
   // Store ExtremaLayout in Result Object
-  m_result->PCA2ExtremaLayout[persistenceLevel] = Linalg<Precision>::Copy(pca2L);  
-  pca2L.deallocate();
+  m_result->PCA2ExtremaLayout[persistenceLevel] = pca2L;
   pca2.cleanup();         
 }
 
@@ -873,7 +1148,7 @@ void HDProcessor::computeIsomapLayout(DenseMatrix<Precision> &S,
   }
 
 
-  KNNNeighborhood<Precision> nh(10);
+  KNNNeighborhood<Precision> nh(10, std::numeric_limits<Precision>::max(), m_knnBackend);
   Isomap<Precision> isomap(&nh, dim);
   DenseMatrix<Precision> isoL = isomap.embedAdj(adj);
 
@@ -886,11 +1161,9 @@ void HDProcessor::computeIsomapLayout(DenseMatrix<Precision> &S,
     DenseVector<Precision> Lmin = Linalg<Precision>::RowMin(isoL);
     DenseVector<Precision> Lmax = Linalg<Precision>::RowMax(isoL);
 
-    // Copy to results object.
-    m_result->LminIso = Linalg<Precision>::Copy(Lmin);
-    m_result->LmaxIso = Linalg<Precision>::Copy(Lmax);
-    Lmin.deallocate();
-    Lmax.deallocate();
+    // Move to results object.
+    m_result->LminIso = Lmin;
+    m_result->LmaxIso = Lmax;
 
     // Store original extream indicies.
     extsOrig = exts;
@@ -919,16 +1192,14 @@ void HDProcessor::computeIsomapLayout(DenseMatrix<Precision> &S,
     }
 
     // Store layout information in result object.
-    m_result->IsoLayout[persistenceLevel][i] = Linalg<Precision>::Copy(tmp);
-    
+    m_result->IsoLayout[persistenceLevel][i] = tmp;
+
     a.deallocate();
     b.deallocate();
-    tmp.deallocate();
     stretch.deallocate();
     pca.cleanup();
   }
 
   // Store ExtremaLayout in Result Object
-  m_result->IsoExtremaLayout[persistenceLevel] = Linalg<Precision>::Copy(isoL);
-  isoL.deallocate();
+  m_result->IsoExtremaLayout[persistenceLevel] = isoL;
 }
@@ -1,25 +1,57 @@
 #pragma once
 
 #include "dimred/Isomap.h"
+#include "dimred/LandmarkMDS.h"
 #include "dimred/PCA.h"
 #include "flinalg/Linalg.h"
 #include "flinalg/LinalgIO.h"
 #include "flinalg/DenseMatrix.h"
 #include "flinalg/DenseVector.h"
+#include "flinalg/OwnedDenseMatrix.h"
+#include "graph/KNNBackend.h"
 #include "graph/KNNNeighborhood.h"
 #include "HDProcessResult.h"
 #include "kernelstats/FirstOrderKernelRegression.h"
-#include "morsesmale/NNMSComplex.h"
+#include "metrics/BlockedDistance.h"
+#include "morsesmale/FlatNNMSComplex.h"
 #include "dspacex/Precision.h"
+#include "utils/CancellationToken.h"
 #include "utils/Random.h"
+#include "utils/ThreadPool.h"
+#include "utils/WorkStealingScheduler.h"
 
 #include <list>
 #include <iostream>
 #include <algorithm>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+/**
+ * Notified by HDProcessor::processOnMetric and processOnSamples while they
+ * fill in the result, so that persistence levels can be used before all of
+ * them are computed.
+ * Calls are serialized but may come from worker threads.
+ */
+class HDProcessorObserver {
+ public:
+  virtual ~HDProcessorObserver() {}
+
+  // The result holds the embedding, persistence and level range, but none of
+  // the levels yet.
+  virtual void persistenceComputed(HDProcessResult &result) = 0;
+
+  // The level is complete in the result and won't change any more. Other
+  // levels of the result may still be written meanwhile.
+  virtual void levelComputed(HDProcessResult &result, unsigned int level) = 0;
+
+  // Processing failed or was cancelled. The observer takes ownership of the
+  // partial result, since it may have handed out levels that are still read.
+  virtual void processingFailed(HDProcessResult *result) = 0;
+};
+
 /**
  * Processes high dimensional data and generate low dimensional embeddings.
  */
@@ -34,18 +66,46 @@ class HDProcessor {
     FortranLinalg::DenseVector<Precision> qoi,
     int knn, int nSamples, int persistence, bool random,
     Precision sigmaArg, Precision sigmaSmooth);
+  HDProcessResult* processOnSamples(FortranLinalg::DenseMatrix<Precision> x,
+    FortranLinalg::DenseVector<Precision> qoi,
+    int knn, int nSamples, int persistence, bool random,
+    Precision sigmaArg, Precision sigmaSmooth);
+  void setThreadCount(unsigned int threadCount);
+  void setNearestNeighbors(FortranLinalg::DenseMatrix<int> &knn,
+                           FortranLinalg::DenseMatrix<Precision> &knnDists);
+  void setKNNBackend(const KNNBackend<Precision> *backend);
+  void setCancellationToken(const CancellationToken *cancellation);
+  void setObserver(HDProcessorObserver *observer);
  
 
  private:  
-  void computeAnalysisForLevel(NNMSComplex<Precision> &msComplex, 
+  HDProcessResult* processComplex(FlatNNMSComplex<Precision> &msComplex,
+    int nSamples, int persistenceArg, Precision sigmaArg);
+  void computeAnalysisForLevels(const MSHierarchy &hierarchy,
+    unsigned int start, int nSamples, Precision sigma);
+  HDProcessor createLevelWorker(unsigned int threadCount) const;
+  void computeAnalysisForLevel(const MSHierarchy &hierarchy,
     unsigned int persistenceLevel, int nSamples, Precision sigma, bool computeRegression = true);
+  // Buffers reused by all crystals regressed on the same worker thread
+  struct RegressionScratch {
+    RegressionScratch(unsigned int dimension, int nSamples);
+    void cleanup();
+
+    FortranLinalg::DenseVector<Precision> z;
+    FortranLinalg::DenseVector<Precision> tmp;
+    FortranLinalg::DenseVector<Precision> sdev;
+    FortranLinalg::DenseMatrix<Precision> Zp;
+    FortranLinalg::DenseMatrix<Precision> gStmp;
+  };
+
   void computeRegressionForCrystal(unsigned int crystalIndex, unsigned int persistenceLevel, 
     Precision sigma, int nSamples,
     std::vector<std::vector<unsigned int>> &Xi,
     std::vector<std::vector<Precision>> &yci, 
     std::vector<FortranLinalg::DenseMatrix<Precision>> &ScrystalIDS,
     FortranLinalg::DenseMatrix<Precision> &S,
-    FortranLinalg::DenseVector<Precision> &eWidths);
+    FortranLinalg::DenseVector<Precision> &eWidths, std::mutex &eWidthsMutex,
+    RegressionScratch &scratch);
   void computePCALayout(FortranLinalg::DenseMatrix<Precision> &S, 
     int nExt, int nSamples, unsigned int persistenceLevel);
   void computePCAExtremaLayout(FortranLinalg::DenseMatrix<Precision> &S, 
@@ -57,9 +117,11 @@ class HDProcessor {
   void fit(FortranLinalg::DenseMatrix<Precision> &E, FortranLinalg::DenseMatrix<Precision> &Efit);
   void addNoise(FortranLinalg::DenseVector<Precision> &v);
 
+  // Partitions of the current level, owned by the result
   FortranLinalg::DenseVector<int> crystalIDs;
   FortranLinalg::DenseMatrix<int> crystals;
   FortranLinalg::DenseVector<Precision> persistence;
+  // Embedded samples, owned by the result
   FortranLinalg::DenseMatrix<Precision> Xall;
   FortranLinalg::DenseVector<Precision> yall;
 
@@ -86,4 +148,25 @@ class HDProcessor {
   typedef map_i_i::iterator map_i_i_it; 
   map_i_i exts;
   map_i_i extsOrig;
+
+  // Precomputed nearest neighbors and their distances, not owned
+  FortranLinalg::DenseMatrix<int> m_knn;
+  FortranLinalg::DenseMatrix<Precision> m_knnDists;
+
+  // Searches nearest neighbors of samples and regression points when set,
+  // not owned
+  const KNNBackend<Precision> *m_knnBackend = nullptr;
+
+  // Global minimum used as coordinate center when aligning persistence levels
+  int m_globalMin = -1;
+
+  // Number of threads available to this processor for computing persistence
+  // levels and the crystals within them; 0 uses all hardware threads
+  unsigned int m_threadCount = 0;
+
+  // Checked between persistence levels and crystals, not owned
+  const CancellationToken *m_cancellation = nullptr;
+
+  // Notified as persistence levels complete, not owned
+  HDProcessorObserver *m_observer = nullptr;
 };
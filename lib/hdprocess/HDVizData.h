@@ -5,6 +5,7 @@
 #include "flinalg/DenseMatrix.h"
 #include "flinalg/Linalg.h"
 #include "dspacex/Precision.h"
+#include "morsesmale/MSHierarchy.h"
 
 #include <string>
 #include <vector>
@@ -27,6 +28,10 @@ class HDVizData {
     virtual FortranLinalg::DenseVector<int>& getCrystalPartitions(int persistenceLevel) = 0;
     virtual FortranLinalg::DenseVector<Precision>& getPersistence() = 0;
     virtual FortranLinalg::DenseVector<std::string>& getNames() = 0;
+    // Crystals of all levels at once, if the data has them.
+    virtual const MSHierarchy* getHierarchy() {
+      return nullptr;
+    };
     virtual std::vector<FortranLinalg::DenseMatrix<Precision>>& getLayout(
         HDVizLayout layout, int persistenceLevel) = 0;
 
@@ -4,29 +4,48 @@
 
 LegacyTopologyDataImpl::LegacyTopologyDataImpl(HDVizData *data) : m_data(data) {
   // Construct DSpaceXData Object Hierarchy
+  m_morseSmaleComplexes.resize(getMaxPersistenceLevel() - getMinPersistenceLevel() + 1, nullptr);
 
+  // Levels without crystals are still being computed and are added later.
   // TODO: Convert to Iterator Range Loop
   for (unsigned int level = getMinPersistenceLevel(); level <= getMaxPersistenceLevel(); level++) {
-    std::vector<Crystal*> crystals;
-    auto crystalPartitions = data->getCrystalPartitions(level);
+    if (m_data->getCrystals(level).N() > 0) {
+      addLevel(level);
+    }
+  }
+}
 
-    for (unsigned int crystalIndex = 0; crystalIndex < m_data->getCrystals(level).N(); crystalIndex++) {
-      unsigned int minIndex = m_data->getCrystals(level)(1, crystalIndex);
-      unsigned int maxIndex = m_data->getCrystals(level)(0, crystalIndex);      
-      std::vector<unsigned int> samples;      
-    
-      for (unsigned int s = 0; s < crystalPartitions.N(); s++) {
-        if (crystalPartitions(s) == crystalIndex) {
-          samples.push_back(s);
-        }
+/**
+ * Build the complex of a persistence level that is complete in the data. A
+ * level must not be read while it is added, but other levels may.
+ */
+void LegacyTopologyDataImpl::addLevel(unsigned int persistenceLevel) {
+  std::vector<Crystal*> crystals;
+  auto crystalPartitions = m_data->getCrystalPartitions(persistenceLevel);
+
+  for (unsigned int crystalIndex = 0; crystalIndex < m_data->getCrystals(persistenceLevel).N(); crystalIndex++) {
+    unsigned int minIndex = m_data->getCrystals(persistenceLevel)(1, crystalIndex);
+    unsigned int maxIndex = m_data->getCrystals(persistenceLevel)(0, crystalIndex);      
+    std::vector<unsigned int> samples;      
+  
+    for (unsigned int s = 0; s < crystalPartitions.N(); s++) {
+      if (crystalPartitions(s) == (int) crystalIndex) {
+        samples.push_back(s);
       }
-      
-      Crystal *crystal = new LegacyCrystalImpl(minIndex, maxIndex, samples); 
-      crystals.push_back(crystal);
     }
+    
+    Crystal *crystal = new LegacyCrystalImpl(minIndex, maxIndex, samples); 
+    crystals.push_back(crystal);
+  }
 
-    MorseSmaleComplex *complex = new LegacyMorseSmaleComplexImpl(crystals);
-    m_morseSmaleComplexes.push_back(complex);
+  MorseSmaleComplex *&complex = m_morseSmaleComplexes[persistenceLevel - getMinPersistenceLevel()];
+  delete complex;
+  complex = new LegacyMorseSmaleComplexImpl(crystals);
+}
+
+LegacyTopologyDataImpl::~LegacyTopologyDataImpl() {
+  for (MorseSmaleComplex *complex : m_morseSmaleComplexes) {
+    delete complex;
   }
 }
 
@@ -44,5 +63,8 @@ MorseSmaleComplex* LegacyTopologyDataImpl::getComplex(unsigned int persistenceLe
   if (index < 0 || index >= m_morseSmaleComplexes.size()) {
     throw std::out_of_range(std::string("Invalid Persistence Level") + std::to_string(persistenceLevel));
   }
+  if (!m_morseSmaleComplexes[index]) {
+    throw std::out_of_range(std::string("Persistence Level not computed yet: ") + std::to_string(persistenceLevel));
+  }
   return m_morseSmaleComplexes[index];
 }
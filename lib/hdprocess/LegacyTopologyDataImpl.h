@@ -10,10 +10,14 @@
 class LegacyTopologyDataImpl : public TopologyData {
  public:
   LegacyTopologyDataImpl(HDVizData *data);
+  virtual ~LegacyTopologyDataImpl();
   virtual unsigned int getMinPersistenceLevel();
   virtual unsigned int getMaxPersistenceLevel();
   virtual MorseSmaleComplex* getComplex(unsigned int persistenceLevel);
 
+  // Levels of a result that is still being processed are added as they complete.
+  void addLevel(unsigned int persistenceLevel);
+
  private:
   HDVizData *m_data;
   std::vector<MorseSmaleComplex*> m_morseSmaleComplexes;
@@ -28,6 +32,11 @@ class LegacyMorseSmaleComplexImpl : public MorseSmaleComplex {
   LegacyMorseSmaleComplexImpl(std::vector<Crystal*> &crystals) {
     m_crystals = crystals;
   }
+  virtual ~LegacyMorseSmaleComplexImpl() {
+    for (Crystal *crystal : m_crystals) {
+      delete crystal;
+    }
+  }
   virtual std::vector<Crystal*>& getCrystals() { return m_crystals;  }
   virtual std::vector<std::pair<unsigned int, unsigned int>> getAdjacency() {
     return std::vector<std::pair<unsigned int, unsigned int>>();
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseVector.h"
+#include "utils/MatrixArchive.h"
+
+#include <cstddef>
+#include <vector>
+
+// Memory accounting and release for the nested matrix and vector lists of the
+// processing results.
+namespace HDProcess {
+
+template <typename T>
+size_t byteSize(FortranLinalg::DenseVector<T> &vector) {
+  return vector.data() ? sizeof(T) * vector.N() : 0;
+}
+
+template <typename T>
+size_t byteSize(FortranLinalg::DenseMatrix<T> &matrix) {
+  return matrix.data() ? sizeof(T) * matrix.M() * matrix.N() : 0;
+}
+
+template <typename T>
+size_t byteSize(std::vector<T> &list) {
+  size_t bytes = 0;
+  for (auto &item : list) {
+    bytes += byteSize(item);
+  }
+  return bytes;
+}
+
+template <typename T>
+void deallocate(FortranLinalg::DenseVector<T> &vector) {
+  vector.deallocate();
+}
+
+template <typename T>
+void deallocate(FortranLinalg::DenseMatrix<T> &matrix) {
+  matrix.deallocate();
+}
+
+template <typename T>
+void deallocate(std::vector<T> &list) {
+  for (auto &item : list) {
+    deallocate(item);
+  }
+  list.clear();
+}
+
+// Give back views of an archive without freeing their storage.
+template <typename T>
+void release(FortranLinalg::DenseVector<T> &vector) {
+  MatrixArchive::release(vector);
+}
+
+template <typename T>
+void release(FortranLinalg::DenseMatrix<T> &matrix) {
+  MatrixArchive::release(matrix);
+}
+
+template <typename T>
+void release(std::vector<T> &list) {
+  for (auto &item : list) {
+    release(item);
+  }
+  list.clear();
+}
+
+} // namespace HDProcess
@@ -0,0 +1,162 @@
+#include "ProcessedResultCache.h"
+
+#include <iterator>
+#include <sstream>
+#include <tuple>
+
+
+bool ProcessedResultKey::operator<(const ProcessedResultKey &other) const {
+  return std::tie(datasetId, category, fieldname, knn, numSamples, sigma,
+                  smoothing, addNoise, numPersistences) <
+         std::tie(other.datasetId, other.category, other.fieldname, other.knn,
+                  other.numSamples, other.sigma, other.smoothing, other.addNoise,
+                  other.numPersistences);
+}
+
+bool ProcessedResultKey::operator==(const ProcessedResultKey &other) const {
+  return !(*this < other) && !(other < *this);
+}
+
+std::string ProcessedResultKey::toString() const {
+  std::ostringstream out;
+  out << "dataset=" << datasetId << " category=" << category
+      << " field=" << fieldname << " knn=" << knn << " samples=" << numSamples
+      << " sigma=" << sigma << " smoothing=" << smoothing
+      << " noise=" << (addNoise ? "true" : "false")
+      << " persistences=" << static_cast<int>(numPersistences);
+  return out.str();
+}
+
+
+ProcessedResultCache::ProcessedResultCache(size_t byteBudget) : m_budget(byteBudget) {}
+
+ProcessedResultCache::~ProcessedResultCache() {
+  clear();
+}
+
+/**
+ * Looks up a key and moves its entry to the front of the usage list.
+ */
+const ProcessedResultCache::Entry* ProcessedResultCache::find(const ProcessedResultKey &key,
+                                                              bool pin) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto iter = m_index.find(key);
+  if (iter == m_index.end()) {
+    m_misses++;
+    return nullptr;
+  }
+  m_hits++;
+  if (pin) {
+    m_pins[key]++;
+  }
+  m_entries.splice(m_entries.begin(), m_entries, iter->second);
+  return &iter->second->second;
+}
+
+/**
+ * Adds an entry as the most recently used one. An entry already cached under
+ * the key is replaced.
+ */
+const ProcessedResultCache::Entry& ProcessedResultCache::insert(
+    const ProcessedResultKey &key, HDProcessResult *result, HDVizData *vizData,
+    TopologyData *topoData, size_t bytes, bool pin) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto existing = m_index.find(key);
+  if (existing != m_index.end()) {
+    m_bytes -= existing->second->second.bytes;
+    release(existing->second->second);
+    m_entries.erase(existing->second);
+    m_index.erase(existing);
+  }
+
+  m_entries.push_front(std::make_pair(key, Entry{result, vizData, topoData, bytes}));
+  m_index[key] = m_entries.begin();
+  m_bytes += bytes;
+  if (pin) {
+    m_pins[key]++;
+  }
+  evict();
+  return m_entries.front().second;
+}
+
+void ProcessedResultCache::pin(const ProcessedResultKey &key) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_index.count(key)) {
+    m_pins[key]++;
+  }
+}
+
+void ProcessedResultCache::unpin(const ProcessedResultKey &key) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  auto pins = m_pins.find(key);
+  if (pins != m_pins.end() && --pins->second == 0) {
+    m_pins.erase(pins);
+    evict();
+  }
+}
+
+void ProcessedResultCache::setBudget(size_t byteBudget) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_budget = byteBudget;
+  evict();
+}
+
+void ProcessedResultCache::clear() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto &entry : m_entries) {
+    release(entry.second);
+  }
+  m_entries.clear();
+  m_index.clear();
+  m_pins.clear();
+  m_bytes = 0;
+}
+
+ProcessedResultCache::Stats ProcessedResultCache::getStats() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return Stats{m_budget, m_bytes, m_entries.size(), m_hits, m_misses, m_evictions};
+}
+
+std::vector<std::pair<ProcessedResultKey, size_t>> ProcessedResultCache::getEntries() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<std::pair<ProcessedResultKey, size_t>> entries;
+  for (auto &entry : m_entries) {
+    entries.push_back(std::make_pair(entry.first, entry.second.bytes));
+  }
+  return entries;
+}
+
+/**
+ * Drops least recently used entries that are not pinned until the budget is
+ * met, keeping at least the most recently used one.
+ */
+void ProcessedResultCache::evict() {
+  if (m_entries.empty()) {
+    return;
+  }
+  auto iter = m_entries.end();
+  while (m_bytes > m_budget && iter != std::next(m_entries.begin())) {
+    --iter;
+    if (m_pins.count(iter->first)) {
+      continue;
+    }
+    m_bytes -= iter->second.bytes;
+    release(iter->second);
+    m_index.erase(iter->first);
+    iter = m_entries.erase(iter);
+    m_evictions++;
+  }
+}
+
+/**
+ * Deletes the data of an entry in dependency order: the topology refers to the
+ * visualization data, which refers to the result.
+ */
+void ProcessedResultCache::release(Entry &entry) {
+  delete entry.topoData;
+  delete entry.vizData;
+  if (entry.result) {
+    entry.result->deallocate();
+    delete entry.result;
+  }
+}
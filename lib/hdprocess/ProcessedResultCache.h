@@ -0,0 +1,111 @@
+#pragma once
+
+#include "HDProcessResult.h"
+#include "HDVizData.h"
+#include "TopologyData.h"
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+ * Parameters that determine a processed result of a dataset field.
+ */
+struct ProcessedResultKey {
+  int datasetId;
+  int category;
+  std::string fieldname;
+  int knn;
+  int numSamples;
+  double sigma;
+  double smoothing;
+  bool addNoise;
+  unsigned int numPersistences;
+
+  bool operator<(const ProcessedResultKey &other) const;
+  bool operator==(const ProcessedResultKey &other) const;
+  std::string toString() const;
+};
+
+
+/**
+ * Least recently used cache of processed results together with the
+ * visualization and topology data built from them. Entries are accounted by
+ * the bytes of their matrices; once the total exceeds the budget, the least
+ * recently used entries are evicted. The most recently used entry is never
+ * evicted, so a single result larger than the budget is still kept while it
+ * is current, and neither are pinned entries, which are in use elsewhere.
+ * All methods may be called from several threads.
+ */
+class ProcessedResultCache {
+ public:
+  struct Entry {
+    HDProcessResult *result;
+    HDVizData *vizData;
+    TopologyData *topoData;
+    size_t bytes;
+  };
+
+  struct Stats {
+    size_t budget;
+    size_t bytes;
+    size_t entries;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+  };
+
+  explicit ProcessedResultCache(size_t byteBudget);
+  ~ProcessedResultCache();
+
+  /**
+   * Returns the entry for the key and marks it most recently used, or nullptr
+   * if the key is not cached. If pin is set, a found entry is also pinned, so
+   * it cannot be evicted by another thread before the caller uses it.
+   */
+  const Entry* find(const ProcessedResultKey &key, bool pin = false);
+
+  /**
+   * Takes ownership of the result and the data built from it, then evicts
+   * least recently used entries to fit the budget. If pin is set, the new
+   * entry is pinned.
+   */
+  const Entry& insert(const ProcessedResultKey &key, HDProcessResult *result,
+                      HDVizData *vizData, TopologyData *topoData, size_t bytes,
+                      bool pin = false);
+
+  /**
+   * Keeps the entry of the key from being evicted until it is unpinned as
+   * often as it was pinned. Pinning a key that is not cached has no effect.
+   */
+  void pin(const ProcessedResultKey &key);
+  void unpin(const ProcessedResultKey &key);
+
+  void setBudget(size_t byteBudget);
+  void clear();
+
+  Stats getStats() const;
+
+  // Keys and sizes of the cached entries, most recently used first.
+  std::vector<std::pair<ProcessedResultKey, size_t>> getEntries() const;
+
+ private:
+  typedef std::list<std::pair<ProcessedResultKey, Entry>> EntryList;
+
+  void evict();
+  static void release(Entry &entry);
+
+  EntryList m_entries; // most recently used first
+  std::map<ProcessedResultKey, EntryList::iterator> m_index;
+  std::map<ProcessedResultKey, unsigned int> m_pins;
+  mutable std::mutex m_mutex;
+  size_t m_budget;
+  size_t m_bytes = 0;
+  size_t m_hits = 0;
+  size_t m_misses = 0;
+  size_t m_evictions = 0;
+};
@@ -1,4 +1,5 @@
 #include "SimpleHDVizDataImpl.h"
+#include "MatrixMemory.h"
 #include <stdexcept>
 
 // TODO: Move these constants into a shared location.
@@ -63,186 +64,251 @@ SimpleHDVizDataImpl::SimpleHDVizDataImpl(HDProcessResult *result) : m_data(resul
   widthMin.resize(m_data->scaledPersistence.N());
   widthMax.resize(m_data->scaledPersistence.N());
 
-  for (unsigned int level = getMinPersistenceLevel(); level < m_data->scaledPersistence.N(); level++) {
-    auto ef = m_data->extremaValues[level];
-    efmin[level] = FortranLinalg::Linalg<Precision>::Min(ef);
-    efmax[level] = FortranLinalg::Linalg<Precision>::Max(ef);
-
-    // Rescaling/min-max normalization of extrema
-    auto ez = FortranLinalg::DenseVector<Precision>(ef.N());
-    FortranLinalg::Linalg<Precision>::Subtract(ef, efmin[level], ez);
-    FortranLinalg::Linalg<Precision>::Scale(ez, 1.f/(efmax[level] - efmin[level]), ez);
-    extremaNormalized[level] = ez;
-
-    auto yc = m_data->fmean[level];    
-    auto z = std::vector<FortranLinalg::DenseVector<Precision>>(getCrystals(level).N());
-    auto yw = m_data->mdists[level];
-    widthMin[level] = std::numeric_limits<Precision>::max();
-    widthMax[level] = std::numeric_limits<Precision>::min();
-    for (unsigned int i=0; i < getCrystals(level).N(); i++) {      
-      z[i] = FortranLinalg::DenseVector<Precision>(yc[i].N());
-      FortranLinalg::Linalg<Precision>::Subtract(yc[i], efmin[level], z[i]);
-      FortranLinalg::Linalg<Precision>::Scale(z[i], 1.f/(efmax[level]- efmin[level]), z[i]);            
-
-      for(unsigned int k=0; k< yw[i].N(); k++){  
-        if(yw[i](k) < widthMin[level]){
-          widthMin[level] = yw[i](k);
-        }      
-        if(yw[i](k) > widthMax[level]){
-          widthMax[level] = yw[i](k);
-        }
-      }
-    }
-    meanNormalized[level] = z;
-
-    widthScaled[level].resize(getCrystals(level).N());
-    for (unsigned int i=0; i < getCrystals(level).N(); i++) { 
-      auto width = FortranLinalg::Linalg<Precision>::Copy(yw[i]);
-      FortranLinalg::Linalg<Precision>::Scale(width, 0.3/ widthMax[level], width);
-      FortranLinalg::Linalg<Precision>::Add(width, 0.03, width);
-      widthScaled[level][i] = width;
-    }
+  // Reconstruction min/max and Gradients min/max
+  Rsmin.resize(m_data->scaledPersistence.N());
+  Rsmax.resize(m_data->scaledPersistence.N());
+  gRmin.resize(m_data->scaledPersistence.N());
+  gRmax.resize(m_data->scaledPersistence.N());
 
-    auto ew = m_data->extremaWidths[level];
-    auto extremaWidth = FortranLinalg::Linalg<Precision>::Copy(ew);
-    FortranLinalg::Linalg<Precision>::Scale(extremaWidth, 0.3/widthMax[level], extremaWidth);
-    FortranLinalg::Linalg<Precision>::Add(extremaWidth, 0.03, extremaWidth);
-    extremaWidthScaled[level] = extremaWidth;
-     
-
-    // Set up Color Maps
-    colormap[level] = ColorMapper<Precision>(efmin[level], efmax[level]);
-    colormap[level].set(0, 204.f/255.f, 210.f/255.f, 102.f/255.f, 204.f/255.f,
-      41.f/255.f, 204.f/255.f, 0, 5.f/255.f);  
-
-    // Set up Density Color Maps
-    Precision densityMax = std::numeric_limits<Precision>::min();
-    auto density = getDensity(level);
-    for (unsigned int i=0; i < getCrystals(level).N(); i++) {      
-      for(unsigned int k=0; k < density[i].N(); k++){      
-        if(density[i](k) > densityMax){
-          densityMax = density[i](k);
-        }
-      }
-    }     
-    // TODO: Move color map creation completely outside of HDVizData impls.
-    //    Expose densityMax via a class method and construct at viz time.
-    dcolormap[level] = ColorMapper<Precision>(0, densityMax); 
-    dcolormap[level].set(1, 0.5, 0, 1, 0.5, 0 , 1, 0.5, 0);  
-  }
+  // Scaled layouts
+  scaledIsoLayout.resize(m_data->scaledPersistence.N());
+  scaledPCALayout.resize(m_data->scaledPersistence.N());
+  scaledPCA2Layout.resize(m_data->scaledPersistence.N());
+  scaledIsoExtremaLayout.resize(m_data->scaledPersistence.N());
+  scaledPCAExtremaLayout.resize(m_data->scaledPersistence.N());
+  scaledPCA2ExtremaLayout.resize(m_data->scaledPersistence.N());
+  levelAdded.resize(m_data->scaledPersistence.N());
 
   // Calculate Geom min/max
   Rmin = FortranLinalg::Linalg<Precision>::RowMin(m_data->X);
   Rmax = FortranLinalg::Linalg<Precision>::RowMax(m_data->X);
 
-  // Calculate Reconstruction min/max and Gradients min/max
-  Rsmin.resize(m_data->scaledPersistence.N());
-  Rsmax.resize(m_data->scaledPersistence.N());
-  gRmin.resize(m_data->scaledPersistence.N());
-  gRmax.resize(m_data->scaledPersistence.N());
+  // Levels without crystals are still being computed and are added later.
   for (unsigned int level = getMinPersistenceLevel(); level < m_data->scaledPersistence.N(); level++) {
-    Rsmin[level] = FortranLinalg::Linalg<Precision>::ExtractColumn(m_data->R[level][0], 0);
-    Rsmax[level] = FortranLinalg::Linalg<Precision>::ExtractColumn(m_data->R[level][0], 0);
-    gRmin[level] = FortranLinalg::Linalg<Precision>::ExtractColumn(m_data->gradR[level][0], 0);
-    gRmax[level] = FortranLinalg::Linalg<Precision>::ExtractColumn(m_data->gradR[level][0], 0);
-
-    for(unsigned int e = 0; e < getCrystals(level).N(); e++){
-      for(unsigned int i = 0; i < m_data->R[level][e].N(); i++){
-        for(unsigned int j = 0; j < m_data->R[level][e].M(); j++){
-          if(Rsmin[level](j) > m_data->R[level][e](j, i) - m_data->Rvar[level][e](j, i)){
-            Rsmin[level](j) = m_data->R[level][e](j, i) - m_data->Rvar[level][e](j, i);
-          }
-          if(Rsmax[level](j) < m_data->R[level][e](j, i) + m_data->Rvar[level][e](j, i)){
-            Rsmax[level](j) = m_data->R[level][e](j, i) + m_data->Rvar[level][e](j, i);
-          }
-
-          if(gRmin[level](j) > m_data->gradR[level][e](j, i)){
-            gRmin[level](j) = m_data->gradR[level][e](j, i);
-          }
-          if(gRmax[level](j) < m_data->gradR[level][e](j, i)){
-            gRmax[level](j) = m_data->gradR[level][e](j, i);
-          }
+    if (m_data->crystals[level].N() > 0) {
+      addLevel(level);
+    }
+  }
+  //
+} // END CONSTRUCTOR
+
+/**
+ * Compute the visualization helper data of a persistence level that is
+ * complete in the processing result. Levels are added by the constructor if
+ * they are already complete; the others can be added as they complete. A
+ * level must not be read while it is added, but other levels may.
+ */
+void SimpleHDVizDataImpl::addLevel(int level) {
+  auto ef = m_data->extremaValues[level];
+  efmin[level] = FortranLinalg::Linalg<Precision>::Min(ef);
+  efmax[level] = FortranLinalg::Linalg<Precision>::Max(ef);
+
+  // Rescaling/min-max normalization of extrema
+  auto ez = FortranLinalg::DenseVector<Precision>(ef.N());
+  FortranLinalg::Linalg<Precision>::Subtract(ef, efmin[level], ez);
+  FortranLinalg::Linalg<Precision>::Scale(ez, 1.f/(efmax[level] - efmin[level]), ez);
+  extremaNormalized[level] = ez;
+
+  auto yc = m_data->fmean[level];    
+  auto z = std::vector<FortranLinalg::DenseVector<Precision>>(getCrystals(level).N());
+  auto yw = m_data->mdists[level];
+  widthMin[level] = std::numeric_limits<Precision>::max();
+  widthMax[level] = std::numeric_limits<Precision>::min();
+  for (unsigned int i=0; i < getCrystals(level).N(); i++) {      
+    z[i] = FortranLinalg::DenseVector<Precision>(yc[i].N());
+    FortranLinalg::Linalg<Precision>::Subtract(yc[i], efmin[level], z[i]);
+    FortranLinalg::Linalg<Precision>::Scale(z[i], 1.f/(efmax[level]- efmin[level]), z[i]);            
+
+    for(unsigned int k=0; k< yw[i].N(); k++){  
+      if(yw[i](k) < widthMin[level]){
+        widthMin[level] = yw[i](k);
+      }      
+      if(yw[i](k) > widthMax[level]){
+        widthMax[level] = yw[i](k);
+      }
+    }
+  }
+  meanNormalized[level] = z;
+
+  widthScaled[level].resize(getCrystals(level).N());
+  for (unsigned int i=0; i < getCrystals(level).N(); i++) { 
+    auto width = FortranLinalg::Linalg<Precision>::Copy(yw[i]);
+    FortranLinalg::Linalg<Precision>::Scale(width, 0.3/ widthMax[level], width);
+    FortranLinalg::Linalg<Precision>::Add(width, 0.03, width);
+    widthScaled[level][i] = width;
+  }
+
+  auto ew = m_data->extremaWidths[level];
+  auto extremaWidth = FortranLinalg::Linalg<Precision>::Copy(ew);
+  FortranLinalg::Linalg<Precision>::Scale(extremaWidth, 0.3/widthMax[level], extremaWidth);
+  FortranLinalg::Linalg<Precision>::Add(extremaWidth, 0.03, extremaWidth);
+  extremaWidthScaled[level] = extremaWidth;
+   
+
+  // Set up Color Maps
+  colormap[level] = ColorMapper<Precision>(efmin[level], efmax[level]);
+  colormap[level].set(0, 204.f/255.f, 210.f/255.f, 102.f/255.f, 204.f/255.f,
+    41.f/255.f, 204.f/255.f, 0, 5.f/255.f);  
+
+  // Set up Density Color Maps
+  Precision densityMax = std::numeric_limits<Precision>::min();
+  auto density = getDensity(level);
+  for (unsigned int i=0; i < getCrystals(level).N(); i++) {      
+    for(unsigned int k=0; k < density[i].N(); k++){      
+      if(density[i](k) > densityMax){
+        densityMax = density[i](k);
+      }
+    }
+  }     
+  // TODO: Move color map creation completely outside of HDVizData impls.
+  //    Expose densityMax via a class method and construct at viz time.
+  dcolormap[level] = ColorMapper<Precision>(0, densityMax); 
+  dcolormap[level].set(1, 0.5, 0, 1, 0.5, 0 , 1, 0.5, 0);  
+
+  // Reconstruction min/max and Gradients min/max
+  Rsmin[level] = FortranLinalg::Linalg<Precision>::ExtractColumn(m_data->R[level][0], 0);
+  Rsmax[level] = FortranLinalg::Linalg<Precision>::ExtractColumn(m_data->R[level][0], 0);
+  gRmin[level] = FortranLinalg::Linalg<Precision>::ExtractColumn(m_data->gradR[level][0], 0);
+  gRmax[level] = FortranLinalg::Linalg<Precision>::ExtractColumn(m_data->gradR[level][0], 0);
+
+  for(unsigned int e = 0; e < getCrystals(level).N(); e++){
+    for(unsigned int i = 0; i < m_data->R[level][e].N(); i++){
+      for(unsigned int j = 0; j < m_data->R[level][e].M(); j++){
+        if(Rsmin[level](j) > m_data->R[level][e](j, i) - m_data->Rvar[level][e](j, i)){
+          Rsmin[level](j) = m_data->R[level][e](j, i) - m_data->Rvar[level][e](j, i);
+        }
+        if(Rsmax[level](j) < m_data->R[level][e](j, i) + m_data->Rvar[level][e](j, i)){
+          Rsmax[level](j) = m_data->R[level][e](j, i) + m_data->Rvar[level][e](j, i);
+        }
+
+        if(gRmin[level](j) > m_data->gradR[level][e](j, i)){
+          gRmin[level](j) = m_data->gradR[level][e](j, i);
+        }
+        if(gRmax[level](j) < m_data->gradR[level][e](j, i)){
+          gRmax[level](j) = m_data->gradR[level][e](j, i);
         }
       }
     }
   }
 
-  computeScaledLayouts();
-  //
-} // END CONSTRUCTOR
+  computeScaledLayouts(level);
+  levelAdded[level] = true;
+}
+
+/**
+ * Whether the helper data of a persistence level was computed.
+ */
+bool SimpleHDVizDataImpl::hasLevel(int persistenceLevel) {
+  return persistenceLevel >= 0 && (size_t) persistenceLevel < levelAdded.size() &&
+      levelAdded[persistenceLevel];
+}
 
-void SimpleHDVizDataImpl::computeScaledLayouts() {
+/**
+ * Frees the visualization helper data. The processing result is not owned.
+ */
+SimpleHDVizDataImpl::~SimpleHDVizDataImpl() {
+  using HDProcess::deallocate;
+  deallocate(extremaNormalized);
+  deallocate(extremaWidthScaled);
+  deallocate(Rmin);
+  deallocate(Rmax);
+  deallocate(Rsmin);
+  deallocate(Rsmax);
+  deallocate(gRmin);
+  deallocate(gRmax);
+  deallocate(meanNormalized);
+  deallocate(widthScaled);
+  deallocate(scaledIsoLayout);
+  deallocate(scaledPCALayout);
+  deallocate(scaledPCA2Layout);
+  deallocate(scaledIsoExtremaLayout);
+  deallocate(scaledPCAExtremaLayout);
+  deallocate(scaledPCA2ExtremaLayout);
+}
+
+/**
+ * Bytes held by the visualization helper data, excluding the processing result.
+ */
+size_t SimpleHDVizDataImpl::getByteSize() {
+  using HDProcess::byteSize;
+  return byteSize(extremaNormalized) + byteSize(extremaWidthScaled) +
+      byteSize(Rmin) + byteSize(Rmax) + byteSize(Rsmin) + byteSize(Rsmax) +
+      byteSize(gRmin) + byteSize(gRmax) +
+      byteSize(meanNormalized) + byteSize(widthScaled) +
+      byteSize(scaledIsoLayout) + byteSize(scaledPCALayout) + byteSize(scaledPCA2Layout) +
+      byteSize(scaledIsoExtremaLayout) + byteSize(scaledPCAExtremaLayout) +
+      byteSize(scaledPCA2ExtremaLayout) +
+      sizeof(Precision) * (efmin.size() + efmax.size() + widthMin.size() + widthMax.size());
+}
+
+void SimpleHDVizDataImpl::computeScaledLayouts(int level) {
   // Resize vectors
-  scaledIsoLayout.resize(m_data->scaledPersistence.N());
-  scaledPCALayout.resize(m_data->scaledPersistence.N());
-  scaledPCA2Layout.resize(m_data->scaledPersistence.N());
-  scaledIsoExtremaLayout.resize(m_data->scaledPersistence.N());
-  scaledPCAExtremaLayout.resize(m_data->scaledPersistence.N());
-  scaledPCA2ExtremaLayout.resize(m_data->scaledPersistence.N());
+  scaledIsoLayout[level].resize(m_data->crystals[level].N());
+  scaledPCALayout[level].resize(m_data->crystals[level].N());
+  scaledPCA2Layout[level].resize(m_data->crystals[level].N());
+
+  // Copy extrema layout matrices
+  scaledIsoExtremaLayout[level] = 
+      FortranLinalg::Linalg<Precision>::Copy(m_data->IsoExtremaLayout[level]);
+  scaledPCAExtremaLayout[level] =
+      FortranLinalg::Linalg<Precision>::Copy(m_data->PCAExtremaLayout[level]);
+  scaledPCA2ExtremaLayout[level] =
+      FortranLinalg::Linalg<Precision>::Copy(m_data->PCA2ExtremaLayout[level]);
+
+  // Compute scaling factors
+  FortranLinalg::DenseVector<Precision> isoDiff = FortranLinalg::Linalg<Precision>::Subtract(m_data->LmaxIso, m_data->LminIso);
+  Precision rISO = std::max(isoDiff(0), isoDiff(1));
+  FortranLinalg::Linalg<Precision>::Scale(isoDiff, 0.5f, isoDiff);
+  FortranLinalg::Linalg<Precision>::Add(isoDiff, m_data->LminIso, isoDiff);
+
+  FortranLinalg::DenseVector<Precision> pcaDiff = FortranLinalg::Linalg<Precision>::Subtract(m_data->LmaxPCA, m_data->LminPCA);
+  Precision rPCA = std::max(pcaDiff(0), pcaDiff(1));
+  FortranLinalg::Linalg<Precision>::Scale(pcaDiff, 0.5f, pcaDiff);
+  FortranLinalg::Linalg<Precision>::Add(pcaDiff, m_data->LminPCA, pcaDiff);
+
+  FortranLinalg::DenseVector<Precision> pca2Diff = FortranLinalg::Linalg<Precision>::Subtract(m_data->LmaxPCA2, m_data->LminPCA2);
+  Precision rPCA2 = std::max(pca2Diff(0), pca2Diff(1));
+  FortranLinalg::Linalg<Precision>::Scale(pca2Diff, 0.5f, pca2Diff);
+  FortranLinalg::Linalg<Precision>::Add(pca2Diff, m_data->LminPCA2, pca2Diff);
+
+  // Peform scaling on extrema layout
+  FortranLinalg::Linalg<Precision>::AddColumnwise(scaledIsoExtremaLayout[level], isoDiff, scaledIsoExtremaLayout[level]);
+  FortranLinalg::Linalg<Precision>::Scale(scaledIsoExtremaLayout[level], 2.f/rISO, scaledIsoExtremaLayout[level]);
+
+  FortranLinalg::Linalg<Precision>::AddColumnwise(scaledPCAExtremaLayout[level], pcaDiff, scaledPCAExtremaLayout[level]);
+  FortranLinalg::Linalg<Precision>::Scale(scaledPCAExtremaLayout[level], 2.f/rPCA, scaledPCAExtremaLayout[level]);
+
+  FortranLinalg::Linalg<Precision>::AddColumnwise(scaledPCA2ExtremaLayout[level], pca2Diff, scaledPCA2ExtremaLayout[level]);
+  FortranLinalg::Linalg<Precision>::Scale(scaledPCA2ExtremaLayout[level], 2.f/rPCA2, scaledPCA2ExtremaLayout[level]);
+
+  // TODO: These values should be the same for all levels, but we should enforce that somehow.
+  // Only the first level sets it, so that it doesn't change while other levels are read.
+  if (level == getMinPersistenceLevel()) {
+    m_numberOfSamples = m_data->IsoLayout[level][0].N();
+  }
 
-  for (unsigned int level = getMinPersistenceLevel(); level < m_data->scaledPersistence.N(); level++) {    
-    // Resize vectors
-    scaledIsoLayout[level].resize(m_data->crystals[level].N());
-    scaledPCALayout[level].resize(m_data->crystals[level].N());
-    scaledPCA2Layout[level].resize(m_data->crystals[level].N());
-
-    // Copy extrema layout matrices
-    scaledIsoExtremaLayout[level] = 
-        FortranLinalg::Linalg<Precision>::Copy(m_data->IsoExtremaLayout[level]);
-    scaledPCAExtremaLayout[level] =
-        FortranLinalg::Linalg<Precision>::Copy(m_data->PCAExtremaLayout[level]);
-    scaledPCA2ExtremaLayout[level] =
-        FortranLinalg::Linalg<Precision>::Copy(m_data->PCA2ExtremaLayout[level]);
-
-    // Compute scaling factors
-    FortranLinalg::DenseVector<Precision> isoDiff = FortranLinalg::Linalg<Precision>::Subtract(m_data->LmaxIso, m_data->LminIso);
-    Precision rISO = std::max(isoDiff(0), isoDiff(1));
-    FortranLinalg::Linalg<Precision>::Scale(isoDiff, 0.5f, isoDiff);
-    FortranLinalg::Linalg<Precision>::Add(isoDiff, m_data->LminIso, isoDiff);
-
-    FortranLinalg::DenseVector<Precision> pcaDiff = FortranLinalg::Linalg<Precision>::Subtract(m_data->LmaxPCA, m_data->LminPCA);
-    Precision rPCA = std::max(pcaDiff(0), pcaDiff(1));
-    FortranLinalg::Linalg<Precision>::Scale(pcaDiff, 0.5f, pcaDiff);
-    FortranLinalg::Linalg<Precision>::Add(pcaDiff, m_data->LminPCA, pcaDiff);
-
-    FortranLinalg::DenseVector<Precision> pca2Diff = FortranLinalg::Linalg<Precision>::Subtract(m_data->LmaxPCA2, m_data->LminPCA2);
-    Precision rPCA2 = std::max(pca2Diff(0), pca2Diff(1));
-    FortranLinalg::Linalg<Precision>::Scale(pca2Diff, 0.5f, pca2Diff);
-    FortranLinalg::Linalg<Precision>::Add(pca2Diff, m_data->LminPCA2, pca2Diff);
-
-    // Peform scaling on extrema layout
-    FortranLinalg::Linalg<Precision>::AddColumnwise(scaledIsoExtremaLayout[level], isoDiff, scaledIsoExtremaLayout[level]);
-    FortranLinalg::Linalg<Precision>::Scale(scaledIsoExtremaLayout[level], 2.f/rISO, scaledIsoExtremaLayout[level]);
-
-    FortranLinalg::Linalg<Precision>::AddColumnwise(scaledPCAExtremaLayout[level], pcaDiff, scaledPCAExtremaLayout[level]);
-    FortranLinalg::Linalg<Precision>::Scale(scaledPCAExtremaLayout[level], 2.f/rPCA, scaledPCAExtremaLayout[level]);
-
-    FortranLinalg::Linalg<Precision>::AddColumnwise(scaledPCA2ExtremaLayout[level], pca2Diff, scaledPCA2ExtremaLayout[level]);
-    FortranLinalg::Linalg<Precision>::Scale(scaledPCA2ExtremaLayout[level], 2.f/rPCA2, scaledPCA2ExtremaLayout[level]);
-
-    // TODO: These values should be the same for all levels, but we should enforce that somehow.
-    m_numberOfSamples = m_data->IsoLayout[level][0].N(); 
-
-    for (unsigned int crystal = 0; crystal < m_data->crystals[level].N(); crystal++) { 
-      // copy layout matrices
-      scaledIsoLayout[level][crystal] = 
-          FortranLinalg::Linalg<Precision>::Copy(m_data->IsoLayout[level][crystal]);
-      scaledPCALayout[level][crystal] = 
-          FortranLinalg::Linalg<Precision>::Copy(m_data->PCALayout[level][crystal]);
-      scaledPCA2Layout[level][crystal] = 
-          FortranLinalg::Linalg<Precision>::Copy(m_data->PCA2Layout[level][crystal]);
-
-      // perform scaling
-      FortranLinalg::Linalg<Precision>::AddColumnwise(scaledIsoLayout[level][crystal], isoDiff, scaledIsoLayout[level][crystal]);
-      FortranLinalg::Linalg<Precision>::Scale(scaledIsoLayout[level][crystal], 2.f/rISO, scaledIsoLayout[level][crystal]);
-
-      FortranLinalg::Linalg<Precision>::AddColumnwise(scaledPCALayout[level][crystal], pcaDiff, scaledPCALayout[level][crystal]);
-      FortranLinalg::Linalg<Precision>::Scale(scaledPCALayout[level][crystal], 2.f/rPCA, scaledPCALayout[level][crystal]);
-
-      FortranLinalg::Linalg<Precision>::AddColumnwise(scaledPCA2Layout[level][crystal], pca2Diff, scaledPCA2Layout[level][crystal]);
-      FortranLinalg::Linalg<Precision>::Scale(scaledPCA2Layout[level][crystal], 2.f/rPCA2, scaledPCA2Layout[level][crystal]);
-    }     
-  }  
+  for (unsigned int crystal = 0; crystal < m_data->crystals[level].N(); crystal++) { 
+    // copy layout matrices
+    scaledIsoLayout[level][crystal] = 
+        FortranLinalg::Linalg<Precision>::Copy(m_data->IsoLayout[level][crystal]);
+    scaledPCALayout[level][crystal] = 
+        FortranLinalg::Linalg<Precision>::Copy(m_data->PCALayout[level][crystal]);
+    scaledPCA2Layout[level][crystal] = 
+        FortranLinalg::Linalg<Precision>::Copy(m_data->PCA2Layout[level][crystal]);
+
+    // perform scaling
+    FortranLinalg::Linalg<Precision>::AddColumnwise(scaledIsoLayout[level][crystal], isoDiff, scaledIsoLayout[level][crystal]);
+    FortranLinalg::Linalg<Precision>::Scale(scaledIsoLayout[level][crystal], 2.f/rISO, scaledIsoLayout[level][crystal]);
+
+    FortranLinalg::Linalg<Precision>::AddColumnwise(scaledPCALayout[level][crystal], pcaDiff, scaledPCALayout[level][crystal]);
+    FortranLinalg::Linalg<Precision>::Scale(scaledPCALayout[level][crystal], 2.f/rPCA, scaledPCALayout[level][crystal]);
+
+    FortranLinalg::Linalg<Precision>::AddColumnwise(scaledPCA2Layout[level][crystal], pca2Diff, scaledPCA2Layout[level][crystal]);
+    FortranLinalg::Linalg<Precision>::Scale(scaledPCA2Layout[level][crystal], 2.f/rPCA2, scaledPCA2Layout[level][crystal]);
+  }     
+  isoDiff.deallocate();
+  pcaDiff.deallocate();
+  pca2Diff.deallocate();
 }
 
 /**
@@ -281,6 +347,13 @@ FortranLinalg::DenseVector<int>& SimpleHDVizDataImpl::getCrystalPartitions(int p
   return m_data->crystalPartitions[persistenceLevel];
 }
 
+/**
+ *
+ */
+const MSHierarchy* SimpleHDVizDataImpl::getHierarchy() {
+  return m_data->hierarchy.get();
+}
+
 /**
  *
  */
@@ -13,6 +13,14 @@
 class SimpleHDVizDataImpl : public HDVizData {
   public:
     SimpleHDVizDataImpl(HDProcessResult *result);    
+    ~SimpleHDVizDataImpl();
+
+    // Bytes held by the visualization helper data, excluding the result.
+    size_t getByteSize();
+
+    // Levels of a result that is still being processed are added as they complete.
+    void addLevel(int persistenceLevel);
+    bool hasLevel(int persistenceLevel);
 
     // Morse-Smale edge information.
     FortranLinalg::DenseMatrix<Precision>& getX();
@@ -22,6 +30,7 @@ class SimpleHDVizDataImpl : public HDVizData {
     FortranLinalg::DenseVector<int>& getCrystalPartitions(int persistenceLevel);
     FortranLinalg::DenseVector<Precision>& getPersistence();
     FortranLinalg::DenseVector<std::string>& getNames();
+    const MSHierarchy* getHierarchy();
     std::vector<FortranLinalg::DenseMatrix<Precision>>& getLayout(
         HDVizLayout layout, int persistenceLevel);
 
@@ -96,7 +105,10 @@ class SimpleHDVizDataImpl : public HDVizData {
     std::vector<ColorMapper<Precision>> colormap;
     std::vector<ColorMapper<Precision>> dcolormap;
 
-    void computeScaledLayouts();
+    // char rather than bool so that adding a level doesn't touch the flags of others
+    std::vector<char> levelAdded;
+
+    void computeScaledLayouts(int persistenceLevel);
     std::vector<std::vector<FortranLinalg::DenseMatrix<Precision>>> scaledIsoLayout; 
     std::vector<std::vector<FortranLinalg::DenseMatrix<Precision>>> scaledPCALayout;
     std::vector<std::vector<FortranLinalg::DenseMatrix<Precision>>> scaledPCA2Layout;
@@ -5,6 +5,7 @@
 
 class Crystal {
  public:
+  virtual ~Crystal() {}
   virtual unsigned int getMaxSample() = 0;
   virtual unsigned int getMinSample() = 0;
   virtual std::vector<unsigned int>& getAllSamples() = 0; 
@@ -13,6 +14,7 @@ class Crystal {
 
 class MorseSmaleComplex {
  public:  
+  virtual ~MorseSmaleComplex() {}
   // TODO replace with Iterator and getCrystalCount() method.
   virtual std::vector<Crystal*>& getCrystals() = 0;
   virtual std::vector<std::pair<unsigned int, unsigned int>> getAdjacency() = 0;
@@ -21,6 +23,7 @@ class MorseSmaleComplex {
 
 class TopologyData {
  public:
+  virtual ~TopologyData() {}
   virtual unsigned int getMinPersistenceLevel() = 0;
   virtual unsigned int getMaxPersistenceLevel() = 0;
   virtual MorseSmaleComplex* getComplex(unsigned int persistenceLevel) = 0;
@@ -1,14 +1,39 @@
 #include "Image.h"
+#include "ImageLoader.h"
 #include "lodepng.h"
 
+#include <utility>
+
 Image::Image(int width, int height, unsigned char *data, 
   std::vector<char> rawData, const std::string &format) : m_width(width), 
-  m_height(height), m_data(data), m_rawData(rawData), m_format(format) {
+  m_height(height), m_data(data), m_rawData(std::move(rawData)), m_format(format) {
   // intentionally left empty
 }
 
+Image Image::fromPNG(std::vector<char> png) {
+  int width = 0;
+  int height = 0;
+  ImageLoader::readPNGSize(png, width, height);
+  Image image(width, height, nullptr, std::move(png), "png");
+  image.m_pixels = std::make_shared<DecodedPixels>();
+  return image;
+}
+
+/**
+ * Decodes the pixels the first time they are asked for. Concurrent callers
+ * wait for the one decoding them.
+ */
+unsigned char* Image::decodedData() const {
+  std::call_once(m_pixels->decoded, [this]() {
+    int width = 0;
+    int height = 0;
+    m_pixels->data = ImageLoader::decodePNG(m_rawData, width, height);
+  });
+  return m_pixels->data.data();
+}
+
 unsigned char* Image::getData() {
-  return m_data;
+  return m_pixels ? decodedData() : m_data;
 }
 
 std::vector<char>& Image::getRawData() {
@@ -16,7 +41,7 @@ std::vector<char>& Image::getRawData() {
 }
 
 const unsigned char* Image::getConstData() const {
-  return m_data;
+  return m_pixels ? decodedData() : m_data;
 }
 
 const std::vector<char>& Image::getConstRawData() const {
@@ -54,8 +79,7 @@ Image Image::convertToImage(const Eigen::MatrixXd &I, const unsigned w, const un
     throw std::runtime_error("encoder error " + std::to_string(error) + ": " + lodepng_error_text(error));
   } 
 
-  std::vector<char> char_png_vec(w * h);        //<ctc> grumble-grumble... it'll just turn around and be converted back to unsigned char*
-  std::copy(png.begin(), png.end(), char_png_vec.begin());
+  std::vector<char> char_png_vec(png.begin(), png.end());        //<ctc> grumble-grumble... it'll just turn around and be converted back to unsigned char*
   return Image(w, h, NULL, char_png_vec, "png");
 
 #if 0
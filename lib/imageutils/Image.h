@@ -1,5 +1,7 @@
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <Eigen/Core>
@@ -9,6 +11,11 @@ class Image {
   Image(int width, int height, unsigned char *data, std::vector<char> rawData, 
     const std::string &format);
 
+  // An image of the PNG file png that keeps only the compressed bytes. Its
+  // size is read from the PNG header, its pixels are decoded the first time
+  // they are asked for, once for all copies of the image.
+  static Image fromPNG(std::vector<char> png);
+
   unsigned char* getData();
   std::vector<char>& getRawData();
 
@@ -22,9 +29,17 @@ class Image {
   static Image convertToImage(const Eigen::MatrixXd &I, const unsigned w, const unsigned h);
 
  private:
+  struct DecodedPixels {
+    std::once_flag decoded;
+    std::vector<unsigned char> data;
+  };
+
+  unsigned char* decodedData() const;
+
   int m_width;
   int m_height;
   unsigned char* m_data;
   std::vector<char> m_rawData;
   std::string m_format;
+  std::shared_ptr<DecodedPixels> m_pixels;  // set if the pixels are decoded from m_rawData
 };
@@ -2,6 +2,7 @@
 #include <png.h>
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -9,50 +10,92 @@
 #include <stdexcept>
 #include <vector>
 
+namespace {
+
+const size_t kPNGSignatureBytes = 8;
+
+// Where libpng is reading in the PNG file held in memory.
+struct PNGReader {
+  const std::vector<char> *png;
+  size_t offset;
+};
+
+void readPNGBytes(png_structp png_ptr, png_bytep data, png_size_t length) {
+  PNGReader *reader = static_cast<PNGReader*>(png_get_io_ptr(png_ptr));
+  if (reader->offset + length > reader->png->size()) {
+    png_error(png_ptr, "Read past the end of the PNG data");
+  }
+  std::memcpy(data, reader->png->data() + reader->offset, length);
+  reader->offset += length;
+}
+
+}  // namespace
+
 // TODO: Add support for JPG images.
 Image ImageLoader::loadImage(const std::string &filename, ImageLoader::Format format) {
   switch(format) {
     case ImageLoader::Format::PNG:
       return loadPNG(filename);
+    case ImageLoader::Format::RAW_PNG:
+      return Image::fromPNG(loadRawData(filename));
     default:
       throw std::runtime_error("Unsupported file format");
   }
 }
 
-//<ctc> change this to use lodepng since it fails in some cases (Kyli has experienced these issues and had to manually convert images to a loadable form)
-
+/**
+ * Reads the file once and decodes the pixels from the bytes it read.
+ */
 Image ImageLoader::loadPNG(const std::string &filename) {
-  int x, y;
-  
-  png_structp png_ptr;
-  png_infop info_ptr;    
-
-  char header[8];    // 8 is the maximum size that can be checked
-  unsigned int sig_read = 0;
+  Image image = Image::fromPNG(loadRawData(filename));
+  image.getConstData();
+  return image;
+}
 
-  // Open file and test for it being a png.
-  FILE *fp = fopen(filename.c_str(), "rb");
-  if (fp == nullptr) {
-    throw std::runtime_error("Error: File could not be opened for reading.");
+/**
+ * The size is in the IHDR chunk, which has to come first, right after the
+ * signature, its length and its type.
+ */
+void ImageLoader::readPNGSize(const std::vector<char> &png, int &width, int &height) {
+  const size_t ihdrOffset = kPNGSignatureBytes + 8;
+  if (png.size() < ihdrOffset + 8 ||
+      png_sig_cmp(reinterpret_cast<png_const_bytep>(png.data()), 0, kPNGSignatureBytes)) {
+    throw std::runtime_error("File is not recognized as a PNG file.");
+  }
+  if (std::memcmp(png.data() + kPNGSignatureBytes + 4, "IHDR", 4) != 0) {
+    throw std::runtime_error("PNG file does not start with its header.");
   }
+  auto bigEndian = [&](size_t offset) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(png.data() + offset);
+    return int(bytes[0]) << 24 | int(bytes[1]) << 16 | int(bytes[2]) << 8 | int(bytes[3]);
+  };
+  width = bigEndian(ihdrOffset);
+  height = bigEndian(ihdrOffset + 4);
+}
 
-  fread(header, 1, 8, fp);
-  if (png_sig_cmp((png_bytep)header, 0, 8)) {
-    throw std::runtime_error("File is not recognized as a PNG file.");
-  } 
+//<ctc> change this to use lodepng since it fails in some cases (Kyli has experienced these issues and had to manually convert images to a loadable form)
 
+std::vector<unsigned char> ImageLoader::decodePNG(const std::vector<char> &png, int &width, int &height) {
+  // Everything with a destructor is declared before setjmp, which longjmp
+  // would skip otherwise.
+  std::vector<unsigned char> pixels;
+  std::vector<png_bytep> row_pointers;
+  PNGReader reader = { &png, kPNGSignatureBytes };
+
+  if (png.size() < kPNGSignatureBytes ||
+      png_sig_cmp(reinterpret_cast<png_const_bytep>(png.data()), 0, kPNGSignatureBytes)) {
+    throw std::runtime_error("File is not recognized as a PNG file.");
+  }
 
   // Create and initialize the png_struct with the desired error handler functions. 
-  png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
   if (png_ptr == nullptr) {
-    fclose(fp);    
     throw std::runtime_error("Failed to initialize png struct.");
   }
           
   // Allocate/initialize the memory 
-  info_ptr = png_create_info_struct(png_ptr);
+  png_infop info_ptr = png_create_info_struct(png_ptr);
   if (info_ptr == nullptr) {
-    fclose(fp);
     png_destroy_read_struct(&png_ptr, NULL, NULL);
     throw std::runtime_error("Failed to initialize png info struct.");
   }
@@ -60,69 +103,45 @@ Image ImageLoader::loadPNG(const std::string &filename) {
   if (setjmp(png_jmpbuf(png_ptr))) {
     // Free all of the memory associated with the png_ptr and info_ptr.
     png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-    fclose(fp);
-    throw std::runtime_error("Failed to set jmpbuffer");
+    throw std::runtime_error("[read_png_file] Error during read_image");
   }    
 
-  // init png reading
-  png_init_io(png_ptr, fp);
-
-  // let libpng know you already read the first 8 bytes
-  png_set_sig_bytes(png_ptr, 8);
+  // read from memory, the signature has been checked already
+  png_set_read_fn(png_ptr, &reader, readPNGBytes);
+  png_set_sig_bytes(png_ptr, kPNGSignatureBytes);
 
   // read all info up to the image data
   png_read_info(png_ptr, info_ptr);
 
-  int width = png_get_image_width(png_ptr, info_ptr);
-  int height = png_get_image_height(png_ptr, info_ptr);
-  png_byte color_type = png_get_color_type(png_ptr, info_ptr);
-  png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+  width = png_get_image_width(png_ptr, info_ptr);
+  height = png_get_image_height(png_ptr, info_ptr);
 
   // if(bit_depth == 16)
   //   png_set_strip_16(png_ptr);
-
-  int number_of_passes = png_set_interlace_handling(png_ptr);
+  
+  png_set_interlace_handling(png_ptr);
   png_read_update_info(png_ptr, info_ptr);
 
-
-  // Set Error Handling to read image.
-  if (setjmp(png_jmpbuf(png_ptr))) {
-    fclose(fp);
-    throw std::runtime_error("[read_png_file] Error during read_image");
-  }    
-
   // Get row size in bytes.
-  unsigned int row_bytes = png_get_rowbytes(png_ptr, info_ptr);
-
-  // glTexImage2d requires rows to be 4-byte aligned?
-  // rowbytes += 3 - ((rowbytes-1) % 4);
-
-  // Allocate the image_data as a big block, to be given to opengl
-  png_byte *image_data = (png_byte*) malloc(row_bytes * height * sizeof(png_byte)+15);
+  size_t row_bytes = png_get_rowbytes(png_ptr, info_ptr);
 
-  png_bytep *row_pointers = (png_bytep*) malloc(height * sizeof(png_bytep));
+  // Read the rows bottom up into one block.
+  pixels.resize(row_bytes * height);
+  row_pointers.resize(height);
   for (int y = 0; y < height; y++) {    
-    row_pointers[height - 1 - y] = image_data + y*row_bytes;
-    // row_pointers[y] = image_data + y*row_bytes;
+    row_pointers[height - 1 - y] = pixels.data() + y * row_bytes;
   }
+  png_read_image(png_ptr, row_pointers.data());
 
-  // Read the png into imageData through the row_pointers
-  png_read_image(png_ptr, row_pointers);
-
-  /* Clean up after the read,
-   * and free any memory allocated 
-   */
   png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-
-  /* Close the file */
-  fclose(fp);
-
-  std::vector<char> raw_data = this->loadRawData(filename); 
-  return Image(width, height, image_data, std::move(raw_data), "png");
+  return pixels;
 }
 
 std::vector<char> ImageLoader::loadRawData(const std::string &filename) {
   std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+  if (!ifs) {
+    throw std::runtime_error("Error: File could not be opened for reading: " + filename);
+  }
   std::ifstream::pos_type pos = ifs.tellg();
   std::vector<char> result(pos);
   ifs.seekg(0, std::ios::beg);
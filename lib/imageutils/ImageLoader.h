@@ -6,9 +6,18 @@
 
 class ImageLoader {
 public:
+  // PNG decodes the pixels right away, RAW_PNG only reads the file and
+  // decodes them on first access.
   enum class Format { PNG, RAW_PNG };
   Image loadImage(const std::string &filename, ImageLoader::Format format);
   Image loadPNG(const std::string &filename);
+
+  // Reads the size of the PNG file png from its header.
+  static void readPNGSize(const std::vector<char> &png, int &width, int &height);
+
+  // Decodes the PNG file png into rows of pixels, bottom row first.
+  static std::vector<unsigned char> decodePNG(const std::vector<char> &png, int &width, int &height);
+
 private:
   std::vector<char> loadRawData(const std::string &filename);
 };
@@ -5,19 +5,27 @@
 #include "flinalg/DenseMatrix.h"
 #include "flinalg/Linalg.h"
 #include "GaussianKernel.h"
+#include "graph/KNNBackend.h"
 #include "metrics/Distance.h"
 #include "metrics/SquaredEuclideanMetric.h"
 
 #include <math.h>
+#include <memory>
 
 
 template<typename TPrecision>
 class FirstOrderKernelRegression {      
   public:
+    // With a backend, the neighbors of each point are queried from an index
+    // built over the labels once, instead of computing all distances.
     FirstOrderKernelRegression(FortranLinalg::DenseMatrix<TPrecision> &data, FortranLinalg::DenseMatrix<TPrecision>
-        &labels, GaussianKernel<TPrecision> &k, int knn):Y(data), X(labels), kernel(k) {
+        &labels, GaussianKernel<TPrecision> &k, int knn,
+        const KNNBackend<TPrecision> *backend = nullptr):Y(data), X(labels), kernel(k) {
 	    if (knn > X.N()){ 
         knn = X.N(); 
+      }
+      if (backend != nullptr) {
+        index = std::shared_ptr<KNNIndex<TPrecision>>(backend->buildIndex(X));
       }
 	    A = FortranLinalg::DenseMatrix<TPrecision>(knn, 1+X.M());
      	b = FortranLinalg::DenseMatrix<TPrecision>(knn, Y.M());
@@ -73,6 +81,7 @@ FortranLinalg::Matrix<TPrecision> &J, double *sse=NULL){
     FortranLinalg::DenseMatrix<TPrecision> X;
 
     GaussianKernel<TPrecision> &kernel;
+    std::shared_ptr<KNNIndex<TPrecision>> index;
 
     FortranLinalg::DenseMatrix<TPrecision> A;
     FortranLinalg::DenseMatrix<TPrecision> b;
@@ -81,7 +90,11 @@ FortranLinalg::Matrix<TPrecision> &J, double *sse=NULL){
         TPrecision *sse=NULL) {
       FortranLinalg::DenseVector<int> knn(A.M());
       FortranLinalg::DenseVector<TPrecision> knnDist(A.M());
-      Distance<TPrecision>::computeKNN(X, x, knn, knnDist, sl2metric);
+      if (index) {
+        index->query(x.data(), A.M(), knn.data(), knnDist.data());
+      } else {
+        Distance<TPrecision>::computeKNN(X, x, knn, knnDist, sl2metric);
+      }
 
       TPrecision wsum = 0; 
       for(unsigned int i=0; i < A.M(); i++){
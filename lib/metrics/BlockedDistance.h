@@ -0,0 +1,241 @@
+#ifndef BLOCKEDDISTANCE_H
+#define BLOCKEDDISTANCE_H
+
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseMatrixView.h"
+#include "flinalg/DenseVector.h"
+#include "flinalg/Linalg.h"
+#include "utils/WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+// Euclidean distance matrices of all columns of a sample matrix. Instead of
+// one metric call per pair, the matrix is split into square tiles of column
+// blocks and each tile is computed from the Gram matrix of its two blocks via
+// |x-y|^2 = |x|^2 + |y|^2 - 2 x'y, using the BLAS matrix multiply. Tiles of the
+// upper triangle are spread across threads and mirrored into the lower one.
+// The nearest neighbors of all columns can be found from the same tiles
+// without ever holding the full matrix.
+template <typename TPrecision>
+class BlockedDistance {
+  public:
+    static FortranLinalg::DenseMatrix<TPrecision> computeEuclidean(
+        FortranLinalg::DenseMatrix<TPrecision> &data, unsigned int threadCount = 0,
+        unsigned int blockSize = DefaultBlockSize) {
+      FortranLinalg::DenseMatrix<TPrecision> distances(data.N(), data.N());
+      computeDistances(data, distances, false, threadCount, blockSize);
+      return distances;
+    };
+
+    static FortranLinalg::DenseMatrix<TPrecision> computeSquaredEuclidean(
+        FortranLinalg::DenseMatrix<TPrecision> &data, unsigned int threadCount = 0,
+        unsigned int blockSize = DefaultBlockSize) {
+      FortranLinalg::DenseMatrix<TPrecision> distances(data.N(), data.N());
+      computeDistances(data, distances, true, threadCount, blockSize);
+      return distances;
+    };
+
+    static void computeDistances(FortranLinalg::DenseMatrix<TPrecision> &data,
+                                 FortranLinalg::DenseMatrix<TPrecision> &distances,
+                                 bool squared, unsigned int threadCount = 0,
+                                 unsigned int blockSize = DefaultBlockSize) {
+      unsigned int n = data.N();
+      if (n == 0) {
+        return;
+      }
+      if (blockSize == 0) {
+        blockSize = DefaultBlockSize;
+      }
+
+      // Squared norms of all samples
+      FortranLinalg::DenseVector<TPrecision> norms(n);
+      for (unsigned int i = 0; i < n; i++) {
+        TPrecision *x = data.data() + (size_t) i * data.M();
+        TPrecision sum = 0;
+        for (unsigned int k = 0; k < data.M(); k++) {
+          sum += x[k] * x[k];
+        }
+        norms(i) = sum;
+      }
+
+      // Upper triangle tiles, listed row of blocks by row of blocks
+      unsigned int nBlocks = (n + blockSize - 1) / blockSize;
+      std::vector<std::pair<unsigned int, unsigned int>> tiles;
+      for (unsigned int bi = 0; bi < nBlocks; bi++) {
+        for (unsigned int bj = bi; bj < nBlocks; bj++) {
+          tiles.push_back(std::make_pair(bi, bj));
+        }
+      }
+      std::vector<unsigned int> order(tiles.size());
+      for (unsigned int i = 0; i < order.size(); i++) {
+        order[i] = i;
+      }
+
+      WorkStealingScheduler scheduler(threadCount);
+      std::vector<FortranLinalg::DenseMatrix<TPrecision>> grams(scheduler.threadCount());
+      for (unsigned int i = 0; i < grams.size(); i++) {
+        grams[i] = FortranLinalg::DenseMatrix<TPrecision>(blockSize, blockSize);
+      }
+
+      scheduler.run(order, [&](unsigned int tile, unsigned int worker) {
+        unsigned int i0 = tiles[tile].first * blockSize;
+        unsigned int j0 = tiles[tile].second * blockSize;
+        unsigned int ni = std::min(blockSize, n - i0);
+        unsigned int nj = std::min(blockSize, n - j0);
+
+        FortranLinalg::DenseMatrixView<TPrecision> blockI(data, i0, ni);
+        FortranLinalg::DenseMatrixView<TPrecision> blockJ(data, j0, nj);
+        FortranLinalg::DenseMatrixView<TPrecision> gram(ni, nj, grams[worker].data());
+        FortranLinalg::Linalg<TPrecision>::Multiply(blockI, blockJ, gram, true, false);
+
+        for (unsigned int b = 0; b < nj; b++) {
+          for (unsigned int a = 0; a < ni; a++) {
+            TPrecision d = norms(i0 + a) + norms(j0 + b) - 2 * gram(a, b);
+            // Cancellation may leave tiny negative values for close samples
+            if (d < 0) {
+              d = 0;
+            }
+            if (!squared) {
+              d = std::sqrt(d);
+            }
+            distances(i0 + a, j0 + b) = d;
+            distances(j0 + b, i0 + a) = d;
+          }
+        }
+        if (i0 == j0) {
+          for (unsigned int a = 0; a < ni; a++) {
+            distances(i0 + a, i0 + a) = 0;
+          }
+        }
+      });
+
+      for (unsigned int i = 0; i < grams.size(); i++) {
+        grams[i].deallocate();
+      }
+      norms.deallocate();
+    };
+
+    // Fill the k = knn.M() nearest neighbors of every column and their
+    // Euclidean distances, or squared ones, sorted by distance, for k at most
+    // the number of columns. The tiles are streamed block of queries by block
+    // of queries and only the k best candidates of each query are kept, so
+    // memory grows with k times the number of samples rather than its square.
+    // Each tile is computed as computeDistances computes it, so the distances
+    // are exactly those of computeEuclidean or computeSquaredEuclidean; equal
+    // distances are ordered by index.
+    static void findKNN(FortranLinalg::DenseMatrix<TPrecision> &data,
+                        FortranLinalg::Matrix<int> &knn, FortranLinalg::Matrix<TPrecision> &dists,
+                        unsigned int threadCount = 0, unsigned int blockSize = DefaultBlockSize,
+                        bool squared = false) {
+      unsigned int n = data.N();
+      unsigned int k = knn.M();
+      if (n == 0 || k == 0) {
+        return;
+      }
+      if (blockSize == 0) {
+        blockSize = DefaultBlockSize;
+      }
+
+      FortranLinalg::DenseVector<TPrecision> norms(n);
+      for (unsigned int i = 0; i < n; i++) {
+        TPrecision *x = data.data() + (size_t) i * data.M();
+        TPrecision sum = 0;
+        for (unsigned int d = 0; d < data.M(); d++) {
+          sum += x[d] * x[d];
+        }
+        norms(i) = sum;
+      }
+
+      unsigned int nBlocks = (n + blockSize - 1) / blockSize;
+      std::vector<unsigned int> order(nBlocks);
+      for (unsigned int i = 0; i < order.size(); i++) {
+        order[i] = i;
+      }
+
+      WorkStealingScheduler scheduler(threadCount);
+      std::vector<FortranLinalg::DenseMatrix<TPrecision>> grams(scheduler.threadCount());
+      std::vector<std::vector<Candidate>> candidates(scheduler.threadCount());
+      for (unsigned int i = 0; i < grams.size(); i++) {
+        grams[i] = FortranLinalg::DenseMatrix<TPrecision>(blockSize, blockSize);
+        candidates[i].reserve((size_t) blockSize * k);
+      }
+
+      scheduler.run(order, [&](unsigned int bq, unsigned int worker) {
+        unsigned int q0 = bq * blockSize;
+        unsigned int nq = std::min(blockSize, n - q0);
+        // Bounded max-heap of the best candidates of each query
+        std::vector<Candidate> &best = candidates[worker];
+        best.assign((size_t) nq * k, Candidate(std::numeric_limits<TPrecision>::max(), -1));
+        FortranLinalg::DenseMatrixView<TPrecision> queries(data, q0, nq);
+
+        for (unsigned int bc = 0; bc < nBlocks; bc++) {
+          unsigned int c0 = bc * blockSize;
+          unsigned int nc = std::min(blockSize, n - c0);
+          FortranLinalg::DenseMatrixView<TPrecision> others(data, c0, nc);
+          // Tiles are only ever computed with the lower block first, as in
+          // computeDistances.
+          bool transposed = bc < bq;
+          FortranLinalg::DenseMatrixView<TPrecision> gram(transposed ? nc : nq,
+              transposed ? nq : nc, grams[worker].data());
+          if (transposed) {
+            FortranLinalg::Linalg<TPrecision>::Multiply(others, queries, gram, true, false);
+          } else {
+            FortranLinalg::Linalg<TPrecision>::Multiply(queries, others, gram, true, false);
+          }
+
+          for (unsigned int a = 0; a < nq; a++) {
+            Candidate *heap = &best[(size_t) a * k];
+            for (unsigned int b = 0; b < nc; b++) {
+              TPrecision d;
+              if (q0 + a == c0 + b) {
+                d = 0;
+              } else {
+                // Within a diagonal tile, computeDistances keeps the Gram
+                // entry with the lower index first.
+                TPrecision g = transposed || (bc == bq && b < a) ? gram(b, a) : gram(a, b);
+                d = norms(q0 + a) + norms(c0 + b) - 2 * g;
+                if (d < 0) {
+                  d = 0;
+                }
+                if (!squared) {
+                  d = std::sqrt(d);
+                }
+              }
+              Candidate candidate(d, c0 + b);
+              if (candidate < heap[0]) {
+                std::pop_heap(heap, heap + k);
+                heap[k - 1] = candidate;
+                std::push_heap(heap, heap + k);
+              }
+            }
+          }
+        }
+
+        for (unsigned int a = 0; a < nq; a++) {
+          Candidate *heap = &best[(size_t) a * k];
+          std::sort_heap(heap, heap + k);
+          for (unsigned int j = 0; j < k; j++) {
+            knn(j, q0 + a) = heap[j].second;
+            dists(j, q0 + a) = heap[j].first;
+          }
+        }
+      });
+
+      for (unsigned int i = 0; i < grams.size(); i++) {
+        grams[i].deallocate();
+      }
+      norms.deallocate();
+    };
+
+    static const unsigned int DefaultBlockSize = 256;
+
+  private:
+    typedef std::pair<TPrecision, int> Candidate;
+};
+
+#endif
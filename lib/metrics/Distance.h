@@ -5,6 +5,11 @@
 #include "flinalg/DenseVector.h"
 #include "Metric.h"
 #include "utils/MinHeap.h"
+#include "utils/WorkStealingScheduler.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
 
 
 template <typename TPrecision>
@@ -59,6 +64,41 @@ class Distance {
     };
 
 
+    // Same as above for a dense, symmetric distance matrix. Each column is
+    // scanned in place keeping its k smallest entries in a bounded max-heap,
+    // and columns are spread across threads. Columns whose neighbor order is
+    // not unique because of equal distances fall back to the full MinHeap, so
+    // neighbors and tie-breaking are identical to the version above.
+    static void findKNN(FortranLinalg::DenseMatrix<TPrecision> &d, 
+        FortranLinalg::Matrix<int> &knn, FortranLinalg::Matrix<TPrecision> &dists,
+        unsigned int threadCount = 0) {
+      std::vector<unsigned int> columns(d.N());
+      for (unsigned int i = 0; i < columns.size(); i++) {
+        columns[i] = i;
+      }
+
+      WorkStealingScheduler scheduler(threadCount);
+      std::vector<std::vector<std::pair<TPrecision, int>>> selections(scheduler.threadCount());
+      scheduler.run(columns, [&](unsigned int i, unsigned int worker) {
+        TPrecision *column = d.data() + (size_t) i * d.M();
+        std::vector<std::pair<TPrecision, int>> &selection = selections[worker];
+        if (selectKNN(column, d.N(), knn.M(), selection)) {
+          for (unsigned int j = 0; j < knn.M(); j++) {
+            knn(j, i) = selection[j].second;
+            dists(j, i) = selection[j].first;
+          }
+        }
+        else {
+          MinHeap<TPrecision> minHeap(column, d.N());
+          for (unsigned int j = 0; j < knn.M(); j++) {
+            knn(j, i) = minHeap.getRootIndex();
+            dists(j, i) = minHeap.extractRoot();
+          }
+        }
+      });
+    };
+
+
     static void computeKNN(FortranLinalg::Matrix<TPrecision> &data, 
         FortranLinalg::Matrix<int> &knn, FortranLinalg::Matrix<TPrecision> &dists, 
         Metric<TPrecision> &metric) {
@@ -112,6 +152,53 @@ class Distance {
       }
       delete[] distances;
     };
+
+  private:
+    static bool byDistance(const std::pair<TPrecision, int> &a, const std::pair<TPrecision, int> &b) {
+      return a.first < b.first;
+    };
+
+    // Select the k smallest of n distances into selection, sorted ascending.
+    // Returns false if equal distances make that order ambiguous, in which case
+    // the caller has to reproduce the heap's tie-breaking.
+    static bool selectKNN(TPrecision *distances, unsigned int n, unsigned int k,
+                          std::vector<std::pair<TPrecision, int>> &selection) {
+      selection.clear();
+      if (k == 0) {
+        return true;
+      }
+      if (k > n) {
+        return false;
+      }
+      for (unsigned int j = 0; j < n; j++) {
+        if (selection.size() < k) {
+          selection.push_back(std::make_pair(distances[j], (int) j));
+          if (selection.size() == k) {
+            std::make_heap(selection.begin(), selection.end(), byDistance);
+          }
+        }
+        else if (distances[j] < selection.front().first) {
+          std::pop_heap(selection.begin(), selection.end(), byDistance);
+          selection.back() = std::make_pair(distances[j], (int) j);
+          std::push_heap(selection.begin(), selection.end(), byDistance);
+        }
+      }
+      std::sort_heap(selection.begin(), selection.end(), byDistance);
+
+      for (unsigned int j = 1; j < k; j++) {
+        if (!(selection[j-1].first < selection[j].first)) {
+          return false;
+        }
+      }
+      unsigned int count = 0;
+      TPrecision kth = selection[k-1].first;
+      for (unsigned int j = 0; j < n; j++) {
+        if (!(distances[j] > kth)) {
+          count++;
+        }
+      }
+      return count == k;
+    };
 };
 
 #endif
\ No newline at end of file
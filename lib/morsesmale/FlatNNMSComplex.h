@@ -0,0 +1,799 @@
+// Morse-Smale complex computation as described in:
+// Gerber S, Bremer PT, Pascucci V, Whitaker R (2010).
+// “Visual Exploration of High Dimensional Scalar Functions.”
+// IEEE Transactions on Visualization and Computer Graphics, 16(6), 1271–1280.
+//
+// Same complex as NNMSComplex, computed on flat arrays for large sample
+// counts: extrema and crystals are plain per-sample arrays, crystals and
+// saddles are keyed by (max, min) extrema in open addressing hash maps instead
+// of std::maps, the merge hierarchy is built from an edge array sorted by
+// persistence and a union-find over the extrema, and crystals at a
+// persistence level are found through array lookups. Steepest neighbors and
+// extrema are computed on several threads with the same result as on one.
+//
+// NNMSComplex keys its persistence levels by value, so of two saddles or
+// merges with exactly the same persistence it silently keeps one. Wherever
+// that does not happen, both produce the same levels, partitions and crystals.
+
+#ifndef FLATNNMSCOMPLEX_H
+#define FLATNNMSCOMPLEX_H
+
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseVector.h"
+#include "graph/KNNBackend.h"
+#include "metrics/Distance.h"
+#include "metrics/SquaredEuclideanMetric.h"
+#include "utils/WorkStealingScheduler.h"
+#include "MSHierarchy.h"
+#include "PairHashMap.h"
+#include "UnionFind.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+
+
+template<typename TPrecision>
+class FlatNNMSComplex {
+  private:
+    // Two extrema of the same kind joined at a persistence. first is the less
+    // significant extremum, which merges into second.
+    struct Merge {
+      TPrecision persistence;
+      int first;
+      int second;
+
+      bool operator<(const Merge &other) const {
+        if (persistence != other.persistence) {
+          return persistence < other.persistence;
+        }
+        return first != other.first ? first < other.first : second < other.second;
+      };
+
+      bool operator>(const Merge &other) const {
+        return other < *this;
+      };
+    };
+
+    // Samples per task of the parallel passes, and most blocks the gradient
+    // pass lists edges between
+    static const unsigned int kBlockSize = 4096;
+    static const unsigned int kMaxGradientBlocks = 1024;
+
+    // Threads for computing the complex, 0 for all hardware threads
+    unsigned int m_threadCount = 0;
+
+    unsigned int m_sampleCount = 0;
+    // Function values, smoothed if requested
+    std::vector<TPrecision> m_y;
+    // Nearest neighbors of each sample, k consecutive entries per sample
+    std::vector<int> m_knn;
+    unsigned int m_k = 0;
+
+    // Steepest ascending and descending neighbor of each sample, -1 at extrema
+    std::vector<int> m_ascending;
+    std::vector<int> m_descending;
+
+    // Maximum and minimum extremum ID of each sample. Maxima are numbered
+    // first, in the order of the first sample of their region, minima continue
+    // after the nMax maxima.
+    std::vector<int> m_max;
+    std::vector<int> m_min;
+    int m_nMax = 0;
+
+    // Extremum ID to sample index
+    std::vector<int> m_extremaIndex;
+
+    // Crystals at persistence zero as (max, min) extrema, sorted, and the
+    // crystal of each sample
+    std::vector<std::pair<int, int>> m_baseCrystals;
+    std::vector<int> m_sampleCrystal;
+
+    // All merges in the order they happen with increasing persistence
+    std::vector<Merge> m_merges;
+
+  public:
+
+    //Merged extrema and crystals for one persistence level. Each caller
+    //holding its own state can query a different persistence level of the
+    //same complex concurrently. Moving a state to a higher level only applies
+    //the merges in between.
+    struct MergeState {
+      // Crystal of each crystal at persistence zero
+      std::vector<int> crystalOf;
+      // (max, min) extrema of each crystal
+      std::vector<std::pair<int, int>> crystals;
+
+      // Merges applied so far, and the sets of extrema they joined with the
+      // surviving extremum of each set root. The surviving extremum of any
+      // extremum is only looked up for the ends of crystals.
+      size_t mergeCount = 0;
+      UnionFind sets;
+      std::vector<int> survivor;
+
+      void cleanup(){
+        std::vector<int>().swap(crystalOf);
+        std::vector<std::pair<int, int>>().swap(crystals);
+        std::vector<int>().swap(survivor);
+        sets.reset(0);
+        mergeCount = 0;
+      };
+    };
+
+
+    FlatNNMSComplex(FortranLinalg::DenseMatrix<TPrecision> &distances,
+                    FortranLinalg::DenseVector<TPrecision> &yin,
+                    int knn, bool smooth = false, double sigma2=0, bool test=true,
+                    unsigned int threadCount = 0) : m_threadCount(threadCount) {
+      unsigned int n = distances.N();
+      if (knn > (int) n) {
+        knn = n;
+      }
+      FortranLinalg::DenseMatrix<int> KNN(knn, n);
+      FortranLinalg::DenseMatrix<TPrecision> KNND(knn, n);
+      Distance<TPrecision>::findKNN(distances, KNN, KNND, threadCount);
+      runMS(KNN, KNND, yin, smooth, sigma2);
+      KNN.deallocate();
+      KNND.deallocate();
+    };
+
+    // Complex from precomputed nearest neighbors (neighbors and distances of
+    // every sample, sorted by distance, as from Distance::findKNN). The
+    // neighbors are copied.
+    FlatNNMSComplex(FortranLinalg::DenseMatrix<int> &knn,
+                    FortranLinalg::DenseMatrix<TPrecision> &knnDists,
+                    FortranLinalg::DenseVector<TPrecision> &yin,
+                    bool smooth = false, double sigma2=0,
+                    unsigned int threadCount = 0) : m_threadCount(threadCount) {
+      runMS(knn, knnDists, yin, smooth, sigma2);
+    };
+
+    FlatNNMSComplex(FortranLinalg::DenseMatrix<TPrecision> &Xin,
+                    FortranLinalg::DenseVector<TPrecision> &yin,
+                    int knn, bool smooth = false, double eps=0.01, double sigma2=0,
+                    unsigned int threadCount = 0,
+                    const KNNBackend<TPrecision> *backend = nullptr) :
+        m_threadCount(threadCount) {
+      unsigned int n = Xin.N();
+      if (knn > (int) n) {
+        knn = n;
+      }
+      FortranLinalg::DenseMatrix<int> KNN(knn, n);
+      FortranLinalg::DenseMatrix<TPrecision> KNND(knn, n);
+      if (backend != nullptr) {
+        backend->findKNN(Xin, KNN, KNND, true);
+      } else {
+        SquaredEuclideanMetric<TPrecision> dist;
+        Distance<TPrecision>::computeKNN(Xin, KNN, KNND, dist);
+      }
+      runMS(KNN, KNND, yin, smooth, sigma2);
+      KNN.deallocate();
+      KNND.deallocate();
+    };
+
+
+    //Compute the MS crystals for the given persistence level into the given
+    //state. Neighboring extrema with a absolute difference between saddle and
+    //lower exterma smaller than pLevel, are recursively joined into a single
+    //extrema. A state at a lower level is updated with the merges up to
+    //pLevel, otherwise the merges are replayed from persistence zero.
+    void mergePersistence(TPrecision pLevel, MergeState &state) const {
+      int nExt = m_extremaIndex.size();
+      size_t end = std::lower_bound(m_merges.begin(), m_merges.end(), pLevel,
+          [](const Merge &m, TPrecision level) { return m.persistence < level; }) - m_merges.begin();
+      bool incremental = state.sets.size() == (unsigned int) nExt &&
+                         state.crystalOf.size() == m_baseCrystals.size() && state.mergeCount <= end;
+      if (!incremental) {
+        state.sets.reset(nExt);
+        state.survivor.resize(nExt);
+        for (int e = 0; e < nExt; e++) {
+          state.survivor[e] = e;
+        }
+        state.mergeCount = 0;
+      } else if (state.mergeCount == end) {
+        return;
+      }
+      for (; state.mergeCount < end; state.mergeCount++) {
+        const Merge &m = m_merges[state.mergeCount];
+        int root = state.sets.unite(state.sets.find(m.first), state.sets.find(m.second));
+        state.survivor[root] = m.second;
+      }
+      auto merge = [&state](int e) {
+        return state.survivor[state.sets.find(e)];
+      };
+
+      // Crystals are numbered in the order of the first crystal at
+      // persistence zero they contain. Crystals of a lower level are in that
+      // order as well, so they can be relabeled instead of all crystals.
+      if (incremental) {
+        PairHashMap<int> merged(state.crystals.size());
+        std::vector<int> relabel(state.crystals.size());
+        std::vector<std::pair<int, int>> crystals;
+        for (unsigned int c = 0; c < state.crystals.size(); c++) {
+          std::pair<int, int> p(merge(state.crystals[c].first), merge(state.crystals[c].second));
+          std::pair<int*, bool> id = merged.insert(p.first, p.second, crystals.size());
+          if (id.second) {
+            crystals.push_back(p);
+          }
+          relabel[c] = *id.first;
+        }
+        for (int &c : state.crystalOf) {
+          c = relabel[c];
+        }
+        state.crystals.swap(crystals);
+        return;
+      }
+      PairHashMap<int> merged(m_baseCrystals.size());
+      state.crystalOf.resize(m_baseCrystals.size());
+      state.crystals.clear();
+      for (unsigned int c = 0; c < m_baseCrystals.size(); c++) {
+        std::pair<int, int> p(merge(m_baseCrystals[c].first), merge(m_baseCrystals[c].second));
+        std::pair<int*, bool> id = merged.insert(p.first, p.second, state.crystals.size());
+        if (id.second) {
+          state.crystals.push_back(p);
+        }
+        state.crystalOf[c] = *id.first;
+      }
+    };
+
+    //Crystals of all persistence levels from firstLevel on, computed level by
+    //level with one merge state. Levels are indexed as getPersistence().
+    MSHierarchy getHierarchy(unsigned int firstLevel = 0) const {
+      std::vector<TPrecision> levels = getLevels();
+      MSHierarchy hierarchy;
+      hierarchy.m_firstLevel = std::min<size_t>(firstLevel, levels.size());
+      hierarchy.m_crystalOffsets.push_back(0);
+      MergeState state;
+      std::vector<int> firstCrystalOf;
+      for (unsigned int level = hierarchy.m_firstLevel; level < levels.size(); level++) {
+        mergePersistence(levels[level], state);
+        if (level == hierarchy.m_firstLevel) {
+          firstCrystalOf = state.crystalOf;
+          hierarchy.m_firstCrystalCount = state.crystals.size();
+          hierarchy.m_sampleCrystal.resize(m_sampleCount);
+          for (unsigned int i = 0; i < m_sampleCount; i++) {
+            hierarchy.m_sampleCrystal[i] = firstCrystalOf[m_sampleCrystal[i]];
+          }
+          hierarchy.m_relabel.reserve((levels.size() - level) * state.crystals.size());
+        }
+        size_t offset = hierarchy.m_relabel.size();
+        hierarchy.m_relabel.resize(offset + hierarchy.m_firstCrystalCount);
+        for (unsigned int b = 0; b < firstCrystalOf.size(); b++) {
+          hierarchy.m_relabel[offset + firstCrystalOf[b]] = state.crystalOf[b];
+        }
+        for (const std::pair<int, int> &c : state.crystals) {
+          hierarchy.m_crystals.push_back(std::make_pair(m_extremaIndex[c.first],
+                                                        m_extremaIndex[c.second]));
+        }
+        hierarchy.m_crystalOffsets.push_back(hierarchy.m_crystals.size());
+      }
+
+      // A merge applies from the first level above its persistence on.
+      hierarchy.m_extremumDeath.assign(m_extremaIndex.size(), levels.size());
+      hierarchy.m_extremumParent.resize(m_extremaIndex.size());
+      for (unsigned int e = 0; e < m_extremaIndex.size(); e++) {
+        hierarchy.m_extremumParent[e] = e;
+      }
+      size_t level = 0;
+      for (const Merge &m : m_merges) {
+        while (level + 1 < levels.size() && !(m.persistence < levels[level])) {
+          level++;
+        }
+        hierarchy.m_extremumDeath[m.first] = level;
+        hierarchy.m_extremumParent[m.first] = m.second;
+      }
+      hierarchy.m_extremumSample = m_extremaIndex;
+      return hierarchy;
+    };
+
+    //Get partioning accordinng to the crystals of the MS-complex for the
+    //persistence level of the state
+    FortranLinalg::DenseVector<int> getPartitions(const MergeState &state) const {
+      FortranLinalg::DenseVector<int> crys(m_sampleCount);
+      for (unsigned int i = 0; i < m_sampleCount; i++) {
+        crys(i) = state.crystalOf[m_sampleCrystal[i]];
+      }
+      return crys;
+    };
+
+    //return extrema indicies (first row is max, secon is min) for each crystal
+    FortranLinalg::DenseMatrix<int> getCrystals(const MergeState &state) const {
+      FortranLinalg::DenseMatrix<int> ce(2, state.crystals.size());
+      for (unsigned int c = 0; c < state.crystals.size(); c++) {
+        ce(0, c) = m_extremaIndex[state.crystals[c].first];
+        ce(1, c) = m_extremaIndex[state.crystals[c].second];
+      }
+      return ce;
+    };
+
+    int getNAllExtrema() const {
+      return m_extremaIndex.size();
+    };
+
+    int getNBaseCrystals() const {
+      return m_baseCrystals.size();
+    };
+
+    //get persistencies, the distinct persistence levels at which extrema
+    //merge followed by the largest value
+    FortranLinalg::DenseVector<TPrecision> getPersistence() const {
+      std::vector<TPrecision> levels = getLevels();
+      FortranLinalg::DenseVector<TPrecision> pers(levels.size());
+      std::copy(levels.begin(), levels.end(), pers.data());
+      return pers;
+    };
+
+    FortranLinalg::DenseMatrix<int> getNearestNeighbors() const {
+      FortranLinalg::DenseMatrix<int> knn(m_k, m_sampleCount);
+      std::copy(m_knn.begin(), m_knn.end(), knn.data());
+      return knn;
+    };
+
+    // All memory is owned by the complex, kept for the interface of
+    // NNMSComplex.
+    void cleanup(){
+    };
+
+  private:
+    // Distinct persistence levels at which extrema merge followed by the
+    // largest value
+    std::vector<TPrecision> getLevels() const {
+      std::vector<TPrecision> levels;
+      for (const Merge &m : m_merges) {
+        if (levels.empty() || levels.back() != m.persistence) {
+          levels.push_back(m.persistence);
+        }
+      }
+      levels.push_back(std::numeric_limits<TPrecision>::max());
+      return levels;
+    };
+
+    // Orders two extrema of the same kind such that first is the less
+    // significant one, the lower maximum or the higher minimum.
+    void orient(int &first, int &second) const {
+      if (first < m_nMax) {
+        if (m_y[m_extremaIndex[first]] > m_y[m_extremaIndex[second]]) {
+          std::swap(first, second);
+        }
+      } else {
+        if (m_y[m_extremaIndex[first]] < m_y[m_extremaIndex[second]]) {
+          std::swap(first, second);
+        }
+      }
+    };
+
+    void runMS(FortranLinalg::DenseMatrix<int> &KNN,
+               FortranLinalg::DenseMatrix<TPrecision> &KNND,
+               FortranLinalg::DenseVector<TPrecision> &yin,
+               bool smooth, double sigma2) {
+      m_sampleCount = KNN.N();
+      m_k = KNN.M();
+      m_knn.assign(KNN.data(), KNN.data() + size_t(m_k) * m_sampleCount);
+      const TPrecision *knnd = KNND.data();
+
+      m_y.resize(m_sampleCount);
+      forEachBlock(m_sampleCount, kBlockSize, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+          if (smooth) {
+            double yi = 0;
+            double wsum = 0;
+            for (unsigned int k = 0; k < m_k; k++) {
+              double w = exp( -knnd[size_t(i) * m_k + k] / sigma2 );
+              yi += w * yin(m_knn[size_t(i) * m_k + k]);
+              wsum += w;
+            }
+            m_y[i] = yi / wsum;
+          } else {
+            m_y[i] = yin(i);
+          }
+        }
+      });
+
+      computeGradients(knnd);
+      computeExtrema();
+      computeBaseCrystals();
+      computeMerges();
+    };
+
+    // Slopes and neighbors of the steepest ascent and descent of a sample
+    struct Steepest {
+      TPrecision ascent;
+      TPrecision descent;
+      int ascending;
+      int descending;
+    };
+
+    // Same updates as NNMSComplex, without branches. An edge only ascends if
+    // its slope is positive and only descends if it is negative, so of edges
+    // with the same slope the first one in the order of NNMSComplex wins.
+    static void updateSteepest(Steepest &s, double g, int j) {
+      bool up = s.ascent < g;
+      bool down = !up && s.descent > g;
+      s.ascent = up ? g : s.ascent;
+      s.ascending = up ? j : s.ascending;
+      s.descent = down ? g : s.descent;
+      s.descending = down ? j : s.descending;
+    };
+
+    // Calls f(begin, end) for consecutive blocks of count samples, spread
+    // over the threads of the complex.
+    template<typename F>
+    void forEachBlock(unsigned int count, unsigned int blockSize, F f) const {
+      std::vector<unsigned int> blocks((count + blockSize - 1) / blockSize);
+      for (unsigned int b = 0; b < blocks.size(); b++) {
+        blocks[b] = b;
+      }
+      WorkStealingScheduler scheduler(m_threadCount);
+      scheduler.run(blocks, [&](unsigned int b, unsigned int) {
+        f(b * blockSize, std::min(count, (b + 1) * blockSize));
+      });
+    };
+
+    // Steepest ascending and descending neighbor of each sample over the
+    // neighbors of both directions of each nearest neighbor edge.
+    void computeGradients(const TPrecision *knnd) {
+      m_ascending.resize(m_sampleCount);
+      m_descending.resize(m_sampleCount);
+      if (ThreadPool::resolveThreadCount(m_threadCount) > 1 &&
+          size_t(m_sampleCount) * m_k <= UINT_MAX) {
+        computeGradientsParallel(knnd);
+      } else {
+        computeGradientsSerial(knnd);
+      }
+    };
+
+    // The largest slopes of a sample are kept next to its neighbors, so that
+    // the update of the far end of an edge touches a single cache line, and
+    // those of the near end stay in registers: an edge from a sample to itself
+    // has no slope and changes neither end.
+    void computeGradientsSerial(const TPrecision *knnd) {
+      std::vector<Steepest> steepest(m_sampleCount, Steepest{0, 0, -1, -1});
+      for (unsigned int i = 0; i < m_sampleCount; i++) {
+        const int *neighbors = &m_knn[size_t(i) * m_k];
+        const TPrecision *dists = &knnd[size_t(i) * m_k];
+        Steepest si = steepest[i];
+        for (unsigned int k = 1; k < m_k; k++) {
+          int j = neighbors[k];
+          double d = sqrt(dists[k]);
+          double g = d == 0 ? 0 : (m_y[j] - m_y[i]) / d;
+          updateSteepest(si, g, j);
+          updateSteepest(steepest[j], -g, i);
+        }
+        steepest[i] = si;
+      }
+      for (unsigned int i = 0; i < m_sampleCount; i++) {
+        m_ascending[i] = steepest[i].ascending;
+        m_descending[i] = steepest[i].descending;
+      }
+    };
+
+    // Two passes without races over blocks of samples. The first lists the
+    // edges from each block into each other block, in the order of the edges.
+    // The second has every block apply the edges from the blocks before it,
+    // then its own edges, then those from the blocks after it. Each sample is
+    // thus updated in the same order as by the serial pass, and only by the
+    // thread of its block.
+    void computeGradientsParallel(const TPrecision *knnd) {
+      unsigned int blockSize = (m_sampleCount + kMaxGradientBlocks - 1) / kMaxGradientBlocks;
+      if (blockSize < kBlockSize) {
+        blockSize = kBlockSize;
+      }
+      unsigned int blockCount = (m_sampleCount + blockSize - 1) / blockSize;
+      std::vector<std::vector<unsigned int>> crossing(size_t(blockCount) * blockCount);
+      forEachBlock(m_sampleCount, blockSize, [&](unsigned int begin, unsigned int end) {
+        unsigned int block = begin / blockSize;
+        std::vector<unsigned int> *fromBlock = &crossing[size_t(block) * blockCount];
+        // Edges within the block all go to one unused entry, which keeps the
+        // listing free of branches.
+        std::vector<unsigned int> counts(blockCount, 0);
+        for (size_t edge = size_t(begin) * m_k; edge < size_t(end) * m_k; edge++) {
+          counts[m_knn[edge] / blockSize]++;
+        }
+        counts[block] = 1;
+        std::vector<unsigned int*> cursors(blockCount);
+        for (unsigned int to = 0; to < blockCount; to++) {
+          fromBlock[to].resize(counts[to]);
+          cursors[to] = fromBlock[to].data();
+        }
+        for (unsigned int i = begin; i < end; i++) {
+          for (unsigned int k = 1; k < m_k; k++) {
+            unsigned int edge = i * m_k + k;
+            unsigned int to = m_knn[edge] / blockSize;
+            *cursors[to] = edge;
+            cursors[to] += to != block;
+          }
+        }
+        for (unsigned int to = 0; to < blockCount; to++) {
+          fromBlock[to].resize(cursors[to] - fromBlock[to].data());
+        }
+      });
+
+      forEachBlock(m_sampleCount, blockSize, [&](unsigned int begin, unsigned int end) {
+        unsigned int block = begin / blockSize;
+        // One more entry takes the updates of samples outside the block.
+        std::vector<Steepest> steepest(end - begin + 1, Steepest{0, 0, -1, -1});
+        auto applyCrossing = [&](unsigned int from) {
+          std::vector<unsigned int> &edges = crossing[size_t(from) * blockCount + block];
+          for (unsigned int edge : edges) {
+            int i = edge / m_k;
+            int j = m_knn[edge];
+            double d = sqrt(knnd[edge]);
+            double g = d == 0 ? 0 : (m_y[j] - m_y[i]) / d;
+            updateSteepest(steepest[j - begin], -g, i);
+          }
+          std::vector<unsigned int>().swap(edges);
+        };
+        for (unsigned int from = 0; from < block; from++) {
+          applyCrossing(from);
+        }
+        for (unsigned int i = begin; i < end; i++) {
+          const int *neighbors = &m_knn[size_t(i) * m_k];
+          const TPrecision *dists = &knnd[size_t(i) * m_k];
+          Steepest si = steepest[i - begin];
+          for (unsigned int k = 1; k < m_k; k++) {
+            unsigned int j = neighbors[k];
+            double d = sqrt(dists[k]);
+            double g = d == 0 ? 0 : (m_y[j] - m_y[i]) / d;
+            updateSteepest(si, g, j);
+            updateSteepest(steepest[j >= begin && j < end ? j - begin : end - begin], -g, i);
+          }
+          steepest[i - begin] = si;
+        }
+        for (unsigned int from = block + 1; from < blockCount; from++) {
+          applyCrossing(from);
+        }
+        for (unsigned int i = begin; i < end; i++) {
+          m_ascending[i] = steepest[i - begin].ascending;
+          m_descending[i] = steepest[i - begin].descending;
+        }
+      });
+    };
+
+    // Labels every sample with the extremum its steepest ascent and descent
+    // end in. Extrema are numbered in the order of the first sample whose
+    // path ends in them, which does not depend on the threads.
+    void computeExtrema() {
+      m_max.assign(m_sampleCount, -1);
+      m_min.assign(m_sampleCount, -1);
+      m_extremaIndex.clear();
+      bool parallel = ThreadPool::resolveThreadCount(m_threadCount) > 1;
+      for (int e = 0; e < 2; e++) {
+        std::vector<int> &extrema = e == 0 ? m_max : m_min;
+        const std::vector<int> &next = e == 0 ? m_ascending : m_descending;
+        if (parallel) {
+          labelExtremaParallel(next, extrema);
+        } else {
+          labelExtremaSerial(next, extrema);
+        }
+        if (e == 0) {
+          m_nMax = m_extremaIndex.size();
+        }
+      }
+    };
+
+    // Follows the path of each sample, stopping at the first sample already
+    // labeled.
+    void labelExtremaSerial(const std::vector<int> &next, std::vector<int> &extrema) {
+      std::vector<int> path;
+      for (unsigned int i = 0; i < m_sampleCount; i++) {
+        if (extrema[i] != -1) {
+          continue;
+        }
+        path.clear();
+        int prev = i;
+        while (prev != -1 && extrema[prev] == -1) {
+          path.push_back(prev);
+          prev = next[prev];
+        }
+        int ext;
+        if (prev == -1) {
+          ext = m_extremaIndex.size();
+          m_extremaIndex.push_back(path.back());
+        } else {
+          ext = extrema[prev];
+        }
+        for (int p : path) {
+          extrema[p] = ext;
+        }
+      }
+    };
+
+    // Pointer jumping: every round links each sample to the target of its
+    // target, which halves the remaining path lengths, until all samples link
+    // to the end of their path. Rounds read one array and write the other.
+    void labelExtremaParallel(const std::vector<int> &next, std::vector<int> &extrema) {
+      std::vector<int> target(m_sampleCount);
+      std::vector<int> jumped(m_sampleCount);
+      forEachBlock(m_sampleCount, kBlockSize, [&](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; i++) {
+          target[i] = next[i] == -1 ? int(i) : next[i];
+        }
+      });
+      bool changed = true;
+      while (changed) {
+        std::atomic<bool> anyChanged(false);
+        forEachBlock(m_sampleCount, kBlockSize, [&](unsigned int begin, unsigned int end) {
+          bool blockChanged = false;
+          for (unsigned int i = begin; i < end; i++) {
+            jumped[i] = target[target[i]];
+            blockChanged |= jumped[i] != target[i];
+          }
+          if (blockChanged) {
+            anyChanged.store(true, std::memory_order_relaxed);
+          }
+        });
+        target.swap(jumped);
+        changed = anyChanged.load();
+      }
+
+      // jumped now numbers the path ends.
+      std::fill(jumped.begin(), jumped.end(), -1);
+      for (unsigned int i = 0; i < m_sampleCount; i++) {
+        int &ext = jumped[target[i]];
+        if (ext == -1) {
+          ext = m_extremaIndex.size();
+          m_extremaIndex.push_back(target[i]);
+        }
+        extrema[i] = ext;
+      }
+    };
+
+    // Crystals at persistence zero, numbered in (max, min) order.
+    void computeBaseCrystals() {
+      PairHashMap<int> crystals;
+      m_baseCrystals.clear();
+      m_sampleCrystal.resize(m_sampleCount);
+      for (unsigned int i = 0; i < m_sampleCount; i++) {
+        std::pair<int*, bool> id = crystals.insert(m_max[i], m_min[i], m_baseCrystals.size());
+        if (id.second) {
+          m_baseCrystals.push_back(std::make_pair(m_max[i], m_min[i]));
+        }
+        m_sampleCrystal[i] = *id.first;
+      }
+
+      std::vector<int> order(m_baseCrystals.size());
+      for (unsigned int c = 0; c < order.size(); c++) {
+        order[c] = c;
+      }
+      std::sort(order.begin(), order.end(), [&](int a, int b) {
+        return m_baseCrystals[a] < m_baseCrystals[b];
+      });
+      std::vector<int> rank(order.size());
+      std::vector<std::pair<int, int>> sorted(order.size());
+      for (unsigned int c = 0; c < order.size(); c++) {
+        rank[order[c]] = c;
+        sorted[c] = m_baseCrystals[order[c]];
+      }
+      m_baseCrystals.swap(sorted);
+      for (unsigned int i = 0; i < m_sampleCount; i++) {
+        m_sampleCrystal[i] = rank[m_sampleCrystal[i]];
+      }
+    };
+
+    // Persistence of each pair of neighboring extrema: the difference between
+    // the less significant extremum and the lowest saddle between them. The
+    // saddle between two maxima is the lower end of an edge crossing from one
+    // to the other, between minima the higher end. Each sample first gathers
+    // the best saddle to each extremum around it, so that the shared map is
+    // updated once per extremum rather than once per edge. On noisy functions
+    // most edges cross between extrema, so the gathering avoids branches.
+    std::vector<Merge> computeSaddles() const {
+      PairHashMap<TPrecision> saddles;
+      auto update = [&](int first, int second, TPrecision saddleValue) {
+        orient(first, second);
+        TPrecision extremum = m_y[m_extremaIndex[first]];
+        TPrecision pers = first < m_nMax ? extremum - saddleValue : saddleValue - extremum;
+        std::pair<TPrecision*, bool> saddle = saddles.insert(first, second, pers);
+        if (!saddle.second && pers < *saddle.first) {
+          *saddle.first = pers;
+        }
+      };
+
+      // Best saddle value to each extremum, valid if the extremum was seen at
+      // the current sample, and the extrema seen at the current sample
+      int nExt = m_extremaIndex.size();
+      std::vector<unsigned int> seenAt(nExt, m_sampleCount);
+      std::vector<TPrecision> best(nExt);
+      std::vector<int> maxSeen(m_k);
+      std::vector<int> minSeen(m_k);
+      for (unsigned int i = 0; i < m_sampleCount; i++) {
+        const int *neighbors = &m_knn[size_t(i) * m_k];
+        TPrecision yi = m_y[i];
+        unsigned int nMaxSeen = 0;
+        unsigned int nMinSeen = 0;
+        for (unsigned int k = 1; k < m_k; k++) {
+          int j = neighbors[k];
+          TPrecision yj = m_y[j];
+
+          int e = m_max[j];
+          bool fresh = seenAt[e] != i;
+          TPrecision low = std::min(yi, yj);
+          best[e] = fresh ? low : std::max(best[e], low);
+          seenAt[e] = i;
+          maxSeen[nMaxSeen] = e;
+          nMaxSeen += fresh;
+
+          e = m_min[j];
+          fresh = seenAt[e] != i;
+          TPrecision high = std::max(yi, yj);
+          best[e] = fresh ? high : std::min(best[e], high);
+          seenAt[e] = i;
+          minSeen[nMinSeen] = e;
+          nMinSeen += fresh;
+        }
+        for (unsigned int s = 0; s < nMaxSeen; s++) {
+          if (maxSeen[s] != m_max[i]) {
+            update(m_max[i], maxSeen[s], best[maxSeen[s]]);
+          }
+        }
+        for (unsigned int s = 0; s < nMinSeen; s++) {
+          if (minSeen[s] != m_min[i]) {
+            update(m_min[i], minSeen[s], best[minSeen[s]]);
+          }
+        }
+      }
+
+      std::vector<Merge> edges;
+      edges.reserve(saddles.size());
+      saddles.forEach([&](int first, int second, TPrecision pers) {
+        edges.push_back(Merge{pers, first, second});
+      });
+      std::sort(edges.begin(), edges.end());
+      return edges;
+    };
+
+    // Recursively merge smallest persistence extrema. A pair whose less
+    // significant extremum was merged before is raised by the difference to
+    // the extremum it merged into and merged once its raised persistence
+    // comes up.
+    void computeMerges() {
+      std::vector<Merge> edges = computeSaddles();
+      int nExt = m_extremaIndex.size();
+      UnionFind sets(nExt);
+      std::vector<int> survivor(nExt);
+      for (int e = 0; e < nExt; e++) {
+        survivor[e] = e;
+      }
+
+      std::priority_queue<Merge, std::vector<Merge>, std::greater<Merge>> raised;
+      m_merges.clear();
+      size_t next = 0;
+      while (next < edges.size() || !raised.empty()) {
+        Merge current;
+        if (raised.empty() || (next < edges.size() && !(raised.top() < edges[next]))) {
+          current = edges[next++];
+        } else {
+          current = raised.top();
+          raised.pop();
+        }
+
+        int first = survivor[sets.find(current.first)];
+        int second = survivor[sets.find(current.second)];
+        orient(first, second);
+        if (first == second) {
+          continue;
+        }
+
+        TPrecision diff;
+        if (first < m_nMax) {
+          diff = m_y[m_extremaIndex[first]] - m_y[m_extremaIndex[current.first]];
+        } else {
+          diff = m_y[m_extremaIndex[current.first]] - m_y[m_extremaIndex[first]];
+        }
+        if (diff > 0) {
+          raised.push(Merge{current.persistence + diff, first, second});
+        } else {
+          survivor[sets.unite(sets.find(first), sets.find(second))] = second;
+          m_merges.push_back(Merge{current.persistence, first, second});
+        }
+      }
+    };
+};
+
+#endif
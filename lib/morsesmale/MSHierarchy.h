@@ -0,0 +1,115 @@
+#ifndef MSHIERARCHY_H
+#define MSHIERARCHY_H
+
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseVector.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+
+// Crystals of a Morse-Smale complex at all of its persistence levels,
+// computed once by FlatNNMSComplex::getHierarchy. Every sample belongs to a
+// crystal at the first level, and every level keeps a relabel table from
+// those crystals to its own, so that the crystal of a sample at any level is
+// two array lookups. The tables hold one entry per crystal of the first level,
+// which is far less than one per sample. Each extremum records the level it
+// dies at by merging into a more significant one.
+class MSHierarchy {
+  public:
+    MSHierarchy() {};
+
+    // Number of persistence levels of the complex; tables are kept from the
+    // first level on.
+    unsigned int getLevelCount() const {
+      return m_firstLevel + m_crystalOffsets.size() - 1;
+    };
+
+    unsigned int getFirstLevel() const {
+      return m_firstLevel;
+    };
+
+    bool hasLevel(unsigned int level) const {
+      return level >= m_firstLevel && level < getLevelCount();
+    };
+
+    unsigned int getSampleCount() const {
+      return m_sampleCrystal.size();
+    };
+
+    unsigned int getCrystalCount(unsigned int level) const {
+      unsigned int l = level - m_firstLevel;
+      return m_crystalOffsets[l + 1] - m_crystalOffsets[l];
+    };
+
+    // Crystal of a sample at a level
+    int getCrystal(unsigned int level, unsigned int sample) const {
+      return m_relabel[size_t(level - m_firstLevel) * m_firstCrystalCount + m_sampleCrystal[sample]];
+    };
+
+    // Crystal of each sample at a level
+    FortranLinalg::DenseVector<int> getPartitions(unsigned int level) const {
+      FortranLinalg::DenseVector<int> crys(getSampleCount());
+      const int *relabel = &m_relabel[size_t(level - m_firstLevel) * m_firstCrystalCount];
+      for (unsigned int i = 0; i < crys.N(); i++) {
+        crys(i) = relabel[m_sampleCrystal[i]];
+      }
+      return crys;
+    };
+
+    // Samples of the maximum (first row) and minimum (second row) of each
+    // crystal at a level
+    FortranLinalg::DenseMatrix<int> getCrystals(unsigned int level) const {
+      unsigned int l = level - m_firstLevel;
+      FortranLinalg::DenseMatrix<int> ce(2, getCrystalCount(level));
+      for (unsigned int c = 0; c < ce.N(); c++) {
+        ce(0, c) = m_crystals[m_crystalOffsets[l] + c].first;
+        ce(1, c) = m_crystals[m_crystalOffsets[l] + c].second;
+      }
+      return ce;
+    };
+
+    // Level from which on the extremum is merged into getExtremumParent(), or
+    // getLevelCount() if it survives all levels. Extrema are numbered as in
+    // the complex, maxima first.
+    unsigned int getExtremumDeath(int extremum) const {
+      return m_extremumDeath[extremum];
+    };
+
+    int getExtremumParent(int extremum) const {
+      return m_extremumParent[extremum];
+    };
+
+    // Sample of an extremum
+    int getExtremumSample(int extremum) const {
+      return m_extremumSample[extremum];
+    };
+
+    size_t byteSize() const {
+      return sizeof(int) * (m_sampleCrystal.size() + m_relabel.size() + m_extremumDeath.size() +
+                            m_extremumParent.size() + m_extremumSample.size()) +
+             sizeof(size_t) * m_crystalOffsets.size() +
+             sizeof(std::pair<int, int>) * m_crystals.size();
+    };
+
+  private:
+    template<typename TPrecision> friend class FlatNNMSComplex;
+
+    unsigned int m_firstLevel = 0;
+    // Crystal at the first level of each sample
+    std::vector<int> m_sampleCrystal;
+    unsigned int m_firstCrystalCount = 0;
+    // Crystal of each crystal of the first level, level by level
+    std::vector<int> m_relabel;
+    // Samples of the (max, min) of each crystal, level by level, and where
+    // each level starts, followed by the end of the last level
+    std::vector<std::pair<int, int>> m_crystals;
+    std::vector<size_t> m_crystalOffsets;
+
+    std::vector<unsigned int> m_extremumDeath;
+    std::vector<int> m_extremumParent;
+    std::vector<int> m_extremumSample;
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include "flinalg/DenseMatrix.h"
 #include "flinalg/DenseVector.h"
 #include "flinalg/Linalg.h"
+#include "graph/KNNBackend.h"
 #include "metrics/Distance.h"
 #include "metrics/EuclideanMetric.h"
 #include "metrics/SquaredEuclideanMetric.h"
@@ -84,32 +85,36 @@ class NNMSComplex {
     };
 
     int followChain(int i){
-      while(merge(i) != i){
-        i = merge(i);
+      return followChain(merge, i);
+    };
+
+    int followChain(FortranLinalg::DenseVector<int> &mergeChain, int i){
+      while(mergeChain(i) != i){
+        i = mergeChain(i);
       }
       return i;
     };
 
 
     //compute crystals based on merge chain
-    void mergeCrystals(){
+    void mergeCrystals(FortranLinalg::DenseVector<int> &mergeChain, map_pi_i &merged){
       //initalize simplified crystals to original crystal assignments
       int nCrystals = 0;
       //reassign crystals based on merge chain
-      pcrystals.clear();
+      merged.clear();
       for (map_pi_i_it it = crystals.begin(); it != crystals.end(); ++it) {
         std::pair<int, int> p = (*it).first;
         
         
         //follow merge chains for min and max
-        p.first = merge(p.first);
-        p.second = merge(p.second);
+        p.first = mergeChain(p.first);
+        p.second = mergeChain(p.second);
         
         //check if we created a new crystal otherwise assign to existing
         //crystal
-        map_pi_i_it ito = pcrystals.find(p);
-        if(ito == pcrystals.end()){
-          pcrystals[p] = nCrystals;
+        map_pi_i_it ito = merged.find(p);
+        if(ito == merged.end()){
+          merged[p] = nCrystals;
           nCrystals++;
         }
       }
@@ -117,6 +122,19 @@ class NNMSComplex {
 
   public:
 
+    //Merge chain and merged crystals for one persistence level. Each caller
+    //holding its own state can query a different persistence level of the
+    //same complex concurrently; the state owns its merge vector and must be
+    //released with cleanup().
+    struct MergeState {
+      FortranLinalg::DenseVector<int> merge;
+      map_pi_i pcrystals;
+
+      void cleanup(){
+        merge.deallocate();
+      };
+    };
+
 
     NNMSComplex(FortranLinalg::DenseMatrix<TPrecision> &distances,                
                 FortranLinalg::DenseVector<TPrecision> &yin,
@@ -144,9 +162,26 @@ class NNMSComplex {
 
 
  
+    // Complex from precomputed nearest neighbors (neighbors and distances of
+    // every sample, sorted by distance, as from Distance::findKNN). Both are
+    // copied.
+    NNMSComplex(FortranLinalg::DenseMatrix<int> &knn,
+                FortranLinalg::DenseMatrix<TPrecision> &knnDists,
+                FortranLinalg::DenseVector<TPrecision> &yin,
+                bool smooth = false, double sigma2=0) : y(yin) {
+      m_sampleCount = knn.N();
+      KNN = FortranLinalg::Linalg<int>::Copy(knn);
+      KNND = FortranLinalg::Linalg<TPrecision>::Copy(knnDists);
+      runMS(smooth, sigma2);
+      KNND.deallocate();
+    };
+
+
+ 
     NNMSComplex(FortranLinalg::DenseMatrix<TPrecision> &Xin, 
                 FortranLinalg::DenseVector<TPrecision> &yin, 
-                int knn, bool smooth = false, double eps=0.01, double sigma2=0) : X(Xin), y(yin){
+                int knn, bool smooth = false, double eps=0.01, double sigma2=0,
+                const KNNBackend<TPrecision> *backend = nullptr) : X(Xin), y(yin){
       m_sampleCount = X.N();
       if (knn > (int) m_sampleCount) {
         knn = m_sampleCount;
@@ -154,10 +189,13 @@ class NNMSComplex {
       KNN = FortranLinalg::DenseMatrix<int>(knn, m_sampleCount);
       KNND = FortranLinalg::DenseMatrix<TPrecision>(knn, m_sampleCount);
 
-      //Compute nearest nieghbors
-      //ANNWrapper<TPrecision>::computeANN(X, KNN, KNND, eps);
-      SquaredEuclideanMetric<TPrecision> dist;
-      Distance<TPrecision>::computeKNN(X, KNN, KNND, dist);
+      //Compute nearest nieghbors, squared distances as SquaredEuclideanMetric
+      if (backend != nullptr) {
+        backend->findKNN(X, KNN, KNND, true);
+      } else {
+        SquaredEuclideanMetric<TPrecision> dist;
+        Distance<TPrecision>::computeKNN(X, KNN, KNND, dist);
+      }
 
       // std::cout << "KNND[" << KNND.M() << "," << KNND.N() << "]" << std::endl;
       // for (unsigned int i = 0; i < KNND.M() && i < 5; i++) {
@@ -179,37 +217,17 @@ class NNMSComplex {
     //extrema with a absolute difference between saddle and lower exterma
     //smaller than pLevel, are recursively joined into a single extrema.
     void mergePersistence(TPrecision pLevel){
-      //compute merge chain 
-      for(unsigned int i=0; i<merge.N(); i++){
-        merge(i) = i;
-      } 
-      
+      mergePersistence(pLevel, merge, pcrystals);
+    };
 
-  
-      for(map_f_pi_it it = persistence.begin(); it != persistence.end() && (*it).first < pLevel; ++it){
-        std::pair<int, int> p = (*it).second;        
-        p.first = followChain(p.first);
-        p.second = followChain(p.second);
-        if(p.first < nMax){
-          if( y(extremaIndex(p.first)) > y(extremaIndex(p.second)) ){ 
-            std::swap(p.second, p.first); 
-          }
-        }
-        else{
-          if( y(extremaIndex(p.first)) < y(extremaIndex(p.second)) ){ 
-            std::swap(p.second, p.first);
-          }
-        }
-        merge(p.first) = p.second;
+    //Same as above, but stores the result in the given merge state and leaves
+    //the complex itself untouched.
+    void mergePersistence(TPrecision pLevel, MergeState &state){
+      if(state.merge.N() != merge.N()){
+        state.cleanup();
+        state.merge = FortranLinalg::DenseVector<int>(merge.N());
       }
-      for(unsigned int i=0; i<merge.N(); i++){
-        merge(i) = followChain(i);
-      }
-
-
-      //compute crystals based on merge chain
-      mergeCrystals();
-      
+      mergePersistence(pLevel, state.merge, state.pcrystals);
     };
 
    
@@ -227,10 +245,13 @@ class NNMSComplex {
 
 
     void getPartitions(FortranLinalg::DenseVector<int> &crys){
-      for(unsigned int i = 0; i < m_sampleCount; i++){
-        std::pair<int, int> p( merge(extrema(0, i)), merge(extrema(1, i)) );
-        crys(i) = pcrystals[p];
-      }
+      getPartitions(merge, pcrystals, crys);
+    };
+
+    FortranLinalg::DenseVector<int> getPartitions(MergeState &state){
+      FortranLinalg::DenseVector<int> crys(m_sampleCount);
+      getPartitions(state.merge, state.pcrystals, crys);
+      return crys;
     };
 
 
@@ -252,11 +273,13 @@ class NNMSComplex {
 
 
     void getCrystals(FortranLinalg::DenseMatrix<int> ce){
-     for(map_pi_i_it it = pcrystals.begin(); it != pcrystals.end(); ++it){
-        std::pair<int, int> p = (*it).first;
-        ce(0, (*it).second) = extremaIndex(p.first);
-        ce(1, (*it).second) = extremaIndex(p.second);
-      }
+      getCrystals(pcrystals, ce);
+    };
+
+    FortranLinalg::DenseMatrix<int> getCrystals(MergeState &state){
+       FortranLinalg::DenseMatrix<int> e(2, state.pcrystals.size());
+       getCrystals(state.pcrystals, e);
+       return e;
     };
 
 
@@ -307,6 +330,57 @@ class NNMSComplex {
     };
 
 private:
+    void mergePersistence(TPrecision pLevel, FortranLinalg::DenseVector<int> &mergeChain,
+                          map_pi_i &merged){
+      //compute merge chain 
+      for(unsigned int i=0; i<mergeChain.N(); i++){
+        mergeChain(i) = i;
+      } 
+      
+
+  
+      for(map_f_pi_it it = persistence.begin(); it != persistence.end() && (*it).first < pLevel; ++it){
+        std::pair<int, int> p = (*it).second;        
+        p.first = followChain(mergeChain, p.first);
+        p.second = followChain(mergeChain, p.second);
+        if(p.first < nMax){
+          if( y(extremaIndex(p.first)) > y(extremaIndex(p.second)) ){ 
+            std::swap(p.second, p.first); 
+          }
+        }
+        else{
+          if( y(extremaIndex(p.first)) < y(extremaIndex(p.second)) ){ 
+            std::swap(p.second, p.first);
+          }
+        }
+        mergeChain(p.first) = p.second;
+      }
+      for(unsigned int i=0; i<mergeChain.N(); i++){
+        mergeChain(i) = followChain(mergeChain, i);
+      }
+
+
+      //compute crystals based on merge chain
+      mergeCrystals(mergeChain, merged);
+      
+    };
+
+    void getPartitions(FortranLinalg::DenseVector<int> &mergeChain, map_pi_i &merged,
+                       FortranLinalg::DenseVector<int> &crys){
+      for(unsigned int i = 0; i < m_sampleCount; i++){
+        std::pair<int, int> p( mergeChain(extrema(0, i)), mergeChain(extrema(1, i)) );
+        crys(i) = merged[p];
+      }
+    };
+
+    void getCrystals(map_pi_i &merged, FortranLinalg::DenseMatrix<int> &ce){
+     for(map_pi_i_it it = merged.begin(); it != merged.end(); ++it){
+        std::pair<int, int> p = (*it).first;
+        ce(0, (*it).second) = extremaIndex(p.first);
+        ce(1, (*it).second) = extremaIndex(p.second);
+      }
+    };
+
     void runMS(bool smooth, double sigma2) {
       int knn = KNN.M();
 
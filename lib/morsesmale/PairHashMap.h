@@ -0,0 +1,127 @@
+#ifndef PAIRHASHMAP_H
+#define PAIRHASHMAP_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+// Open addressing hash map from pairs of non-negative ints, such as the
+// (max, min) extrema of a crystal, to values. Both ints are packed into one
+// 64 bit key, which is placed by Fibonacci hashing and probed linearly in a
+// power of two table that is kept at most half full. Pairs cannot be removed.
+template<typename TValue>
+class PairHashMap {
+  public:
+    explicit PairHashMap(size_t expectedSize = 0) {
+      reserve(expectedSize);
+    };
+
+    size_t size() const {
+      return m_size;
+    };
+
+    // Removes all pairs but keeps the table.
+    void clear() {
+      for (Slot &slot : m_slots) {
+        slot.key = kEmpty;
+      }
+      m_size = 0;
+    };
+
+    // Grows the table to hold the given number of pairs without rehashing.
+    void reserve(size_t expectedSize) {
+      size_t capacity = kMinCapacity;
+      while (capacity < 2 * expectedSize) {
+        capacity *= 2;
+      }
+      if (capacity > m_slots.size()) {
+        rehash(capacity);
+      }
+    };
+
+    // Inserts the pair with the given value unless it is present already.
+    // Returns the value stored for the pair, which stays valid until the next
+    // insertion, and whether the pair was inserted.
+    std::pair<TValue*, bool> insert(int first, int second, const TValue &value) {
+      if (2 * (m_size + 1) > m_slots.size()) {
+        rehash(2 * m_slots.size());
+      }
+      uint64_t key = pack(first, second);
+      size_t index = slot(key);
+      while (m_slots[index].key != kEmpty) {
+        if (m_slots[index].key == key) {
+          return std::make_pair(&m_slots[index].value, false);
+        }
+        index = (index + 1) & m_mask;
+      }
+      m_slots[index].key = key;
+      m_slots[index].value = value;
+      m_size++;
+      return std::make_pair(&m_slots[index].value, true);
+    };
+
+    // Value stored for the pair, or NULL if the pair is not present.
+    TValue *find(int first, int second) {
+      uint64_t key = pack(first, second);
+      for (size_t index = slot(key); m_slots[index].key != kEmpty; index = (index + 1) & m_mask) {
+        if (m_slots[index].key == key) {
+          return &m_slots[index].value;
+        }
+      }
+      return NULL;
+    };
+
+    // Calls f(first, second, value) for every pair, in no particular order.
+    template<typename F>
+    void forEach(F f) const {
+      for (const Slot &slot : m_slots) {
+        if (slot.key != kEmpty) {
+          f(int(slot.key >> 32), int(slot.key & 0xffffffffu), slot.value);
+        }
+      }
+    };
+
+  private:
+    struct Slot {
+      uint64_t key;
+      TValue value;
+    };
+
+    static const uint64_t kEmpty = ~uint64_t(0);
+    static const size_t kMinCapacity = 16;
+
+    static uint64_t pack(int first, int second) {
+      return (uint64_t(uint32_t(first)) << 32) | uint32_t(second);
+    };
+
+    size_t slot(uint64_t key) const {
+      return size_t((key * 0x9E3779B97F4A7C15ull) >> m_shift);
+    };
+
+    void rehash(size_t capacity) {
+      std::vector<Slot> old(capacity, Slot{kEmpty, TValue()});
+      old.swap(m_slots);
+      m_mask = capacity - 1;
+      m_shift = 64;
+      for (size_t c = capacity; c > 1; c /= 2) {
+        m_shift--;
+      }
+      for (const Slot &s : old) {
+        if (s.key != kEmpty) {
+          size_t index = slot(s.key);
+          while (m_slots[index].key != kEmpty) {
+            index = (index + 1) & m_mask;
+          }
+          m_slots[index] = s;
+        }
+      }
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_size = 0;
+    size_t m_mask = 0;
+    unsigned int m_shift = 64;
+};
+
+#endif
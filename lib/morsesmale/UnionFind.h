@@ -0,0 +1,63 @@
+#ifndef UNIONFIND_H
+#define UNIONFIND_H
+
+#include <numeric>
+#include <utility>
+#include <vector>
+
+
+// Disjoint sets over the integers 0..n-1, with union by rank and path
+// compression.
+class UnionFind {
+  public:
+    explicit UnionFind(unsigned int n = 0) {
+      reset(n);
+    };
+
+    // Puts every element back into a set of its own.
+    void reset(unsigned int n) {
+      m_parent.resize(n);
+      std::iota(m_parent.begin(), m_parent.end(), 0);
+      m_rank.assign(n, 0);
+    };
+
+    unsigned int size() const {
+      return m_parent.size();
+    };
+
+    // Root of the set containing i. Every element on the way is linked
+    // directly to the root.
+    int find(int i) {
+      int root = i;
+      while (m_parent[root] != root) {
+        root = m_parent[root];
+      }
+      while (m_parent[i] != root) {
+        int next = m_parent[i];
+        m_parent[i] = root;
+        i = next;
+      }
+      return root;
+    };
+
+    // Joins the sets of the roots a and b and returns the root of the joined
+    // set, which is either a or b.
+    int unite(int a, int b) {
+      if (a == b) {
+        return a;
+      }
+      if (m_rank[a] < m_rank[b]) {
+        std::swap(a, b);
+      } else if (m_rank[a] == m_rank[b]) {
+        m_rank[a]++;
+      }
+      m_parent[b] = a;
+      return a;
+    };
+
+  private:
+    std::vector<int> m_parent;
+    std::vector<unsigned char> m_rank;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "ModelCache.h"
+
+#include <iostream>
+
+namespace dspacex {
+
+// models are read ahead of time on this many threads
+const unsigned kPrefetchThreads = 2;
+
+ModelCache::ModelCache(size_t byteBudget) : budget(byteBudget), prefetcher(kPrefetchThreads)
+{}
+
+ModelCache& ModelCache::instance()
+{
+  static ModelCache cache;
+  return cache;
+}
+
+std::shared_ptr<const Model> ModelCache::get(const std::string &key, const Loader &load)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  auto found = index.find(key);
+  if (found != index.end())
+  {
+    entries.splice(entries.begin(), entries, found->second);
+    hits++;
+    return found->second->model;
+  }
+
+  // if it's already being read (e.g., prefetched), wait for that rather than reading it again
+  auto pending = reading.find(key);
+  if (pending != reading.end())
+  {
+    PendingModel model(pending->second);
+    hits++;
+    lock.unlock();
+    return model.get();
+  }
+
+  misses++;
+  std::promise<std::shared_ptr<const Model>> promise;
+  reading[key] = promise.get_future().share();
+  lock.unlock();
+  return read(key, load, promise);
+}
+
+void ModelCache::prefetch(const std::string &key, Loader load)
+{
+  auto promise = std::make_shared<std::promise<std::shared_ptr<const Model>>>();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (index.count(key) || reading.count(key))
+      return;
+    prefetches++;
+    reading[key] = promise->get_future().share();
+  }
+  prefetcher.submit([this, key, load, promise]() {
+    try {
+      read(key, load, *promise);
+    } catch (const std::exception &e) {
+      std::cout << "Failed to prefetch model " << key << ": " << e.what() << std::endl;
+    }
+  });
+}
+
+// reads the model of the key, which must be marked as being read, and caches it, handing it
+// (or the error reading it) to whoever waits for it as well
+std::shared_ptr<const Model> ModelCache::read(const std::string &key, const Loader &load,
+                                              std::promise<std::shared_ptr<const Model>> &promise)
+{
+  std::shared_ptr<const Model> model;
+  try {
+    model = load();
+  } catch (...) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      reading.erase(key);
+    }
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    reading.erase(key);
+    entries.push_front(Entry{ key, model, model->byteSize() });
+    index[key] = entries.begin();
+    bytes += entries.front().bytes;
+    evict();
+  }
+  promise.set_value(model);
+  return model;
+}
+
+void ModelCache::setBudget(size_t byteBudget)
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  budget = byteBudget;
+  evict();
+}
+
+void ModelCache::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  index.clear();
+  bytes = 0;
+}
+
+ModelCache::Stats ModelCache::getStats() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return Stats{ budget, bytes, entries.size(), hits, misses, prefetches, evictions };
+}
+
+// drops least recently used models until the rest fit the budget, but always keeps the most
+// recently used one, so a model larger than the budget is still kept while it's in use
+void ModelCache::evict()
+{
+  while (bytes > budget && entries.size() > 1)
+  {
+    const Entry &entry = entries.back();
+    bytes -= entry.bytes;
+    index.erase(entry.key);
+    entries.pop_back();
+    evictions++;
+  }
+}
+
+} // dspacex
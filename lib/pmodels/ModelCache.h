@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Models.h"
+#include "utils/ThreadPool.h"
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace dspacex {
+
+// Least recently used cache of the predictive models of all loaded datasets, keyed by the
+// directory each was read from. Models are accounted by the bytes of their matrices; once the
+// total exceeds the budget, the least recently used ones are dropped. Those still in use stay
+// valid until their last user lets go of them. A model is read once even if it's asked for from
+// several threads at the same time, and models can be read ahead of time on a background thread.
+// The same model is handed to every thread that asks for it, so models can't be modified once
+// read; a model is bound to the values of its field per use instead (see BoundModel).
+class ModelCache
+{
+public:
+  typedef std::function<std::shared_ptr<const Model>()> Loader;
+
+  struct Stats
+  {
+    size_t budget;
+    size_t bytes;
+    size_t entries;
+    size_t hits;
+    size_t misses;
+    size_t prefetches;
+    size_t evictions;
+  };
+
+  static const size_t kDefaultBytes = size_t(1024) << 20;
+
+  explicit ModelCache(size_t byteBudget = kDefaultBytes);
+
+  // the cache shared by all M-S complexes
+  static ModelCache& instance();
+
+  // returns the model of the key and marks it most recently used, reading it with load if it
+  // isn't cached (or waiting for it if it's already being read); rethrows errors of load
+  std::shared_ptr<const Model> get(const std::string &key, const Loader &load);
+
+  // reads the model of the key on a background thread unless it's cached or being read
+  void prefetch(const std::string &key, Loader load);
+
+  void setBudget(size_t byteBudget);
+  void clear();
+
+  Stats getStats() const;
+
+private:
+  struct Entry
+  {
+    std::string key;
+    std::shared_ptr<const Model> model;
+    size_t bytes;
+  };
+
+  typedef std::shared_future<std::shared_ptr<const Model>> PendingModel;
+  typedef std::list<Entry> EntryList;
+
+  std::shared_ptr<const Model> read(const std::string &key, const Loader &load,
+                                    std::promise<std::shared_ptr<const Model>> &promise);
+  void evict();
+
+  EntryList entries;  // most recently used first
+  std::map<std::string, EntryList::iterator> index;
+  std::map<std::string, PendingModel> reading;
+  mutable std::mutex mutex;
+  size_t budget;
+  size_t bytes = 0;
+  size_t hits = 0;
+  size_t misses = 0;
+  size_t prefetches = 0;
+  size_t evictions = 0;
+
+  ThreadPool prefetcher;  // last, so it finishes its reads before the rest of the cache is gone
+};
+
+} // dspacex
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <set>
 #include <vector>
 #include <iostream>
 #include <Eigen/Core>
 #include "imageutils/Image.h"
+#include "utils/CancellationToken.h"
 
 namespace dspacex {
 
@@ -45,14 +47,15 @@ public:
     sample_indices.push_back(n);
   }
 
-  const unsigned numSamples() const
+  // bytes taken by the model's matrices
+  size_t byteSize() const
   {
-    return sample_indices.size();
+    return sizeof(double) * (W.size() + w0.size() + Z.size());
   }
 
-  const std::vector<ValueIndexPair>& getSampleIndices() const
+  const unsigned numSamples() const
   {
-    return fieldvalues_and_indices;
+    return sample_indices.size();
   }
 
   const Eigen::VectorXd getZCoord(const unsigned global_idx) const
@@ -74,13 +77,37 @@ public:
     return fieldname;
   }
 
-  void setFieldValues(Eigen::Map<Eigen::VectorXd> values)
+private:
+  // Shapeodds model 
+  std::vector<unsigned> sample_indices;        // indices of images used to construct this model
+  Eigen::MatrixXd Z;                        // ALL latent space coordinates of the dataset (todo: don't store these in the model)
+  Eigen::MatrixXd W;
+  Eigen::MatrixXd w0;
+
+  std::string fieldname;
+
+  friend class ShapeOdds;
+  friend class BoundModel;
+};
+
+
+///////////////////////////////////////////////////////////////////////////////
+// A model bound to the values of its field, from which new latent space coordinates are
+// regressed for new field values. It's built for each request rather than stored in the model,
+// so a model shared by several requests at once is never modified; the model must outlive it.
+class BoundModel
+{
+public:
+  typedef Model::ValueIndexPair ValueIndexPair;
+
+  // values holds the field value of every sample of the dataset
+  BoundModel(const Model &m, Eigen::Map<Eigen::VectorXd> values) : model(m)
   {
-    fieldvalues_and_indices.resize(sample_indices.size());
-    fieldvalues.resize(sample_indices.size());
+    fieldvalues_and_indices.resize(model.sample_indices.size());
+    fieldvalues.resize(model.sample_indices.size());
     {
       unsigned i = 0;
-      for (auto idx : sample_indices)
+      for (auto idx : model.sample_indices)
       {
         fieldvalues_and_indices[i].idx = idx;
         fieldvalues_and_indices[i].val = values(idx);
@@ -88,20 +115,30 @@ public:
       }
     }
 
-    // sort by increasing fieldvalue... TODO: maybe addSample should add its corresponding field value rather than this awkward fcn
+    // sort by increasing fieldvalue
     std::sort(fieldvalues_and_indices.begin(), fieldvalues_and_indices.end(), ValueIndexPair::compare);
 
-    // TODO: odd place to put this... the reason is that the sample_indices aren't there when the model is set above
-    z_coords.resize(sample_indices.size(), Z.cols());
+    z_coords.resize(model.sample_indices.size(), model.Z.cols());
     {
       unsigned i = 0;
-      for (auto idx : sample_indices)
+      for (auto idx : model.sample_indices)
       {
-        z_coords.row(i++) = Z.row(idx);
+        z_coords.row(i++) = model.Z.row(idx);
       }
     }
   }
 
+  const Model& getModel() const
+  {
+    return model;
+  }
+
+  // the model's samples sorted by increasing field value
+  const std::vector<ValueIndexPair>& getSampleIndices() const
+  {
+    return fieldvalues_and_indices;
+  }
+
   double minFieldValue() const
   {
     return fieldvalues.minCoeff();
@@ -154,19 +191,26 @@ public:
     return output;
   }
 
-private:
-  // Shapeodds model 
-  std::vector<unsigned> sample_indices;        // indices of images used to construct this model
-  Eigen::MatrixXd z_coords;                 // latent space coordinates of samples used to learn this model
-  Eigen::MatrixXd Z;                        // ALL latent space coordinates of the dataset (todo: don't store these in the model)
-  Eigen::MatrixXd W;
-  Eigen::MatrixXd w0;
+  // gaussian kernel regression of a new latent space coordinate for each of the given field
+  // values at once, one per row of the result (the batched form of getNewLatentSpaceValue)
+  const Eigen::MatrixXd getNewLatentSpaceValues(const Eigen::VectorXd &new_fieldvals, double sigma = 0.25) const
+  {
+    using namespace Eigen;
 
-  std::string fieldname;
-  Eigen::RowVectorXd fieldvalues;  
-  std::vector<ValueIndexPair> fieldvalues_and_indices;  //TODO: this feels pretty hokey...
+    // weight of each training sample (column) for each new field value (row); the constant
+    // factor of the Gaussian is left out as it is divided out by the normalization below
+    MatrixXd weights = (new_fieldvals.replicate(1, fieldvalues.size()).rowwise() - fieldvalues).array().square();
+    weights = (weights.array() / (-2.0 * sigma * sigma)).exp();
+    weights.array().colwise() /= weights.rowwise().sum().array();
 
-  friend class ShapeOdds;
+    return weights * z_coords;
+  }
+
+private:
+  const Model &model;
+  Eigen::MatrixXd z_coords;        // latent space coordinates of samples used to learn the model
+  Eigen::RowVectorXd fieldvalues;  // field values of the same samples
+  std::vector<ValueIndexPair> fieldvalues_and_indices;
 };
 
 
@@ -182,6 +226,13 @@ public:
                                  const unsigned p, const unsigned c, const unsigned z_idx, const Image &sampleImage,
                                  const bool writeToDisk = false, const std::string path = "");
 
+  // evaluates the model at every row of Z as a single matrix product, returning one 8-bit
+  // greyscale w x h PNG image per latent space coordinate, encoded on several threads; throws
+  // OperationCancelled once the token, if any, is cancelled
+  static std::vector<Image> evaluateModelImages(const Model &model, const Eigen::MatrixXd &Z,
+                                                unsigned w, unsigned h,
+                                                const CancellationToken *cancellation = nullptr);
+
 private:
   std::vector<Model> models;
 };
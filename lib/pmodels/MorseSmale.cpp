@@ -1,5 +1,7 @@
 #include "MorseSmale.h"
 
+#include <set>
+
 namespace dspacex {
 
 bool MSComplex::hasModel(unsigned persistence, unsigned crystal) const
@@ -8,13 +10,16 @@ bool MSComplex::hasModel(unsigned persistence, unsigned crystal) const
            crystal >= persistence_levels[persistence].numCrystals());
 }
 
+// returns the model of the crystal, reading it if it isn't in the model cache
 ModelPair MSComplex::getModel(unsigned persistence, unsigned crystal)
 {
   if (!hasModel(persistence, crystal))
     throw std::runtime_error("Requested model persistence / crystal index is out of range");
-      
-  return ModelPair(modelName(persistence, crystal),
-                   persistence_levels[persistence].getCrystal(crystal).getModel());
+
+  const MSCrystal &c = persistence_levels[persistence].getCrystal(crystal);
+  auto model = ModelCache::instance().get(c.getModelPath(), modelLoader(persistence, crystal));
+  prefetchNeighbors(persistence, crystal);
+  return ModelPair(modelName(persistence, crystal), model);
 }
 
 std::vector<ModelPair> MSComplex::getAllModels()
@@ -27,11 +32,55 @@ std::vector<ModelPair> MSComplex::getAllModels()
     unsigned crystals_padding = persistence_levels[p].numCrystals();
     for (unsigned c = 0; c < persistence_levels[p].numCrystals(); c++)
     {
-      models.push_back(ModelPair(modelName(p,c,persistence_padding,crystals_padding),
-                                 persistence_levels[p].getCrystal(c).getModel()));
+      auto model = ModelCache::instance().get(persistence_levels[p].getCrystal(c).getModelPath(), modelLoader(p, c));
+      models.push_back(ModelPair(modelName(p,c,persistence_padding,crystals_padding), model));
     }
   }
   return models;
 }
 
+// creates the function that reads the model of a crystal; it only copies what it needs, so it may
+// still run (prefetching) after this complex is gone
+ModelCache::Loader MSComplex::modelLoader(unsigned persistence, unsigned crystal) const
+{
+  if (!read_model)
+    throw std::runtime_error("No reader set for the models of the M-S complex of " + fieldname);
+
+  const MSCrystal &c = persistence_levels[persistence].getCrystal(crystal);
+  ModelReader read(read_model);
+  std::string path(c.getModelPath()), field(fieldname);
+  std::vector<unsigned> samples(c.getSamples());
+  return [read, path, field, samples]() {
+    auto model = std::make_shared<Model>();
+    model->setFieldname(field); // <ctc> see TODOs in dspacex::Model
+    read(path, *model);
+    for (auto n : samples)
+      model->addSample(n);
+    return model;
+  };
+}
+
+// starts reading the models of the crystals at the adjacent persistence levels that share samples
+// with this crystal: the one it merges into and the ones it splits into
+void MSComplex::prefetchNeighbors(unsigned persistence, unsigned crystal) const
+{
+  const MSCrystal &c = persistence_levels[persistence].getCrystal(crystal);
+  for (int neighbor_persistence : { int(persistence) - 1, int(persistence) + 1 })
+  {
+    if (neighbor_persistence < 0 || unsigned(neighbor_persistence) >= persistence_levels.size())
+      continue;
+
+    const MSPersistenceLevel &P = persistence_levels[neighbor_persistence];
+    std::set<unsigned> neighbors;
+    for (auto n : c.getSamples())
+    {
+      int neighbor = P.crystalOfSample(n);
+      if (neighbor >= 0 && unsigned(neighbor) < P.numCrystals())
+        neighbors.insert(neighbor);
+    }
+    for (auto neighbor : neighbors)
+      ModelCache::instance().prefetch(P.getCrystal(neighbor).getModelPath(), modelLoader(neighbor_persistence, neighbor));
+  }
+}
+
 } // dspacex
@@ -3,6 +3,10 @@
 #include "dspacex/Precision.h"
 #include "utils/StringUtils.h"
 #include "Models.h"
+#include "ModelCache.h"
+
+#include <functional>
+#include <memory>
 
 namespace dspacex {
 
@@ -13,7 +17,7 @@ namespace dspacex {
 //
 //  MSModelContainer knows the total number of samples for this M-S, contains its set of Persistence levels
 //   - Persistences contains set of Crystals and their global embeddings (common 2d latent space for all crystals at that level)
-//     - Crystal contains its model, which contains indices of its samples and its local embedding (latent space), along with W and w0.
+//     - Crystal contains the indices of its samples and the location of its model, which contains its local embedding (latent space), along with W and w0.
 //
 // Looking forward...
 //      There could be different models associated with a given crystal (e.g., ShapeOdds or SharedGP of various types),
@@ -29,33 +33,35 @@ class MSCrystal
 public:
   void addSample(unsigned n)
   {
-    model.addSample(n);
+    sample_indices.push_back(n);
   }
 
   unsigned numSamples() const
   {
-    return model.numSamples();
+    return sample_indices.size();
   }
 
-  const std::vector<Model::ValueIndexPair>& getSampleIndices() const
+  const std::vector<unsigned>& getSamples() const
   {
-    return model.getSampleIndices();
+    return sample_indices;
   }
 
-  Model& getModel() //todo: return by model type since a crystal can have more than one model. Maybe have to return a pointer in case model doesn't exist. Could a crystal have more than one of the same type of model? Seems possible since differently-constructed models may want to be compared.
+  // the crystal's model is only read from here once it's asked for (see MSComplex::getModel)
+  void setModelPath(const std::string &path)
   {
-    return model;  //todo: which model?
+    model_path = path;
+  }
+
+  const std::string& getModelPath() const
+  {
+    return model_path;
   }
-  
-  // void addModel(Model &m)
-  // {
-  //   models.append(m)
-  // }
 
 private:
   // todo: there can be more than one model per crystal (say, one per qoi and one per design param and one per image/dt
   // todo: the crystal probably shouldn't own the model(s) since they're technically independent of the crystal
-  Model model;
+  std::vector<unsigned> sample_indices;  // indices of the samples in this crystal, used to learn its model
+  std::string model_path;                // directory of its model's files
 };
 
 class MSPersistenceLevel
@@ -75,6 +81,11 @@ public:
   {
     return crystals[i];
   }
+
+  const MSCrystal& getCrystal(unsigned i) const
+  {
+    return crystals[i];
+  }
   
   void setGlobalEmbeddings(const Eigen::MatrixXd &embeddings)
   {
@@ -86,25 +97,43 @@ public:
   {
     // NOTE: all crystals must have been added or these crystal ids will be out of range      
 
-    for (unsigned n = 0; n < crystal_ids.rows(); n++)
+    sample_crystals.resize(crystal_ids.size());
+    for (unsigned n = 0; n < crystal_ids.size(); n++)
     {
       crystals[crystal_ids(n)].addSample(n);
+      sample_crystals[n] = crystal_ids(n);
     }
   }
 
+  // crystal to which the given sample belongs at this persistence level, -1 if unknown
+  int crystalOfSample(unsigned n) const
+  {
+    return n < sample_crystals.size() ? sample_crystals[n] : -1;
+  }
+
 private:
   std::vector<MSCrystal> crystals;
+  std::vector<unsigned> sample_crystals;
   Eigen::MatrixXd global_embeddings;
 };
 
 
 // Associates a model with it's name (pXXcYY) // todo: this is an issue because there could be more than one model with the same name (in another MSComplex)
-typedef std::pair<std::string, Model&> ModelPair;
+typedef std::pair<std::string, std::shared_ptr<const Model>> ModelPair;
 
 // Morse-Smale model container, a M-S complex for a given field and the models learned for each of its crystals.
+//
+// Models are large (an image model has a weight per pixel per latent dimension), so they're only
+// read when first asked for and are kept in the ModelCache, shared by all complexes, from which
+// the least recently used ones are dropped. Asking for a crystal's model also starts reading the
+// models of the crystals it merges into or splits into at the adjacent persistence levels, which
+// are likely to be asked for next.
 class MSComplex
 {
 public:
+  // reads the model in the given directory (e.g., its W, w0 and Z)
+  typedef std::function<void(const std::string &modelPath, Model &model)> ModelReader;
+
   MSComplex(std::string &field, unsigned nSamples, unsigned nPersistences)
     : fieldname(field), num_samples(nSamples), persistence_levels(nPersistences)
   {}
@@ -129,9 +158,14 @@ public:
     return persistence_levels[idx];
   }
 
+  void setModelReader(ModelReader reader)
+  {
+    read_model = reader;
+  }
+
   bool hasModel(unsigned p, unsigned c) const;
   ModelPair getModel(unsigned p, unsigned c);
-  std::vector<ModelPair> getAllModels();
+  std::vector<ModelPair> getAllModels();  // note: reads all of them
   
 private:
   static std::string modelName(unsigned p, unsigned c, unsigned persistence_padding = 2, unsigned crystals_padding = 2)
@@ -139,9 +173,13 @@ private:
     return std::string("p"+paddedIndexString(p, persistence_padding)+"c"+paddedIndexString(c, crystals_padding));
   }
 
+  ModelCache::Loader modelLoader(unsigned p, unsigned c) const;
+  void prefetchNeighbors(unsigned p, unsigned c) const;
+
   std::string fieldname;            // name of field for which this M-S complex was computed
   unsigned num_samples;             // how many samples were used to compute this M-S
   std::vector<MSPersistenceLevel> persistence_levels;
+  ModelReader read_model;
 };
 
 
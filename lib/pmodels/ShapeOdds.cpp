@@ -1,9 +1,18 @@
 #include "Models.h"
 #include "imageutils/ImageLoader.h"
 #include "lodepng.h"
+#include "utils/ThreadPool.h"
+
+#include <future>
 
 namespace dspacex {
 
+// most threads used to encode the images of a batch
+const unsigned kEncodeThreads = 8;
+
+// number of images of a batch evaluated together, few enough for their pixels to stay in cache
+const unsigned kEvaluateBlockSize = 8;
+
 void testEigen()
 {
 #if 0 // was just learning how to use the Eigen library
@@ -144,6 +153,61 @@ Eigen::MatrixXd ShapeOdds::evaluateModel(const Model &model, const Eigen::Vector
   return I;
 }
 
+// evaluates the model at each latent space coordinate (row) of Z and returns the images
+// I = f(z) = 1 / (1 + e^(-phi)) for phi = W * z + w0, a block of coordinates at a time:
+//  - phi for the block is a single matrix product instead of a product per coordinate
+//  - the sigmoid and scaling to [0, 255] are one vectorized pass over the block, which is small
+//    enough to still be in cache for it and for the conversion to 8-bit row-order pixels
+//  - the images are PNG-encoded on several threads while the next block is evaluated
+// The token, if given, is checked before each block, so a cancelled batch stops within a block.
+std::vector<Image> ShapeOdds::evaluateModelImages(const Model &model, const Eigen::MatrixXd &Z,
+                                                  unsigned w, unsigned h,
+                                                  const CancellationToken *cancellation)
+{
+  if (model.W.rows() != w * h)
+    throw std::runtime_error("w * h (" + std::to_string(w) + " * " + std::to_string(h) + ") != model image size (" + std::to_string(model.W.rows()) + ")");
+  if (Z.cols() != model.W.cols())
+    throw std::runtime_error("latent space coordinates have " + std::to_string(Z.cols()) + " dimensions, but the model has " + std::to_string(model.W.cols()));
+
+  typedef Eigen::Matrix<unsigned char, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> RowOrderImage;
+  const unsigned n = Z.rows();
+  std::vector<std::future<Image>> encodings;
+  encodings.reserve(n);
+  {
+    ThreadPool pool(std::min(kEncodeThreads, std::max(1u, n)));
+    Eigen::MatrixXd phi(model.W.rows(), std::min(kEvaluateBlockSize, n));
+    for (unsigned first = 0; first < n; first += kEvaluateBlockSize)
+    {
+      CancellationToken::throwIfCancelled(cancellation);
+      auto block = phi.leftCols(std::min(kEvaluateBlockSize, n - first));
+      block.noalias() = model.W * Z.middleRows(first, block.cols()).transpose();
+      block.colwise() += model.w0.col(0);
+      block.array() = 255.0 / (1.0 + (-block.array()).exp());
+
+      for (unsigned i = 0; i < block.cols(); i++)
+      {
+        std::vector<unsigned char> pixels(w * h);
+        Eigen::Map<RowOrderImage>(pixels.data(), h, w) =
+          Eigen::Map<const Eigen::MatrixXd>(block.col(i).data(), h, w).cast<unsigned char>();
+        encodings.push_back(pool.submit([pixels = std::move(pixels), w, h]() {
+          std::vector<unsigned char> png;
+          unsigned error = lodepng::encode(png, pixels.data(), w, h, LCT_GREY, 8);
+          if (error) {
+            throw std::runtime_error("encoder error " + std::to_string(error) + ": " + lodepng_error_text(error));
+          }
+          return Image(w, h, NULL, std::vector<char>(png.begin(), png.end()), "png");
+        }));
+      }
+    }
+  }
+
+  std::vector<Image> images;
+  images.reserve(n);
+  for (auto &encoding : encodings)
+    images.push_back(encoding.get());
+  return images;
+}
+
 // verify evaluated model and how closely it corresponds to sample at that idx
 // return measured difference between generated sample and original, and ...
 float ShapeOdds::testEvaluateModel(const Model &model, const Eigen::Matrix<double, 1, Eigen::Dynamic> &z_coord,
@@ -26,18 +26,22 @@
   extern void  wst_free(/*@null@*/ /*@only@*/ void *ptr);
   extern void  wst_destroyContext(wstContext **context);
 
-#ifdef STANDALONE
-  extern /*@null@*/ wstContext *wst_createContext( );
-  extern void wst_freeData( wstData *data );
+  extern void  wst_freeData( wstData *data );
   extern /*@null@*/ wstData *wst_createData( const char *name,
                                              enum TypedArray type, int hlen,
                                              const int *header, int len,
                                              void *array );
+#ifdef STANDALONE
+  extern /*@null@*/ wstContext *wst_createContext( );
 #endif
 
+  extern void  wst_sendText( struct libwebsocket *wsi, char *text );
+  extern void  wst_sendData( struct libwebsocket *wsi, wstData *data );
+
   /* message call-backs */
   extern void  browserText( struct libwebsocket *wsi, char *buf, int len );
   extern void  browserData( struct libwebsocket *wsi, wstData *data );
+  extern void  browserClosed( struct libwebsocket *wsi );
 
 
 enum wst_protocols {
@@ -93,6 +97,154 @@ static int       nServers = 0;
 static wstServer *servers = NULL;
 
 
+/* messages posted by other threads, sent by the server thread */
+
+typedef struct wstPosted {
+        struct libwebsocket *wsi;
+        char                *text;         /* text message or NULL */
+        wstData             *data;         /* binary message or NULL */
+        struct wstPosted    *next;
+} wstPosted;
+
+static wstPosted           *postedHead = NULL;
+static wstPosted           *postedTail = NULL;
+static struct libwebsocket **liveWsi   = NULL;  /* open text & data sockets */
+static int                 nLiveWsi    = 0;
+static int                 mLiveWsi    = 0;
+
+#ifdef WIN32
+static CRITICAL_SECTION    postedLock;
+static int                 postedLockInit = 0;
+#define LOCK_POSTED()      EnterCriticalSection(&postedLock)
+#define UNLOCK_POSTED()    LeaveCriticalSection(&postedLock)
+#else
+static pthread_mutex_t     postedLock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK_POSTED()      pthread_mutex_lock(&postedLock)
+#define UNLOCK_POSTED()    pthread_mutex_unlock(&postedLock)
+#endif
+
+
+static void freePosted(wstPosted *posted)
+{
+  if (posted->text != NULL) wst_free(posted->text);
+  if (posted->data != NULL) wst_freeData(posted->data);
+  wst_free(posted);
+}
+
+
+static void addLiveSocket(struct libwebsocket *wsi)
+{
+  struct libwebsocket **tmp;
+
+  LOCK_POSTED();
+  if (nLiveWsi == mLiveWsi) {
+    if (liveWsi == NULL) {
+      tmp = (struct libwebsocket **)
+            wst_alloc((mLiveWsi+8)*sizeof(struct libwebsocket *));
+    } else {
+      tmp = (struct libwebsocket **)
+            wst_realloc(liveWsi, (mLiveWsi+8)*sizeof(struct libwebsocket *));
+    }
+    if (tmp == NULL) {
+      UNLOCK_POSTED();
+      fprintf(stderr, "addLiveSocket: Malloc Problem!\n");
+      return;
+    }
+    liveWsi   = tmp;
+    mLiveWsi += 8;
+  }
+  liveWsi[nLiveWsi++] = wsi;
+  UNLOCK_POSTED();
+}
+
+
+/* forget a closed socket and drop the messages still posted to it */
+static void removeLiveSocket(struct libwebsocket *wsi)
+{
+  int       i, n;
+  wstPosted *posted, *prev, *next;
+
+  LOCK_POSTED();
+  for (n = i = 0; i < nLiveWsi; i++) {
+    if (liveWsi[i] == wsi) continue;
+    liveWsi[n++] = liveWsi[i];
+  }
+  nLiveWsi = n;
+  prev = NULL;
+  for (posted = postedHead; posted != NULL; posted = next) {
+    next = posted->next;
+    if (posted->wsi != wsi) {
+      prev = posted;
+      continue;
+    }
+    if (prev == NULL) {
+      postedHead = next;
+    } else {
+      prev->next = next;
+    }
+    if (postedTail == posted) postedTail = prev;
+    freePosted(posted);
+  }
+  UNLOCK_POSTED();
+}
+
+
+/* queue a message for a socket that is still open; takes the message */
+static void postMessage(struct libwebsocket *wsi, char *text, wstData *data)
+{
+  int       i;
+  wstPosted *posted;
+
+  posted = (wstPosted *) wst_alloc(sizeof(wstPosted));
+  if (posted == NULL) {
+    fprintf(stderr, "ERROR: post Malloc!");
+    if (text != NULL) wst_free(text);
+    if (data != NULL) wst_freeData(data);
+    return;
+  }
+  posted->wsi  = wsi;
+  posted->text = text;
+  posted->data = data;
+  posted->next = NULL;
+
+  LOCK_POSTED();
+  for (i = 0; i < nLiveWsi; i++)
+    if (liveWsi[i] == wsi) break;
+  if (i == nLiveWsi) {
+    UNLOCK_POSTED();
+    freePosted(posted);
+    return;
+  }
+  if (postedTail == NULL) {
+    postedHead = posted;
+  } else {
+    postedTail->next = posted;
+  }
+  postedTail = posted;
+  UNLOCK_POSTED();
+}
+
+
+/* send the posted messages -- only called by the server thread */
+static void flushPosted()
+{
+  wstPosted *posted, *next;
+
+  LOCK_POSTED();
+  posted     = postedHead;
+  postedHead = postedTail = NULL;
+  UNLOCK_POSTED();
+
+  /* sockets only close while servicing, so all of these are still open */
+  for (; posted != NULL; posted = next) {
+    next = posted->next;
+    if (posted->text != NULL) wst_sendText(posted->wsi, posted->text);
+    if (posted->data != NULL) wst_sendData(posted->wsi, posted->data);
+    freePosted(posted);
+  }
+}
+
+
 /* this protocol server (always the first one) just knows how to do HTTP */
 
 static int callback_http(/*@unused@*/ struct libwebsocket_context *context,
@@ -233,6 +385,7 @@ callback_data_binary(struct libwebsocket_context *context,
 	case LWS_CALLBACK_ESTABLISHED:
 		fprintf(stderr, "callback_data_binary: LWS_CALLBACK_ESTABLISHED\n");
                 pss->wsi = wsi;
+                addLiveSocket(wsi);
 		break;
 
 	case LWS_CALLBACK_BROADCAST:
@@ -288,6 +441,8 @@ callback_data_binary(struct libwebsocket_context *context,
                 
         case LWS_CALLBACK_CLOSED:
                 fprintf(stderr, "callback_data_binary: LWS_CALLBACK_CLOSED\n");
+                removeLiveSocket(wsi);
+                browserClosed(wsi);
                 break;
         
 	/*
@@ -337,6 +492,7 @@ callback_ui_text(struct libwebsocket_context *context,
 	case LWS_CALLBACK_ESTABLISHED:
 		fprintf(stderr, "callback_ui_text: LWS_CALLBACK_ESTABLISHED\n");
 		pss->wsi = wsi;
+                addLiveSocket(wsi);
                 n        = servers[slot].nClient + 1;
                 if (servers[slot].wsi == NULL) {
                   tmp = (struct libwebsocket **)
@@ -366,6 +522,8 @@ callback_ui_text(struct libwebsocket_context *context,
             
         case LWS_CALLBACK_CLOSED:
               fprintf(stderr, "callback_ui_text: LWS_CALLBACK_CLOSED\n");
+              removeLiveSocket(wsi);
+              browserClosed(wsi);
               for (n = i = 0; i < servers[slot].nClient; i++) {
                   if (servers[slot].wsi[i] == wsi) continue;
                   servers[slot].wsi[n] = servers[slot].wsi[i];
@@ -436,8 +594,9 @@ static void serverThread(wstServer *server)
   
   while (server->loop) {
     
-    usleep(50000);
+    usleep(10000);
     libwebsocket_service(server->WScontext, 0);
+    flushPosted();
     
   }
   
@@ -457,6 +616,12 @@ int wst_startServer(int port, /*@null@*/ char *interface,
   struct libwebsocket_context *context;
   
   fprintf(stderr, "\nwst libwebsockets server thread start\n\n");
+#ifdef WIN32
+  if (postedLockInit == 0) {
+    InitializeCriticalSection(&postedLock);
+    postedLockInit = 1;
+  }
+#endif
   
   context = libwebsocket_create_context(port, interface, wst_protocols,
                                         libwebsocket_internal_extensions,
@@ -586,6 +751,43 @@ void wst_sendText(struct libwebsocket *wsi, char *text)
 }
 
 
+/* thread-safe: queue a copy of the text for the server thread to send */
+void wst_postText(struct libwebsocket *wsi, const char *text)
+{
+  int  n;
+  char *copy;
+
+  if (text == NULL) {
+    fprintf(stderr, "ERROR: postText called with NULL text!");
+    return;
+  }
+  n    = strlen(text);
+  copy = (char *) wst_alloc((n+1)*sizeof(char));
+  if (copy == NULL) {
+    fprintf(stderr, "ERROR: postText Malloc with length %d!", n);
+    return;
+  }
+  memcpy(copy, text, n+1);
+  postMessage(wsi, copy, NULL);
+}
+
+
+/* thread-safe: queue a copy of the data for the server thread to send */
+void wst_postData(struct libwebsocket *wsi, wstData *wstdata)
+{
+  wstData *copy;
+
+  if (wstdata == NULL) {
+    fprintf(stderr, "ERROR: postData called with NULL!");
+    return;
+  }
+  copy = wst_createData(wstdata->name, wstdata->type, wstdata->hlen,
+                        wstdata->header, wstdata->len, wstdata->data);
+  if (copy == NULL) return;
+  postMessage(wsi, NULL, copy);
+}
+
+
 void wst_broadcastText(char *text)
 {
   int  n;
@@ -768,6 +970,12 @@ void browserData(struct libwebsocket *wsi, wstData *data)
 }
 
 
+void browserClosed(struct libwebsocket *wsi)
+{
+  printf(" closed %lx\n", (long) wsi);
+}
+
+
 int main(/*@unused@*/ int argc, /*@unused@*/ char **argv)
 {
   int        stat;
@@ -48,6 +48,12 @@ extern "C" {
   __ProtoExt__ void wst_sendData( void *wsi, wstData *data );
 #endif
   
+  /* thread-safe: copy and queue for the server thread, dropped if the
+     socket closes first */
+  __ProtoExt__ void wst_postText( void *wsi, const char *text );
+
+  __ProtoExt__ void wst_postData( void *wsi, wstData *data );
+  
   __ProtoExt__ void wst_broadcastText( char *text );
   
   __ProtoExt__ void wst_broadcastData( wstData *data );
@@ -0,0 +1,323 @@
+#include "CSVReader.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace HDProcess {
+
+namespace {
+
+const double kPowersOfTen[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Largest mantissa and decimal exponent that convert exactly: both the
+// mantissa and the power of ten are representable, so the one rounding of
+// the multiplication or division gives the correctly rounded result.
+const uint64_t kMaxExactMantissa = uint64_t(1) << 53;
+const int kMaxExactExponent = 22;
+
+bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+bool isPadding(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+const char* skipPadding(const char *p, const char *last) {
+  while (p != last && isPadding(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+const char* endOfLine(const char *p, const char *last) {
+  const char *eol = static_cast<const char*>(std::memchr(p, '\n', last - p));
+  return eol ? eol : last;
+}
+
+bool isBlank(const char *line, const char *eol) {
+  return skipPadding(line, eol) == eol;
+}
+
+// Slow path for numbers the exact conversion does not cover.
+const char* parseWithStrtod(const char *first, const char *last, double &value) {
+  const char *end = first;
+  while (end != last && *end != ',' && *end != '\n' && !isPadding(*end)) {
+    ++end;
+  }
+  std::string token(first, end);
+  char *parsedEnd = nullptr;
+  double parsed = std::strtod(token.c_str(), &parsedEnd);
+  if (parsedEnd == token.c_str()) {
+    return first;
+  }
+  value = parsed;
+  return first + (parsedEnd - token.c_str());
+}
+
+} // namespace
+
+
+const char* parseDouble(const char *first, const char *last, double &value) {
+  const char *p = first;
+  bool negative = false;
+  if (p != last && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  // Up to 19 significant digits fit the mantissa, leading zeros do not count.
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  bool anyDigits = false;
+  bool truncated = false;
+  for (; p != last && isDigit(*p); ++p) {
+    anyDigits = true;
+    if (mantissa == 0 && *p == '0') {
+      continue;
+    }
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits++;
+    } else {
+      exponent++;
+      truncated = true;
+    }
+  }
+  if (p != last && *p == '.') {
+    for (++p; p != last && isDigit(*p); ++p) {
+      anyDigits = true;
+      if (mantissa == 0 && *p == '0') {
+        exponent--;
+      } else if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits++;
+        exponent--;
+      } else {
+        truncated = true;
+      }
+    }
+  }
+  if (!anyDigits) {
+    // inf, nan and friends
+    return parseWithStrtod(first, last, value);
+  }
+
+  // The exponent is only consumed if it has digits, as with from_chars.
+  if (p != last && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool negativeExponent = false;
+    if (q != last && (*q == '-' || *q == '+')) {
+      negativeExponent = *q == '-';
+      ++q;
+    }
+    if (q != last && isDigit(*q)) {
+      int explicitExponent = 0;
+      for (; q != last && isDigit(*q); ++q) {
+        if (explicitExponent < 100000) {
+          explicitExponent = explicitExponent * 10 + (*q - '0');
+        }
+      }
+      exponent += negativeExponent ? -explicitExponent : explicitExponent;
+      p = q;
+    }
+  }
+
+  if (truncated || mantissa > kMaxExactMantissa ||
+      exponent > kMaxExactExponent || exponent < -kMaxExactExponent) {
+    return parseWithStrtod(first, p, value);
+  }
+  double result = mantissa;
+  if (exponent >= 0) {
+    result *= kPowersOfTen[exponent];
+  } else {
+    result /= kPowersOfTen[-exponent];
+  }
+  value = negative ? -result : result;
+  return p;
+}
+
+
+CSVReader::CSVReader(const std::string &filename, bool hasHeader) : m_filename(filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to open CSV file " + filename);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw std::runtime_error("Unable to read CSV file " + filename);
+  }
+  m_size = info.st_size;
+  if (m_size > 0) {
+    void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Unable to map CSV file " + filename);
+    }
+    m_data = static_cast<char*>(data);
+    madvise(m_data, m_size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  const char *p = m_data;
+  const char *last = m_data + m_size;
+  while (p != last && isBlank(p, endOfLine(p, last))) {
+    p = std::min(endOfLine(p, last) + 1, last);
+  }
+  if (hasHeader && p != last) {
+    const char *eol = endOfLine(p, last);
+    while (true) {
+      const char *comma = std::find(p, eol, ',');
+      const char *begin = skipPadding(p, comma);
+      const char *end = comma;
+      while (end != begin && isPadding(end[-1])) {
+        --end;
+      }
+      m_columnNames.push_back(std::string(begin, end));
+      if (comma == eol) {
+        break;
+      }
+      p = comma + 1;
+    }
+    p = std::min(eol + 1, last);
+  }
+  m_body = p;
+
+  // Columns are counted on the first data line, rows are non-blank lines.
+  while (p != last) {
+    const char *eol = endOfLine(p, last);
+    if (!isBlank(p, eol)) {
+      if (m_rowCount == 0) {
+        m_columnCount = 1 + std::count(p, eol, ',');
+      }
+      m_rowCount++;
+    }
+    p = std::min(eol + 1, last);
+  }
+  if (m_rowCount == 0) {
+    m_columnCount = m_columnNames.size();
+  }
+  if (hasHeader && m_columnCount != m_columnNames.size()) {
+    if (m_data) {
+      munmap(m_data, m_size);
+    }
+    throw std::runtime_error(filename + ": header has " + std::to_string(m_columnNames.size()) +
+                             " columns but data has " + std::to_string(m_columnCount));
+  }
+}
+
+CSVReader::~CSVReader() {
+  if (m_data) {
+    munmap(m_data, m_size);
+  }
+}
+
+FortranLinalg::DenseMatrix<Precision> CSVReader::readMatrix() {
+  FortranLinalg::DenseMatrix<Precision> matrix(m_rowCount, m_columnCount);
+  std::vector<Precision*> columns(m_columnCount);
+  for (unsigned int j = 0; j < m_columnCount; j++) {
+    columns[j] = matrix.data() + (size_t) j * m_rowCount;
+  }
+  try {
+    parse(columns, m_columnCount);
+  } catch (...) {
+    matrix.deallocate();
+    throw;
+  }
+  return matrix;
+}
+
+std::vector<FortranLinalg::DenseVector<Precision>> CSVReader::readColumns() {
+  std::vector<FortranLinalg::DenseVector<Precision>> vectors;
+  std::vector<Precision*> columns;
+  for (unsigned int j = 0; j < m_columnCount; j++) {
+    vectors.push_back(FortranLinalg::DenseVector<Precision>(m_rowCount));
+    columns.push_back(vectors.back().data());
+  }
+  try {
+    parse(columns, m_columnCount);
+  } catch (...) {
+    for (auto &vector : vectors) {
+      vector.deallocate();
+    }
+    throw;
+  }
+  return vectors;
+}
+
+FortranLinalg::DenseVector<Precision> CSVReader::readColumn(unsigned int column) {
+  if (column >= m_columnCount) {
+    throw std::runtime_error("CSV file " + m_filename + " has no column " + std::to_string(column));
+  }
+  FortranLinalg::DenseVector<Precision> vector(m_rowCount);
+  std::vector<Precision*> columns(column + 1, nullptr);
+  columns[column] = vector.data();
+  try {
+    parse(columns, column + 1);
+  } catch (...) {
+    vector.deallocate();
+    throw;
+  }
+  return vector;
+}
+
+/**
+ * Parses the first parsedColumns fields of every data row, storing field j of
+ * row i at columns[j][i] unless columns[j] is null. Rows must have exactly
+ * getColumnCount() fields when all of them are parsed.
+ */
+void CSVReader::parse(const std::vector<Precision*> &columns, unsigned int parsedColumns) {
+  const char *last = m_data + m_size;
+  const char *p = m_body;
+  unsigned int row = 0;
+  while (p != last) {
+    const char *eol = endOfLine(p, last);
+    if (isBlank(p, eol)) {
+      p = std::min(eol + 1, last);
+      continue;
+    }
+    for (unsigned int j = 0; j < parsedColumns; j++) {
+      p = skipPadding(p, eol);
+      double value;
+      const char *next = parseDouble(p, eol, value);
+      if (next == p) {
+        fail("Expected a number", p);
+      }
+      if (columns[j]) {
+        columns[j][row] = value;
+      }
+      p = skipPadding(next, eol);
+      if (j + 1 < parsedColumns) {
+        if (p == eol || *p != ',') {
+          fail("Expected " + std::to_string(m_columnCount) + " fields", p);
+        }
+        ++p;
+      }
+    }
+    if (parsedColumns == m_columnCount && p != eol) {
+      fail("Expected " + std::to_string(m_columnCount) + " fields", p);
+    }
+    row++;
+    p = std::min(eol + 1, last);
+  }
+}
+
+void CSVReader::fail(const std::string &message, const char *position) const {
+  size_t line = 1 + std::count(static_cast<const char*>(m_data), position, '\n');
+  throw std::runtime_error(m_filename + ":" + std::to_string(line) + ": " + message);
+}
+
+} // namespace HDProcess
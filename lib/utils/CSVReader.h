@@ -0,0 +1,76 @@
+#pragma once
+
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseVector.h"
+#include "dspacex/Precision.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace HDProcess {
+
+/**
+ * Parses a decimal floating point number from [first, last) in the manner of
+ * std::from_chars. Numbers with at most 19 significant digits and a small
+ * decimal exponent are converted exactly with a single multiplication or
+ * division; everything else, including inf and nan, goes through strtod.
+ * Returns a pointer past the number, or first if there is none.
+ */
+const char* parseDouble(const char *first, const char *last, double &value);
+
+/**
+ * Reader of numeric CSV files. The file is memory mapped and parsed in one
+ * sequential pass straight into preallocated column storage, instead of
+ * building rows of strings first. Blank lines are skipped, fields may be
+ * padded with spaces and lines may end in CRLF. Throws std::runtime_error if
+ * the file cannot be read, a row has the wrong number of fields or a field is
+ * not a number.
+ */
+class CSVReader {
+ public:
+  /**
+   * Maps the file and counts its rows. If hasHeader is set, the first line
+   * holds the column names.
+   */
+  CSVReader(const std::string &filename, bool hasHeader);
+  ~CSVReader();
+
+  CSVReader(const CSVReader&) = delete;
+  CSVReader& operator=(const CSVReader&) = delete;
+
+  const std::vector<std::string>& getColumnNames() const {
+    return m_columnNames;
+  }
+
+  unsigned int getRowCount() const {
+    return m_rowCount;
+  }
+
+  unsigned int getColumnCount() const {
+    return m_columnCount;
+  }
+
+  // All fields as a rows x columns matrix.
+  FortranLinalg::DenseMatrix<Precision> readMatrix();
+
+  // Every column as its own vector.
+  std::vector<FortranLinalg::DenseVector<Precision>> readColumns();
+
+  // A single column; the other fields of each row are skipped unparsed.
+  FortranLinalg::DenseVector<Precision> readColumn(unsigned int column);
+
+ private:
+  void parse(const std::vector<Precision*> &columns, unsigned int parsedColumns);
+  void fail(const std::string &message, const char *position) const;
+
+  std::string m_filename;
+  char *m_data = nullptr;
+  size_t m_size = 0;
+  const char *m_body = nullptr;  // start of the first data line
+  std::vector<std::string> m_columnNames;
+  unsigned int m_rowCount = 0;
+  unsigned int m_columnCount = 0;
+};
+
+} // namespace HDProcess
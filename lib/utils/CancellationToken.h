@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+
+/**
+ * Thrown by long computations that stopped because their token was cancelled.
+ */
+class OperationCancelled : public std::runtime_error {
+ public:
+  OperationCancelled() : std::runtime_error("operation cancelled") {}
+};
+
+/**
+ * Flag that asks a running computation to stop. The computation checks it
+ * at points where it can give up cleanly, e.g. between persistence levels,
+ * and throws OperationCancelled from there. Cancelling is thread-safe and
+ * cannot be undone.
+ */
+class CancellationToken {
+ public:
+  CancellationToken() = default;
+  CancellationToken(const CancellationToken&) = delete;
+  CancellationToken& operator=(const CancellationToken&) = delete;
+
+  void cancel() {
+    m_cancelled.store(true, std::memory_order_relaxed);
+  }
+
+  bool isCancelled() const {
+    return m_cancelled.load(std::memory_order_relaxed);
+  }
+
+  void throwIfCancelled() const {
+    if (isCancelled()) {
+      throw OperationCancelled();
+    }
+  }
+
+  // Checks a token that may be null, i.e. a computation that can't be cancelled.
+  static void throwIfCancelled(const CancellationToken *token) {
+    if (token) {
+      token->throwIfCancelled();
+    }
+  }
+
+ private:
+  std::atomic<bool> m_cancelled{false};
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Incremental 128 bit hash of binary content, used to name cached results
+ * after the data they were computed from. Input is consumed eight bytes at a
+ * time by two independently seeded multiply-xorshift lanes, fast enough to
+ * hash large sample or distance matrices. The digest only depends on the
+ * concatenated input, not on how it was split into updates. Not a
+ * cryptographic hash.
+ */
+class ContentHash {
+ public:
+  ContentHash() : m_lanes{0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full} {}
+
+  void update(const void *data, size_t bytes) {
+    const unsigned char *input = static_cast<const unsigned char*>(data);
+    m_length += bytes;
+
+    // Complete the word left over from the previous update first.
+    if (m_pendingBytes > 0) {
+      size_t take = std::min(bytes, sizeof(uint64_t) - m_pendingBytes);
+      std::memcpy(m_pending + m_pendingBytes, input, take);
+      m_pendingBytes += take;
+      input += take;
+      bytes -= take;
+      if (m_pendingBytes < sizeof(uint64_t)) {
+        return;
+      }
+      mix(m_lanes, load(m_pending));
+      m_pendingBytes = 0;
+    }
+
+    for (; bytes >= sizeof(uint64_t); input += sizeof(uint64_t), bytes -= sizeof(uint64_t)) {
+      mix(m_lanes, load(input));
+    }
+    std::memcpy(m_pending, input, bytes);
+    m_pendingBytes = bytes;
+  }
+
+  // Hash the value representation of a scalar.
+  template <typename T>
+  void add(T value) {
+    static_assert(std::is_arithmetic<T>::value, "ContentHash::add expects a scalar");
+    update(&value, sizeof(T));
+  }
+
+  // Hash a string together with its length, so that concatenations differ.
+  void add(const std::string &value) {
+    add<uint64_t>(value.size());
+    update(value.data(), value.size());
+  }
+
+  // 64 bit digest of everything added so far, for use as a checksum.
+  uint64_t value() const {
+    return finalize(lanes()[0] ^ m_length);
+  }
+
+  // Hex digest of everything added so far.
+  std::string hex() const {
+    std::vector<uint64_t> digest = lanes();
+    std::ostringstream out;
+    out << std::hex << std::setfill('0')
+        << std::setw(16) << finalize(digest[0] ^ m_length)
+        << std::setw(16) << finalize(digest[1] ^ (m_length * 0x9e3779b97f4a7c15ull));
+    return out.str();
+  }
+
+ private:
+  static uint64_t load(const unsigned char *input) {
+    uint64_t word;
+    std::memcpy(&word, input, sizeof(uint64_t));
+    return word;
+  }
+
+  static void mix(uint64_t *lanes, uint64_t word) {
+    lanes[0] = (lanes[0] ^ word) * 0xff51afd7ed558ccdull;
+    lanes[0] ^= lanes[0] >> 29;
+    lanes[1] = (lanes[1] ^ (word + 0x165667b19e3779f9ull)) * 0xc4ceb9fe1a85ec53ull;
+    lanes[1] ^= lanes[1] >> 31;
+  }
+
+  // Lanes including the zero padded partial word.
+  std::vector<uint64_t> lanes() const {
+    std::vector<uint64_t> lanes(m_lanes, m_lanes + 2);
+    if (m_pendingBytes > 0) {
+      unsigned char tail[sizeof(uint64_t)] = {};
+      std::memcpy(tail, m_pending, m_pendingBytes);
+      mix(lanes.data(), load(tail));
+    }
+    return lanes;
+  }
+
+  static uint64_t finalize(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  uint64_t m_lanes[2];
+  uint64_t m_length = 0;
+  unsigned char m_pending[sizeof(uint64_t)];
+  size_t m_pendingBytes = 0;
+};
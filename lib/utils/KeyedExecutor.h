@@ -0,0 +1,86 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+/**
+ * Runs tasks on a pool of worker threads such that tasks submitted under the
+ * same key run one at a time in submission order, while tasks with different
+ * keys run concurrently. Tasks under the empty key are not serialized at all.
+ * Destroying the executor finishes all submitted tasks.
+ */
+class KeyedExecutor {
+ public:
+  /**
+   * @param[in] threadCount Number of worker threads; 0 uses all hardware threads.
+   */
+  explicit KeyedExecutor(unsigned int threadCount = 0) : m_pool(threadCount) {}
+
+  KeyedExecutor(const KeyedExecutor&) = delete;
+  KeyedExecutor& operator=(const KeyedExecutor&) = delete;
+
+  /**
+   * Queue a task under a key. Exceptions thrown by the task are dropped, so
+   * tasks should report their own failures.
+   */
+  void submit(const std::string &key, std::function<void()> task) {
+    if (key.empty()) {
+      m_pool.submit([task]() { run(task); });
+      return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::deque<std::function<void()>> &queue = m_queues[key];
+    queue.push_back(std::move(task));
+    // Otherwise the task of the key that is running submits the next one.
+    if (queue.size() == 1) {
+      m_pool.submit([this, key]() { runNext(key); });
+    }
+  }
+
+  // Number of tasks queued or running under a key.
+  size_t pending(const std::string &key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto queue = m_queues.find(key);
+    return queue == m_queues.end() ? 0 : queue->second.size();
+  }
+
+  unsigned int threadCount() const {
+    return m_pool.size();
+  }
+
+ private:
+  static void run(const std::function<void()> &task) {
+    try {
+      task();
+    } catch (...) {
+    }
+  }
+
+  // The running task stays at the front of its queue until it finished.
+  void runNext(const std::string &key) {
+    std::function<void()> task;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      task = m_queues[key].front();
+    }
+    run(task);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::deque<std::function<void()>> &queue = m_queues[key];
+    queue.pop_front();
+    if (queue.empty()) {
+      m_queues.erase(key);
+    } else {
+      m_pool.submit([this, key]() { runNext(key); });
+    }
+  }
+
+  std::mutex m_mutex;
+  std::map<std::string, std::deque<std::function<void()>>> m_queues;
+  ThreadPool m_pool; // declared last so that it finishes the tasks first
+};
@@ -0,0 +1,146 @@
+#include "MatrixArchive.h"
+#include "ContentHash.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace MatrixArchiveFormat;
+
+namespace {
+
+size_t aligned(size_t offset) {
+  return (offset + Alignment - 1) / Alignment * Alignment;
+}
+
+} // namespace
+
+/**
+ * Lays out the table and payloads, then writes the file in one pass. The
+ * checksum covers the table and the payloads including padding, which is
+ * hashed as zeros.
+ */
+void MatrixArchiveWriter::write(const std::string &filename) {
+  Header header = {};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.sectionCount = m_entries.size();
+  header.tableOffset = sizeof(Header);
+
+  size_t offset = aligned(sizeof(Header) + sizeof(Section) * m_entries.size());
+  for (Entry &entry : m_entries) {
+    entry.section.offset = offset;
+    offset = aligned(offset + entry.section.bytes);
+  }
+  header.fileSize = offset;
+
+  static const char padding[Alignment] = {};
+  ContentHash checksum;
+  size_t position = sizeof(Header);
+  for (Entry &entry : m_entries) {
+    checksum.update(&entry.section, sizeof(Section));
+    position += sizeof(Section);
+  }
+  for (Entry &entry : m_entries) {
+    checksum.update(padding, entry.section.offset - position);
+    checksum.update(entry.data, entry.section.bytes);
+    position = entry.section.offset + entry.section.bytes;
+  }
+  checksum.update(padding, header.fileSize - position);
+  header.checksum = checksum.value();
+
+  std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Unable to create archive " + filename);
+  }
+  file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+  for (Entry &entry : m_entries) {
+    file.write(reinterpret_cast<const char*>(&entry.section), sizeof(Section));
+  }
+  position = sizeof(Header) + sizeof(Section) * m_entries.size();
+  for (Entry &entry : m_entries) {
+    file.write(padding, entry.section.offset - position);
+    file.write(static_cast<const char*>(entry.data), entry.section.bytes);
+    position = entry.section.offset + entry.section.bytes;
+  }
+  file.write(padding, header.fileSize - position);
+  if (!file) {
+    throw std::runtime_error("Failed to write archive " + filename);
+  }
+}
+
+
+MatrixArchive::MatrixArchive(const std::string &filename, bool verify) : m_filename(filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to open archive " + filename);
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+    close(fd);
+    throw std::runtime_error("Not an archive: " + filename);
+  }
+  m_size = info.st_size;
+  // Private mapping, so that views may be modified without changing the file.
+  m_data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m_data == MAP_FAILED) {
+    m_data = nullptr;
+    throw std::runtime_error("Unable to map archive " + filename);
+  }
+
+  const Header &header = *static_cast<const Header*>(m_data);
+  const char *bytes = static_cast<const char*>(m_data);
+  std::string error;
+  if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version) {
+    error = "Not an archive: ";
+  } else if (header.fileSize != m_size ||
+             header.tableOffset + sizeof(Section) * uint64_t(header.sectionCount) > m_size) {
+    error = "Truncated archive: ";
+  } else if (verify) {
+    ContentHash checksum;
+    checksum.update(bytes + sizeof(Header), m_size - sizeof(Header));
+    if (checksum.value() != header.checksum) {
+      error = "Archive checksum mismatch: ";
+    }
+  }
+
+  const Section *table = reinterpret_cast<const Section*>(bytes + header.tableOffset);
+  for (uint32_t i = 0; error.empty() && i < header.sectionCount; i++) {
+    const Section &section = table[i];
+    if (section.offset % Alignment != 0 || section.offset + section.bytes > m_size ||
+        section.bytes != uint64_t(section.elementSize) * section.rows * section.cols ||
+        section.name[NameLength - 1] != '\0') {
+      error = "Corrupt archive section table: ";
+      break;
+    }
+    m_sections[section.name] = &section;
+  }
+
+  if (!error.empty()) {
+    munmap(m_data, m_size);
+    m_data = nullptr;
+    throw std::runtime_error(error + filename);
+  }
+}
+
+MatrixArchive::~MatrixArchive() {
+  if (m_data) {
+    munmap(m_data, m_size);
+  }
+}
+
+/**
+ * Checks the magic number of a file without mapping it.
+ */
+bool MatrixArchive::isArchive(const std::string &filename) {
+  std::ifstream file(filename, std::ios::binary);
+  char magic[sizeof(Magic)];
+  if (!file.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return std::memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
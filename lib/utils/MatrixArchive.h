@@ -0,0 +1,186 @@
+#pragma once
+
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseMatrixView.h"
+#include "flinalg/DenseVector.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Single-file container of named column-major matrices and vectors.
+ *
+ * The file starts with a 64 byte header followed by a table of 128 byte
+ * section entries holding name, element type, shape, offset and size of each
+ * array. Array payloads follow the table, each aligned to 64 bytes. The header
+ * carries a checksum of everything after it.
+ */
+namespace MatrixArchiveFormat {
+
+const char Magic[8] = {'D', 'S', 'X', 'A', 'R', 'C', 'H', '\0'};
+const uint32_t Version = 1;
+const size_t Alignment = 64;
+const size_t NameLength = 80;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t sectionCount;
+  uint64_t tableOffset;
+  uint64_t fileSize;
+  uint64_t checksum;
+  uint8_t reserved[24];
+};
+
+struct Section {
+  char name[NameLength];
+  uint32_t floatingPoint; // 1 for floating point, 0 for integer elements
+  uint32_t elementSize;
+  uint32_t dimensions;    // 1 for vectors, 2 for matrices
+  uint32_t rows;
+  uint32_t cols;
+  uint32_t reserved0;
+  uint64_t offset;
+  uint64_t bytes;
+  uint64_t reserved1;
+};
+
+static_assert(sizeof(Header) == 64, "archive header must be 64 bytes");
+static_assert(sizeof(Section) == 128, "archive section entry must be 128 bytes");
+
+} // namespace MatrixArchiveFormat
+
+
+/**
+ * Collects matrices and vectors and writes them into a single archive file.
+ * Arrays are referenced, not copied, until write() is called.
+ */
+class MatrixArchiveWriter {
+ public:
+  template <typename T>
+  void addMatrix(const std::string &name, FortranLinalg::DenseMatrix<T> &matrix) {
+    add<T>(name, 2, matrix.M(), matrix.N(), matrix.data());
+  }
+
+  template <typename T>
+  void addVector(const std::string &name, FortranLinalg::DenseVector<T> &vector) {
+    add<T>(name, 1, vector.N(), 1, vector.data());
+  }
+
+  // Throws std::runtime_error if the file cannot be written.
+  void write(const std::string &filename);
+
+ private:
+  struct Entry {
+    MatrixArchiveFormat::Section section;
+    const void *data;
+  };
+
+  template <typename T>
+  void add(const std::string &name, uint32_t dimensions, uint32_t rows, uint32_t cols,
+           const T *data) {
+    static_assert(std::is_arithmetic<T>::value, "archives hold numeric arrays only");
+    if (name.size() >= MatrixArchiveFormat::NameLength) {
+      throw std::runtime_error("Archive section name too long: " + name);
+    }
+    Entry entry = {};
+    name.copy(entry.section.name, name.size());
+    entry.section.floatingPoint = std::is_floating_point<T>::value ? 1 : 0;
+    entry.section.elementSize = sizeof(T);
+    entry.section.dimensions = dimensions;
+    entry.section.rows = data ? rows : 0;
+    entry.section.cols = data ? cols : 0;
+    entry.section.bytes = data ? sizeof(T) * uint64_t(rows) * cols : 0;
+    entry.data = data;
+    m_entries.push_back(entry);
+  }
+
+  std::vector<Entry> m_entries;
+};
+
+
+/**
+ * Read access to an archive file. The file is memory mapped copy-on-write and
+ * arrays are returned as views of the mapping, so reading an array neither
+ * copies it nor touches the disk until its pages are used. Views stay valid
+ * while the archive is alive and must be given back with release() instead of
+ * being deallocated.
+ */
+class MatrixArchive {
+ public:
+  /**
+   * Maps the archive. Throws std::runtime_error if the file is missing, not
+   * an archive, truncated or, when verify is set, fails the checksum.
+   */
+  explicit MatrixArchive(const std::string &filename, bool verify = true);
+  ~MatrixArchive();
+
+  MatrixArchive(const MatrixArchive&) = delete;
+  MatrixArchive& operator=(const MatrixArchive&) = delete;
+
+  bool contains(const std::string &name) const {
+    return m_sections.find(name) != m_sections.end();
+  }
+
+  template <typename T>
+  FortranLinalg::DenseMatrixView<T> getMatrix(const std::string &name) {
+    const MatrixArchiveFormat::Section &section = find<T>(name);
+    if (section.bytes == 0) {
+      return FortranLinalg::DenseMatrixView<T>();
+    }
+    return FortranLinalg::DenseMatrixView<T>(section.rows, section.cols, payload<T>(section));
+  }
+
+  template <typename T>
+  FortranLinalg::DenseVectorView<T> getVector(const std::string &name) {
+    const MatrixArchiveFormat::Section &section = find<T>(name);
+    if (section.bytes == 0) {
+      return FortranLinalg::DenseVectorView<T>();
+    }
+    return FortranLinalg::DenseVectorView<T>(section.rows * section.cols, payload<T>(section));
+  }
+
+  // Give back a view that was stored as a plain DenseMatrix without freeing
+  // the mapped storage.
+  template <typename T>
+  static void release(FortranLinalg::DenseMatrix<T> &view) {
+    view = FortranLinalg::DenseMatrix<T>();
+  }
+
+  template <typename T>
+  static void release(FortranLinalg::DenseVector<T> &view) {
+    view = FortranLinalg::DenseVector<T>();
+  }
+
+  static bool isArchive(const std::string &filename);
+
+ private:
+  template <typename T>
+  const MatrixArchiveFormat::Section& find(const std::string &name) const {
+    auto iter = m_sections.find(name);
+    if (iter == m_sections.end()) {
+      throw std::runtime_error("Archive " + m_filename + " has no section " + name);
+    }
+    const MatrixArchiveFormat::Section &section = *iter->second;
+    if (section.elementSize != sizeof(T) ||
+        section.floatingPoint != (std::is_floating_point<T>::value ? 1u : 0u)) {
+      throw std::runtime_error("Archive section " + name + " has a different element type");
+    }
+    return section;
+  }
+
+  template <typename T>
+  T* payload(const MatrixArchiveFormat::Section &section) const {
+    return reinterpret_cast<T*>(static_cast<char*>(m_data) + section.offset);
+  }
+
+  std::string m_filename;
+  void *m_data = nullptr;
+  size_t m_size = 0;
+  std::map<std::string, const MatrixArchiveFormat::Section*> m_sections;
+};
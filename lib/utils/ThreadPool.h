@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Fixed-size pool of worker threads executing tasks in submission order.
+ * Destroying the pool finishes all queued tasks before joining the workers.
+ */
+class ThreadPool {
+ public:
+  /**
+   * @param[in] threadCount Number of worker threads; 0 uses all hardware threads.
+   */
+  explicit ThreadPool(unsigned int threadCount = 0) {
+    threadCount = resolveThreadCount(threadCount);
+    m_workers.reserve(threadCount);
+    for (unsigned int i = 0; i < threadCount; i++) {
+      m_workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_condition.notify_all();
+    for (auto &worker : m_workers) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /**
+   * Queue a task for execution. Exceptions thrown by the task are rethrown
+   * from the returned future's get().
+   */
+  template <typename F>
+  std::future<typename std::result_of<F()>::type> submit(F &&task) {
+    typedef typename std::result_of<F()>::type Result;
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> result = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.emplace([packaged]() { (*packaged)(); });
+    }
+    m_condition.notify_one();
+    return result;
+  }
+
+  unsigned int size() const {
+    return m_workers.size();
+  }
+
+  /**
+   * Number of threads to use for a requested count; 0 means all hardware threads.
+   */
+  static unsigned int resolveThreadCount(unsigned int threadCount) {
+    if (threadCount == 0) {
+      threadCount = std::thread::hardware_concurrency();
+    }
+    return std::max(1u, threadCount);
+  }
+
+ private:
+  void workerLoop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+        if (m_tasks.empty()) {
+          return;
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> m_workers;
+  std::queue<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stopping = false;
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Runs a batch of independent tasks on a fixed number of threads. Tasks are
+ * dealt round-robin to per-worker queues in the given order; each worker takes
+ * tasks from the front of its own queue and, once it runs dry, steals from the
+ * back of the other queues. Ordering the tasks by decreasing cost therefore
+ * starts the expensive tasks first and leaves the cheap ones to balance the tail.
+ */
+class WorkStealingScheduler {
+ public:
+  /**
+   * @param[in] threadCount Number of worker threads; 0 uses all hardware threads.
+   */
+  explicit WorkStealingScheduler(unsigned int threadCount = 0) :
+    m_threadCount(ThreadPool::resolveThreadCount(threadCount)) {}
+
+  unsigned int threadCount() const {
+    return m_threadCount;
+  }
+
+  /**
+   * Call task(taskIndex, workerIndex) for every index in order and block until
+   * all of them finished. workerIndex is below threadCount() and identifies the
+   * calling worker, so tasks may use it to pick per-worker scratch buffers. The
+   * first exception thrown by a task is rethrown once all workers stopped.
+   */
+  template <typename F>
+  void run(const std::vector<unsigned int> &order, F &&task) {
+    unsigned int workerCount = std::min<size_t>(m_threadCount, order.size());
+    if (workerCount <= 1) {
+      for (unsigned int index : order) {
+        task(index, 0);
+      }
+      return;
+    }
+
+    std::vector<WorkQueue> queues(workerCount);
+    for (unsigned int i = 0; i < order.size(); i++) {
+      queues[i % workerCount].tasks.push_back(order[i]);
+    }
+
+    std::exception_ptr failure;
+    std::mutex failureMutex;
+    auto work = [&](unsigned int worker) {
+      unsigned int index;
+      while (next(queues, worker, index)) {
+        try {
+          task(index, worker);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(failureMutex);
+          if (!failure) {
+            failure = std::current_exception();
+          }
+        }
+      }
+    };
+
+    // The calling thread acts as worker 0.
+    std::vector<std::thread> threads;
+    threads.reserve(workerCount - 1);
+    for (unsigned int worker = 1; worker < workerCount; worker++) {
+      threads.emplace_back(work, worker);
+    }
+    work(0);
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    if (failure) {
+      std::rethrow_exception(failure);
+    }
+  }
+
+ private:
+  struct WorkQueue {
+    std::deque<unsigned int> tasks;
+    std::mutex mutex;
+  };
+
+  /**
+   * Take the next task for a worker, stealing from other queues if needed.
+   * Returns false once all queues are empty.
+   */
+  static bool next(std::vector<WorkQueue> &queues, unsigned int worker, unsigned int &index) {
+    {
+      WorkQueue &own = queues[worker];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty()) {
+        index = own.tasks.front();
+        own.tasks.pop_front();
+        return true;
+      }
+    }
+    for (unsigned int i = 1; i < queues.size(); i++) {
+      WorkQueue &victim = queues[(worker + i) % queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        index = victim.tasks.back();
+        victim.tasks.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  unsigned int m_threadCount;
+};
@@ -1,90 +1,46 @@
 #include "loaders.h"
-#include "csv/csv.h"
+#include "CSVReader.h"
 
-#include <cassert>
-#include <fstream>
-#include <sstream>
+#include <algorithm>
+#include <stdexcept>
 
 namespace HDProcess {
 
 FortranLinalg::DenseMatrix<Precision> loadCSVMatrix(std::string filename) {
-  std::ifstream fstream(filename);
-  std::string line;
-  std::string token;
-
-  std::vector<std::vector<double>> matrix;
-  while (std::getline(fstream, line)) {
-    std::istringstream ss(line);
-    std::vector<double> row;
-    while (std::getline(ss, token, ',')) {
-      row.push_back(std::stod(token));
-    }
-    matrix.push_back(row);
-  }
-
-  FortranLinalg::DenseMatrix<Precision> m(matrix.size(),matrix[0].size());
-  for (int i = 0; i < matrix.size(); i++) {
-    for (int j = 0; j < matrix[0].size(); j++) {
-      m(i,j) = matrix[i][j];
-    }
-  }
-
-  return m;
+  CSVReader reader(filename, false /* hasHeader */);
+  return reader.readMatrix();
 }
 
 FortranLinalg::DenseVector<Precision> loadCSVColumn(std::string filename) {
-  std::ifstream fstream(filename);
-  std::string line;
-  std::string token;
-
-  std::vector<double> vector;
-  while (std::getline(fstream, line)) {
-    std::istringstream ss(line);
-    std::vector<double> row;
-    while (std::getline(ss, token, ',')) {
-      row.push_back(std::stod(token));
-    }
-    vector.push_back(row[0]);
-  }
-
-  FortranLinalg::DenseVector<Precision> v(vector.size());
-  for (int i = 0; i < vector.size(); i++) {
-    v(i) = vector[i];
-  }
-
-  return v;
+  CSVReader reader(filename, false /* hasHeader */);
+  return reader.readColumn(0);
 }
 
 FortranLinalg::DenseVector<Precision> loadCSVColumn(std::string filename, std::string columnName) {
-  io::CSVReader<1> in(filename.c_str());
-  in.read_header(io::ignore_extra_column, columnName);
-  double value;
-  std::vector<double> vec;
-  while (in.read_row(value)) {
-    vec.push_back(value);
+  CSVReader reader(filename, true /* hasHeader */);
+  const std::vector<std::string> &names = reader.getColumnNames();
+  auto column = std::find(names.begin(), names.end(), columnName);
+  if (column == names.end()) {
+    throw std::runtime_error("CSV file " + filename + " has no column " + columnName);
   }
+  return reader.readColumn(column - names.begin());
+}
 
-  FortranLinalg::DenseVector<Precision> v(vec.size());
-  for (int i = 0; i < vec.size(); i++) {
-    v(i) = vec[i];
+std::vector<std::pair<std::string, FortranLinalg::DenseVector<Precision>>> loadCSVColumns(
+    std::string filename) {
+  CSVReader reader(filename, true /* hasHeader */);
+  std::vector<FortranLinalg::DenseVector<Precision>> values = reader.readColumns();
+  std::vector<std::pair<std::string, FortranLinalg::DenseVector<Precision>>> columns;
+  for (unsigned int i = 0; i < values.size(); i++) {
+    columns.push_back(std::make_pair(reader.getColumnNames()[i], values[i]));
   }
-
-  return v;
+  return columns;
 }
 
-// TODO: Trim Whitespace from scanned column names.
 std::vector<std::string> loadCSVColumnNames(std::string filename) {
-  io::LineReader in(filename.c_str());
-  char *line = in.next_line();
-    
-  std::stringstream ss(line);
-  std::string item;
-  std::vector<std::string> names;
-  while (std::getline(ss, item, ',')) {    
-    names.push_back(item);
-  }
-  return names;
+  CSVReader reader(filename, true /* hasHeader */);
+  return reader.getColumnNames();
 }
 
 
-} // namespace HDProcess
\ No newline at end of file
+} // namespace HDProcess
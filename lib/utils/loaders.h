@@ -6,6 +6,7 @@
 #include "dspacex/Precision.h"
 
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace HDProcess {
@@ -16,6 +17,10 @@ FortranLinalg::DenseVector<Precision> loadCSVColumn(std::string filename);
 
 FortranLinalg::DenseVector<Precision> loadCSVColumn(std::string filename, std::string columnName);
 
+// Loads every column of a CSV file with a header line in a single pass.
+std::vector<std::pair<std::string, FortranLinalg::DenseVector<Precision>>> loadCSVColumns(
+    std::string filename);
+
 std::vector<std::string> loadCSVColumnNames(std::string filename);
  
 }
@@ -1,26 +1,15 @@
 #include "utils.h"
-#include "DenseVectorSample.h"
-#include "flinalg/DenseMatrix.h"
-#include "hdprocess/HDGenericProcessor.h"
+#include "metrics/BlockedDistance.h"
 
 
 namespace HDProcess {
 
+/**
+ * Compute the Euclidean distances between all columns of x.
+ */
 FortranLinalg::DenseMatrix<Precision> computeDistanceMatrix(
     FortranLinalg::DenseMatrix<Precision> &x) {
-  std::vector<DenseVectorSample*> samples;
-  for (int j = 0; j < x.N(); j++) {
-    FortranLinalg::DenseVector<Precision> vector(x.M());
-    for (int i = 0; i < x.M(); i++) {
-      vector(i) = x(i, j);
-    }
-    DenseVectorSample *sample = new DenseVectorSample(vector);
-    samples.push_back(sample);
-  }
-
-  HDGenericProcessor<DenseVectorSample, DenseVectorEuclideanMetric> genericProcessor;
-  DenseVectorEuclideanMetric metric;
-  return genericProcessor.computeDistances(samples, metric);
+  return BlockedDistance<Precision>::computeEuclidean(x);
 }
 
 }
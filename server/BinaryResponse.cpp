@@ -0,0 +1,31 @@
+#include "BinaryResponse.h"
+
+#include <stdexcept>
+
+const char *BinaryResponse::kFloat32 = "float32";
+const char *BinaryResponse::kInt32 = "int32";
+const char *BinaryResponse::kUint8 = "uint8";
+
+void BinaryResponse::writeBytes(JsonWriter &writer, const char *data, size_t size) {
+  if (!m_enabled) {
+    throw std::logic_error("Bytes can only be sent in a binary response");
+  }
+  writeReference(writer, kUint8, m_bytes.size(), { static_cast<unsigned int>(size) });
+  m_bytes.insert(m_bytes.end(), data, data + size);
+}
+
+void BinaryResponse::describe(Json::Value &response) const {
+  if (!m_enabled) {
+    return;
+  }
+  response["binaryBuffers"] = Json::Value(Json::arrayValue);
+  if (!m_floats.empty()) {
+    response["binaryBuffers"].append(kFloat32);
+  }
+  if (!m_ints.empty()) {
+    response["binaryBuffers"].append(kInt32);
+  }
+  if (!m_bytes.empty()) {
+    response["binaryBuffers"].append(kUint8);
+  }
+}
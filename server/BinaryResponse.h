@@ -0,0 +1,190 @@
+#pragma once
+
+#include "JsonWriter.h"
+
+#include <jsoncpp/json/json.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/**
+ * The bulk arrays of a command response: layouts, colors, graphs, sample
+ * lists and field values. When the client asked for a binary response and
+ * has a data socket, the arrays are packed into typed buffers, one of
+ * Float32 and one of Int32 values, plus one of Uint8 bytes for opaque blobs
+ * such as PNG files, which are sent as binary frames.
+ * The JSON response then only holds a reference to each array:
+ *
+ *   { "bufferType": "float32", "offset": 0, "shape": [rows, cols] }
+ *
+ * and lists the buffers the client has to wait for in "binaryBuffers".
+ * Otherwise the arrays are written into the JSON response as before.
+ *
+ * The set* methods fill in a member of a Json::Value response, the write*
+ * methods write it with a JsonWriter instead, which is what large responses
+ * do to avoid building a node per element.
+ */
+class BinaryResponse {
+ public:
+  explicit BinaryResponse(bool enabled = false) : m_enabled(enabled) {}
+
+  bool isEnabled() const {
+    return m_enabled;
+  }
+
+  // Sets value to the rows x cols matrix of values at(i, j). Floating point
+  // values go into the Float32 buffer, integers into the Int32 buffer.
+  template<typename Accessor>
+  void setMatrix(Json::Value &value, unsigned int rows, unsigned int cols, Accessor at) {
+    if (!m_enabled) {
+      value = Json::Value(Json::arrayValue);
+      for (unsigned int i = 0; i < rows; i++) {
+        Json::Value row(Json::arrayValue);
+        for (unsigned int j = 0; j < cols; j++) {
+          row.append(at(i, j));
+        }
+        value.append(row);
+      }
+      return;
+    }
+    auto &buffer = getBuffer<decltype(at(0u, 0u))>();
+    value = reference<decltype(at(0u, 0u))>(buffer.size());
+    value["shape"].append(rows);
+    value["shape"].append(cols);
+    for (unsigned int i = 0; i < rows; i++) {
+      for (unsigned int j = 0; j < cols; j++) {
+        buffer.push_back(at(i, j));
+      }
+    }
+  }
+
+  // Sets value to the vector of values at(i).
+  template<typename Accessor>
+  void setVector(Json::Value &value, unsigned int size, Accessor at) {
+    if (!m_enabled) {
+      value = Json::Value(Json::arrayValue);
+      for (unsigned int i = 0; i < size; i++) {
+        value.append(at(i));
+      }
+      return;
+    }
+    auto &buffer = getBuffer<decltype(at(0u))>();
+    value = reference<decltype(at(0u))>(buffer.size());
+    value["shape"].append(size);
+    for (unsigned int i = 0; i < size; i++) {
+      buffer.push_back(at(i));
+    }
+  }
+
+  // Writes the rows x cols matrix of values at(i, j), or its reference.
+  template<typename Accessor>
+  void writeMatrix(JsonWriter &writer, unsigned int rows, unsigned int cols, Accessor at) {
+    if (!m_enabled) {
+      writer.matrix(rows, cols, at);
+      return;
+    }
+    auto &buffer = getBuffer<decltype(at(0u, 0u))>();
+    writeReference(writer, bufferType<decltype(at(0u, 0u))>(), buffer.size(), { rows, cols });
+    for (unsigned int i = 0; i < rows; i++) {
+      for (unsigned int j = 0; j < cols; j++) {
+        buffer.push_back(at(i, j));
+      }
+    }
+  }
+
+  // Writes the vector of values at(i), or its reference.
+  template<typename Accessor>
+  void writeVector(JsonWriter &writer, unsigned int size, Accessor at) {
+    if (!m_enabled) {
+      writer.vector(size, at);
+      return;
+    }
+    auto &buffer = getBuffer<decltype(at(0u))>();
+    writeReference(writer, bufferType<decltype(at(0u))>(), buffer.size(), { size });
+    for (unsigned int i = 0; i < size; i++) {
+      buffer.push_back(at(i));
+    }
+  }
+
+  // Writes a reference to a copy of the size bytes at data in the Uint8
+  // buffer. Without binary responses there is nowhere to put them, the caller
+  // has to encode them into the JSON itself.
+  void writeBytes(JsonWriter &writer, const char *data, size_t size);
+
+  /**
+   * Lists the buffers that will be sent in response["binaryBuffers"], so the
+   * client knows which frames to wait for.
+   */
+  void describe(Json::Value &response) const;
+
+  const std::vector<float>& getFloats() const {
+    return m_floats;
+  }
+
+  const std::vector<int32_t>& getInts() const {
+    return m_ints;
+  }
+
+  const std::vector<char>& getBytes() const {
+    return m_bytes;
+  }
+
+  // Bytes of array data in the buffers.
+  size_t byteSize() const {
+    return m_floats.size() * sizeof(float) + m_ints.size() * sizeof(int32_t) + m_bytes.size();
+  }
+
+  static const char *kFloat32;
+  static const char *kInt32;
+  static const char *kUint8;
+
+ private:
+  template<typename T>
+  using IsFloat = std::is_floating_point<typename std::decay<T>::type>;
+
+  template<typename T>
+  typename std::enable_if<IsFloat<T>::value, std::vector<float>&>::type getBuffer() {
+    return m_floats;
+  }
+
+  template<typename T>
+  typename std::enable_if<!IsFloat<T>::value, std::vector<int32_t>&>::type getBuffer() {
+    return m_ints;
+  }
+
+  template<typename T>
+  static const char* bufferType() {
+    return IsFloat<T>::value ? kFloat32 : kInt32;
+  }
+
+  template<typename T>
+  Json::Value reference(size_t offset) const {
+    Json::Value value(Json::objectValue);
+    value["bufferType"] = bufferType<T>();
+    value["offset"] = Json::UInt(offset);
+    value["shape"] = Json::Value(Json::arrayValue);
+    return value;
+  }
+
+  void writeReference(JsonWriter &writer, const char *bufferType, size_t offset,
+                      std::initializer_list<unsigned int> shape) const {
+    writer.beginObject();
+    writer.key("bufferType").value(bufferType);
+    writer.key("offset").value(offset);
+    writer.key("shape").beginArray();
+    for (unsigned int extent : shape) {
+      writer.value(extent);
+    }
+    writer.endArray();
+    writer.endObject();
+  }
+
+  bool m_enabled;
+  std::vector<float> m_floats;
+  std::vector<int32_t> m_ints;
+  std::vector<char> m_bytes;
+};
@@ -4,6 +4,7 @@
 #include "dspacex/DatasetLoader.h"
 #include "flinalg/DenseMatrix.h"
 #include "flinalg/DenseVector.h"
+#include "flinalg/EigenInterop.h"
 #include "flinalg/Linalg.h"
 #include "flinalg/LinalgIO.h"
 #include "hdprocess/HDGenericProcessor.h"
@@ -13,6 +14,7 @@
 #include <jsoncpp/json/json.h>
 #include "dspacex/Precision.h"
 #include "serverlib/wst.h"
+#include "utils/ContentHash.h"
 #include "utils/DenseVectorSample.h"
 #include "utils/loaders.h"
 #include "utils/utils.h"
@@ -20,12 +22,17 @@
 
 #include <cassert>
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <exception>
 #include <functional>
 #include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <stdexcept>
 #include <string>
 
 using namespace dspacex;
@@ -36,12 +43,34 @@ using namespace std::placeholders;
 // Maximum number of directories from root path to seek config.yaml files
 const int MAX_DATASET_DEPTH = 3;
 
+// Commands that only read server-wide state. They run on their own thread so
+// they are answered right away even while all workers are processing data.
+const std::set<std::string> kFastCommands = {
+  "bindDataSocket", "cancelRequest", "fetchDatasetList", "fetchServerCacheStats"
+};
 
-Controller::Controller(const std::string &datapath_) : datapath(datapath_) {
+thread_local Controller::CommandContext *Controller::s_context = nullptr;
+
+
+Controller::Controller(const std::string &datapath_, size_t resultCacheBytes,
+                       const std::string &resultCachePath, size_t datasetBytes,
+                       size_t modelBytes) :
+    m_datasetBudget(datasetBytes), m_resultCache(resultCacheBytes),
+    m_resultDiskCache(resultCachePath), datapath(datapath_), m_fastLane(1) {
+  dspacex::ModelCache::instance().setBudget(modelBytes);
   configureCommandHandlers();
   configureAvailableDatasets(datapath);
 }
 
+/**
+ * Search nearest neighbors of samples and regression points with the given
+ * backend instead of computing distances blockwise. Must be set before the
+ * controller handles any request.
+ */
+void Controller::setKNNBackend(std::unique_ptr<KNNBackend<Precision>> backend) {
+  m_knnBackend = std::move(backend);
+}
+
 // sendError
 // Sets the given error message in the Json response.
 void Controller::sendError(Json::Value &response, std::string str)
@@ -54,6 +83,8 @@ void Controller::sendError(Json::Value &response, std::string str)
  * Construct map of command names to command handlers.
  */
 void Controller::configureCommandHandlers() {
+  m_commandMap.insert({"bindDataSocket", std::bind(&Controller::bindDataSocket, this, _1, _2)});
+  m_commandMap.insert({"cancelRequest", std::bind(&Controller::cancelRequest, this, _1, _2)});
   m_commandMap.insert({"fetchDatasetList", std::bind(&Controller::fetchDatasetList, this, _1, _2)});
   m_commandMap.insert({"fetchDataset", std::bind(&Controller::fetchDataset, this, _1, _2)});
   m_commandMap.insert({"fetchKNeighbors", std::bind(&Controller::fetchKNeighbors, this, _1, _2)});
@@ -69,11 +100,13 @@ void Controller::configureCommandHandlers() {
   m_commandMap.insert({"fetchParameter", std::bind(&Controller::fetchParameter, this, _1, _2)});
   m_commandMap.insert({"fetchQoi", std::bind(&Controller::fetchQoi, this, _1, _2)});
   m_commandMap.insert({"fetchThumbnails", std::bind(&Controller::fetchThumbnails, this, _1, _2)});
+  m_commandMap.insert({"fetchThumbnailRange", std::bind(&Controller::fetchThumbnailRange, this, _1, _2)});
   m_commandMap.insert({"fetchImageForLatentSpaceCoord_Shapeodds", std::bind(&Controller::fetchImageForLatentSpaceCoord_Shapeodds, this, _1, _2)});
   m_commandMap.insert({"fetchNImagesForCrystal_Shapeodds", std::bind(&Controller::fetchNImagesForCrystal_Shapeodds, this, _1, _2)});
   m_commandMap.insert({"fetchAllImagesForCrystal_Shapeodds", std::bind(&Controller::fetchAllImagesForCrystal_Shapeodds, this, _1, _2)});
 
   m_commandMap.insert({"fetchAllForLatentSpaceUsingSharedGP", std::bind(&Controller::fetchAllForLatentSpaceUsingSharedGP, this, _1, _2)});
+  m_commandMap.insert({"fetchServerCacheStats", std::bind(&Controller::fetchServerCacheStats, this, _1, _2)});
 }
 
 /**
@@ -128,48 +161,423 @@ void Controller::configureAvailableDatasets(const std::string &path) {
 bool Controller::verifyFieldname(Fieldtype type, const std::string &name)
 {
   if (type == Fieldtype::QoI) {
-    auto qois = m_currentDataset->getQoiNames();
+    auto qois = dataset().getQoiNames();
     return std::find(std::begin(qois), std::end(qois), name) != std::end(qois);
   }
   else if (type == Fieldtype::DesignParameter) {
-    auto parameters = m_currentDataset->getParameterNames();
+    auto parameters = dataset().getParameterNames();
     return std::find(std::begin(parameters), std::end(parameters), name) != std::end(parameters);
   }
   return false;
 }    
 
+/**
+ * Handle a frame from a data socket. The only frame clients send is the
+ * registration of the socket under a token, which the client then passes to
+ * bindDataSocket over its text socket to pair the two.
+ */
 void Controller::handleData(void *wsi, void *data) {
-  // TODO:  Implement
+  wstData *frame = static_cast<wstData*>(data);
+  if (!frame) {
+    return;
+  }
+  if (std::string(frame->name) == "registerDataSocket" && frame->hlen > 0) {
+    std::lock_guard<std::mutex> lock(m_socketsMutex);
+    m_dataSockets[frame->header[0]] = wsi;
+  } else {
+    std::cout << "Error: Unrecognized data frame: " << frame->name << std::endl;
+  }
+  wst_freeData(frame);
 }
 
+/**
+ * Handle a command from a text socket. Commands run on worker threads so that
+ * the socket keeps answering while data is processed; their replies are
+ * posted back to the socket's service thread.
+ *
+ * A request identical to one that is still queued or running, apart from its
+ * id and channel, waits for that command's reply instead of running again.
+ * A request with a "channel" supersedes the previous request of its socket on
+ * the same channel, e.g. while the client drags the persistence slider only
+ * the last level asked for matters. The superseded request is answered with
+ * {"id": id, "cancelled": true} right away.
+ */
 void Controller::handleText(void *wsi, const std::string &text) {
   Json::Reader reader;
   Json::Value request;
+  if (!reader.parse(text, request)) {
+    std::cerr << "Command Execution Error: " << reader.getFormattedErrorMessages() << std::endl;
+    return;
+  }
+  int messageId = request["id"].asInt();
+  std::string commandName = request["name"].asString();
+  std::string channel = request["channel"].asString();
+
+  std::shared_ptr<PendingCommand> command(new PendingCommand);
+  command->request = request;
+  command->socket = wsi;
+  command->waiters.push_back({wsi, messageId, channel});
+  if (request["binary"].asBool()) {
+    std::lock_guard<std::mutex> lock(m_socketsMutex);
+    auto bound = m_boundDataSockets.find(wsi);
+    command->dataSocket = bound == m_boundDataSockets.end() ? nullptr : bound->second;
+  }
 
-  try {
-    reader.parse(text, request);
-    int messageId = request["id"].asInt();
-    std::string commandName = request["name"].asString();
+  // Fast commands are cheap and act on the socket that sent them.
+  if (kFastCommands.count(commandName)) {
     std::cout << "[" << messageId << "] " << commandName << std::endl;
+    m_fastLane.submit([this, command]() { runCommand(command); });
+    return;
+  }
 
-    Json::Value response(Json::objectValue);
-    response["id"] = messageId;
+  {
+    std::lock_guard<std::mutex> lock(m_sessionsMutex);
+    if (!m_sessions.count(wsi)) {
+      m_sessions[wsi] = std::make_shared<Session>();
+    }
+  }
 
-    auto command = m_commandMap[commandName];
-    if (command) {
-      command(request, response);
+  // A command runs in the session of its text socket and sends binary
+  // responses on a single data socket, so only requests of the same sockets
+  // can share it.
+  Json::Value identity = request;
+  identity.removeMember("id");
+  identity.removeMember("channel");
+  std::ostringstream key;
+  key << wsi << " " << command->dataSocket << " " << Json::FastWriter().write(identity);
+  command->key = key.str();
+
+  int joined = -1;
+  int superseded = -1;
+  {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    auto pending = m_pending.find(command->key);
+    if (pending != m_pending.end()) {
+      joined = pending->second->request["id"].asInt();
+      pending->second->waiters.push_back(command->waiters.front());
     } else {
-      std::cout << "Error: Unrecognized Command: " << commandName << std::endl;
+      m_pending[command->key] = command;
+    }
+    // Drop the previous request of the channel only after joining, so that
+    // resending the same request doesn't cancel the command it joins.
+    if (!channel.empty()) {
+      auto latest = m_channels.find({wsi, channel});
+      if (latest != m_channels.end() && dropWaiter(wsi, latest->second)) {
+        superseded = latest->second;
+      }
+      m_channels[{wsi, channel}] = messageId;
     }
+  }
 
-    Json::StyledWriter writer;
-    std::string text = writer.write(response);
-    wst_sendText(wsi, const_cast<char *>(text.c_str()));
+  if (superseded >= 0) {
+    std::cout << "[" << superseded << "] superseded by [" << messageId << "]" << std::endl;
+    postCancelled(wsi, superseded);
+  }
+  if (joined >= 0) {
+    std::cout << "[" << messageId << "] " << commandName << " joins [" << joined << "]" << std::endl;
+    return;
+  }
+  std::cout << "[" << messageId << "] " << commandName << std::endl;
+  m_executor.submit(commandKey(request, wsi), [this, command]() { runCommand(command); });
+}
+
+/**
+ * Forget the pairing of a closed text or data socket and stop the commands
+ * only it was waiting for. The session of a text socket is closed once its
+ * queued commands are done.
+ */
+void Controller::handleClose(void *wsi) {
+  std::shared_ptr<Session> session;
+  {
+    std::lock_guard<std::mutex> lock(m_sessionsMutex);
+    auto found = m_sessions.find(wsi);
+    if (found != m_sessions.end()) {
+      session = found->second;
+      m_sessions.erase(found);
+    }
+  }
+  if (session) {
+    m_executor.submit(sessionKey(wsi), [this, session, wsi]() {
+      closeSession(*session, wsi);
+    });
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_socketsMutex);
+    m_boundDataSockets.erase(wsi);
+    for (auto iter = m_boundDataSockets.begin(); iter != m_boundDataSockets.end();) {
+      iter = iter->second == wsi ? m_boundDataSockets.erase(iter) : std::next(iter);
+    }
+    for (auto iter = m_dataSockets.begin(); iter != m_dataSockets.end();) {
+      iter = iter->second == wsi ? m_dataSockets.erase(iter) : std::next(iter);
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(m_pendingMutex);
+  for (auto iter = m_pending.begin(); iter != m_pending.end();) {
+    std::vector<Waiter> &waiters = iter->second->waiters;
+    waiters.erase(std::remove_if(waiters.begin(), waiters.end(),
+                                 [wsi](const Waiter &waiter) { return waiter.socket == wsi; }),
+                  waiters.end());
+    if (waiters.empty()) {
+      iter->second->cancellation.cancel();
+      iter = m_pending.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+  for (auto iter = m_channels.begin(); iter != m_channels.end();) {
+    iter = iter->first.first == wsi ? m_channels.erase(iter) : std::next(iter);
+  }
+}
+
+/**
+ * Stop waiting for the reply to a request. The command is cancelled if no
+ * other request waits for it. Returns false if the request already got its
+ * reply. The caller must hold m_pendingMutex.
+ */
+bool Controller::dropWaiter(void *socket, int messageId) {
+  for (auto iter = m_pending.begin(); iter != m_pending.end(); ++iter) {
+    std::vector<Waiter> &waiters = iter->second->waiters;
+    auto waiter = std::find_if(waiters.begin(), waiters.end(), [&](const Waiter &waiter) {
+      return waiter.socket == socket && waiter.messageId == messageId;
+    });
+    if (waiter == waiters.end()) {
+      continue;
+    }
+    waiters.erase(waiter);
+    if (waiters.empty()) {
+      iter->second->cancellation.cancel();
+      m_pending.erase(iter);
+    }
+    return true;
+  }
+  return false;
+}
+
+void Controller::postCancelled(void *socket, int messageId) {
+  std::string text;
+  JsonWriter writer(text);
+  writer.beginObject();
+  writer.key("id").value(messageId);
+  writer.key("cancelled").value(true);
+  writer.endObject();
+  wst_postText(socket, text.c_str());
+}
+
+/**
+ * Commands of a session depend on its current result, so they are serialized
+ * per session. Sessions run concurrently, also on the same dataset, which
+ * they only read. Commands without a dataset run on any worker.
+ */
+std::string Controller::commandKey(const Json::Value &request, void *socket) const {
+  const Json::Value &datasetId = request["datasetId"];
+  if (!datasetId.isIntegral() || datasetId.asInt() < 0 ||
+      datasetId.asUInt() >= m_availableDatasets.size()) {
+    return "";
+  }
+  return sessionKey(socket);
+}
+
+std::string Controller::sessionKey(void *socket) const {
+  std::ostringstream key;
+  key << "session/" << socket;
+  return key.str();
+}
+
+/**
+ * Run a command on the calling worker thread and post its reply to every
+ * request waiting for it. A command cancelled before it started is skipped.
+ */
+void Controller::runCommand(std::shared_ptr<PendingCommand> command) {
+  const Json::Value &request = command->request;
+  int messageId = request["id"].asInt();
+  std::string commandName = request["name"].asString();
+
+  // Bulk members are written straight into a buffer the thread reuses, so
+  // that it keeps its capacity from one response to the next.
+  static thread_local std::string members;
+  members.clear();
+  JsonWriter writer(members, true);
+
+  Json::Value response(Json::objectValue);
+  BinaryResponse binary(command->dataSocket != nullptr);
+  CommandContext context;
+  context.socket = command->socket;
+  context.binary = &binary;
+  context.writer = &writer;
+  context.cancellation = &command->cancellation;
+  s_context = &context;
+
+  // A command whose socket closed after it was queued runs in a session of
+  // its own that is closed right after.
+  std::shared_ptr<Session> session;
+  bool closed = false;
+  if (!kFastCommands.count(commandName)) {
+    std::lock_guard<std::mutex> lock(m_sessionsMutex);
+    auto found = m_sessions.find(command->socket);
+    closed = found == m_sessions.end();
+    session = closed ? std::make_shared<Session>() : found->second;
+    context.session = session.get();
+  }
+
+  auto handler = m_commandMap.find(commandName);
+  try {
+    command->cancellation.throwIfCancelled();
+    // Handlers may look at the dataset before they ask to load it.
+    if (!commandKey(request, command->socket).empty() && !kFastCommands.count(commandName)) {
+      maybeLoadDataset(request["datasetId"].asInt());
+    }
+    if (handler == m_commandMap.end()) {
+      std::cout << "Error: Unrecognized Command: " << commandName << std::endl;
+    } else {
+      handler->second(request, response);
+    }
+    if (!writer.isComplete()) {
+      throw std::logic_error(commandName + " left its response incomplete");
+    }
+  } catch (const OperationCancelled &) {
+    std::cout << "[" << messageId << "] " << commandName << " cancelled" << std::endl;
+    members.clear();
   } catch (const std::exception &e) {
     std::cerr << "Command Execution Error: " << e.what() << std::endl;
+    members.clear();
+    sendError(response, e.what());
+  }
+  if (closed) {
+    closeSession(*session, command->socket);
+  }
+  context.stream.reset();
+  context.dataset.reset();
+  s_context = nullptr;
+
+  std::vector<Waiter> waiters;
+  {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    auto pending = m_pending.find(command->key);
+    if (pending != m_pending.end() && pending->second == command) {
+      m_pending.erase(pending);
+    }
+    waiters.swap(command->waiters);
+    for (const Waiter &waiter : waiters) {
+      auto latest = m_channels.find({waiter.socket, waiter.channel});
+      if (latest != m_channels.end() && latest->second == waiter.messageId) {
+        m_channels.erase(latest);
+      }
+    }
+  }
+
+  if (binary.isEnabled()) {
+    binary.describe(response);
+  }
+  static thread_local std::string text;
+  for (const Waiter &waiter : waiters) {
+    // The frames go out first so that they are usually in by the time the
+    // client reads the JSON, which lists the ones to wait for.
+    if (binary.isEnabled()) {
+      sendBinaryResponse(command->dataSocket, waiter.messageId, binary);
+    }
+    response["id"] = waiter.messageId;
+    text.clear();
+    JsonWriter(text).beginObject().members(response).rawMembers(members).endObject();
+    wst_postText(waiter.socket, text.c_str());
+  }
+}
+
+Controller::CommandContext& Controller::context() const {
+  if (!s_context) {
+    throw std::logic_error("No command is running on this thread");
+  }
+  return *s_context;
+}
+
+/**
+ * Returns the session of the socket the running command came from.
+ */
+Controller::Session& Controller::session() const {
+  if (!context().session) {
+    throw std::logic_error("Command runs outside of a session");
+  }
+  return *context().session;
+}
+
+/**
+ * Returns the dataset of the running command, loaded by maybeLoadDataset.
+ */
+dspacex::Dataset& Controller::dataset() const {
+  if (!context().dataset) {
+    throw std::logic_error("Command uses a dataset it did not load");
+  }
+  return *context().dataset->dataset;
+}
+
+/**
+ * Post the Float32, Int32 and Uint8 buffers of a binary response as frames
+ * named "response" whose header holds the message id.
+ */
+void Controller::sendBinaryResponse(void *wsi, int messageId, const BinaryResponse &binary) {
+  // wst_postData copies the frame, so it can point at the buffers.
+  char name[] = "response";
+  int header[] = { messageId };
+  wstData frame;
+  frame.name = name;
+  frame.hlen = 1;
+  frame.header = header;
+  if (!binary.getFloats().empty()) {
+    frame.type = WST_Float32;
+    frame.len = binary.getFloats().size();
+    frame.data = const_cast<float*>(binary.getFloats().data());
+    wst_postData(wsi, &frame);
+  }
+  if (!binary.getInts().empty()) {
+    frame.type = WST_Int32;
+    frame.len = binary.getInts().size();
+    frame.data = const_cast<int32_t*>(binary.getInts().data());
+    wst_postData(wsi, &frame);
+  }
+  if (!binary.getBytes().empty()) {
+    frame.type = WST_Uint8;
+    frame.len = binary.getBytes().size();
+    frame.data = const_cast<char*>(binary.getBytes().data());
+    wst_postData(wsi, &frame);
   }
 }
 
+/**
+ * Handle the command to pair the requesting text socket with the data socket
+ * the client registered under the given token, so that bulk arrays of later
+ * responses can be sent as binary frames.
+ */
+void Controller::bindDataSocket(const Json::Value &request, Json::Value &response) {
+  std::lock_guard<std::mutex> lock(m_socketsMutex);
+  auto dataSocket = m_dataSockets.find(request["token"].asInt());
+  if (dataSocket == m_dataSockets.end())
+    return sendError(response, "unknown data socket token");
+
+  m_boundDataSockets[context().socket] = dataSocket->second;
+  m_dataSockets.erase(dataSocket);
+  response["bound"] = true;
+}
+
+/**
+ * Handle the command to cancel an earlier request of the requesting socket.
+ * The cancelled request is answered with a cancellation notice, and its
+ * command stops unless identical requests still wait for it.
+ */
+void Controller::cancelRequest(const Json::Value &request, Json::Value &response) {
+  int messageId = request["requestId"].asInt();
+  bool cancelled;
+  {
+    std::lock_guard<std::mutex> lock(m_pendingMutex);
+    cancelled = dropWaiter(context().socket, messageId);
+  }
+  if (cancelled) {
+    postCancelled(context().socket, messageId);
+  }
+  response["requestId"] = messageId;
+  response["requestCancelled"] = cancelled;
+}
+
 /**
  * Handle the command to fetch list of available datasets.
  */
@@ -195,14 +603,14 @@ void Controller::fetchDataset(const Json::Value &request, Json::Value &response)
   maybeLoadDataset(datasetId);
 
   response["datasetId"] = datasetId;
-  response["name"] = m_currentDataset->getName();
-  response["numberOfSamples"] = m_currentDataset->numberOfSamples();
+  response["name"] = dataset().getName();
+  response["numberOfSamples"] = dataset().numberOfSamples();
   response["parameterNames"] = Json::Value(Json::arrayValue);
-  for (std::string parameterName : m_currentDataset->getParameterNames()) {
+  for (std::string parameterName : dataset().getParameterNames()) {
     response["parameterNames"].append(parameterName);
   }
   response["qoiNames"] = Json::Value(Json::arrayValue);
-  for (std::string qoiName : m_currentDataset->getQoiNames()) {
+  for (std::string qoiName : dataset().getQoiNames()) {
     response["qoiNames"].append(qoiName);
   }
 }
@@ -219,22 +627,27 @@ void Controller::fetchKNeighbors(const Json::Value &request, Json::Value &respon
   int k = request["k"].asInt();
   if (k < 0) return sendError(response, "invalid knn");
 
-  // TODO: Don't reprocess data if previous commands already did so.
-  int n = m_currentDataset->getDistanceMatrix().N();
+  maybeLoadDataset(datasetId);
+  LoadedDataset &dataset = *context().dataset;
+  bool samplesOnly = dataset.hasSamplesOnly();
+  FortranLinalg::DenseMatrix<Precision> &matrix =
+      samplesOnly ? dataset.dataset->getSamplesMatrix() : dataset.getDistanceMatrix();
+  int n = matrix.N();
+  k = std::min(k, n);
   auto KNN = FortranLinalg::DenseMatrix<int>(k, n);
   auto KNND = FortranLinalg::DenseMatrix<Precision>(k, n);
-  Distance<Precision>::findKNN(m_currentDataset->getDistanceMatrix(), KNN, KNND);
+  if (samplesOnly) {
+    m_knnGraphCache.findSampleKNN(datasetId, matrix, KNN, KNND, 0, m_knnBackend.get());
+  } else {
+    m_knnGraphCache.findKNN(datasetId, matrix, KNN, KNND);
+  }
 
   response["datasetId"] = datasetId;
   response["k"] = k;
-  response["graph"] = Json::Value(Json::arrayValue);
-  for (unsigned i = 0; i < KNN.M(); i++) {
-    Json::Value row = Json::Value(Json::arrayValue);
-    response["graph"].append(row);
-    for (unsigned int j = 0; j < KNN.N(); j++) {
-      response["graph"][i].append(KNN(i, j));
-    }
-  }
+  context().binary->writeMatrix(context().writer->key("graph"), KNN.M(), KNN.N(),
+                                [&](unsigned int i, unsigned int j) { return KNN(i, j); });
+  KNN.deallocate();
+  KNND.deallocate();
 }
 /**
  * Handle the command to fetch the morse smale persistence levels of a dataset.
@@ -257,20 +670,30 @@ void Controller::fetchMorseSmalePersistence(const Json::Value &request, Json::Va
   std::string fieldname = request["fieldname"].asString();
   if (!verifyFieldname(category, fieldname)) return sendError(response, "invalid fieldname");
 
+  // A streamed reply comes as soon as the persistence levels are known. The
+  // levels are announced with persistenceLevelReady events as they complete.
+  bool stream = request["stream"].asBool();
+
   maybeLoadDataset(datasetId);
-  maybeProcessData(category, fieldname, k);
+  maybeProcessData(category, fieldname, k, stream ? ProcessingMode::Streamed : ProcessingMode::Complete);
 
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  if (!session().topoData) return sendError(response, "no processed data for the session");
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
+  ResultStream *pending = context().stream.get();
 
   response["datasetId"] = datasetId;
   response["decompositionMode"] = "Morse-Smale";
   response["minPersistenceLevel"] = minLevel;
   response["maxPersistenceLevel"] = maxLevel;
+  response["streaming"] = pending && !pending->isFinished();
   response["complexSizes"] = Json::Value(Json::arrayValue);
   for (int level = minLevel; level <= maxLevel; level++) {
-    MorseSmaleComplex *complex = m_currentTopoData->getComplex(level);
-    int size = complex->getCrystals().size();
+    // Levels still being computed have no crystals yet.
+    int size = 0;
+    if (!pending || pending->isLevelReady(level)) {
+      size = session().topoData->getComplex(level)->getCrystals().size();
+    }
     response["complexSizes"].append(size);
   }
 }
@@ -296,16 +719,19 @@ void Controller::fetchMorseSmalePersistenceLevel(const Json::Value &request, Jso
   if (!verifyFieldname(category, fieldname)) return sendError(response, "invalid fieldname");
 
   maybeLoadDataset(datasetId);
-  maybeProcessData(category, fieldname, k);
+  maybeProcessData(category, fieldname, k, ProcessingMode::Streamed);
+
+  if (!session().topoData) return sendError(response, "no processed data for the session");
 
   // get requested persistence level
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
   int persistenceLevel = request["persistenceLevel"].asInt();
   if (persistenceLevel < minLevel || persistenceLevel > maxLevel)
     return sendError(response, "invalid persistence level");
+  waitForLevel(persistenceLevel);
 
-  MorseSmaleComplex *complex = m_currentTopoData->getComplex(persistenceLevel);
+  MorseSmaleComplex *complex = session().topoData->getComplex(persistenceLevel);
 
   response["datasetId"] = datasetId;
   response["decompositionMode"] = "Morse-Smale";
@@ -348,16 +774,19 @@ void Controller::fetchMorseSmaleCrystal(const Json::Value &request, Json::Value
   if (!verifyFieldname(category, fieldname)) return sendError(response, "invalid fieldname");
 
   maybeLoadDataset(datasetId);
-  maybeProcessData(category, fieldname, k);
+  maybeProcessData(category, fieldname, k, ProcessingMode::Streamed);
+
+  if (!session().topoData) return sendError(response, "no processed data for the session");
 
   // get requested persistence level
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
   int persistenceLevel = request["persistenceLevel"].asInt();
   if (persistenceLevel < minLevel || persistenceLevel > maxLevel)
     return sendError(response, "invalid persistence level");
+  waitForLevel(persistenceLevel);
 
-  MorseSmaleComplex *complex = m_currentTopoData->getComplex(persistenceLevel);
+  MorseSmaleComplex *complex = session().topoData->getComplex(persistenceLevel);
 
   int crystalId = request["crystalId"].asInt();
   if (crystalId < 0 || crystalId >= complex->getCrystals().size())
@@ -405,33 +834,38 @@ void Controller::fetchMorseSmaleDecomposition(const Json::Value &request, Json::
   maybeLoadDataset(datasetId);
   maybeProcessData(category, fieldname, k);
 
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  if (!session().topoData) return sendError(response, "no processed data for the session");
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
 
   response["datasetId"] = datasetId;
   response["decompositionMode"] = "Morse-Smale";
   response["minPersistenceLevel"] = minLevel;
   response["maxPersistenceLevel"] = maxLevel;
-  response["complexes"] = Json::Value(Json::arrayValue);
+
+  // Every level lists the samples of all of its crystals, so the complexes
+  // are written as they are read rather than built as a Json::Value.
+  JsonWriter &writer = *context().writer;
+  writer.key("complexes").beginArray();
   for (unsigned int level = minLevel; level <= maxLevel; level++) {
-    MorseSmaleComplex *complex = m_currentTopoData->getComplex(level);
-    Json::Value complexObject(Json::objectValue);
-    complexObject["crystals"] = Json::Value(Json::arrayValue);
+    MorseSmaleComplex *complex = session().topoData->getComplex(level);
+    writer.beginObject();
+    writer.key("crystals").beginArray();
     for (unsigned int c = 0; c < complex->getCrystals().size(); c++) {
       Crystal *crystal = complex->getCrystals()[c];
-      Json::Value crystalObject(Json::objectValue);
-      crystalObject["minIndex"] = crystal->getMinSample();
-      crystalObject["maxIndex"] = crystal->getMaxSample();
-      crystalObject["sampleIndexes"] = Json::Value(Json::arrayValue);
-      for (unsigned int i = 0; i < crystal->getAllSamples().size(); i++) {
-        unsigned int index = crystal->getAllSamples()[i];
-        crystalObject["sampleIndexes"].append(index);
-      }
-      complexObject["crystals"].append(crystalObject);
+      writer.beginObject();
+      writer.key("minIndex").value(crystal->getMinSample());
+      writer.key("maxIndex").value(crystal->getMaxSample());
+      auto &samples = crystal->getAllSamples();
+      context().binary->writeVector(writer.key("sampleIndexes"), samples.size(),
+                                    [&](unsigned int i) { return samples[i]; });
+      writer.endObject();
     }
+    writer.endArray();
     // TODO: Add adjacency to the complex json object.
-    response["complexes"].append(complexObject);
+    writer.endObject();
   }
+  writer.endArray();
 }
 
 /**
@@ -461,18 +895,22 @@ void Controller::fetchSingleEmbedding(const Json::Value &request, Json::Value &r
   if (!verifyFieldname(category, fieldname)) return sendError(response, "invalid field name");
 
   maybeLoadDataset(datasetId);
-  maybeProcessData(category, fieldname, k);
+  maybeProcessData(category, fieldname, k, ProcessingMode::Streamed);
+
+  if (!session().topoData) return sendError(response, "no processed data for the session");
 
   // get requested persistence level
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
   int persistenceLevel = request["persistenceLevel"].asInt();
   if (persistenceLevel < minLevel || persistenceLevel > maxLevel)
     return sendError(response, "invalid persistence level");
+  waitForLevel(persistenceLevel);
 
-  if (m_currentDataset->numberOfEmbeddings() > 0) {
-    auto embedding = m_currentDataset->getEmbeddingMatrix(embeddingId);
-    auto name = m_currentDataset->getEmbeddingNames()[embeddingId];
+  JsonWriter &writer = *context().writer;
+  if (dataset().numberOfEmbeddings() > 0) {
+    auto embedding = dataset().getEmbeddingMatrix(embeddingId);
+    auto name = dataset().getEmbeddingNames()[embeddingId];
 
     // TODO: Factor out a normalizing routine.
     float minX = embedding(0, 0);
@@ -485,57 +923,46 @@ void Controller::fetchSingleEmbedding(const Json::Value &request, Json::Value &r
       minY = embedding(i, 1) < minY ? embedding(i, 1) : minY;
       maxY = embedding(i, 1) > maxY ? embedding(i, 1) : maxY;
     }
-    for (int i = 0; i < embedding.M(); i++) {
-      embedding(i, 0) = (embedding(i, 0) - minX) / (maxX - minX) - 0.5;
-      embedding(i, 1) = (embedding(i, 1) - minY) / (maxY - minY) - 0.5;
-    }
-
-    response["embedding"] = Json::Value(Json::objectValue);
-    response["embedding"]["name"] = name;
-    // TODO: Write utility for DenseMatrix to JSON nested array conversion.
-    auto layout = Json::Value(Json::arrayValue);
-    for (int i = 0; i < embedding.M(); i++) {
-      auto row = Json::Value(Json::arrayValue);
-      for (int j = 0; j < embedding.N(); j++) {
-        row.append(embedding(i, j));
-      }
-      layout.append(row);
-    }
-    response["embedding"]["layout"] = layout;
-
-    auto adjacency = Json::Value(Json::arrayValue);
-    auto neighbors = m_currentVizData->getNearestNeighbors();
+    // The layout is normalized as it is written, the dataset is shared by
+    // every session and stays as it was loaded.
+    float min[] = { minX, minY };
+    float range[] = { maxX - minX, maxY - minY };
+    auto normalized = [&](unsigned int i, unsigned int j) -> Precision {
+      return j < 2 ? (embedding(i, j) - min[j]) / range[j] - 0.5 : embedding(i, j);
+    };
+
+    writer.key("embedding").beginObject();
+    writer.key("name").value(name);
+    context().binary->writeMatrix(writer.key("layout"), embedding.M(), embedding.N(), normalized);
+
+    std::vector<std::pair<int, int>> adjacency;
+    auto neighbors = session().vizData->getNearestNeighbors();
     for (int i = 0; i < neighbors.N(); i++) {
       for (int j = 0; j < neighbors.M(); j++) {
         int neighbor = neighbors(j, i);
         if (i == neighbor)
           continue;
-        auto row = Json::Value(Json::arrayValue);
-        row.append(i);
-        row.append(neighbor);
-        adjacency.append(row);
+        adjacency.push_back({i, neighbor});
       }
-
     }
-    response["embedding"]["adjacency"] = adjacency;
+    context().binary->writeMatrix(writer.key("adjacency"), adjacency.size(), 2,
+        [&](unsigned int i, unsigned int j) { return j == 0 ? adjacency[i].first : adjacency[i].second; });
+    writer.endObject();
   }
 
   // get the vector of values for the requested field
-  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(category, fieldname);
+  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(dataset(), category, fieldname);
   if (!fieldvals.data())
     std::runtime_error("Invalid fieldname or empty field");
 
   // Get colors based on current field
-  auto colorMap = m_currentVizData->getColorMap(persistenceLevel);
-  response["colors"] = Json::Value(Json::arrayValue);
+  auto colorMap = session().vizData->getColorMap(persistenceLevel);
+  std::vector<Precision> colors(3 * fieldvals.size());
   for(unsigned int i = 0; i < fieldvals.size(); ++i) {
-    auto colorRow = Json::Value(Json::arrayValue);
-    auto color = colorMap.getColor(fieldvals(i));
-    colorRow.append(color[0]);
-    colorRow.append(color[1]);
-    colorRow.append(color[2]);
-    response["colors"].append(colorRow);
+    colorMap.getColor(fieldvals(i), &colors[3 * i]);
   }
+  context().binary->writeMatrix(writer.key("colors"), fieldvals.size(), 3,
+                                [&](unsigned int i, unsigned int j) { return colors[3 * i + j]; });
 }
 
 void Controller::fetchMorseSmaleRegression(const Json::Value &request, Json::Value &response) {
@@ -556,55 +983,50 @@ void Controller::fetchMorseSmaleRegression(const Json::Value &request, Json::Val
   if (!verifyFieldname(category, fieldname)) return sendError(response, "invalid fieldname");
 
   maybeLoadDataset(datasetId);
-  maybeProcessData(category, fieldname, k);
+  maybeProcessData(category, fieldname, k, ProcessingMode::Streamed);
+
+  if (!session().topoData) return sendError(response, "no processed data for the session");
 
   // get requested persistence level
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
   int persistenceLevel = request["persistenceLevel"].asInt();
   if (persistenceLevel < minLevel || persistenceLevel > maxLevel)
     return sendError(response, "invalid persistence level");
+  waitForLevel(persistenceLevel);
 
   // Get points for regression line
-  auto layout = m_currentVizData->getLayout(HDVizLayout::ISOMAP, persistenceLevel);
-  int rows = m_currentVizData->getNumberOfSamples();
-  double points[rows][3];
-  double colors[rows][3];
+  auto layout = session().vizData->getLayout(HDVizLayout::ISOMAP, persistenceLevel);
+  int rows = session().vizData->getNumberOfSamples();
+  std::vector<double> points(rows * 3);
+  std::vector<double> colors(rows * 3);
 
   // For each crystal
-  response["curves"] = Json::Value(Json::arrayValue);
-  for (unsigned int i = 0; i < m_currentVizData->getCrystals(persistenceLevel).N(); i++) {
+  JsonWriter &writer = *context().writer;
+  writer.key("curves").beginArray();
+  for (unsigned int i = 0; i < session().vizData->getCrystals(persistenceLevel).N(); i++) {
 
     // Get all the points and node colors
     for (unsigned int n = 0; n < layout[i].N(); ++n) {
-      auto color = m_currentVizData->getColorMap(persistenceLevel).getColor(m_currentVizData->getMean(persistenceLevel)[i](n));
-      colors[n][0] = color[0];
-      colors[n][1] = color[1];
-      colors[n][2] = color[2];
+      auto color = session().vizData->getColorMap(persistenceLevel).getColor(session().vizData->getMean(persistenceLevel)[i](n));
+      colors[3 * n + 0] = color[0];
+      colors[3 * n + 1] = color[1];
+      colors[3 * n + 2] = color[2];
 
       for (unsigned int m = 0; m < layout[i].M(); ++m) {
-        points[n][m] = layout[i](m, n);
+        points[3 * n + m] = layout[i](m, n);
       }
-      points[n][2] = m_currentVizData->getMeanNormalized(persistenceLevel)[i](n);
+      points[3 * n + 2] = session().vizData->getMeanNormalized(persistenceLevel)[i](n);
     }
 
     // Get layout for each crystal
-    Json::Value regressionObject(Json::objectValue);
-    regressionObject["id"] = i;
-    regressionObject["points"] = Json::Value(Json::arrayValue);
-    regressionObject["colors"] = Json::Value(Json::arrayValue);
-    for (unsigned int n = 0; n < rows; ++n) {
-      auto regressionRow = Json::Value(Json::arrayValue);
-      auto colorRow = Json::Value(Json::arrayValue);
-      for (unsigned int m = 0; m < 3; ++m) {
-        regressionRow.append(points[n][m]);
-        colorRow.append(colors[n][m]);
-      }
-      regressionObject["points"].append(regressionRow);
-      regressionObject["colors"].append(colorRow);
-    }
-    response["curves"].append(regressionObject);
+    writer.beginObject();
+    writer.key("id").value(i);
+    writer.key("points").matrix(rows, 3, [&](unsigned int n, unsigned int m) { return points[3 * n + m]; });
+    writer.key("colors").matrix(rows, 3, [&](unsigned int n, unsigned int m) { return colors[3 * n + m]; });
+    writer.endObject();
   }
+  writer.endArray();
 }
 
 void Controller::fetchMorseSmaleExtrema(const Json::Value &request, Json::Value &response) {
@@ -625,18 +1047,21 @@ void Controller::fetchMorseSmaleExtrema(const Json::Value &request, Json::Value
   if (!verifyFieldname(category, fieldname)) return sendError(response, "invalid fieldname");
 
   maybeLoadDataset(datasetId);
-  maybeProcessData(category, fieldname, k);
+  maybeProcessData(category, fieldname, k, ProcessingMode::Streamed);
+
+  if (!session().topoData) return sendError(response, "no processed data for the session");
 
   // get requested persistence level
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
   int persistenceLevel = request["persistenceLevel"].asInt();
   if (persistenceLevel < minLevel || persistenceLevel > maxLevel)
     return sendError(response, "invalid persistence level");
+  waitForLevel(persistenceLevel);
 
-  auto extremaLayout = m_currentVizData->getExtremaLayout(HDVizLayout::ISOMAP, persistenceLevel);
-  auto extremaNormalized = m_currentVizData->getExtremaNormalized(persistenceLevel);
-  auto extremaValues = m_currentVizData->getExtremaValues(persistenceLevel);
+  auto extremaLayout = session().vizData->getExtremaLayout(HDVizLayout::ISOMAP, persistenceLevel);
+  auto extremaNormalized = session().vizData->getExtremaNormalized(persistenceLevel);
+  auto extremaValues = session().vizData->getExtremaValues(persistenceLevel);
 
   response["extrema"] = Json::Value(Json::arrayValue);
   for (unsigned int i = 0; i < extremaLayout.N(); ++i) {
@@ -648,7 +1073,7 @@ void Controller::fetchMorseSmaleExtrema(const Json::Value &request, Json::Value
     extremaObject["position"].append(extremaNormalized(i));
 
     // Color
-    auto color = m_currentVizData->getColorMap(persistenceLevel).getColor(extremaValues(i));
+    auto color = session().vizData->getColorMap(persistenceLevel).getColor(extremaValues(i));
     extremaObject["color"] = Json::Value(Json::arrayValue);
     extremaObject["color"].append(color[0]);
     extremaObject["color"].append(color[1]);
@@ -663,24 +1088,36 @@ void Controller::fetchCrystalPartition(const Json::Value &request, Json::Value &
   if (datasetId < 0 || datasetId >= m_availableDatasets.size())
     return sendError(response, "invalid datasetid");
 
+  if (!session().topoData) return sendError(response, "no processed data for the session");
+
   // get requested persistence level
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
   int persistenceLevel = request["persistenceLevel"].asInt();
   if (persistenceLevel < minLevel || persistenceLevel > maxLevel)
     return sendError(response, "invalid persistence level");
+  const MSHierarchy *hierarchy = waitForPartitions(persistenceLevel);
 
   // the crystal id to look for in this persistence level
   int crystalID = request["crystalID"].asInt();
 
-  auto crystal_partition = m_currentVizData->getCrystalPartitions(persistenceLevel);
-
-  response["crystalSamples"] = Json::Value(Json::arrayValue);
-  for(unsigned int i = 0; i < crystal_partition.N(); ++i) {
-    if(crystal_partition(i) == crystalID) {
-      response["crystalSamples"].append(i);
+  JsonWriter &writer = *context().writer;
+  writer.key("crystalSamples").beginArray();
+  if (hierarchy) {
+    for (unsigned int i = 0; i < hierarchy->getSampleCount(); ++i) {
+      if (hierarchy->getCrystal(persistenceLevel, i) == crystalID) {
+        writer.value(i);
+      }
+    }
+  } else {
+    auto crystal_partition = session().vizData->getCrystalPartitions(persistenceLevel);
+    for(unsigned int i = 0; i < crystal_partition.N(); ++i) {
+      if(crystal_partition(i) == crystalID) {
+        writer.value(i);
+      }
     }
   }
+  writer.endArray();
 }
 
 void Controller::fetchEmbeddingsList(const Json::Value &request, Json::Value &response) {
@@ -691,7 +1128,7 @@ void Controller::fetchEmbeddingsList(const Json::Value &request, Json::Value &re
 
     maybeLoadDataset(datasetId);
 
-    auto embeddingNames = m_currentDataset->getEmbeddingNames();
+    auto embeddingNames = dataset().getEmbeddingNames();
     response["embeddings"] = Json::Value(Json::arrayValue);
     for (unsigned int i = 0; i < embeddingNames.size(); ++i) {
         Json::Value embeddingObject(Json::objectValue);
@@ -712,14 +1149,12 @@ void Controller::fetchParameter(const Json::Value &request, Json::Value &respons
 
   // get the vector of values for the requested field
   std::string parameterName = request["parameterName"].asString();
-  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(Fieldtype::DesignParameter, parameterName);
+  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(dataset(), Fieldtype::DesignParameter, parameterName);
   if (!fieldvals.data()) return sendError(response, "invalid fieldname");
   
   response["parameterName"] = parameterName;
-  response["parameter"] = Json::Value(Json::arrayValue);
-  for (int i = 0; i < fieldvals.size(); i++) {
-    response["parameter"].append(fieldvals(i));
-  }
+  context().binary->writeVector(context().writer->key("parameter"), fieldvals.size(),
+                                [&](unsigned int i) { return fieldvals(i); });
 }
 
 /**
@@ -733,14 +1168,12 @@ void Controller::fetchQoi(const Json::Value &request, Json::Value &response) {
 
   // get the vector of values for the requested field
   std::string qoiName = request["qoiName"].asString();
-  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(Fieldtype::QoI, qoiName);
+  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(dataset(), Fieldtype::QoI, qoiName);
   if (!fieldvals.data()) return sendError(response, "invalid fieldname");
   
   response["qoiName"] = qoiName;
-  response["qoi"] = Json::Value(Json::arrayValue);
-  for (int i = 0; i < fieldvals.size(); i++) {
-    response["qoi"].append(fieldvals(i));
-  }
+  context().binary->writeVector(context().writer->key("qoi"), fieldvals.size(),
+                                [&](unsigned int i) { return fieldvals(i); });
 }
 
 /**
@@ -752,20 +1185,75 @@ void Controller::fetchThumbnails(const Json::Value &request, Json::Value &respon
     return sendError(response, "invalid datasetid");
   maybeLoadDataset(datasetId);
 
-  auto thumbnails = m_currentDataset->getThumbnails();
+  const std::vector<Image> &thumbnails = dataset().getThumbnails();
 
-  response["thumbnails"] = Json::Value(Json::arrayValue);
-  for (auto image : thumbnails) {
-    Json::Value imageObject = Json::Value(Json::objectValue);
-    imageObject["width"] = image.getWidth();
-    imageObject["height"] = image.getHeight();
-    // imageObject["data"] = base64_encode(  // <ctc> not needed by anything, so why are we sending this?
-    //                                     reinterpret_cast<const unsigned char *>(image.getData()),
-    //                                     4 * image.getWidth() * image.getHeight());
-    imageObject["rawData"] = base64_encode(reinterpret_cast<const unsigned char *>(&image.getRawData()[0]),
-                                           image.getRawData().size());
-    response["thumbnails"].append(imageObject);
+  JsonWriter &writer = *context().writer;
+  writer.key("thumbnails").beginArray();
+  for (unsigned int i = 0; i < thumbnails.size(); i++) {
+    writeThumbnail(writer, i, thumbnails[i]);
   }
+  writer.endArray();
+}
+
+/**
+ * Handle the command to fetch a page of thumbnails, so that a gallery only
+ * asks for the ones it shows. The page is either "count" thumbnails from
+ * "offset" on, or the samples listed in "indexes". Over a data socket the PNG
+ * files are sent as they are in a Uint8 frame, otherwise base64 encoded.
+ *
+ * Response: { "total": thumbnails in the dataset,
+ *             "thumbnails": [{ "index", "width", "height", "rawData" }] }
+ */
+void Controller::fetchThumbnailRange(const Json::Value &request, Json::Value &response) {
+  int datasetId = request["datasetId"].asInt();
+  if (datasetId < 0 || datasetId >= (int) m_availableDatasets.size())
+    return sendError(response, "invalid datasetid");
+  maybeLoadDataset(datasetId);
+
+  const std::vector<Image> &thumbnails = dataset().getThumbnails();
+  std::vector<unsigned int> indexes;
+  if (request.isMember("indexes")) {
+    for (const Json::Value &index : request["indexes"]) {
+      if (!index.isIntegral() || index.asInt() < 0 || index.asUInt() >= thumbnails.size())
+        return sendError(response, "invalid thumbnail index");
+      indexes.push_back(index.asUInt());
+    }
+  } else {
+    int offset = request["offset"].asInt();
+    int count = request.isMember("count") ? request["count"].asInt() : thumbnails.size();
+    if (offset < 0 || count < 0)
+      return sendError(response, "invalid thumbnail range");
+    for (unsigned int i = offset; i < std::min<size_t>(offset + size_t(count), thumbnails.size()); i++) {
+      indexes.push_back(i);
+    }
+  }
+
+  response["total"] = static_cast<int>(thumbnails.size());
+  JsonWriter &writer = *context().writer;
+  writer.key("thumbnails").beginArray();
+  for (unsigned int index : indexes) {
+    writeThumbnail(writer, index, thumbnails[index]);
+  }
+  writer.endArray();
+}
+
+/**
+ * Writes the size and PNG data of a thumbnail, as bytes of a binary response
+ * if there is one and base64 encoded otherwise.
+ */
+void Controller::writeThumbnail(JsonWriter &writer, unsigned int index, const Image &image) {
+  const std::vector<char> &rawData = image.getConstRawData();
+  writer.beginObject();
+  writer.key("index").value(index);
+  writer.key("width").value(image.getWidth());
+  writer.key("height").value(image.getHeight());
+  if (context().binary->isEnabled()) {
+    context().binary->writeBytes(writer.key("rawData"), rawData.data(), rawData.size());
+  } else {
+    writer.key("rawData").value(base64_encode(reinterpret_cast<const unsigned char *>(rawData.data()),
+                                              rawData.size()));
+  }
+  writer.endObject();
 }
 
 /**
@@ -793,7 +1281,7 @@ void Controller::fetchImageForLatentSpaceCoord_Shapeodds(const Json::Value &requ
   std::cout << "fetchImageForLatentSpaceCoord_Shapeodds: datasetId is "<<datasetId<<", persistence is "<<persistence<<", crystalid is "<<crystalid<<std::endl;
 
   //create images using the elements of this model's Z
-  const dspacex::Model &model(m_currentDataset->getMSModels()[0].getModel(persistence, crystalid).second);
+  const dspacex::Model &model(dataset().getMSModels()[0].getModel(persistence, crystalid).second);
 
   Eigen::MatrixXd new_sample =  ShapeOdds::evaluateModel(model, z_coord);
 
@@ -824,15 +1312,16 @@ void Controller::fetchNImagesForCrystal_Shapeodds(const Json::Value &request, Js
   if (datasetId < 0 || datasetId >= m_availableDatasets.size())
     return sendError(response, "invalid datasetid");
   maybeLoadDataset(datasetId);
-  // maybeLoadModel(persistence,crystal); //<ctc> TODO: for speed, do not load models till their evaluation is requested
 
   // category of the passed fieldname (design param or qoi)
   Fieldtype category = Fieldtype(request["category"].asString());
   if (!category.valid()) return sendError(response, "invalid category");
 
+  if (!session().topoData) return sendError(response, "no processed data for the session");
+
   // get requested persistence level
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
   int persistenceLevel = request["persistenceLevel"].asInt();
   if (persistenceLevel < minLevel || persistenceLevel > maxLevel)
     return sendError(response, "invalid persistence level");
@@ -840,13 +1329,13 @@ void Controller::fetchNImagesForCrystal_Shapeodds(const Json::Value &request, Js
   std::string fieldname = request["fieldname"].asString();
   int crystalid = request["crystalID"].asInt();
   
-  int mscomplex_idx = m_currentDataset->getMSComplexIdxForFieldname(fieldname);
+  int mscomplex_idx = dataset().getMSComplexIdxForFieldname(fieldname);
 
   // if there isn't a model associated with the crystal at this plvl, just show its associated samples' images 
   if (mscomplex_idx < 0)
     return fetchCrystalOriginalSampleImages(request, response);
 
-  dspacex::MSComplex &mscomplex = m_currentDataset->getMSComplex(fieldname);
+  dspacex::MSComplex &mscomplex = dataset().getMSComplex(fieldname);
   int persistenceLevel_idx = getPersistenceLevelIdx(persistenceLevel, mscomplex);
 
   // if there isn't a model for the selected persistence level, just show its associated samples' images
@@ -861,41 +1350,38 @@ void Controller::fetchNImagesForCrystal_Shapeodds(const Json::Value &request, Js
   int numZ = request["numSamples"].asInt();
   std::cout << "fetchNImagesForCrystal_Shapeodds: " << numZ << " samples requested for crystal "<<crystalid<<" of persistence level "<<persistenceLevel<<" (datasetId is "<<datasetId<<", fieldname is "<<fieldname<<")\n";
   
-  dspacex::Model &model(mscomplex.getModel(persistenceLevel_idx, crystalid).second);  
+  // held while it's used, as the model cache may drop it in the meantime
+  std::shared_ptr<const dspacex::Model> model_ptr(mscomplex.getModel(persistenceLevel_idx, crystalid).second);
+  const dspacex::Model &model(*model_ptr);
 
   // <ctc> we need to connect the dataset and its values more closely when reading a model, as the crystal's model should already know its fieldvalues
   // get the vector of values for the field
-  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(category, fieldname);
+  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(dataset(), category, fieldname);
   if (!fieldvals.data())
     std::runtime_error("Invalid fieldname or empty field");
-  model.setFieldValues(fieldvals);
+  dspacex::BoundModel bound(model, fieldvals);  // the model is shared with other requests, so it isn't modified
 
-  const Image& sample_image = m_currentDataset->getThumbnail(0);  // just using this to get dims of image created by model prediction
+  const Image& sample_image = dataset().getThumbnail(0);  // just using this to get dims of image created by model prediction
 
-  // partition the crystal's model's field (QoI) into numZ values and evaluate model for each of them
-  double minval = model.minFieldValue();
-  double maxval = model.maxFieldValue();
+  // partition the crystal's model's field (QoI) into numZ values and evaluate model for all of them
+  double minval = bound.minFieldValue();
+  double maxval = bound.maxFieldValue();
   double delta = (maxval - minval) / static_cast<double>(numZ-1);  // / (numZ - 1) so it will generate samples for the crystal min and max
   double sigma = delta * 0.15; // ~15% of fieldrange // TODO: this should be user-specifiable; it's not the same as M-S computation
-  
-  for (unsigned i = 0; i < numZ; i++)
-  {
-    double fieldval = minval + delta * i;
+  Eigen::VectorXd new_fieldvals(std::max(numZ, 0));
+  for (unsigned i = 0; i < new_fieldvals.size(); i++)
+    new_fieldvals(i) = minval + delta * i;
 
-    // get new latent space coordinate for this field_val
-    Eigen::RowVectorXd z_coord = model.getNewLatentSpaceValue(fieldval, sigma);
+  // get new latent space coordinates for these field values and evaluate the model at them
+  Eigen::MatrixXd z_coords = bound.getNewLatentSpaceValues(new_fieldvals, sigma);
+  std::vector<Image> images = dspacex::ShapeOdds::evaluateModelImages(model, z_coords, sample_image.getWidth(), sample_image.getHeight(), context().cancellation);
 
-    // evaluate model at this coordinate
-    Eigen::MatrixXd I = dspacex::ShapeOdds::evaluateModel(model, z_coord, false /*writeToDisk*/);
-    
-    // add result image to response
-    Image image = Image::convertToImage(I, sample_image.getWidth(), sample_image.getHeight());
-    Json::Value imageObject = Json::Value(Json::objectValue);
-    imageObject["width"] = image.getWidth();
-    imageObject["height"] = image.getHeight();
-    imageObject["rawData"] = base64_encode(reinterpret_cast<const unsigned char *>(&image.getConstRawData()[0]), image.getConstRawData().size());
-    response["thumbnails"].append(imageObject);
-  }
+  // add result images to response
+  JsonWriter &writer = *context().writer;
+  writer.key("thumbnails").beginArray();
+  for (unsigned i = 0; i < images.size(); i++)
+    writeThumbnail(writer, i, images[i]);
+  writer.endArray();
 
   response["msg"] = std::string("returning " + std::to_string(numZ) + " requested images predicted by model at crystal " + std::to_string(crystalid) + " of persistence level " + std::to_string(persistenceLevel));
 }
@@ -905,7 +1391,7 @@ void Controller::fetchNImagesForCrystal_Shapeodds(const Json::Value &request, Js
 int Controller::getPersistenceLevelIdx(const unsigned desired_persistenceLevel, const dspacex::MSComplex &mscomplex) const
 {
   int persistenceLevel_idx = desired_persistenceLevel -
-    (m_currentTopoData->getMaxPersistenceLevel() - mscomplex.numPersistenceLevels() + 1);
+    (session().topoData->getMaxPersistenceLevel() - mscomplex.numPersistenceLevels() + 1);
 
   // the new default behavior is to send samples' original images when there's no model at this plvl
 //  if (persistenceLevel_idx < 0)
@@ -929,15 +1415,16 @@ void Controller::fetchAllImagesForCrystal_Shapeodds(const Json::Value &request,
   if (datasetId < 0 || datasetId >= m_availableDatasets.size())
     return sendError(response, "invalid datasetid");
   maybeLoadDataset(datasetId);
-  // maybeLoadModel(persistence,crystal); //<ctc> TODO: for speed, do not load models till their evaluation is requested
 
   // category of the passed fieldname (design param or qoi)
   Fieldtype category = Fieldtype(request["category"].asString());
   if (!category.valid()) return sendError(response, "invalid category");
 
+  if (!session().topoData) return sendError(response, "no processed data for the session");
+
   // get requested persistence level
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
   int persistenceLevel = request["persistenceLevel"].asInt();
   if (persistenceLevel < minLevel || persistenceLevel > maxLevel)
     return sendError(response, "invalid persistence level");
@@ -946,58 +1433,42 @@ void Controller::fetchAllImagesForCrystal_Shapeodds(const Json::Value &request,
   int crystalid = request["crystalID"].asInt();
   std::cout << "fetchAllImagesForCrystal_Shapeodds: datasetId is "<<datasetId<<", persistence is "<<persistenceLevel<<", crystalid is "<<crystalid<<std::endl;
 
-  dspacex::MSComplex &mscomplex = m_currentDataset->getMSComplex(fieldname);
+  dspacex::MSComplex &mscomplex = dataset().getMSComplex(fieldname);
   int persistenceLevel_idx = getPersistenceLevelIdx(persistenceLevel, mscomplex);
-  dspacex::Model &model(mscomplex.getModel(persistenceLevel_idx, crystalid).second);
+  // held while it's used, as the model cache may drop it in the meantime
+  std::shared_ptr<const dspacex::Model> model_ptr(mscomplex.getModel(persistenceLevel_idx, crystalid).second);
+  const dspacex::Model &model(*model_ptr);
 
   // TODO: cut and paste from above! ugh:
   // <ctc> we need to connect the dataset and its values more closely when reading a model, as the crystal's model should already know its fieldvalues
   // get the vector of values for the field
-  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(category, fieldname);
+  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(dataset(), category, fieldname);
   if (!fieldvals.data())
     std::runtime_error("Invalid fieldname or empty field");
-  model.setFieldValues(fieldvals);
+  dspacex::BoundModel bound(model, fieldvals);  // the model is shared with other requests, so it isn't modified
 
   //create images using the elements of this model's Z
-  auto sample_indices(model.getSampleIndices());
-  std::cout << "Testing all latent space variables computed for the " << sample_indices.size() << " samples in this model.\n";
+  const std::vector<dspacex::BoundModel::ValueIndexPair> &sample_indices(bound.getSampleIndices());
+  std::cout << "Evaluating model at the latent space coordinates of the " << sample_indices.size() << " samples in this model.\n";
 
-  //z coords are sorted by fieldvalue in Model::setFieldValues
-  //for (unsigned zidx = 0; zidx < sample_indices.size(); zidx++)
+  //z coords are sorted by fieldvalue in BoundModel
+  std::vector<Eigen::VectorXd> sample_z_coords;
   for (auto sample: sample_indices)
-  {
-    // load thumbnail corresponding to this z_idx for comparison to evaluated model at same z_idx (they should be close)
-    extern Controller *controller;
-    if (!controller || !controller->m_currentDataset)
-      throw std::runtime_error("ERROR: tried to access controller's current dataset, but it's NULL.");
-
-    const Image& sample_image = controller->m_currentDataset->getThumbnail(sample.idx);
-    unsigned sampleWidth = sample_image.getWidth(), sampleHeight = sample_image.getHeight();
-
-    std::string outputBasepath(datapath + "/CantileverBeam_wclust_wraw/outimages"); //<ctc> todo: dataset_name or /debug/datasetname/outimages
-    std::string outpath(outputBasepath + "/p" + std::to_string(persistenceLevel) + "-c" + std::to_string(crystalid) +
-                        "-z" + std::to_string(sample.idx) + ".png");
-    Eigen::MatrixXd I = dspacex::ShapeOdds::evaluateModel(model, model.getZCoord(sample.idx), false /*writeToDisk*/,
-                                                            outpath, sample_image.getWidth(), sample_image.getHeight());
-
-
-    //<ctc> simplify this to use the images passed in rather than re-generating (rename it to compareImages or something)
-    float quality = dspacex::ShapeOdds::testEvaluateModel(model, model.getZCoord(sample.idx), persistenceLevel, crystalid, sample.idx, sample_image,
-                                                          false /*writeToDisk*/, outputBasepath);
-
-    // todo: is "quality" the correct term for comparison of generated image vs original?
-    std::cout << "Quality of generation of image for model at persistence level "
-              << persistenceLevel << ", crystalid " << crystalid << ": " << quality << std::endl;
-
-    // add image to response
-    Image image = Image::convertToImage(I, sample_image.getWidth(), sample_image.getHeight());
-    Json::Value imageObject = Json::Value(Json::objectValue);
-    imageObject["width"] = image.getWidth();
-    imageObject["height"] = image.getHeight();
-    //imageObject["data"] = base64_encode(image.getConstData(), 4 * image.getWidth() * image.getHeight());  //<ctc> not used by client
-    imageObject["rawData"] = base64_encode(reinterpret_cast<const unsigned char *>(&image.getConstRawData()[0]), image.getConstRawData().size());
-    response["thumbnails"].append(imageObject);
-  }
+    sample_z_coords.push_back(model.getZCoord(sample.idx));
+  Eigen::MatrixXd z_coords(sample_z_coords.size(), sample_z_coords.empty() ? 0 : sample_z_coords[0].size());
+  for (unsigned i = 0; i < sample_z_coords.size(); i++)
+    z_coords.row(i) = sample_z_coords[i];
+
+  // note: the images aren't compared to their samples' thumbnails here (see ShapeOdds::testEvaluateModel) since that evaluates the model again for each one
+  const Image& sample_image = dataset().getThumbnail(0);  // just using this to get dims of image created by model prediction
+  std::vector<Image> images = dspacex::ShapeOdds::evaluateModelImages(model, z_coords, sample_image.getWidth(), sample_image.getHeight(), context().cancellation);
+
+  // add result images to response
+  JsonWriter &writer = *context().writer;
+  writer.key("thumbnails").beginArray();
+  for (unsigned i = 0; i < images.size(); i++)
+    writeThumbnail(writer, sample_indices[i].idx, images[i]);
+  writer.endArray();
 
   response["msg"] = std::string("returning " + std::to_string(sample_indices.size()) + " images for model at crystal " + std::to_string(crystalid) + " of persistence level " + std::to_string(persistenceLevel));
 }
@@ -1013,24 +1484,29 @@ void Controller::fetchCrystalOriginalSampleImages(const Json::Value &request, Js
   Fieldtype category = Fieldtype(request["category"].asString());
   if (!category.valid()) return sendError(response, "invalid category");
 
+  if (!session().topoData) return sendError(response, "no processed data for the session");
+
   // get requested persistence level
-  unsigned int minLevel = m_currentTopoData->getMinPersistenceLevel();
-  unsigned int maxLevel = m_currentTopoData->getMaxPersistenceLevel();
+  unsigned int minLevel = session().topoData->getMinPersistenceLevel();
+  unsigned int maxLevel = session().topoData->getMaxPersistenceLevel();
   int persistenceLevel = request["persistenceLevel"].asInt();
   if (persistenceLevel < minLevel || persistenceLevel > maxLevel)
     return sendError(response, "invalid persistence level");
+  const MSHierarchy *hierarchy = waitForPartitions(persistenceLevel);
 
   std::string fieldname = request["fieldname"].asString();
   int crystalid = request["crystalID"].asInt();
   std::cout << "fetchCrystalOriginalSampleImages: datasetId is "<<datasetId<<", persistence is "<<persistenceLevel<<", crystalid is "<<crystalid<<std::endl;
 
   // get the vector of values for the field
-  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(category, fieldname);
+  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(dataset(), category, fieldname);
   if (!fieldvals.data())
-    std::runtime_error("Invalid fieldname or empty field");
+    return sendError(response, "invalid fieldname or empty field");
 
-  FortranLinalg::DenseVector<int> &crystal_partition(m_currentVizData->getCrystalPartitions(persistenceLevel));
-  Eigen::Map<Eigen::VectorXi> partitions(crystal_partition.data(), crystal_partition.N());
+  FortranLinalg::DenseVector<int> crystal_partition = hierarchy ?
+      hierarchy->getPartitions(persistenceLevel) :
+      session().vizData->getCrystalPartitions(persistenceLevel);
+  Eigen::Map<Eigen::VectorXi> partitions = FortranLinalg::asEigen(crystal_partition);
   std::vector<dspacex::Model::ValueIndexPair> fieldvalues_and_indices;
   for (unsigned i = 0; i < partitions.size(); i++)
   {
@@ -1042,6 +1518,9 @@ void Controller::fetchCrystalOriginalSampleImages(const Json::Value &request, Js
       fieldvalues_and_indices.push_back(sample);
     }
   }
+  if (hierarchy) {
+    crystal_partition.deallocate();
+  }
 
   // sort by increasing fieldvalue
   std::sort(fieldvalues_and_indices.begin(), fieldvalues_and_indices.end(), dspacex::Model::ValueIndexPair::compare);
@@ -1050,7 +1529,7 @@ void Controller::fetchCrystalOriginalSampleImages(const Json::Value &request, Js
   for (auto sample: fieldvalues_and_indices)
   {
     // load thumbnail corresponding to this z_idx
-    const Image& sample_image = m_currentDataset->getThumbnail(sample.idx);
+    const Image& sample_image = dataset().getThumbnail(sample.idx);
     unsigned sampleWidth = sample_image.getWidth(), sampleHeight = sample_image.getHeight();
 
     // add image to response
@@ -1081,88 +1560,374 @@ void Controller::fetchAllForLatentSpaceUsingSharedGP(const Json::Value &request,
 }
 
 /**
- * Checks if the requested dataset is loaded.
- * If not, loads the dataset and sets state.
+ * Handle the command to fetch the usage of the processed result cache, how
+ * long processing fields took, which datasets are loaded and the usage of
+ * the model cache.
+ */
+void Controller::fetchServerCacheStats(const Json::Value &request, Json::Value &response) {
+  ProcessedResultCache::Stats stats = m_resultCache.getStats();
+  response["budgetBytes"] = Json::UInt64(stats.budget);
+  response["bytes"] = Json::UInt64(stats.bytes);
+  response["entries"] = Json::UInt64(stats.entries);
+  response["hits"] = Json::UInt64(stats.hits);
+  response["misses"] = Json::UInt64(stats.misses);
+  response["evictions"] = Json::UInt64(stats.evictions);
+  {
+    // Seconds until the first persistence level of a field could be shown
+    std::lock_guard<std::mutex> lock(m_processingStatsMutex);
+    Json::Value processing(Json::objectValue);
+    processing["results"] = Json::UInt64(m_processingStats.results);
+    processing["lastTimeToFirstCrystal"] = m_processingStats.lastTimeToFirstCrystal;
+    processing["meanTimeToFirstCrystal"] = m_processingStats.results == 0 ? 0.0 :
+        m_processingStats.totalTimeToFirstCrystal / m_processingStats.results;
+    processing["lastProcessingTime"] = m_processingStats.lastProcessingTime;
+    response["processing"] = processing;
+  }
+  {
+    // Users are the commands and processing tasks holding a dataset.
+    std::lock_guard<std::mutex> lock(m_datasetsMutex);
+    Json::Value datasets(Json::objectValue);
+    size_t bytes = 0;
+    datasets["loaded"] = Json::Value(Json::arrayValue);
+    for (auto &entry : m_datasets) {
+      Json::Value dataset(Json::objectValue);
+      dataset["datasetId"] = entry.first;
+      dataset["bytes"] = Json::UInt64(entry.second.bytes);
+      dataset["users"] = Json::UInt64(entry.second.dataset.use_count() - 1);
+      datasets["loaded"].append(dataset);
+      bytes += entry.second.bytes;
+    }
+    datasets["budgetBytes"] = Json::UInt64(m_datasetBudget);
+    datasets["bytes"] = Json::UInt64(bytes);
+    response["datasets"] = datasets;
+  }
+  {
+    // Predictive models of the crystals, read as they are asked for.
+    dspacex::ModelCache::Stats modelStats = dspacex::ModelCache::instance().getStats();
+    Json::Value models(Json::objectValue);
+    models["budgetBytes"] = Json::UInt64(modelStats.budget);
+    models["bytes"] = Json::UInt64(modelStats.bytes);
+    models["entries"] = Json::UInt64(modelStats.entries);
+    models["hits"] = Json::UInt64(modelStats.hits);
+    models["misses"] = Json::UInt64(modelStats.misses);
+    models["prefetches"] = Json::UInt64(modelStats.prefetches);
+    models["evictions"] = Json::UInt64(modelStats.evictions);
+    response["models"] = models;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_sessionsMutex);
+    response["sessions"] = Json::UInt64(m_sessions.size());
+  }
+  response["results"] = Json::Value(Json::arrayValue);
+  for (auto &entry : m_resultCache.getEntries()) {
+    Json::Value result = Json::Value(Json::objectValue);
+    result["datasetId"] = entry.first.datasetId;
+    result["category"] = entry.first.category == Fieldtype::QoI ? "qoi" : "parameter";
+    result["fieldname"] = entry.first.fieldname;
+    result["knn"] = entry.first.knn;
+    result["numSamples"] = entry.first.numSamples;
+    result["sigma"] = entry.first.sigma;
+    result["smoothing"] = entry.first.smoothing;
+    result["addNoise"] = entry.first.addNoise;
+    result["numPersistences"] = entry.first.numPersistences;
+    result["bytes"] = Json::UInt64(entry.second);
+    response["results"].append(result);
+  }
+}
+
+/**
+ * Makes the requested dataset the one of the running command, loading it if
+ * needed. A command uses a single dataset.
  */
 void Controller::maybeLoadDataset(int datasetId) {
-  if (datasetId == m_currentDatasetId) {
+  CommandContext &command = context();
+  if (command.dataset) {
+    if (command.dataset->id != datasetId) {
+      throw std::logic_error("Command uses more than one dataset");
+    }
     return;
   }
+  command.dataset = acquireDataset(datasetId);
+}
+
+/**
+ * Returns a dataset, loading it if it is not loaded, for the calling command
+ * to hold while it uses it. A dataset is loaded once even if several sessions
+ * ask for it at the same time. Loading a dataset may unload idle ones to
+ * keep within the memory budget of datasets.
+ */
+std::shared_ptr<Controller::LoadedDataset> Controller::acquireDataset(int datasetId) {
+  std::shared_ptr<LoadedDataset> loaded;
+  {
+    std::lock_guard<std::mutex> lock(m_datasetsMutex);
+    DatasetEntry &entry = m_datasets[datasetId];
+    if (!entry.dataset) {
+      entry.dataset = std::make_shared<LoadedDataset>(datasetId);
+    }
+    entry.lastUsed = std::chrono::steady_clock::now();
+    loaded = entry.dataset;
+  }
+
+  bool loadedNow = false;
+  std::call_once(loaded->loaded, [&]() {
+    std::string configPath = m_availableDatasets[datasetId].second;
+    loaded->dataset = DatasetLoader::loadDataset(configPath); // <ctc> need std::move(loaded_dataset)?
+    loadedNow = true;
+  });
+  if (loadedNow) {
+    size_t bytes = loaded->dataset->byteSize();
+    std::cout << loaded->dataset->getName() << " dataset loaded (" << (bytes >> 20) << " MB)." << std::endl;
+    {
+      std::lock_guard<std::mutex> lock(m_datasetsMutex);
+      m_datasets[datasetId].bytes = bytes;
+    }
+    evictDatasets();
+  }
+  return loaded;
+}
+
+/**
+ * Unloads idle datasets, least recently used first, while the loaded ones
+ * exceed the memory budget. A dataset is idle if no command or processing
+ * task holds it; sessions only remember which datasets they use, so the
+ * datasets of clients that are not active can be unloaded. Processed results
+ * stay cached under their dataset id.
+ */
+void Controller::evictDatasets() {
+  std::vector<std::shared_ptr<LoadedDataset>> unloaded;
+  {
+    std::lock_guard<std::mutex> lock(m_datasetsMutex);
+    size_t bytes = 0;
+    for (auto &entry : m_datasets) {
+      bytes += entry.second.bytes;
+    }
+    while (bytes > m_datasetBudget) {
+      auto idle = m_datasets.end();
+      for (auto iter = m_datasets.begin(); iter != m_datasets.end(); ++iter) {
+        if (iter->second.dataset.use_count() == 1 &&
+            (idle == m_datasets.end() || iter->second.lastUsed < idle->second.lastUsed)) {
+          idle = iter;
+        }
+      }
+      if (idle == m_datasets.end()) {
+        break;
+      }
+      bytes -= idle->second.bytes;
+      unloaded.push_back(std::move(idle->second.dataset));
+      m_datasets.erase(idle);
+    }
+  }
+  // Freed outside of the lock.
+  for (auto &dataset : unloaded) {
+    if (dataset->dataset) {
+      std::cout << dataset->dataset->getName() << " dataset unloaded." << std::endl;
+    }
+  }
+}
 
-  if (m_currentDataset) {
-    m_currentDataset.reset();
+Controller::LoadedDataset::~LoadedDataset() {
+  if (m_ownsDistanceMatrix) {
+    m_distanceMatrix.deallocate();
+  }
+}
+
+/**
+ * Releases the current result of a closed session.
+ */
+void Controller::closeSession(Session &session, void *socket) {
+  if (session.hasResult) {
+    m_resultCache.unpin(session.resultKey);
+    session.hasResult = false;
   }
-  if (m_currentVizData) {
-    delete m_currentVizData;
-    m_currentVizData = nullptr;
+  if (session.stream) {
+    session.stream->unsubscribe(socket);
+    unfollowStream(session.stream);
+    session.stream.reset();
   }
-  if (m_currentTopoData) {
-    delete m_currentTopoData;
-    m_currentTopoData = nullptr;
+  session.vizData = nullptr;
+  session.topoData = nullptr;
+}
+
+/**
+ * Makes a cached result the current one of the running command's session.
+ * The entry must be pinned by the caller and stays pinned while it is
+ * current; the previous one is unpinned.
+ */
+void Controller::setCurrentResult(const ProcessedResultKey &key,
+                                  const ProcessedResultCache::Entry *entry) {
+  Session &current = session();
+  if (current.hasResult) {
+    m_resultCache.unpin(current.resultKey);
   }
-  m_currentKNN = -1;
+  current.hasResult = entry != nullptr;
+  current.resultKey = key;
+  current.vizData = entry ? entry->vizData : nullptr;
+  current.topoData = entry ? entry->topoData : nullptr;
+}
 
-  std::string configPath = m_availableDatasets[datasetId].second;
-  m_currentDataset = DatasetLoader::loadDataset(configPath); // <ctc> need std::move(loaded_dataset)?
-  std::cout << m_currentDataset->getName() << " dataset loaded." << std::endl;
+/**
+ * Makes the running command's session follow a streamed result, which must
+ * already count the session as a follower, and stops following the previous
+ * one.
+ */
+void Controller::setCurrentStream(const std::shared_ptr<ResultStream> &stream) {
+  Session &current = session();
+  if (current.stream == stream) {
+    return;
+  }
+  if (current.stream) {
+    current.stream->unsubscribe(context().socket);
+    unfollowStream(current.stream);
+  }
+  current.stream = stream;
+}
 
-  m_currentDatasetId = datasetId;
+/**
+ * Stops following a streamed result. Once no session follows it, it is
+ * cancelled if it is still computed, or moved to the result cache.
+ */
+void Controller::unfollowStream(const std::shared_ptr<ResultStream> &stream) {
+  std::lock_guard<std::mutex> lock(m_streamsMutex);
+  auto shared = m_streams.find(stream->getKey());
+  if (shared == m_streams.end() || shared->second.stream != stream ||
+      --shared->second.followers > 0) {
+    return;
+  }
+  m_streams.erase(shared);
+  if (stream->isFinished()) {
+    adoptStream(*stream);
+  } else {
+    stream->getCancellation().cancel();
+  }
 }
 
 // getFieldvalues
 // 
 // returns Eigen::Map wrapping the vector of values for a given field
-const Eigen::Map<Eigen::VectorXd> Controller::getFieldvalues(Fieldtype type, const std::string &name)
+const Eigen::Map<Eigen::VectorXd> Controller::getFieldvalues(dspacex::Dataset &dataset, Fieldtype type,
+                                                            const std::string &name)
 {
   if (type == Fieldtype::DesignParameter)
   {
-    auto parameters = m_currentDataset->getParameterNames();
+    auto parameters = dataset.getParameterNames();
     auto result = std::find(std::begin(parameters), std::end(parameters), name);
     if (result == std::end(parameters)) 
       return Eigen::Map<Eigen::VectorXd>(NULL, 0);
 
     int index = std::distance(parameters.begin(), result);
-    FortranLinalg::DenseVector<Precision> values = m_currentDataset->getParameterVector(index);
-    return Eigen::Map<Eigen::VectorXd>(values.data(), values.N());
+    FortranLinalg::DenseVector<Precision> values = dataset.getParameterVector(index);
+    return FortranLinalg::asEigen(values);
   }
   else if (type == Fieldtype::QoI)
   {
-    auto qois = m_currentDataset->getQoiNames();
+    auto qois = dataset.getQoiNames();
     auto result = std::find(std::begin(qois), std::end(qois), name);
     if (result == std::end(qois)) 
       return Eigen::Map<Eigen::VectorXd>(NULL, 0);
 
     int index = std::distance(qois.begin(), result);
-    FortranLinalg::DenseVector<Precision> values = m_currentDataset->getQoiVector(index);
-    return Eigen::Map<Eigen::VectorXd>(values.data(), values.N());
+    FortranLinalg::DenseVector<Precision> values = dataset.getQoiVector(index);
+    return FortranLinalg::asEigen(values);
   }
   return Eigen::Map<Eigen::VectorXd>(NULL, 0);
 }
 
 /**
  * Checks if the requested dataset has been processed. If not, processes the data.
+ * Processed results are shared by all sessions: a result that another session
+ * is computing is followed rather than computed again.
  *
  * k is the num nearest neighbors to consider when generating M-S complex for a dataset
  * category is design parameter or qoi
  * fieldname is the element of the given category to process
+ * mode Streamed returns once the persistence levels are known while the levels are
+ *      computed in the background; the command then waits for the levels it uses
+ *      with waitForLevel.
  *
  * TODO: maybeLoadDataset and maybeProcessData should return bool and caller return error if they fail
  */
-void Controller::maybeProcessData(Fieldtype category, std::string fieldname, int knn, int num_samples,
-                                  double sigma, double smoothing, bool add_noise, unsigned num_persistences) {
-  if (knn == m_currentKNN && m_currentField == fieldname) {
-    // TODO: once user can interactively specify different params, also consider them here
-    return;
+void Controller::maybeProcessData(Fieldtype category, std::string fieldname, int knn, ProcessingMode mode,
+                                  int num_samples, double sigma, double smoothing, bool add_noise,
+                                  unsigned num_persistences) {
+  ProcessedResultKey key{context().dataset->id, category, fieldname, knn, num_samples,
+                         sigma, smoothing, add_noise, num_persistences};
+
+  std::shared_ptr<ResultStream> stream = session().stream;
+  if (!stream || !(stream->getKey() == key) || stream->hasFailed()) {
+    // The streams and the cache are looked at together so that a result
+    // moving from one to the other is found in either.
+    const ProcessedResultCache::Entry *entry = nullptr;
+    bool start = false;
+    {
+      std::lock_guard<std::mutex> lock(m_streamsMutex);
+      auto shared = m_streams.find(key);
+      if (shared != m_streams.end() && !shared->second.stream->hasFailed()) {
+        shared->second.followers++;
+        stream = shared->second.stream;
+      } else if (!(entry = m_resultCache.find(key, true /* pin */))) {
+        stream = std::make_shared<ResultStream>(key,
+            [this](ResultStream &stream, unsigned int level) { postLevelReady(stream, level); });
+        m_streams[key] = SharedStream{stream, 1};
+        start = true;
+      } else {
+        stream.reset();
+      }
+    }
+    setCurrentStream(stream);
+    setCurrentResult(key, entry);
+    if (entry) {
+      return;
+    }
+    if (start) {
+      startStream(stream);
+    }
+  }
+
+  readStream(stream);
+  if (mode == ProcessingMode::Complete) {
+    stream->waitForCompletion(context().cancellation);
   }
+}
+
+/**
+ * Computes a result in the background, or loads it from disk, while the
+ * commands of the sessions following its stream read the levels that are
+ * ready. The task holds the command's dataset until it is done.
+ */
+void Controller::startStream(const std::shared_ptr<ResultStream> &stream) {
+  std::shared_ptr<LoadedDataset> dataset = context().dataset;
+  m_background.submit([this, stream, dataset]() {
+    const ProcessedResultKey &key = stream->getKey();
+    try {
+      processStream(*stream, *dataset);
+    } catch (const OperationCancelled &) {
+      std::cout << "Stopped streaming " << key.fieldname << "." << std::endl;
+      stream->fail("processing cancelled");
+    } catch (const std::exception &e) {
+      std::cerr << "Processing Error: " << e.what() << std::endl;
+      stream->fail(e.what());
+    } catch (const char *err) {
+      std::cerr << err << std::endl;
+      stream->fail(err);
+    }
+  });
+}
+
+/**
+ * Processes the field of a stream's key. The field values are normalized in
+ * a copy, so the dataset stays as it was loaded.
+ */
+void Controller::processStream(ResultStream &stream, LoadedDataset &dataset) {
+  const ProcessedResultKey &key = stream.getKey();
 
   // get the vector of values for the requested field
-  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(category, fieldname);
+  Eigen::Map<Eigen::VectorXd> fieldvals = getFieldvalues(*dataset.dataset, key.category, key.fieldname);
   if (!fieldvals.data())
-    std::runtime_error("Invalid fieldname or empty field");
+    throw std::runtime_error("Invalid fieldname or empty field");
 
   // <ctc> TODO: change [Vector|Matrix]Xd to [Vector|Matrix]<Precision> rather than hardcode double
 
-  std::cout << "fieldname: " << fieldname << std::endl;
+  std::cout << "fieldname: " << key.fieldname << std::endl;
   Precision minval = fieldvals.minCoeff();
   Precision maxval = fieldvals.maxCoeff();
   Precision meanval = fieldvals.mean();
@@ -1179,46 +1944,235 @@ void Controller::maybeProcessData(Fieldtype category, std::string fieldname, int
     std::cout << "var: " << variance << std::endl;
     std::cout << "sdv: " << sqrt(variance) << std::endl;
   }
-  
-  fieldvals.normalize();
-  
-  m_currentField = fieldname;
-  m_currentKNN = knn;
-  
-  if (m_currentVizData) {
-    delete m_currentVizData;
-    m_currentVizData = nullptr;
+
+  FortranLinalg::DenseVector<Precision> values(fieldvals.size());
+  FortranLinalg::asEigen(values) = fieldvals.normalized();
+
+  // Results on disk are named after the data and parameters they depend on
+  ContentHash hash;
+  hash.add(std::string("HDProcessResult"));
+  hash.add(dataset.getHash());
+  hash.update(values.data(), sizeof(Precision) * values.N());
+  hash.add(key.knn);
+  hash.add(key.numSamples);
+  hash.add(key.sigma);
+  hash.add(key.smoothing);
+  hash.add(key.addNoise);
+  hash.add(key.numPersistences);
+  if (m_knnBackend) {
+    hash.add(m_knnBackend->getName());
+    hash.add(m_knnBackend->getEpsilon());
   }
-  if (m_currentTopoData) {
-    delete m_currentTopoData;
-    m_currentTopoData = nullptr;
+  std::string resultHash = hash.hex();
+
+  HDProcessResult *result = m_resultDiskCache.read(resultHash);
+  if (result) {
+    std::cout << "Loaded processed result " << resultHash << " from disk." << std::endl;
+    values.deallocate();
+    stream.persistenceComputed(*result);
+    HDVizData *vizData = stream.getVizData();
+    for (int level = vizData->getMaxPersistenceLevel(); level >= vizData->getMinPersistenceLevel(); level--) {
+      stream.levelComputed(*result, level);
+    }
+    stream.finish();
+    return;
   }
 
-  if (m_currentDataset->hasDistanceMatrix()) {
-    m_currentDistanceMatrix = m_currentDataset->getDistanceMatrix();
-  } else if (m_currentDataset->hasSamplesMatrix()) {
-    auto samplesMatrix = m_currentDataset->getSamplesMatrix();
-    m_currentDistanceMatrix = HDProcess::computeDistanceMatrix(samplesMatrix);
+  CancellationToken::throwIfCancelled(&stream.getCancellation());
+  // Datasets of samples only are processed without their distance matrix,
+  // which for large datasets wouldn't fit in memory.
+  bool samplesOnly = dataset.hasSamplesOnly();
+  FortranLinalg::DenseMatrix<Precision> &matrix =
+      samplesOnly ? dataset.dataset->getSamplesMatrix() : dataset.getDistanceMatrix();
+
+  // Nearest neighbors are shared by all fields of a dataset
+  int k = std::min(key.knn, (int) matrix.N());
+  FortranLinalg::DenseMatrix<int> KNN(k, matrix.N());
+  FortranLinalg::DenseMatrix<Precision> KNND(k, matrix.N());
+  if (samplesOnly) {
+    m_knnGraphCache.findSampleKNN(key.datasetId, matrix, KNN, KNND, 0, m_knnBackend.get());
   } else {
-    std::runtime_error("No distance matrix or samplesMatrix available.");
+    m_knnGraphCache.findKNN(key.datasetId, matrix, KNN, KNND);
   }
 
-
   HDGenericProcessor<DenseVectorSample, DenseVectorEuclideanMetric> genericProcessor;
-
-  // TODO: Expose processing parameters to function interface.
+  genericProcessor.setNearestNeighbors(KNN, KNND);
+  genericProcessor.setKNNBackend(m_knnBackend.get());
+  genericProcessor.setCancellationToken(&stream.getCancellation());
+  genericProcessor.setObserver(&stream);
   try {
-    HDProcessResult *result = genericProcessor.processOnMetric(m_currentDistanceMatrix,
-                                                               FortranLinalg::DenseVector<Precision>(fieldvals.size(), fieldvals.data()),
-                                                               m_currentKNN,     /* k nearest neighbors to consider */
-                                                               num_samples,      /* points along each crystal */
-                                                               num_persistences, /* -1 generates all of 'em */
-                                                               add_noise,  /* adds very slight noise to field values, which must differ */
-                                                               sigma,      /* should be ~15% of fieldrange (maybe not for M-S computation?) */
-                                                               smoothing); /* smooth */
-    m_currentVizData = new SimpleHDVizDataImpl(result);
-    m_currentTopoData = new LegacyTopologyDataImpl(m_currentVizData);
-  } catch (const char *err) {
-    std::cerr << err << std::endl;
+    // TODO: Expose processing parameters to function interface.
+    if (samplesOnly) {
+      result = genericProcessor.processOnSamples(matrix, values, key.knn, key.numSamples,
+                                                 key.numPersistences, key.addNoise,
+                                                 key.sigma, key.smoothing);
+    } else {
+      result = genericProcessor.processOnMetric(matrix,
+                                                values,
+                                                key.knn,             /* k nearest neighbors to consider */
+                                                key.numSamples,      /* points along each crystal */
+                                                key.numPersistences, /* -1 generates all of 'em */
+                                                key.addNoise,  /* adds very slight noise to field values, which must differ */
+                                                key.sigma,     /* should be ~15% of fieldrange (maybe not for M-S computation?) */
+                                                key.smoothing); /* smooth */
+    }
+  } catch (...) {
+    KNN.deallocate();
+    KNND.deallocate();
+    values.deallocate();
+    throw;
   }
+  KNN.deallocate();
+  KNND.deallocate();
+  values.deallocate();
+
+  // Written before the stream can be handed to the result cache, which may free it.
+  m_resultDiskCache.write(resultHash, result);
+  stream.finish();
+  recordProcessingTime(stream.getTimeToFirstLevel(), stream.getProcessingTime());
+  std::cout << "Streamed " << key.fieldname << ": first crystals after "
+            << stream.getTimeToFirstLevel() << "s, all levels after "
+            << stream.getProcessingTime() << "s." << std::endl;
+}
+
+/**
+ * Makes the running command a reader of a streamed result, which it keeps
+ * alive until it finished, and waits until the persistence levels are known.
+ * The command's socket is told about levels as they complete.
+ */
+void Controller::readStream(const std::shared_ptr<ResultStream> &stream) {
+  CommandContext &command = context();
+  command.stream = stream;
+  stream->subscribe(command.socket);
+  stream->waitForPersistence(command.cancellation);
+  session().vizData = stream->getVizData();
+  session().topoData = stream->getTopoData();
+}
+
+/**
+ * Moves the data of a finished stream into the result cache, where it may be
+ * evicted once no session uses it.
+ */
+void Controller::adoptStream(ResultStream &stream) {
+  HDProcessResult *result;
+  HDVizData *vizData;
+  TopologyData *topoData;
+  size_t bytes = stream.getByteSize();
+  stream.release(result, vizData, topoData);
+  m_resultCache.insert(stream.getKey(), result, vizData, topoData, bytes);
+}
+
+/**
+ * Waits until a persistence level of the current result is computed if the
+ * result is still streamed in.
+ */
+void Controller::waitForLevel(unsigned int persistenceLevel) {
+  if (!context().stream && session().stream) {
+    readStream(session().stream);
+  }
+  if (context().stream) {
+    context().stream->waitForLevel(persistenceLevel, context().cancellation);
+  }
+}
+
+/**
+ * Returns the crystal hierarchy of the current result if it has the
+ * persistence level. The hierarchy is complete as soon as the persistence is
+ * known, so a result that is still streamed in answers partition queries
+ * without waiting for the level. Results without a hierarchy, such as those
+ * read from disk, wait for the level and return nullptr.
+ */
+const MSHierarchy* Controller::waitForPartitions(unsigned int persistenceLevel) {
+  if (!context().stream && session().stream) {
+    readStream(session().stream);
+  }
+  const MSHierarchy *hierarchy = session().vizData->getHierarchy();
+  if (hierarchy && hierarchy->hasLevel(persistenceLevel)) {
+    return hierarchy;
+  }
+  waitForLevel(persistenceLevel);
+  return nullptr;
+}
+
+/**
+ * Tells the clients reading a streamed result that a level is ready with
+ * {"event": "persistenceLevelReady", ...}, which has no message id.
+ */
+void Controller::postLevelReady(ResultStream &stream, unsigned int level) {
+  const ProcessedResultKey &key = stream.getKey();
+  Json::Value event(Json::objectValue);
+  event["event"] = "persistenceLevelReady";
+  event["datasetId"] = key.datasetId;
+  event["category"] = key.category == Fieldtype::QoI ? "qoi" : "parameter";
+  event["fieldname"] = key.fieldname;
+  event["k"] = key.knn;
+  event["persistenceLevel"] = level;
+  event["crystalCount"] = static_cast<int>(stream.getTopoData()->getComplex(level)->getCrystals().size());
+  std::string text;
+  JsonWriter(text).value(event);
+  for (void *socket : stream.getSubscribers()) {
+    wst_postText(socket, text.c_str());
+  }
+}
+
+void Controller::recordProcessingTime(double timeToFirstCrystal, double processingTime) {
+  std::lock_guard<std::mutex> lock(m_processingStatsMutex);
+  m_processingStats.results++;
+  m_processingStats.lastTimeToFirstCrystal = timeToFirstCrystal;
+  m_processingStats.totalTimeToFirstCrystal += timeToFirstCrystal;
+  m_processingStats.lastProcessingTime = processingTime;
+}
+
+/**
+ * Returns the distance matrix of the dataset, computing it from the samples
+ * matrix the first time if the dataset doesn't provide one.
+ */
+FortranLinalg::DenseMatrix<Precision>& Controller::LoadedDataset::getDistanceMatrix() {
+  std::call_once(m_distanceMatrixComputed, [this]() {
+    if (dataset->hasDistanceMatrix()) {
+      m_distanceMatrix = dataset->getDistanceMatrix();
+    } else if (dataset->hasSamplesMatrix()) {
+      auto samplesMatrix = dataset->getSamplesMatrix();
+      m_distanceMatrix = HDProcess::computeDistanceMatrix(samplesMatrix);
+      m_ownsDistanceMatrix = true;
+    } else {
+      throw std::runtime_error("No distance matrix or samplesMatrix available.");
+    }
+  });
+  return m_distanceMatrix;
+}
+
+/**
+ * Whether the dataset has a samples matrix but no distance matrix. Such
+ * datasets are processed from their samples, without ever computing the
+ * distance matrix.
+ */
+bool Controller::LoadedDataset::hasSamplesOnly() {
+  return !dataset->hasDistanceMatrix() && dataset->hasSamplesMatrix();
+}
+
+/**
+ * Returns the hash of the distance matrix of the dataset, or of its samples
+ * matrix if it has no distance matrix. This identifies the dataset by
+ * content without computing distances.
+ */
+const std::string& Controller::LoadedDataset::getHash() {
+  std::call_once(m_hashComputed, [this]() {
+    ContentHash hash;
+    if (dataset->hasDistanceMatrix()) {
+      auto &distances = dataset->getDistanceMatrix();
+      hash.add(std::string("distances"));
+      hash.add(distances.M());
+      hash.add(distances.N());
+      hash.update(distances.data(), sizeof(Precision) * distances.M() * distances.N());
+    } else if (dataset->hasSamplesMatrix()) {
+      auto &samples = dataset->getSamplesMatrix();
+      hash.add(std::string("samples"));
+      hash.add(samples.M());
+      hash.add(samples.N());
+      hash.update(samples.data(), sizeof(Precision) * samples.M() * samples.N());
+    }
+    m_hash = hash.hex();
+  });
+  return m_hash;
 }
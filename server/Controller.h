@@ -3,34 +3,183 @@
 #include "dspacex/Dataset.h"
 #include "hdprocess/HDProcessResult.h"
 #include "hdprocess/HDVizData.h"
+#include "hdprocess/ProcessedResultCache.h"
 #include "hdprocess/TopologyData.h"
 #include "dspacex/Fieldtype.h"
+#include "graph/KNNBackend.h"
+#include "graph/KNNGraphCache.h"
+#include "pmodels/ModelCache.h"
+#include "utils/CancellationToken.h"
+#include "utils/KeyedExecutor.h"
+#include "utils/ThreadPool.h"
+#include "BinaryResponse.h"
+#include "JsonWriter.h"
+#include "ResultDiskCache.h"
+#include "ResultStream.h"
 
 #include <jsoncpp/json/json.h>
+#include <chrono>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <functional>
+#include <string>
+#include <utility>
+#include <vector>
 
 
 class Controller {
  public:
-  Controller(const std::string &datapath_);
+  static const size_t kDefaultResultCacheBytes = size_t(2048) << 20;
+  static const size_t kDefaultDatasetBytes = size_t(4096) << 20;
+  static const size_t kDefaultModelBytes = dspacex::ModelCache::kDefaultBytes;
+
+  Controller(const std::string &datapath_, size_t resultCacheBytes = kDefaultResultCacheBytes,
+             const std::string &resultCachePath = "", size_t datasetBytes = kDefaultDatasetBytes,
+             size_t modelBytes = kDefaultModelBytes);
+  void setKNNBackend(std::unique_ptr<KNNBackend<Precision>> backend);
   void handleData(void *wsi, void *data);
   void handleText(void *wsi, const std::string &text);
+  void handleClose(void *wsi);
 
  private:
+  // A loaded dataset, shared by the commands and processing tasks of all
+  // sessions that use it, which hold a reference to it while they run. It is
+  // not modified once loaded, so they may read it concurrently; the data
+  // derived from it is computed once, on first use.
+  struct LoadedDataset {
+    explicit LoadedDataset(int id) : id(id) {}
+    ~LoadedDataset();
+
+    FortranLinalg::DenseMatrix<Precision>& getDistanceMatrix();
+    bool hasSamplesOnly();
+    const std::string& getHash();
+
+    const int id;
+    std::once_flag loaded;
+    std::unique_ptr<dspacex::Dataset> dataset;
+
+   private:
+    std::once_flag m_distanceMatrixComputed;
+    FortranLinalg::DenseMatrix<Precision> m_distanceMatrix;
+    bool m_ownsDistanceMatrix = false; // distance matrix was computed from samples
+    std::once_flag m_hashComputed;
+    std::string m_hash;                // content hash of the dataset
+  };
+
+  // A loaded dataset in the registry, guarded by m_datasetsMutex.
+  struct DatasetEntry {
+    std::shared_ptr<LoadedDataset> dataset;
+    size_t bytes = 0; // known once the dataset is loaded
+    std::chrono::steady_clock::time_point lastUsed;
+  };
+
+  // State of a client connection. The commands of a session are serialized,
+  // so it is used by one thread at a time. The result the session works on
+  // is kept pinned in the result cache, or followed while it is streamed in,
+  // until the session moves on to another one.
+  struct Session {
+    bool hasResult = false;          // resultKey is pinned in the result cache
+    ProcessedResultKey resultKey;    // field processed last
+    std::shared_ptr<ResultStream> stream; // current result while it is computed
+    HDVizData *vizData = nullptr;
+    TopologyData *topoData = nullptr;
+  };
+
+  // A result being computed and the number of sessions whose current result
+  // it is, guarded by m_streamsMutex. It is cancelled once no session follows
+  // it any more, or moved to the result cache if it is finished by then.
+  struct SharedStream {
+    std::shared_ptr<ResultStream> stream;
+    unsigned int followers = 0;
+  };
+
+  // A client waiting for the reply to one of its requests.
+  struct Waiter {
+    void *socket;        // text socket the request came from
+    int messageId;
+    std::string channel; // requests on the same channel supersede each other
+  };
+
+  // A command queued or running on behalf of the client that sent it.
+  // Identical requests of the same text socket arriving meanwhile join its
+  // waiters instead of running again. It is cancelled once nobody waits for
+  // it any more.
+  struct PendingCommand {
+    std::string key;            // text and data socket, and the request without its id and channel
+    Json::Value request;
+    void *socket = nullptr;     // text socket of the first request
+    void *dataSocket = nullptr; // data socket of binary responses
+    std::vector<Waiter> waiters; // guarded by m_pendingMutex
+    CancellationToken cancellation;
+  };
+
+  // The command running on the calling thread.
+  struct CommandContext {
+    void *socket = nullptr;           // text socket the command came from
+    BinaryResponse *binary = nullptr; // bulk arrays of the response
+    JsonWriter *writer = nullptr;     // members written after those of the Json::Value response
+    Session *session = nullptr;       // session of the socket
+    std::shared_ptr<LoadedDataset> dataset; // dataset loaded by maybeLoadDataset
+    const CancellationToken *cancellation = nullptr;
+    std::shared_ptr<ResultStream> stream; // streamed result the command reads
+  };
+
+  // How far maybeProcessData computes a result before it returns.
+  enum class ProcessingMode {
+    Complete, // all persistence levels
+    Streamed, // the persistence levels are known, they are computed in the background
+  };
+
+  // Time until the crystals of the first persistence level of a processed
+  // field were available, guarded by m_processingStatsMutex.
+  struct ProcessingStats {
+    size_t results = 0;
+    double lastTimeToFirstCrystal = 0;
+    double totalTimeToFirstCrystal = 0;
+    double lastProcessingTime = 0;
+  };
+
+  void runCommand(std::shared_ptr<PendingCommand> command);
+  std::string commandKey(const Json::Value &request, void *socket) const;
+  std::string sessionKey(void *socket) const;
+  bool dropWaiter(void *socket, int messageId);
+  void postCancelled(void *socket, int messageId);
+  CommandContext& context() const;
+  Session& session() const;
+  dspacex::Dataset& dataset() const;
+  std::shared_ptr<LoadedDataset> acquireDataset(int datasetId);
+  void evictDatasets();
+  void closeSession(Session &session, void *socket);
+  void setCurrentResult(const ProcessedResultKey &key, const ProcessedResultCache::Entry *entry);
+  void setCurrentStream(const std::shared_ptr<ResultStream> &stream);
+  void unfollowStream(const std::shared_ptr<ResultStream> &stream);
+  void startStream(const std::shared_ptr<ResultStream> &stream);
+  void processStream(ResultStream &stream, LoadedDataset &dataset);
+  void readStream(const std::shared_ptr<ResultStream> &stream);
+  void adoptStream(ResultStream &stream);
+  void waitForLevel(unsigned int persistenceLevel);
+  const MSHierarchy* waitForPartitions(unsigned int persistenceLevel);
+  void postLevelReady(ResultStream &stream, unsigned int level);
+  void recordProcessingTime(double timeToFirstCrystal, double processingTime);
+
   void sendError(Json::Value &response, std::string str = "server error");
   bool verifyFieldname(Fieldtype type, const std::string &name);
+  void sendBinaryResponse(void *wsi, int messageId, const BinaryResponse &binary);
 
   void configureCommandHandlers();
   void configureAvailableDatasets(const std::string &rootPath);
 
   void maybeLoadDataset(int datasetId);
   void maybeProcessData(Fieldtype category, std::string fieldname, int knn,
+                        ProcessingMode mode = ProcessingMode::Complete,
                         int num_samples = 50, double sigma = 0.25, double smoothing = 15.0,
                         bool add_noise = true /* duplicate values risk erroroneous M-S */,
                         unsigned num_persistences = -1 /* generates all persistence levels */);
 
   // Command Handlers
+  void bindDataSocket(const Json::Value &request, Json::Value &response);
+  void cancelRequest(const Json::Value &request, Json::Value &response);
   void fetchDatasetList(const Json::Value &request, Json::Value &response);
   void fetchDataset(const Json::Value &request, Json::Value &response);
   void fetchKNeighbors(const Json::Value &request, Json::Value &response);
@@ -46,13 +195,18 @@ class Controller {
   void fetchParameter(const Json::Value &request, Json::Value &response);
   void fetchQoi(const Json::Value &request, Json::Value &response);
   void fetchThumbnails(const Json::Value &request, Json::Value &response);
+  void fetchThumbnailRange(const Json::Value &request, Json::Value &response);
   void fetchAllForLatentSpaceUsingSharedGP(const Json::Value &request, Json::Value &response);
   void fetchImageForLatentSpaceCoord_Shapeodds(const Json::Value &request, Json::Value &response);
   void fetchNImagesForCrystal_Shapeodds(const Json::Value &request, Json::Value &response);
   void fetchAllImagesForCrystal_Shapeodds(const Json::Value &request, Json::Value &response);
   void fetchCrystalOriginalSampleImages(const Json::Value &request, Json::Value &response);
+  void fetchServerCacheStats(const Json::Value &request, Json::Value &response);
+
+  void writeThumbnail(JsonWriter &writer, unsigned int index, const Image &image);
 
-  const Eigen::Map<Eigen::VectorXd> getFieldvalues(Fieldtype type, const std::string &name);
+  static const Eigen::Map<Eigen::VectorXd> getFieldvalues(dspacex::Dataset &dataset, Fieldtype type,
+                                                          const std::string &name);
 
   // todo: user shouldn't need this: a plvl is a plvl, so bury the details
   int getPersistenceLevelIdx(const unsigned desired_persistence, const dspacex::MSComplex &mscomplex) const;
@@ -60,12 +214,35 @@ class Controller {
   typedef std::function<void(const Json::Value&, Json::Value&)> RequestHandler;
   std::map<std::string, RequestHandler> m_commandMap;
   std::vector<std::pair<std::string, std::string>> m_availableDatasets;
-  std::unique_ptr<dspacex::Dataset> m_currentDataset;
-  int m_currentDatasetId = -1;
-  std::string m_currentField;
-  FortranLinalg::DenseMatrix<Precision> m_currentDistanceMatrix;
-  int m_currentKNN = -1; // num nearest neighbors to consider when generating M-S complex for a dataset
-  HDVizData *m_currentVizData = nullptr;
-  TopologyData *m_currentTopoData = nullptr;
+  std::map<int, DatasetEntry> m_datasets; // loaded datasets by id
+  size_t m_datasetBudget;                 // bytes of loaded datasets before idle ones are evicted
+  std::mutex m_datasetsMutex;
+  std::map<void*, std::shared_ptr<Session>> m_sessions; // by text socket
+  std::mutex m_sessionsMutex;
+  std::map<ProcessedResultKey, SharedStream> m_streams; // results being computed
+  std::mutex m_streamsMutex;
+  KNNGraphCache<Precision> m_knnGraphCache; // nearest neighbors of the dataset used last
+  std::unique_ptr<KNNBackend<Precision>> m_knnBackend; // searches neighbors of samples, or null
+  ProcessedResultCache m_resultCache; // processed fields of all datasets, owns their data
+  ResultDiskCache m_resultDiskCache;  // processed results kept across server restarts
   std::string datapath;
+
+  std::map<int, void*> m_dataSockets;       // data sockets by registration token
+  std::map<void*, void*> m_boundDataSockets; // data socket of each text socket
+  std::mutex m_socketsMutex;
+
+  std::map<std::string, std::shared_ptr<PendingCommand>> m_pending; // by request without id
+  std::map<std::pair<void*, std::string>, int> m_channels; // latest message id per socket and channel
+  std::mutex m_pendingMutex;
+
+  ProcessingStats m_processingStats;
+  std::mutex m_processingStatsMutex;
+
+  static thread_local CommandContext *s_context;
+
+  // Declared last so that queued commands finish before the state they use
+  // is destroyed.
+  ThreadPool m_fastLane;     // commands that answer without touching a dataset
+  KeyedExecutor m_executor;  // all other commands, serialized per session
+  ThreadPool m_background;   // streamed processing that outlives its command
 };
@@ -0,0 +1,389 @@
+#include "JsonWriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Doubles whose magnitude is below this are integral if they equal their
+// truncation, and can be written without going through printf.
+const double kMaxExactInteger = 9007199254740992.0;  // 2^53
+
+// Infinity is written the way jsoncpp writes it, as a number out of range
+// of a double, which JSON.parse reads back as Infinity.
+const char *kPositiveInfinity = "1e+9999";
+const char *kNegativeInfinity = "-1e+9999";
+
+void appendInteger(std::string &out, unsigned long long value, bool negative) {
+  char digits[24];
+  char *end = digits + sizeof(digits);
+  char *begin = end;
+  do {
+    *--begin = char('0' + value % 10);
+    value /= 10;
+  } while (value != 0);
+  if (negative) {
+    *--begin = '-';
+  }
+  out.append(begin, end);
+}
+
+/**
+ * Appends the significant digits of a number whose first digit has the given
+ * decimal exponent the way printf("%.*g", precision) prints them: in fixed
+ * notation if -4 <= exponent < precision, in scientific notation otherwise.
+ */
+void appendDigits(std::string &out, bool negative, const char *digits, int count,
+                  int exponent, int precision) {
+  // Trailing zeros are not significant, %g drops them as well.
+  while (count > 1 && digits[count - 1] == '0') {
+    count--;
+  }
+  if (negative) {
+    out.push_back('-');
+  }
+  if (exponent < -4 || exponent >= precision) {
+    out.push_back(digits[0]);
+    if (count > 1) {
+      out.push_back('.');
+      out.append(digits + 1, count - 1);
+    }
+    char suffix[8];
+    int length = std::snprintf(suffix, sizeof(suffix), "e%c%02d", exponent < 0 ? '-' : '+',
+                               exponent < 0 ? -exponent : exponent);
+    out.append(suffix, length);
+  } else if (exponent < 0) {
+    out.append("0.");
+    out.append(-exponent - 1, '0');
+    out.append(digits, count);
+  } else if (count <= exponent + 1) {
+    out.append(digits, count);
+    out.append(exponent + 1 - count, '0');
+  } else {
+    out.append(digits, exponent + 1);
+    out.push_back('.');
+    out.append(digits + exponent + 1, count - exponent - 1);
+  }
+}
+
+/**
+ * Appends the shortest of value printed with shortest to longest significant
+ * digits that parses back as value. Printing takes most of the time, so the
+ * value is printed once with the longest precision, which always reads back,
+ * and the shorter candidates are rounded from those digits. Rounding twice
+ * can rarely miss a candidate printf would have found, which then only costs
+ * a digit.
+ */
+template<typename T, typename Parse>
+void appendRoundTrip(std::string &out, T value, int shortest, int longest, Parse parse) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.*e", longest - 1, double(value));
+  const char *c = text;
+  bool negative = *c == '-';
+  if (negative) {
+    c++;
+  }
+  char digits[24];
+  digits[0] = *c++;
+  c++;  // the decimal point
+  for (int i = 1; i < longest; i++) {
+    digits[i] = *c++;
+  }
+  int exponent = std::atoi(c + 1);
+
+  std::string candidate;
+  for (int precision = shortest; precision < longest; precision++) {
+    char rounded[24];
+    std::memcpy(rounded, digits, precision);
+    int roundedExponent = exponent;
+    if (digits[precision] >= '5') {
+      int i = precision - 1;
+      while (i >= 0 && rounded[i] == '9') {
+        rounded[i--] = '0';
+      }
+      if (i >= 0) {
+        rounded[i]++;
+      } else {
+        rounded[0] = '1';
+        roundedExponent++;
+      }
+    }
+    candidate.clear();
+    appendDigits(candidate, negative, rounded, precision, roundedExponent, precision);
+    if (parse(candidate.c_str()) == value) {
+      out.append(candidate);
+      return;
+    }
+  }
+  appendDigits(out, negative, digits, longest, exponent, longest);
+}
+
+}  // namespace
+
+
+JsonWriter::JsonWriter(std::string &out, bool inObject) : m_out(out) {
+  if (inObject) {
+    m_scopes.push_back(false);
+  }
+  m_baseDepth = m_scopes.size();
+}
+
+/**
+ * Writes the comma between elements, unless the value follows its key.
+ */
+void JsonWriter::separate() {
+  if (m_afterKey) {
+    m_afterKey = false;
+    return;
+  }
+  if (!m_scopes.empty()) {
+    if (m_scopes.back()) {
+      m_out.push_back(',');
+    }
+    m_scopes.back() = true;
+  }
+}
+
+JsonWriter& JsonWriter::beginObject() {
+  separate();
+  m_out.push_back('{');
+  m_scopes.push_back(false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+  if (m_scopes.size() <= m_baseDepth || m_afterKey) {
+    throw std::logic_error("JsonWriter: endObject without a matching beginObject");
+  }
+  m_scopes.pop_back();
+  m_out.push_back('}');
+  return *this;
+}
+
+JsonWriter& JsonWriter::beginArray() {
+  separate();
+  m_out.push_back('[');
+  m_scopes.push_back(false);
+  return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+  if (m_scopes.size() <= m_baseDepth || m_afterKey) {
+    throw std::logic_error("JsonWriter: endArray without a matching beginArray");
+  }
+  m_scopes.pop_back();
+  m_out.push_back(']');
+  return *this;
+}
+
+JsonWriter& JsonWriter::key(const char *name) {
+  separate();
+  appendString(name, std::strlen(name));
+  m_out.push_back(':');
+  m_afterKey = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::key(const std::string &name) {
+  separate();
+  appendString(name.data(), name.size());
+  m_out.push_back(':');
+  m_afterKey = true;
+  return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+  separate();
+  m_out.append("null");
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(bool value) {
+  separate();
+  m_out.append(value ? "true" : "false");
+  return *this;
+}
+
+template<typename T>
+JsonWriter& JsonWriter::integer(T value) {
+  separate();
+  if (value < 0) {
+    // Negate as unsigned so the most negative value does not overflow.
+    appendInteger(m_out, 0ull - static_cast<unsigned long long>(value), true);
+  } else {
+    appendInteger(m_out, static_cast<unsigned long long>(value), false);
+  }
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(int value) {
+  return integer(value);
+}
+
+JsonWriter& JsonWriter::value(unsigned int value) {
+  return integer(value);
+}
+
+JsonWriter& JsonWriter::value(long value) {
+  return integer(value);
+}
+
+JsonWriter& JsonWriter::value(unsigned long value) {
+  return integer(value);
+}
+
+JsonWriter& JsonWriter::value(long long value) {
+  return integer(value);
+}
+
+JsonWriter& JsonWriter::value(unsigned long long value) {
+  return integer(value);
+}
+
+JsonWriter& JsonWriter::value(float value) {
+  separate();
+  appendShortest(m_out, value);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(double value) {
+  separate();
+  appendShortest(m_out, value);
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const char *value) {
+  separate();
+  appendString(value, std::strlen(value));
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const std::string &value) {
+  separate();
+  appendString(value.data(), value.size());
+  return *this;
+}
+
+JsonWriter& JsonWriter::value(const Json::Value &value) {
+  switch (value.type()) {
+    case Json::nullValue:
+      return null();
+    case Json::intValue:
+      return this->value(static_cast<long long>(value.asLargestInt()));
+    case Json::uintValue:
+      return this->value(static_cast<unsigned long long>(value.asLargestUInt()));
+    case Json::realValue:
+      return this->value(value.asDouble());
+    case Json::stringValue: {
+      const char *begin = nullptr;
+      const char *end = nullptr;
+      value.getString(&begin, &end);
+      separate();
+      appendString(begin, end - begin);
+      return *this;
+    }
+    case Json::booleanValue:
+      return this->value(value.asBool());
+    case Json::arrayValue:
+      beginArray();
+      for (const auto &element : value) {
+        this->value(element);
+      }
+      return endArray();
+    case Json::objectValue:
+      beginObject();
+      members(value);
+      return endObject();
+  }
+  return *this;
+}
+
+JsonWriter& JsonWriter::members(const Json::Value &object) {
+  for (auto it = object.begin(); it != object.end(); ++it) {
+    key(it.name());
+    value(*it);
+  }
+  return *this;
+}
+
+JsonWriter& JsonWriter::rawMembers(const std::string &members) {
+  if (members.empty()) {
+    return *this;
+  }
+  separate();
+  m_out.append(members);
+  return *this;
+}
+
+/**
+ * Writes integral values as integers, which is both the shortest form and
+ * much faster than printf, and other values with 15 to 17 significant
+ * digits, whichever is the first to read back exactly. NaN has no JSON
+ * representation and is written as null, like jsoncpp does.
+ */
+void JsonWriter::appendShortest(std::string &out, double value) {
+  if (std::isnan(value)) {
+    out.append("null");
+  } else if (std::isinf(value)) {
+    out.append(value > 0 ? kPositiveInfinity : kNegativeInfinity);
+  } else if (std::fabs(value) < kMaxExactInteger && value == std::trunc(value) &&
+             !(value == 0 && std::signbit(value))) {
+    appendInteger(out, static_cast<unsigned long long>(std::fabs(value)), value < 0);
+  } else {
+    appendRoundTrip(out, value, 15, 17, [](const char *text) {
+      return std::strtod(text, nullptr);
+    });
+  }
+}
+
+/**
+ * Floats need 6 to 9 significant digits to read back as the same float.
+ */
+void JsonWriter::appendShortest(std::string &out, float value) {
+  if (std::isnan(value)) {
+    out.append("null");
+  } else if (std::isinf(value)) {
+    out.append(value > 0 ? kPositiveInfinity : kNegativeInfinity);
+  } else if (std::fabs(value) < 16777216.0f && value == std::trunc(value) &&
+             !(value == 0 && std::signbit(value))) {
+    appendInteger(out, static_cast<unsigned long long>(std::fabs(value)), value < 0);
+  } else {
+    appendRoundTrip(out, value, 6, 9, [](const char *text) {
+      return std::strtof(text, nullptr);
+    });
+  }
+}
+
+void JsonWriter::appendString(const char *value, size_t length) {
+  static const char *kHex = "0123456789abcdef";
+  m_out.push_back('"');
+  const char *end = value + length;
+  const char *run = value;
+  for (const char *c = value; c != end; c++) {
+    unsigned char ch = static_cast<unsigned char>(*c);
+    if (ch >= 0x20 && ch != '"' && ch != '\\') {
+      continue;
+    }
+    m_out.append(run, c);
+    run = c + 1;
+    switch (ch) {
+      case '"':  m_out.append("\\\""); break;
+      case '\\': m_out.append("\\\\"); break;
+      case '\b': m_out.append("\\b"); break;
+      case '\f': m_out.append("\\f"); break;
+      case '\n': m_out.append("\\n"); break;
+      case '\r': m_out.append("\\r"); break;
+      case '\t': m_out.append("\\t"); break;
+      default: {
+        char escaped[] = { '\\', 'u', '0', '0', kHex[ch >> 4], kHex[ch & 0xf] };
+        m_out.append(escaped, sizeof(escaped));
+      }
+    }
+  }
+  m_out.append(run, end);
+  m_out.push_back('"');
+}
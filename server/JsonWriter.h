@@ -0,0 +1,132 @@
+#pragma once
+
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseVector.h"
+
+#include <Eigen/Core>
+#include <jsoncpp/json/json.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Writes compact JSON text straight into a string, without building a
+ * Json::Value first. Large responses are written member by member, so no
+ * node is allocated per element, and the string can be cleared and reused
+ * for the next response to keep its capacity. Doubles are written with the
+ * fewest digits that read back as the same value.
+ *
+ * Values, keys and the begin and end calls are written in document order:
+ *
+ *   JsonWriter writer(text);
+ *   writer.beginObject();
+ *   writer.key("layout").matrix(rows, 2, [&](unsigned int i, unsigned int j) { ... });
+ *   writer.endObject();
+ *
+ * Small parts can still be built as a Json::Value and written with value().
+ */
+class JsonWriter {
+ public:
+  /**
+   * Appends to out. If inObject is set, the writer starts inside an object
+   * whose braces someone else writes, so that it only writes members, which
+   * can later be inserted into that object with rawMembers().
+   */
+  explicit JsonWriter(std::string &out, bool inObject = false);
+
+  JsonWriter& beginObject();
+  JsonWriter& endObject();
+  JsonWriter& beginArray();
+  JsonWriter& endArray();
+  JsonWriter& key(const char *name);
+  JsonWriter& key(const std::string &name);
+
+  JsonWriter& null();
+  JsonWriter& value(bool value);
+  JsonWriter& value(int value);
+  JsonWriter& value(unsigned int value);
+  JsonWriter& value(long value);
+  JsonWriter& value(unsigned long value);
+  JsonWriter& value(long long value);
+  JsonWriter& value(unsigned long long value);
+  JsonWriter& value(float value);
+  JsonWriter& value(double value);
+  JsonWriter& value(const char *value);
+  JsonWriter& value(const std::string &value);
+  JsonWriter& value(const Json::Value &value);
+
+  // Writes the members of a Json::Value object into the current object.
+  JsonWriter& members(const Json::Value &object);
+
+  // Inserts members written by a writer constructed with inObject set.
+  JsonWriter& rawMembers(const std::string &members);
+
+  // Writes the rows x cols matrix of values at(i, j) as an array of rows.
+  template<typename Accessor>
+  JsonWriter& matrix(unsigned int rows, unsigned int cols, Accessor at) {
+    beginArray();
+    for (unsigned int i = 0; i < rows; i++) {
+      beginArray();
+      for (unsigned int j = 0; j < cols; j++) {
+        value(at(i, j));
+      }
+      endArray();
+    }
+    return endArray();
+  }
+
+  // Writes the vector of values at(i).
+  template<typename Accessor>
+  JsonWriter& vector(unsigned int size, Accessor at) {
+    beginArray();
+    for (unsigned int i = 0; i < size; i++) {
+      value(at(i));
+    }
+    return endArray();
+  }
+
+  template<typename T>
+  JsonWriter& value(FortranLinalg::DenseMatrix<T> &matrix) {
+    return this->matrix(matrix.M(), matrix.N(),
+                        [&](unsigned int i, unsigned int j) { return matrix(i, j); });
+  }
+
+  template<typename T>
+  JsonWriter& value(FortranLinalg::DenseVector<T> &vector) {
+    return this->vector(vector.N(), [&](unsigned int i) { return vector(i); });
+  }
+
+  // Eigen vectors, including maps of them, are written as flat arrays and
+  // matrices as arrays of rows.
+  template<typename Derived>
+  JsonWriter& value(const Eigen::DenseBase<Derived> &values) {
+    if (values.cols() == 1) {
+      return vector(values.rows(), [&](unsigned int i) { return values(i, 0); });
+    }
+    return matrix(values.rows(), values.cols(),
+                  [&](unsigned int i, unsigned int j) { return values(i, j); });
+  }
+
+  // True once every object and array begun has been ended.
+  bool isComplete() const {
+    return m_scopes.size() == m_baseDepth && !m_afterKey;
+  }
+
+  // Appends the fewest digits that read back as value.
+  static void appendShortest(std::string &out, double value);
+  static void appendShortest(std::string &out, float value);
+
+ private:
+  void separate();
+  void appendString(const char *value, size_t length);
+
+  template<typename T>
+  JsonWriter& integer(T value);
+
+  std::string &m_out;
+  std::vector<char> m_scopes;  // per open object or array, whether it has an element yet
+  size_t m_baseDepth;
+  bool m_afterKey = false;
+};
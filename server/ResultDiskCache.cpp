@@ -0,0 +1,79 @@
+#include "ResultDiskCache.h"
+#include "hdprocess/HDProcessResultSerializer.h"
+
+#include <boost/filesystem.hpp>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+
+ResultDiskCache::ResultDiskCache(const std::string &directory) : m_directory(directory) {
+  if (!enabled()) {
+    return;
+  }
+  boost::system::error_code error;
+  boost::filesystem::create_directories(m_directory, error);
+  if (error) {
+    std::cout << "Result cache directory " << m_directory << " is not usable: "
+              << error.message() << std::endl;
+    m_directory.clear();
+  }
+}
+
+HDProcessResult* ResultDiskCache::read(const std::string &key) {
+  if (!enabled()) {
+    return nullptr;
+  }
+  boost::filesystem::path path = boost::filesystem::path(m_directory) / key;
+  if (!boost::filesystem::is_directory(path)) {
+    return nullptr;
+  }
+  try {
+    return HDProcessResultSerializer::read(path.string());
+  } catch (const char *err) {
+    std::cerr << "Failed to read cached result " << path.string() << ": " << err << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "Failed to read cached result " << path.string() << ": " << e.what() << std::endl;
+  }
+  return nullptr;
+}
+
+void ResultDiskCache::write(const std::string &key, HDProcessResult *result) {
+  if (!enabled()) {
+    return;
+  }
+  boost::filesystem::path path = boost::filesystem::path(m_directory) / key;
+  // Commands on datasets with identical content may write the same key at once.
+  std::ostringstream suffix;
+  suffix << ".tmp" << getpid() << "-" << std::this_thread::get_id();
+  boost::filesystem::path staging = boost::filesystem::path(m_directory) / (key + suffix.str());
+  boost::system::error_code error;
+  boost::filesystem::remove_all(staging, error);
+  boost::filesystem::create_directories(staging, error);
+  if (!error) {
+    // A full disk or unwritable directory doesn't fail the computed result.
+    std::string failure;
+    try {
+      HDProcessResultSerializer::write(result, staging.string());
+    } catch (const char *err) {
+      failure = err;
+    } catch (const std::exception &e) {
+      failure = e.what();
+    }
+    if (!failure.empty()) {
+      std::cerr << "Failed to cache result " << path.string() << ": " << failure << std::endl;
+      boost::filesystem::remove_all(staging, error);
+      return;
+    }
+    boost::filesystem::rename(staging, path, error);
+  }
+  if (error) {
+    // Another server may have stored the same result in the meantime.
+    if (!boost::filesystem::is_directory(path)) {
+      std::cerr << "Failed to cache result " << path.string() << ": " << error.message() << std::endl;
+    }
+    boost::filesystem::remove_all(staging, error);
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "hdprocess/HDProcessResult.h"
+
+#include <string>
+
+
+/**
+ * Content-addressed on-disk store of processed results. Each result lives in
+ * a directory named after the hash of the data and parameters it was computed
+ * from, so results survive server restarts and are shared by every dataset
+ * with identical content. An empty cache directory disables the store.
+ */
+class ResultDiskCache {
+ public:
+  explicit ResultDiskCache(const std::string &directory = "");
+
+  bool enabled() const {
+    return !m_directory.empty();
+  }
+
+  /**
+   * Returns the result stored under the key, or nullptr if there is none or
+   * it could not be read.
+   */
+  HDProcessResult* read(const std::string &key);
+
+  /**
+   * Stores a result under the key. The result is written to a temporary
+   * directory first and renamed into place, so readers never see partial
+   * results. Failures are logged and otherwise ignored.
+   */
+  void write(const std::string &key, HDProcessResult *result);
+
+ private:
+  std::string m_directory;
+};
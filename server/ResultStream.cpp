@@ -0,0 +1,187 @@
+#include "ResultStream.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Waiting commands check their cancellation token this often.
+const std::chrono::milliseconds kCancellationPollInterval(100);
+
+
+ResultStream::ResultStream(const ProcessedResultKey &key, LevelCallback levelReady) :
+    m_key(key), m_levelReady(levelReady), m_start(std::chrono::steady_clock::now()) {}
+
+/**
+ * Frees the result and the data built from it unless they were released.
+ */
+ResultStream::~ResultStream() {
+  if (m_owned) {
+    delete m_topoData;
+    delete m_vizData;
+    if (m_result) {
+      m_result->deallocate();
+      delete m_result;
+    }
+  }
+}
+
+void ResultStream::subscribe(void *socket) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (std::find(m_subscribers.begin(), m_subscribers.end(), socket) == m_subscribers.end()) {
+    m_subscribers.push_back(socket);
+  }
+}
+
+void ResultStream::unsubscribe(void *socket) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_subscribers.erase(std::remove(m_subscribers.begin(), m_subscribers.end(), socket),
+                      m_subscribers.end());
+}
+
+std::vector<void*> ResultStream::getSubscribers() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_subscribers;
+}
+
+/**
+ * Builds the visualization and topology data while they have no levels yet.
+ */
+void ResultStream::persistenceComputed(HDProcessResult &result) {
+  SimpleHDVizDataImpl *vizData = new SimpleHDVizDataImpl(&result);
+  LegacyTopologyDataImpl *topoData = new LegacyTopologyDataImpl(vizData);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_result = &result;
+  m_vizData = vizData;
+  m_topoData = topoData;
+  m_readyLevels.assign(result.scaledPersistence.N(), false);
+  m_changed.notify_all();
+}
+
+void ResultStream::levelComputed(HDProcessResult &result, unsigned int level) {
+  // Commands only read levels that are ready, so the new one can be added
+  // while they do. The levels of a complete result are added right away.
+  if (!m_vizData->hasLevel(level)) {
+    m_vizData->addLevel(level);
+    m_topoData->addLevel(level);
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_readyLevels[level] = true;
+    if (m_readyCount++ == 0) {
+      m_firstLevelTime = std::chrono::steady_clock::now();
+    }
+    m_changed.notify_all();
+  }
+  if (m_levelReady) {
+    m_levelReady(*this, level);
+  }
+}
+
+void ResultStream::processingFailed(HDProcessResult *result) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_result = result;
+}
+
+void ResultStream::finish() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_finished = true;
+  m_finishTime = std::chrono::steady_clock::now();
+  m_changed.notify_all();
+}
+
+void ResultStream::fail(const std::string &error) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_failed = true;
+  m_error = error;
+  m_changed.notify_all();
+}
+
+void ResultStream::waitForPersistence(const CancellationToken *cancellation) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  waitUntil(lock, [this]() { return m_vizData != nullptr; }, cancellation);
+}
+
+void ResultStream::waitForLevel(unsigned int level, const CancellationToken *cancellation) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  waitUntil(lock, [this]() { return m_vizData != nullptr; }, cancellation);
+  if (level >= m_readyLevels.size()) {
+    throw std::out_of_range("Invalid Persistence Level" + std::to_string(level));
+  }
+  waitUntil(lock, [this, level]() { return m_readyLevels[level] != 0; }, cancellation);
+}
+
+void ResultStream::waitForCompletion(const CancellationToken *cancellation) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  waitUntil(lock, [this]() { return m_finished; }, cancellation);
+}
+
+/**
+ * Waits until ready returns true, which it is checked for whenever the stream
+ * changes. A failure is only thrown if ready is false, so levels that were
+ * computed before processing failed can still be used.
+ */
+void ResultStream::waitUntil(std::unique_lock<std::mutex> &lock,
+                             const std::function<bool()> &ready,
+                             const CancellationToken *cancellation) {
+  while (!ready()) {
+    if (m_failed) {
+      throw std::runtime_error(m_error);
+    }
+    CancellationToken::throwIfCancelled(cancellation);
+    m_changed.wait_for(lock, kCancellationPollInterval);
+  }
+}
+
+bool ResultStream::isLevelReady(unsigned int level) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return level < m_readyLevels.size() && m_readyLevels[level];
+}
+
+bool ResultStream::isFinished() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_finished;
+}
+
+bool ResultStream::hasFailed() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_failed;
+}
+
+HDVizData* ResultStream::getVizData() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_vizData;
+}
+
+TopologyData* ResultStream::getTopoData() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_topoData;
+}
+
+size_t ResultStream::getByteSize() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return (m_result ? m_result->byteSize() : 0) + (m_vizData ? m_vizData->getByteSize() : 0);
+}
+
+void ResultStream::release(HDProcessResult *&result, HDVizData *&vizData, TopologyData *&topoData) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (!m_finished || !m_owned) {
+    throw std::logic_error("Only a finished result stream can be released, and only once");
+  }
+  m_owned = false;
+  result = m_result;
+  vizData = m_vizData;
+  topoData = m_topoData;
+}
+
+double ResultStream::getTimeToFirstLevel() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_readyCount > 0 ? secondsSinceStart(m_firstLevelTime) : -1;
+}
+
+double ResultStream::getProcessingTime() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_finished ? secondsSinceStart(m_finishTime) : -1;
+}
+
+double ResultStream::secondsSinceStart(std::chrono::steady_clock::time_point time) const {
+  return std::chrono::duration<double>(time - m_start).count();
+}
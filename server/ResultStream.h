@@ -0,0 +1,117 @@
+#pragma once
+
+#include "hdprocess/HDProcessor.h"
+#include "hdprocess/HDProcessResult.h"
+#include "hdprocess/LegacyTopologyDataImpl.h"
+#include "hdprocess/ProcessedResultCache.h"
+#include "hdprocess/SimpleHDVizDataImpl.h"
+#include "utils/CancellationToken.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+ * A processed result whose persistence levels are still computed in the
+ * background. It observes the processor and builds the visualization and
+ * topology data of each level as soon as the level is complete, so that
+ * commands can use the coarse levels while the finer ones fill in. Commands
+ * wait for the levels they need; once all levels are in, the result can be
+ * handed over to the result cache. The stream owns the result until then,
+ * including the partial result of a failed run, so it stays valid for as long
+ * as commands hold on to the stream.
+ */
+class ResultStream : public HDProcessorObserver {
+ public:
+  // Called on a processing thread after a level became ready.
+  typedef std::function<void(ResultStream &stream, unsigned int level)> LevelCallback;
+
+  ResultStream(const ProcessedResultKey &key, LevelCallback levelReady);
+  ~ResultStream();
+
+  ResultStream(const ResultStream&) = delete;
+  ResultStream& operator=(const ResultStream&) = delete;
+
+  const ProcessedResultKey& getKey() const {
+    return m_key;
+  }
+
+  CancellationToken& getCancellation() {
+    return m_cancellation;
+  }
+
+  // Text sockets of the clients using the stream, which are told about levels
+  // as they become ready.
+  void subscribe(void *socket);
+  void unsubscribe(void *socket);
+  std::vector<void*> getSubscribers();
+
+  void persistenceComputed(HDProcessResult &result) override;
+  void levelComputed(HDProcessResult &result, unsigned int level) override;
+  void processingFailed(HDProcessResult *result) override;
+
+  // Called by the processing task once processOnMetric returned or threw.
+  void finish();
+  void fail(const std::string &error);
+
+  /**
+   * Block until the persistence levels are known, a level is ready or all
+   * levels are ready. Throw the processing error if processing failed, or
+   * OperationCancelled if the waiting command is cancelled meanwhile.
+   */
+  void waitForPersistence(const CancellationToken *cancellation);
+  void waitForLevel(unsigned int level, const CancellationToken *cancellation);
+  void waitForCompletion(const CancellationToken *cancellation);
+
+  bool isLevelReady(unsigned int level);
+  bool isFinished();
+  bool hasFailed();
+
+  // Valid once the persistence levels are known.
+  HDVizData* getVizData();
+  TopologyData* getTopoData();
+
+  // Bytes of the result and the visualization data built from it.
+  size_t getByteSize();
+
+  /**
+   * Hands the finished result and the data built from it over to the caller.
+   * The stream keeps pointing to them but no longer frees them.
+   */
+  void release(HDProcessResult *&result, HDVizData *&vizData, TopologyData *&topoData);
+
+  // Seconds from the start of the stream until the first level was ready and
+  // until all levels were ready, or negative if they are not ready yet.
+  double getTimeToFirstLevel();
+  double getProcessingTime();
+
+ private:
+  void waitUntil(std::unique_lock<std::mutex> &lock, const std::function<bool()> &ready,
+                 const CancellationToken *cancellation);
+  double secondsSinceStart(std::chrono::steady_clock::time_point time) const;
+
+  const ProcessedResultKey m_key;
+  const LevelCallback m_levelReady;
+  CancellationToken m_cancellation;
+  const std::chrono::steady_clock::time_point m_start;
+
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  HDProcessResult *m_result = nullptr;
+  SimpleHDVizDataImpl *m_vizData = nullptr;
+  LegacyTopologyDataImpl *m_topoData = nullptr;
+  bool m_owned = true;            // result and data are freed by the stream
+  std::vector<char> m_readyLevels;
+  unsigned int m_readyCount = 0;
+  bool m_finished = false;
+  bool m_failed = false;
+  std::string m_error;
+  std::chrono::steady_clock::time_point m_firstLevelTime;
+  std::chrono::steady_clock::time_point m_finishTime;
+  std::vector<void*> m_subscribers;
+};
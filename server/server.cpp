@@ -2,14 +2,28 @@
 #include "serverlib/wst.h"
 #include "optparse/OptionParser.h"
 #include <chrono>
+#include <cstdlib>
 #include <exception>
+#include <memory>
 #include <thread>
+#include <utility>
 
 const int kDefaultPort = 7681;
 const std::string kDefaultDatapath("../../examples");
  
 Controller *controller = nullptr;
 
+// Processed results are kept in the user's cache directory by default.
+std::string defaultResultCachePath() {
+  if (const char *cacheHome = getenv("XDG_CACHE_HOME")) {
+    return std::string(cacheHome) + "/dSpaceX/results";
+  }
+  if (const char *home = getenv("HOME")) {
+    return std::string(home) + "/.cache/dSpaceX/results";
+  }
+  return "";
+}
+
 extern "C" void browserData(void *wsi, void *data) {
   controller->handleData(wsi, data);
 }
@@ -18,21 +32,49 @@ extern "C" void browserText(void *wsi, char *text, int lena) {
   controller->handleText(wsi, std::string(text));
 }
 
+extern "C" void browserClosed(void *wsi) {
+  controller->handleClose(wsi);
+}
+
 int main(int argc, char *argv[])
 {
   using optparse::OptionParser;
   OptionParser parser = OptionParser().description("dSpaceX Server");
   parser.add_option("-p", "--port").dest("port").type("int").set_default(kDefaultPort).help("server port");
   parser.add_option("-d", "--datapath").dest("datapath").set_default(kDefaultDatapath).help("path to datasets");
+  parser.add_option("-c", "--cachesize").dest("cachesize").type("int")
+      .set_default(Controller::kDefaultResultCacheBytes >> 20)
+      .help("memory budget of processed results in MB");
+  parser.add_option("-m", "--datasetmemory").dest("datasetmemory").type("int")
+      .set_default(Controller::kDefaultDatasetBytes >> 20)
+      .help("memory budget of loaded datasets in MB, beyond which idle ones are unloaded");
+  parser.add_option("-M", "--modelmemory").dest("modelmemory").type("int")
+      .set_default(Controller::kDefaultModelBytes >> 20)
+      .help("memory budget of predictive models in MB, beyond which least recently used ones are dropped");
+  parser.add_option("-r", "--resultcache").dest("resultcache").set_default(defaultResultCachePath())
+      .help("directory of processed results kept across restarts, empty to disable");
+  parser.add_option("-k", "--knnbackend").dest("knnbackend").set_default("brute")
+      .help("nearest neighbor search of samples: brute, kdtree or bdtree");
+  parser.add_option("-e", "--knneps").dest("knneps").type("float").set_default(0)
+      .help("error bound of kdtree and bdtree neighbors, 0 for exact ones");
 
   const optparse::Values &options = parser.parse_args(argc, argv);
   const std::vector<std::string> args = parser.args();
 
   int port = options.get("port");
   std::string datapath = options["datapath"];
+  size_t cacheBytes = size_t(int(options.get("cachesize"))) << 20;
+  std::string resultCachePath = options["resultcache"];
+  size_t datasetBytes = size_t(int(options.get("datasetmemory"))) << 20;
+  size_t modelBytes = size_t(int(options.get("modelmemory"))) << 20;
+  std::string knnBackend = options["knnbackend"];
+  double knnEps = options.get("knneps");
   
   try {
-    controller = new Controller(datapath);
+    std::unique_ptr<KNNBackend<Precision>> backend =
+        KNNBackend<Precision>::create(knnBackend, 0, knnEps);
+    controller = new Controller(datapath, cacheBytes, resultCachePath, datasetBytes, modelBytes);
+    controller->setKNNBackend(std::move(backend));
   } catch (const std::exception &e) {
     std::cout << e.what() << std::endl;
     return 1;
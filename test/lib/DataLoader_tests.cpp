@@ -1,6 +1,13 @@
 #include "gtest/gtest.h"
 #include "DatasetLoader.h"
 #include "Dataset.h"
+#include "utils/CSVReader.h"
+#include "utils/loaders.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
 
 const std::string kExampleDirPath = std::string(EXAMPLE_DATA_DIR);   
 
@@ -17,3 +24,69 @@ TEST(DatasetLoader, loadDataset_csv) {
   std::string filePath = kExampleDirPath + "/cantilever_beam/config.yaml";
   std::unique_ptr<dspacex::Dataset> dataset = dspacex::DatasetLoader::loadDataset(filePath);
 }
+
+TEST(CSVReader, parseDoubleMatchesStrtod) {
+  const char *numbers[] = {"0", "-0", "1", "-17", "3.25", ".5", "5.", "1e3", "1E-3", "-2.5e+2",
+                           "0.1", "0.000123456789", "123456789012345678901234", "9007199254740993",
+                           "1.7976931348623157e308", "4.9e-324", "1e-400", "2.2250738585072014e-308",
+                           "0.30000000000000004", "1234.5678e-10", "inf", "-nan"};
+  for (const char *number : numbers) {
+    std::string text(number);
+    double value = 0;
+    const char *end = HDProcess::parseDouble(text.data(), text.data() + text.size(), value);
+    EXPECT_EQ(text.data() + text.size(), end) << number;
+    double expected = std::strtod(number, nullptr);
+    if (expected == expected) {
+      EXPECT_EQ(expected, value) << number;
+    } else {
+      EXPECT_NE(value, value) << number;
+    }
+  }
+
+  std::string partial("12e,");
+  double value = 0;
+  EXPECT_EQ(partial.data() + 2, HDProcess::parseDouble(partial.data(), partial.data() + 4, value));
+  EXPECT_EQ(12, value);
+  std::string empty("x");
+  EXPECT_EQ(empty.data(), HDProcess::parseDouble(empty.data(), empty.data() + 1, value));
+}
+
+TEST(CSVReader, loadsColumnsInOnePass) {
+  std::string filename = "CSVReader_loadsColumnsInOnePass.csv";
+  {
+    std::ofstream file(filename);
+    file << " a , b,c\r\n1,2.5, -3\r\n\n4 ,5e1,6\n";
+  }
+
+  auto columns = HDProcess::loadCSVColumns(filename);
+  ASSERT_EQ(3u, columns.size());
+  EXPECT_EQ("a", columns[0].first);
+  EXPECT_EQ("c", columns[2].first);
+  ASSERT_EQ(2u, columns[1].second.N());
+  EXPECT_EQ(2.5, columns[1].second(0));
+  EXPECT_EQ(50, columns[1].second(1));
+  EXPECT_EQ(-3, columns[2].second(0));
+  for (auto &column : columns) {
+    column.second.deallocate();
+  }
+
+  FortranLinalg::DenseVector<Precision> c = HDProcess::loadCSVColumn(filename, "c");
+  EXPECT_EQ(6, c(1));
+  c.deallocate();
+  EXPECT_THROW(HDProcess::loadCSVColumn(filename, "d"), std::runtime_error);
+
+  {
+    std::ofstream file(filename);
+    file << "1,2\n3,4\n5,6,7\n";
+  }
+  HDProcess::CSVReader reader(filename, false);
+  EXPECT_EQ(3u, reader.getRowCount());
+  EXPECT_EQ(2u, reader.getColumnCount());
+  FortranLinalg::DenseVector<Precision> first = reader.readColumn(0);
+  EXPECT_EQ(5, first(2));
+  first.deallocate();
+  EXPECT_THROW(HDProcess::loadCSVMatrix(filename), std::runtime_error);
+  std::remove(filename.c_str());
+
+  EXPECT_THROW(HDProcess::loadCSVMatrix(filename), std::runtime_error);
+}
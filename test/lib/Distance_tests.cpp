@@ -0,0 +1,306 @@
+#include "gtest/gtest.h"
+#include "flinalg/DenseMatrix.h"
+#include "graph/KNNBackend.h"
+#include "graph/KNNGraphCache.h"
+#include "metrics/BlockedDistance.h"
+#include "metrics/Distance.h"
+#include "metrics/EuclideanMetric.h"
+#include "metrics/SquaredEuclideanMetric.h"
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+
+//---------------------------------------------------------------------
+// Declarations
+//---------------------------------------------------------------------
+
+FortranLinalg::DenseMatrix<double> createSamples(unsigned int dimension, unsigned int count) {
+  FortranLinalg::DenseMatrix<double> samples(dimension, count);
+  for (unsigned int j = 0; j < count; j++) {
+    for (unsigned int i = 0; i < dimension; i++) {
+      samples(i, j) = std::sin(0.37 * (i + 1) * (j + 1)) + 0.01 * j;
+    }
+  }
+  return samples;
+}
+
+void EXPECT_DISTANCES_NEAR(FortranLinalg::DenseMatrix<double> expected,
+                           FortranLinalg::DenseMatrix<double> actual) {
+  ASSERT_EQ(expected.M(), actual.M());
+  ASSERT_EQ(expected.N(), actual.N());
+  for (unsigned int j = 0; j < expected.N(); j++) {
+    EXPECT_EQ(0, actual(j, j));
+    for (unsigned int i = 0; i < expected.M(); i++) {
+      EXPECT_NEAR(expected(i, j), actual(i, j), 1e-9 * (1 + expected(i, j)));
+      EXPECT_EQ(actual(i, j), actual(j, i));
+    }
+  }
+}
+
+//---------------------------------------------------------------------
+// Tests
+//---------------------------------------------------------------------
+
+/**
+ * Blocked distances must match the per-pair metric for sample counts that are
+ * not a multiple of the block size, serially and with several threads.
+ */
+TEST(BlockedDistance, matchesMetric) {
+  FortranLinalg::DenseMatrix<double> samples = createSamples(7, 83);
+  EuclideanMetric<double> euclidean;
+  SquaredEuclideanMetric<double> squaredEuclidean;
+  FortranLinalg::DenseMatrix<double> expected = Distance<double>::computeDistances(samples, euclidean);
+  FortranLinalg::DenseMatrix<double> expectedSquared =
+      Distance<double>::computeDistances(samples, squaredEuclidean);
+
+  for (unsigned int threads : {1u, 3u}) {
+    FortranLinalg::DenseMatrix<double> distances =
+        BlockedDistance<double>::computeEuclidean(samples, threads, 16);
+    EXPECT_DISTANCES_NEAR(expected, distances);
+    distances.deallocate();
+
+    FortranLinalg::DenseMatrix<double> squared =
+        BlockedDistance<double>::computeSquaredEuclidean(samples, threads, 16);
+    EXPECT_DISTANCES_NEAR(expectedSquared, squared);
+    squared.deallocate();
+  }
+
+  samples.deallocate();
+  expected.deallocate();
+  expectedSquared.deallocate();
+}
+
+/**
+ * Neighbors streamed from the samples must be those of the blocked distance
+ * matrix, with the same distances, for sample counts that are not a multiple
+ * of the block size, serially and with several threads.
+ */
+TEST(BlockedDistance, findKNNMatchesDistanceMatrix) {
+  const unsigned int n = 83;
+  FortranLinalg::DenseMatrix<double> samples = createSamples(5, n);
+  FortranLinalg::DenseMatrix<double> distances =
+      BlockedDistance<double>::computeEuclidean(samples, 1, 16);
+
+  for (unsigned int k : {1u, 7u}) {
+    FortranLinalg::DenseMatrix<int> expectedKNN(k, n);
+    FortranLinalg::DenseMatrix<double> expectedDists(k, n);
+    Distance<double>::findKNN(distances, expectedKNN, expectedDists);
+    for (unsigned int threads : {1u, 3u}) {
+      FortranLinalg::DenseMatrix<int> knn(k, n);
+      FortranLinalg::DenseMatrix<double> dists(k, n);
+      BlockedDistance<double>::findKNN(samples, knn, dists, threads, 16);
+      for (unsigned int i = 0; i < n; i++) {
+        for (unsigned int j = 0; j < k; j++) {
+          EXPECT_EQ(expectedKNN(j, i), knn(j, i));
+          EXPECT_EQ(expectedDists(j, i), dists(j, i));
+        }
+      }
+      knn.deallocate();
+      dists.deallocate();
+    }
+    expectedKNN.deallocate();
+    expectedDists.deallocate();
+  }
+
+  samples.deallocate();
+  distances.deallocate();
+}
+
+/**
+ * Exact kd-tree and bd-tree searches on several threads must find the
+ * neighbors of the brute force backend, and approximate ones neighbors within
+ * their error bound.
+ */
+TEST(KNNBackend, treesMatchBruteForce) {
+  const unsigned int n = 700;
+  const unsigned int k = 9;
+  FortranLinalg::DenseMatrix<double> samples = createSamples(4, n);
+  FortranLinalg::DenseMatrix<int> expectedKNN(k, n);
+  FortranLinalg::DenseMatrix<double> expectedDists(k, n);
+  std::unique_ptr<KNNBackend<double>> brute = KNNBackend<double>::create("brute", 3);
+  brute->findKNN(samples, expectedKNN, expectedDists, false);
+  EXPECT_EQ(1.0, brute->recall(samples, k, 100));
+
+  for (const char *name : {"kdtree", "bdtree"}) {
+    std::unique_ptr<KNNBackend<double>> tree = KNNBackend<double>::create(name, 3);
+    EXPECT_EQ(name, tree->getName());
+    FortranLinalg::DenseMatrix<int> knn(k, n);
+    FortranLinalg::DenseMatrix<double> dists(k, n);
+    tree->findKNN(samples, knn, dists, false);
+    for (unsigned int i = 0; i < n; i++) {
+      EXPECT_EQ((int) i, knn(0, i));
+      for (unsigned int j = 0; j < k; j++) {
+        EXPECT_NEAR(expectedDists(j, i), dists(j, i), 1e-9);
+      }
+    }
+    EXPECT_EQ(1.0, tree->recall(samples, k));
+
+    std::unique_ptr<KNNBackend<double>> approximate = KNNBackend<double>::create(name, 3, 1.0);
+    approximate->findKNN(samples, knn, dists, false);
+    for (unsigned int i = 0; i < n; i++) {
+      for (unsigned int j = 0; j < k; j++) {
+        EXPECT_LE(dists(j, i), 2 * expectedDists(j, i) + 1e-9);
+      }
+    }
+    double recall = approximate->recall(samples, k);
+    EXPECT_GT(recall, 0.5);
+    EXPECT_LE(recall, 1.0);
+    knn.deallocate();
+    dists.deallocate();
+  }
+
+  EXPECT_THROW(KNNBackend<double>::create("lsh"), std::invalid_argument);
+  samples.deallocate();
+  expectedKNN.deallocate();
+  expectedDists.deallocate();
+}
+
+/**
+ * Selecting neighbors in place must give the same neighbors, in the same order,
+ * as the full heap, also when many distances are equal.
+ */
+TEST(Distance, findKNNMatchesHeap) {
+  // Points on an integer grid, with duplicates, have many equal distances.
+  const unsigned int n = 60;
+  FortranLinalg::DenseMatrix<double> samples(2, n);
+  for (unsigned int j = 0; j < n; j++) {
+    samples(0, j) = j % 7;
+    samples(1, j) = (j / 7) % 5;
+  }
+  EuclideanMetric<double> metric;
+  FortranLinalg::DenseMatrix<double> distances = Distance<double>::computeDistances(samples, metric);
+  FortranLinalg::DenseMatrix<double> smoothSamples = createSamples(5, n);
+  FortranLinalg::DenseMatrix<double> smooth = BlockedDistance<double>::computeEuclidean(smoothSamples);
+
+  for (FortranLinalg::DenseMatrix<double> *d : {&distances, &smooth}) {
+    for (unsigned int k : {1u, 6u, n}) {
+      FortranLinalg::DenseMatrix<int> expectedKNN(k, n), knn(k, n);
+      FortranLinalg::DenseMatrix<double> expectedDists(k, n), dists(k, n);
+      FortranLinalg::Matrix<double> &heapInput = *d;
+      Distance<double>::findKNN(heapInput, expectedKNN, expectedDists);
+      Distance<double>::findKNN(*d, knn, dists, 3);
+      for (unsigned int i = 0; i < n; i++) {
+        for (unsigned int j = 0; j < k; j++) {
+          EXPECT_EQ(expectedKNN(j, i), knn(j, i));
+          EXPECT_EQ(expectedDists(j, i), dists(j, i));
+        }
+      }
+      expectedKNN.deallocate();
+      knn.deallocate();
+      expectedDists.deallocate();
+      dists.deallocate();
+    }
+  }
+
+  samples.deallocate();
+  smoothSamples.deallocate();
+  distances.deallocate();
+  smooth.deallocate();
+}
+
+/**
+ * Smaller k must be answered from the prefix of the largest cached graph and
+ * match a direct neighbor search.
+ */
+TEST(KNNGraphCache, slicesLargestGraph) {
+  const unsigned int n = 40;
+  FortranLinalg::DenseMatrix<double> samples = createSamples(3, n);
+  FortranLinalg::DenseMatrix<double> distances = BlockedDistance<double>::computeEuclidean(samples);
+  KNNGraphCache<double> cache;
+
+  for (unsigned int k : {5u, 12u, 3u}) {
+    FortranLinalg::DenseMatrix<int> expectedKNN(k, n), knn(k, n);
+    FortranLinalg::DenseMatrix<double> expectedDists(k, n), dists(k, n);
+    Distance<double>::findKNN(distances, expectedKNN, expectedDists);
+    cache.findKNN(0, distances, knn, dists);
+    for (unsigned int i = 0; i < n; i++) {
+      for (unsigned int j = 0; j < k; j++) {
+        EXPECT_EQ(expectedKNN(j, i), knn(j, i));
+        EXPECT_EQ(expectedDists(j, i), dists(j, i));
+      }
+    }
+    expectedKNN.deallocate();
+    knn.deallocate();
+    expectedDists.deallocate();
+    dists.deallocate();
+  }
+  EXPECT_EQ(12u, cache.size());
+
+  samples.deallocate();
+  distances.deallocate();
+}
+
+/**
+ * A neighbor search that fails, e.g. as it is cancelled, must not leave its
+ * partial graph in the cache.
+ */
+TEST(KNNGraphCache, failedSearchIsNotCached) {
+  class FailingBackend : public KNNBackend<double> {
+    public:
+      FailingBackend() : KNNBackend<double>(1) {};
+      std::string getName() const override { return "failing"; };
+      std::unique_ptr<KNNIndex<double>> buildIndex(
+          FortranLinalg::DenseMatrix<double> &data) const override {
+        throw std::runtime_error("search failed");
+      };
+  };
+  const unsigned int n = 40, k = 5;
+  FortranLinalg::DenseMatrix<double> samples = createSamples(3, n);
+  FortranLinalg::DenseMatrix<int> expectedKNN(k, n), knn(k, n);
+  FortranLinalg::DenseMatrix<double> expectedDists(k, n), dists(k, n);
+  KNNGraphCache<double> cache;
+  FailingBackend failing;
+
+  EXPECT_THROW(cache.findSampleKNN(0, samples, knn, dists, 1, &failing), std::runtime_error);
+  EXPECT_EQ(0u, cache.size());
+
+  BlockedDistance<double>::findKNN(samples, expectedKNN, expectedDists, 1);
+  cache.findSampleKNN(0, samples, knn, dists, 1);
+  for (unsigned int i = 0; i < n; i++) {
+    for (unsigned int j = 0; j < k; j++) {
+      EXPECT_EQ(expectedKNN(j, i), knn(j, i));
+      EXPECT_EQ(expectedDists(j, i), dists(j, i));
+    }
+  }
+  EXPECT_EQ(k, cache.size());
+
+  expectedKNN.deallocate();
+  knn.deallocate();
+  expectedDists.deallocate();
+  dists.deallocate();
+  samples.deallocate();
+}
+
+/**
+ * The graph of an approximate search isn't answered from the prefix of a
+ * larger one, which a search for fewer neighbors may not return, but must
+ * match a direct search for the same k.
+ */
+TEST(KNNGraphCache, approximateSearchIsNotSliced) {
+  const unsigned int n = 200;
+  FortranLinalg::DenseMatrix<double> samples = createSamples(4, n);
+  std::unique_ptr<KNNBackend<double>> backend = KNNBackend<double>::create("kdtree", 1, 2.0);
+  KNNGraphCache<double> cache;
+
+  for (unsigned int k : {12u, 5u}) {
+    FortranLinalg::DenseMatrix<int> expectedKNN(k, n), knn(k, n);
+    FortranLinalg::DenseMatrix<double> expectedDists(k, n), dists(k, n);
+    backend->findKNN(samples, expectedKNN, expectedDists, false);
+    cache.findSampleKNN(0, samples, knn, dists, 1, backend.get());
+    for (unsigned int i = 0; i < n; i++) {
+      for (unsigned int j = 0; j < k; j++) {
+        EXPECT_EQ(expectedKNN(j, i), knn(j, i));
+        EXPECT_EQ(expectedDists(j, i), dists(j, i));
+      }
+    }
+    EXPECT_EQ(k, cache.size());
+    expectedKNN.deallocate();
+    knn.deallocate();
+    expectedDists.deallocate();
+    dists.deallocate();
+  }
+
+  samples.deallocate();
+}
@@ -0,0 +1,438 @@
+#include "gtest/gtest.h"
+#include "hdprocess/HDProcessor.h"
+#include "hdprocess/HDProcessResult.h"
+#include "hdprocess/HDProcessResultSerializer.h"
+#include "hdprocess/LegacyTopologyDataImpl.h"
+#include "hdprocess/ProcessedResultCache.h"
+#include "hdprocess/SimpleHDVizDataImpl.h"
+#include "utils/MatrixArchive.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+//---------------------------------------------------------------------
+// Declarations
+//---------------------------------------------------------------------
+
+/**
+ * Sample a function with several peaks on a jittered grid so that the
+ * Morse-Smale complex has multiple persistence levels.
+ */
+void createPeaksSamples(FortranLinalg::DenseMatrix<Precision> &samples,
+                        FortranLinalg::DenseVector<Precision> &qoi) {
+  const unsigned int side = 9;
+  const unsigned int n = side * side;
+  samples = FortranLinalg::DenseMatrix<Precision>(2, n);
+  qoi = FortranLinalg::DenseVector<Precision>(n);
+  for (unsigned int i = 0; i < n; i++) {
+    samples(0, i) = (i % side) + 0.1 * std::sin(1.7 * i);
+    samples(1, i) = (i / side) + 0.1 * std::cos(2.3 * i);
+    qoi(i) = std::sin(0.9 * samples(0, i)) * std::cos(0.7 * samples(1, i)) + 0.001 * i;
+  }
+}
+
+void createPeaksDistances(FortranLinalg::DenseMatrix<Precision> &distances,
+                          FortranLinalg::DenseVector<Precision> &qoi) {
+  FortranLinalg::DenseMatrix<Precision> samples;
+  createPeaksSamples(samples, qoi);
+  unsigned int n = samples.N();
+  distances = FortranLinalg::DenseMatrix<Precision>(n, n);
+  for (unsigned int i = 0; i < n; i++) {
+    for (unsigned int j = 0; j < n; j++) {
+      Precision dx = samples(0, i) - samples(0, j);
+      Precision dy = samples(1, i) - samples(1, j);
+      distances(i, j) = std::sqrt(dx * dx + dy * dy);
+    }
+  }
+  samples.deallocate();
+}
+
+HDProcessResult* processPeaks(unsigned int threadCount) {
+  FortranLinalg::DenseMatrix<Precision> distances;
+  FortranLinalg::DenseVector<Precision> qoi;
+  createPeaksDistances(distances, qoi);
+
+  HDProcessor processor;
+  processor.setThreadCount(threadCount);
+  HDProcessResult *result = processor.processOnMetric(distances, qoi,
+      8 /* knn */, 20 /* nSamples */, -1 /* persistence */, false /* random */,
+      0.25 /* sigma */, 0 /* sigmaSmooth */);
+  distances.deallocate();
+  qoi.deallocate();
+  return result;
+}
+
+template <typename T>
+void EXPECT_VECTOR_EQ(FortranLinalg::DenseVector<T> a, FortranLinalg::DenseVector<T> b) {
+  ASSERT_EQ(a.N(), b.N());
+  for (unsigned int i = 0; i < a.N(); i++) {
+    EXPECT_EQ(a(i), b(i));
+  }
+}
+
+template <typename T>
+void EXPECT_MATRIX_EQ(FortranLinalg::DenseMatrix<T> a, FortranLinalg::DenseMatrix<T> b) {
+  ASSERT_EQ(a.M(), b.M());
+  ASSERT_EQ(a.N(), b.N());
+  for (unsigned int i = 0; i < a.M(); i++) {
+    for (unsigned int j = 0; j < a.N(); j++) {
+      EXPECT_EQ(a(i, j), b(i, j));
+    }
+  }
+}
+
+template <typename T>
+void EXPECT_MATRICES_EQ(const std::vector<std::vector<FortranLinalg::DenseMatrix<T>>> &a,
+                        const std::vector<std::vector<FortranLinalg::DenseMatrix<T>>> &b) {
+  ASSERT_EQ(a.size(), b.size());
+  for (unsigned int level = 0; level < a.size(); level++) {
+    ASSERT_EQ(a[level].size(), b[level].size());
+    for (unsigned int crystal = 0; crystal < a[level].size(); crystal++) {
+      EXPECT_MATRIX_EQ(a[level][crystal], b[level][crystal]);
+    }
+  }
+}
+
+void EXPECT_LEVELS_EQ(HDProcessResult *expected, HDProcessResult *actual) {
+  ASSERT_GT(expected->crystals.size(), 2u);
+  ASSERT_EQ(expected->crystals.size(), actual->crystals.size());
+  for (unsigned int level = 0; level < expected->crystals.size(); level++) {
+    EXPECT_MATRIX_EQ(expected->crystals[level], actual->crystals[level]);
+    EXPECT_VECTOR_EQ(expected->crystalPartitions[level], actual->crystalPartitions[level]);
+    EXPECT_VECTOR_EQ(expected->extremaValues[level], actual->extremaValues[level]);
+    EXPECT_VECTOR_EQ(expected->extremaWidths[level], actual->extremaWidths[level]);
+    EXPECT_MATRIX_EQ(expected->PCAExtremaLayout[level], actual->PCAExtremaLayout[level]);
+    EXPECT_MATRIX_EQ(expected->PCA2ExtremaLayout[level], actual->PCA2ExtremaLayout[level]);
+    EXPECT_MATRIX_EQ(expected->IsoExtremaLayout[level], actual->IsoExtremaLayout[level]);
+  }
+  EXPECT_MATRICES_EQ(expected->R, actual->R);
+  EXPECT_MATRICES_EQ(expected->gradR, actual->gradR);
+  EXPECT_MATRICES_EQ(expected->Rvar, actual->Rvar);
+  EXPECT_MATRICES_EQ(expected->PCALayout, actual->PCALayout);
+  EXPECT_MATRICES_EQ(expected->PCA2Layout, actual->PCA2Layout);
+  EXPECT_MATRICES_EQ(expected->IsoLayout, actual->IsoLayout);
+}
+
+//---------------------------------------------------------------------
+// Tests
+//---------------------------------------------------------------------
+
+/**
+ * Computing persistence levels concurrently must give the same result as
+ * computing them one after another.
+ */
+TEST(HDProcessor, parallelLevelsMatchSerial) {
+  HDProcessResult *serial = processPeaks(1);
+  HDProcessResult *parallel = processPeaks(4);
+  EXPECT_LEVELS_EQ(serial, parallel);
+  serial->deallocate();
+  parallel->deallocate();
+  delete serial;
+  delete parallel;
+}
+
+/**
+ * Processing a small samples matrix without its distance matrix must give the
+ * same result as processing its distance matrix.
+ */
+TEST(HDProcessor, samplesMatchMetric) {
+  FortranLinalg::DenseMatrix<Precision> samples;
+  FortranLinalg::DenseVector<Precision> qoi;
+  createPeaksSamples(samples, qoi);
+  FortranLinalg::DenseMatrix<Precision> distances =
+      BlockedDistance<Precision>::computeEuclidean(samples);
+
+  HDProcessor processor;
+  HDProcessResult *expected = processor.processOnMetric(distances, qoi, 8, 20, -1, false, 0.25, 0);
+  HDProcessResult *actual = processor.processOnSamples(samples, qoi, 8, 20, -1, false, 0.25, 0);
+  EXPECT_MATRIX_EQ(expected->X, actual->X);
+  EXPECT_MATRIX_EQ(expected->knn, actual->knn);
+  EXPECT_LEVELS_EQ(expected, actual);
+
+  expected->deallocate();
+  actual->deallocate();
+  delete expected;
+  delete actual;
+  samples.deallocate();
+  distances.deallocate();
+  qoi.deallocate();
+}
+
+/**
+ * Landmark MDS of samples in as many dimensions as the embedding keeps their
+ * distances, also for samples that are not landmarks.
+ */
+TEST(LandmarkMDS, preservesEuclideanDistances) {
+  const unsigned int n = 300;
+  FortranLinalg::DenseMatrix<Precision> samples(3, n);
+  for (unsigned int i = 0; i < n; i++) {
+    samples(0, i) = std::sin(0.37 * i);
+    samples(1, i) = 2 * std::cos(0.61 * i);
+    samples(2, i) = 0.01 * i;
+  }
+  LandmarkMDS<Precision> mds(40, 2);
+  FortranLinalg::DenseMatrix<Precision> embedding = mds.embed(samples, 3);
+  ASSERT_EQ(3u, embedding.M());
+  ASSERT_EQ(n, embedding.N());
+  for (unsigned int i = 0; i < n; i += 7) {
+    for (unsigned int j = 0; j < n; j += 5) {
+      Precision expected = 0;
+      Precision actual = 0;
+      for (unsigned int d = 0; d < 3; d++) {
+        expected += (samples(d, i) - samples(d, j)) * (samples(d, i) - samples(d, j));
+        actual += (embedding(d, i) - embedding(d, j)) * (embedding(d, i) - embedding(d, j));
+      }
+      EXPECT_NEAR(std::sqrt(expected), std::sqrt(actual), 1e-6);
+    }
+  }
+  samples.deallocate();
+  embedding.deallocate();
+}
+
+TEST(HDProcessor, stopsWhenCancelled) {
+  FortranLinalg::DenseMatrix<Precision> distances;
+  FortranLinalg::DenseVector<Precision> qoi;
+  createPeaksDistances(distances, qoi);
+
+  HDProcessor processor;
+  CancellationToken cancellation;
+  cancellation.cancel();
+  processor.setCancellationToken(&cancellation);
+  EXPECT_THROW(processor.processOnMetric(distances, qoi, 8, 20, -1, false, 0.25, 0),
+               OperationCancelled);
+
+  // The processor is still usable afterwards.
+  processor.setCancellationToken(nullptr);
+  HDProcessResult *result = processor.processOnMetric(distances, qoi, 8, 20, -1, false, 0.25, 0);
+  EXPECT_GT(result->crystals.size(), 2u);
+  delete result;
+  distances.deallocate();
+  qoi.deallocate();
+}
+
+/**
+ * Records the levels an observer is told about and builds visualization data
+ * from them as they complete.
+ */
+class LevelRecorder : public HDProcessorObserver {
+ public:
+  ~LevelRecorder() {
+    delete vizData;
+  }
+  void persistenceComputed(HDProcessResult &result) override {
+    vizData = new SimpleHDVizDataImpl(&result);
+  }
+  void levelComputed(HDProcessResult &result, unsigned int level) override {
+    vizData->addLevel(level);
+    levels.push_back(level);
+  }
+  void processingFailed(HDProcessResult *result) override {
+    result->deallocate();
+    delete result;
+  }
+
+  SimpleHDVizDataImpl *vizData = nullptr;
+  std::vector<unsigned int> levels;
+};
+
+/**
+ * An observer gets every level once, the start level first since all others
+ * are aligned to it and then the coarsest ones, without changing the result.
+ */
+TEST(HDProcessor, notifiesObserverCoarsestLevelsFirst) {
+  FortranLinalg::DenseMatrix<Precision> distances;
+  FortranLinalg::DenseVector<Precision> qoi;
+  createPeaksDistances(distances, qoi);
+
+  HDProcessor processor;
+  processor.setThreadCount(1);
+  LevelRecorder recorder;
+  processor.setObserver(&recorder);
+  HDProcessResult *streamed = processor.processOnMetric(distances, qoi, 8, 20, -1, false, 0.25, 0);
+  HDProcessResult *expected = processPeaks(1);
+
+  unsigned int minLevel = streamed->minLevel(0);
+  unsigned int maxLevel = streamed->scaledPersistence.N() - 1;
+  ASSERT_GT(maxLevel, minLevel + 1);
+  ASSERT_EQ(recorder.levels.size(), maxLevel - minLevel + 1);
+  EXPECT_EQ(recorder.levels[0], minLevel);
+  EXPECT_EQ(recorder.levels[1], maxLevel);
+  for (unsigned int i = 2; i < recorder.levels.size(); i++) {
+    EXPECT_LT(recorder.levels[i], recorder.levels[i - 1]);
+  }
+
+  SimpleHDVizDataImpl complete(expected);
+  for (unsigned int level = minLevel; level <= maxLevel; level++) {
+    EXPECT_TRUE(recorder.vizData->hasLevel(level));
+    EXPECT_MATRIX_EQ(streamed->crystals[level], expected->crystals[level]);
+    EXPECT_VECTOR_EQ(recorder.vizData->getExtremaNormalized(level),
+                     complete.getExtremaNormalized(level));
+    EXPECT_MATRIX_EQ(recorder.vizData->getExtremaLayout(HDVizLayout::ISOMAP, level),
+                     complete.getExtremaLayout(HDVizLayout::ISOMAP, level));
+  }
+  EXPECT_MATRICES_EQ(streamed->R, expected->R);
+  EXPECT_MATRICES_EQ(streamed->IsoLayout, expected->IsoLayout);
+
+  delete streamed;
+  delete expected;
+  distances.deallocate();
+  qoi.deallocate();
+}
+
+void EXPECT_RESULTS_EQ(HDProcessResult *expected, HDProcessResult *actual) {
+  EXPECT_MATRIX_EQ(expected->X, actual->X);
+  EXPECT_VECTOR_EQ(expected->Y, actual->Y);
+  EXPECT_MATRIX_EQ(expected->knn, actual->knn);
+  ASSERT_EQ(expected->crystals.size(), actual->crystals.size());
+  for (unsigned int level = expected->minLevel(0); level < expected->crystals.size(); level++) {
+    EXPECT_MATRIX_EQ(expected->crystals[level], actual->crystals[level]);
+    EXPECT_VECTOR_EQ(expected->crystalPartitions[level], actual->crystalPartitions[level]);
+    EXPECT_VECTOR_EQ(expected->extremaWidths[level], actual->extremaWidths[level]);
+    EXPECT_MATRIX_EQ(expected->IsoExtremaLayout[level], actual->IsoExtremaLayout[level]);
+  }
+  EXPECT_MATRICES_EQ(expected->R, actual->R);
+  EXPECT_MATRICES_EQ(expected->IsoLayout, actual->IsoLayout);
+}
+
+/**
+ * A serialized result must read back with the partitions the topology is
+ * built from, both from the single-file archive and from per-array files.
+ */
+TEST(HDProcessResultSerializer, roundTrip) {
+  HDProcessResult *written = processPeaks(1);
+  for (bool archive : {true, false}) {
+    char directory[] = "/tmp/hdprocessresultXXXXXX";
+    ASSERT_NE(nullptr, mkdtemp(directory));
+    if (archive) {
+      HDProcessResultSerializer::write(written, directory);
+    } else {
+      HDProcessResultSerializer::writeFiles(written, directory);
+    }
+    HDProcessResult *read = HDProcessResultSerializer::read(directory);
+    EXPECT_EQ(archive, read->archive != nullptr);
+    EXPECT_RESULTS_EQ(written, read);
+    read->deallocate();
+    delete read;
+    std::system((std::string("rm -rf ") + directory).c_str());
+  }
+  written->deallocate();
+  delete written;
+}
+
+/**
+ * Reading an archive whose payload was modified must fail the checksum.
+ */
+TEST(MatrixArchive, detectsCorruption) {
+  char directory[] = "/tmp/matrixarchiveXXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(directory));
+  std::string filename = std::string(directory) + "/test.dsx";
+  FortranLinalg::DenseMatrix<Precision> matrix(3, 5);
+  FortranLinalg::DenseVector<int> vector(7);
+  for (unsigned int i = 0; i < 15; i++) {
+    matrix.data()[i] = 0.5 * i;
+  }
+  for (unsigned int i = 0; i < 7; i++) {
+    vector(i) = i * i;
+  }
+  MatrixArchiveWriter writer;
+  writer.addMatrix("matrix", matrix);
+  writer.addVector("vector", vector);
+  writer.write(filename);
+
+  {
+    MatrixArchive archive(filename);
+    FortranLinalg::DenseMatrix<Precision> matrixView = archive.getMatrix<Precision>("matrix");
+    FortranLinalg::DenseVector<int> vectorView = archive.getVector<int>("vector");
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(matrixView.data()) % 64);
+    EXPECT_MATRIX_EQ(matrix, matrixView);
+    EXPECT_VECTOR_EQ(vector, vectorView);
+    EXPECT_THROW(archive.getMatrix<int>("matrix"), std::runtime_error);
+    MatrixArchive::release(matrixView);
+    MatrixArchive::release(vectorView);
+  }
+
+  std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+  file.seekp(-1, std::ios::end);
+  file.put(1);
+  file.close();
+  EXPECT_THROW(MatrixArchive archive(filename), std::runtime_error);
+
+  matrix.deallocate();
+  vector.deallocate();
+  std::system((std::string("rm -rf ") + directory).c_str());
+}
+
+/**
+ * The cache must evict the least recently used result once the budget is
+ * exceeded, but keep the most recently used one even if it alone is too large.
+ */
+TEST(ProcessedResultCache, evictsLeastRecentlyUsed) {
+  auto cacheResult = [](ProcessedResultCache &cache, const ProcessedResultKey &key) {
+    HDProcessResult *result = processPeaks(1);
+    SimpleHDVizDataImpl *vizData = new SimpleHDVizDataImpl(result);
+    TopologyData *topoData = new LegacyTopologyDataImpl(vizData);
+    return cache.insert(key, result, vizData, topoData,
+                        result->byteSize() + vizData->getByteSize()).bytes;
+  };
+  ProcessedResultKey first{0, 1, "first", 8, 20, 0.25, 0, false, 0};
+  ProcessedResultKey second = first;
+  second.fieldname = "second";
+  ProcessedResultKey third = first;
+  third.knn = 9;
+
+  ProcessedResultCache cache(0);
+  size_t bytes = cacheResult(cache, first);
+  EXPECT_GT(bytes, 0u);
+  cache.setBudget(2 * bytes);
+  cacheResult(cache, second);
+  EXPECT_NE(nullptr, cache.find(first));
+  cacheResult(cache, third);
+
+  EXPECT_NE(nullptr, cache.find(first));
+  EXPECT_EQ(nullptr, cache.find(second));
+  EXPECT_NE(nullptr, cache.find(third));
+
+  ProcessedResultCache::Stats stats = cache.getStats();
+  EXPECT_EQ(2u, stats.entries);
+  EXPECT_EQ(2 * bytes, stats.bytes);
+  EXPECT_EQ(3u, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+  EXPECT_EQ(1u, stats.evictions);
+
+  cache.setBudget(0);
+  EXPECT_EQ(1u, cache.getStats().entries);
+  EXPECT_NE(nullptr, cache.find(third));
+}
+
+/**
+ * Pinned entries are in use by a command and must survive eviction until they
+ * are unpinned.
+ */
+TEST(ProcessedResultCache, keepsPinnedEntries) {
+  auto cacheResult = [](ProcessedResultCache &cache, const ProcessedResultKey &key) {
+    HDProcessResult *result = processPeaks(1);
+    SimpleHDVizDataImpl *vizData = new SimpleHDVizDataImpl(result);
+    TopologyData *topoData = new LegacyTopologyDataImpl(vizData);
+    return cache.insert(key, result, vizData, topoData,
+                        result->byteSize() + vizData->getByteSize()).bytes;
+  };
+  ProcessedResultKey first{0, 1, "first", 8, 20, 0.25, 0, false, 0};
+  ProcessedResultKey second = first;
+  second.datasetId = 1;
+
+  ProcessedResultCache cache(0);
+  cacheResult(cache, first);
+  cache.pin(first);
+  cacheResult(cache, second);
+  EXPECT_EQ(2u, cache.getStats().entries);
+
+  cache.unpin(first);
+  EXPECT_EQ(1u, cache.getStats().entries);
+  EXPECT_EQ(nullptr, cache.find(first));
+  EXPECT_NE(nullptr, cache.find(second));
+}
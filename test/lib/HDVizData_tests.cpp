@@ -4,6 +4,7 @@
 #include "hdprocess/HDProcessResult.h"
 #include "hdprocess/HDProcessResultSerializer.h"
 
+#include <cstdlib>
 #include <iostream>
 #include <exception>
 
@@ -163,3 +164,37 @@ TEST(HDVizData, compare) {
   delete cachedData;
   delete result;
 }
+
+/**
+ * FileCachedHDVizDataImpl must read the same data from a single-file archive
+ * as from the per-array files it was converted from.
+ */
+TEST(HDVizData, compareArchive) {
+  char archive_dir[] = "/tmp/hdvizdataXXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(archive_dir));
+  HDProcessResult *result = HDProcessResultSerializer::readFiles(data_dir);
+  HDProcessResultSerializer::write(result, archive_dir);
+
+  HDVizData *fileData = new FileCachedHDVizDataImpl(data_dir);
+  HDVizData *archiveData = new FileCachedHDVizDataImpl(archive_dir);
+  ASSERT_VECTOR_EQ(fileData->getPersistence(), archiveData->getPersistence());
+  ASSERT_VECTOR_EQ(fileData->getRMin(), archiveData->getRMin());
+  for (int level = fileData->getMinPersistenceLevel(); level <= fileData->getMaxPersistenceLevel(); level++) {
+    ASSERT_MATRIX_EQ(fileData->getCrystals(level), archiveData->getCrystals(level));
+    ASSERT_MATRIX_EQ(
+        fileData->getExtremaLayout(HDVizLayout::PCA, level),
+        archiveData->getExtremaLayout(HDVizLayout::PCA, level));
+    ASSERT_VECTOR_EQ(fileData->getExtremaWidthsScaled(level), archiveData->getExtremaWidthsScaled(level));
+    for (unsigned int i = 0; i < fileData->getCrystals(level).N(); i++) {
+      ASSERT_MATRIX_EQ(fileData->getReconstruction(level)[i], archiveData->getReconstruction(level)[i]);
+      ASSERT_VECTOR_EQ(fileData->getDensity(level)[i], archiveData->getDensity(level)[i]);
+    }
+  }
+
+  // cleanup
+  delete fileData;
+  delete archiveData;
+  result->deallocate();
+  delete result;
+  std::system((std::string("rm -rf ") + archive_dir).c_str());
+}
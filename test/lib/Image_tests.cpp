@@ -0,0 +1,52 @@
+#include "gtest/gtest.h"
+#include "imageutils/Image.h"
+#include "imageutils/ImageLoader.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+const std::string kImagePath = std::string(EXAMPLE_DATA_DIR) + "/ellipses/images/46.png";
+
+//---------------------------------------------------------------------
+// Tests
+//---------------------------------------------------------------------
+
+/**
+ * The pixels of an image kept as PNG bytes are decoded on first access, once
+ * for all its copies, and must be those of the decoded image, even when they
+ * are first asked for from several threads at once.
+ */
+TEST(Image, lazyPNGMatchesDecoded) {
+  ImageLoader loader;
+  Image expected = loader.loadPNG(kImagePath);
+  std::ifstream file(kImagePath, std::ios::binary);
+  std::vector<char> png((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  ASSERT_FALSE(png.empty());
+  size_t size = size_t(expected.getWidth()) * expected.getHeight();
+
+  Image image = Image::fromPNG(png);
+  const Image copy(image);
+  EXPECT_EQ(expected.getWidth(), copy.getWidth());
+  EXPECT_EQ(expected.getHeight(), copy.getHeight());
+
+  const unsigned int threadCount = 8;
+  std::vector<const unsigned char*> pixels(threadCount);
+  std::vector<std::thread> threads;
+  for (unsigned int t = 0; t < threadCount; t++) {
+    threads.emplace_back([&, t]() {
+      pixels[t] = (t % 2 ? copy : image).getConstData();
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (unsigned int t = 0; t < threadCount; t++) {
+    ASSERT_EQ(pixels[0], pixels[t]);
+  }
+  ASSERT_NE(nullptr, pixels[0]);
+  EXPECT_TRUE(std::equal(pixels[0], pixels[0] + size, expected.getConstData()));
+}
@@ -0,0 +1,143 @@
+#include "gtest/gtest.h"
+#include "BinaryResponse.h"
+#include "JsonWriter.h"
+
+#include <jsoncpp/json/json.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <random>
+#include <string>
+
+
+//---------------------------------------------------------------------
+// Declarations
+//---------------------------------------------------------------------
+
+Json::Value parse(const std::string &text) {
+  Json::Value value;
+  Json::Reader reader;
+  EXPECT_TRUE(reader.parse(text, value)) << text;
+  return value;
+}
+
+std::string shortest(double value) {
+  std::string text;
+  JsonWriter::appendShortest(text, value);
+  return text;
+}
+
+//---------------------------------------------------------------------
+// Tests
+//---------------------------------------------------------------------
+
+/**
+ * Doubles are written with the fewest digits that read back exactly, and
+ * integral values without a fraction.
+ */
+TEST(JsonWriter, doublesRoundTrip) {
+  EXPECT_EQ("0.1", shortest(0.1));
+  EXPECT_EQ("-2.5", shortest(-2.5));
+  EXPECT_EQ("42", shortest(42.0));
+  EXPECT_EQ("-0", shortest(-0.0));
+  EXPECT_EQ("0.30000000000000004", shortest(0.1 + 0.2));
+  EXPECT_EQ("1e+300", shortest(1e300));
+
+  std::mt19937_64 random(7);
+  std::uniform_real_distribution<double> mantissa(-1, 1);
+  std::uniform_int_distribution<int> exponent(-300, 300);
+  for (int i = 0; i < 10000; i++) {
+    double value = std::ldexp(mantissa(random), exponent(random));
+    std::string text = shortest(value);
+    EXPECT_EQ(value, std::strtod(text.c_str(), nullptr)) << text;
+  }
+
+  std::string text;
+  JsonWriter::appendShortest(text, 0.1f);
+  EXPECT_EQ("0.1", text);
+}
+
+/**
+ * Values JSON has no number for are written the way jsoncpp writes them.
+ */
+TEST(JsonWriter, specialValues) {
+  EXPECT_EQ("null", shortest(std::numeric_limits<double>::quiet_NaN()));
+  EXPECT_EQ("1e+9999", shortest(std::numeric_limits<double>::infinity()));
+  EXPECT_EQ("-1e+9999", shortest(-std::numeric_limits<double>::infinity()));
+
+  std::string text;
+  JsonWriter(text).value(std::string("a\"b\\c\n\x01"));
+  EXPECT_EQ("\"a\\\"b\\\\c\\n\\u0001\"", text);
+}
+
+/**
+ * A Json::Value written with the writer reads back as the same value, also
+ * when members written separately are inserted into it.
+ */
+TEST(JsonWriter, matchesDom) {
+  Json::Value response(Json::objectValue);
+  response["id"] = 3;
+  response["name"] = "fetchQoi";
+  response["flags"] = Json::Value(Json::arrayValue);
+  response["flags"].append(true);
+  response["flags"].append(Json::Value());
+  response["nested"]["value"] = -1.25;
+
+  std::string members;
+  JsonWriter memberWriter(members, true);
+  memberWriter.key("qoi").vector(3, [](unsigned int i) { return 0.5 * i; });
+  memberWriter.key("empty").beginArray().endArray();
+  EXPECT_TRUE(memberWriter.isComplete());
+
+  std::string text;
+  JsonWriter(text).beginObject().members(response).rawMembers(members).endObject();
+
+  Json::Value expected = response;
+  expected["qoi"].append(0);
+  expected["qoi"].append(0.5);
+  expected["qoi"].append(1);
+  expected["empty"] = Json::Value(Json::arrayValue);
+  EXPECT_EQ(expected, parse(text));
+}
+
+/**
+ * Matrices, vectors and Eigen maps are written as arrays of rows and flat
+ * arrays, or as references into the buffers of a binary response.
+ */
+TEST(JsonWriter, emitters) {
+  FortranLinalg::DenseMatrix<double> matrix(2, 3);
+  FortranLinalg::DenseVector<int> vector(2);
+  for (unsigned int i = 0; i < 2; i++) {
+    vector(i) = i + 1;
+    for (unsigned int j = 0; j < 3; j++) {
+      matrix(i, j) = i * 3 + j;
+    }
+  }
+  double values[] = { 0.25, 0.5 };
+  Eigen::Map<Eigen::VectorXd> map(values, 2);
+
+  std::string text;
+  JsonWriter writer(text);
+  writer.beginArray().value(matrix).value(vector).value(map).endArray();
+  EXPECT_EQ("[[[0,1,2],[3,4,5]],[1,2],[0.25,0.5]]", text);
+
+  BinaryResponse binary(true);
+  text.clear();
+  JsonWriter binaryWriter(text);
+  binaryWriter.beginObject();
+  binary.writeVector(binaryWriter.key("qoi"), 2, [&](unsigned int i) { return map(i); });
+  binary.writeMatrix(binaryWriter.key("graph"), 2, 2,
+                     [&](unsigned int i, unsigned int j) { return vector(i) * vector(j); });
+  binaryWriter.endObject();
+  Json::Value response = parse(text);
+  EXPECT_EQ("float32", response["qoi"]["bufferType"].asString());
+  EXPECT_EQ(2u, response["qoi"]["shape"][0].asUInt());
+  EXPECT_EQ("int32", response["graph"]["bufferType"].asString());
+  EXPECT_EQ(2u, response["graph"]["shape"][1].asUInt());
+  ASSERT_EQ(4u, binary.getInts().size());
+  EXPECT_EQ(4, binary.getInts()[3]);
+
+  matrix.deallocate();
+  vector.deallocate();
+}
@@ -0,0 +1,193 @@
+#include "gtest/gtest.h"
+#include "flinalg/DenseMatrix.h"
+#include "flinalg/DenseVector.h"
+#include "metrics/Distance.h"
+#include "metrics/SquaredEuclideanMetric.h"
+#include "morsesmale/FlatNNMSComplex.h"
+#include "morsesmale/NNMSComplex.h"
+#include "morsesmale/PairHashMap.h"
+
+#include <cmath>
+#include <random>
+
+
+//---------------------------------------------------------------------
+// Declarations
+//---------------------------------------------------------------------
+
+/**
+ * Samples scattered over the unit square with a function of several maxima
+ * and minima, and their nearest neighbors.
+ */
+struct Samples {
+  FortranLinalg::DenseMatrix<double> X;
+  FortranLinalg::DenseVector<double> y;
+  FortranLinalg::DenseMatrix<int> knn;
+  FortranLinalg::DenseMatrix<double> knnDists;
+
+  Samples(unsigned int count, unsigned int k, unsigned int seed) :
+      X(2, count), y(count), knn(k, count), knnDists(k, count) {
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    for (unsigned int i = 0; i < count; i++) {
+      X(0, i) = uniform(random);
+      X(1, i) = uniform(random);
+      y(i) = std::sin(9 * X(0, i)) * std::cos(7 * X(1, i)) + 0.05 * uniform(random);
+    }
+    SquaredEuclideanMetric<double> metric;
+    Distance<double>::computeKNN(X, knn, knnDists, metric);
+  }
+
+  ~Samples() {
+    X.deallocate();
+    y.deallocate();
+    knn.deallocate();
+    knnDists.deallocate();
+  }
+};
+
+void EXPECT_COMPLEXES_EQ(NNMSComplex<double> &expected, FlatNNMSComplex<double> &actual) {
+  EXPECT_EQ(expected.getNAllExtrema(), actual.getNAllExtrema());
+  FortranLinalg::DenseVector<double> persistence = expected.getPersistence();
+  FortranLinalg::DenseVector<double> actualPersistence = actual.getPersistence();
+  ASSERT_EQ(persistence.N(), actualPersistence.N());
+  for (unsigned int level = 0; level < persistence.N(); level++) {
+    EXPECT_EQ(persistence(level), actualPersistence(level));
+  }
+
+  // The flat merge state moves up level by level, the hierarchy holds all
+  // levels at once.
+  NNMSComplex<double>::MergeState expectedState;
+  FlatNNMSComplex<double>::MergeState actualState;
+  MSHierarchy hierarchy = actual.getHierarchy();
+  ASSERT_EQ(persistence.N(), hierarchy.getLevelCount());
+  for (unsigned int level = 0; level < persistence.N(); level++) {
+    expected.mergePersistence(persistence(level), expectedState);
+    actual.mergePersistence(persistence(level), actualState);
+    FortranLinalg::DenseVector<int> partitions = expected.getPartitions(expectedState);
+    FortranLinalg::DenseVector<int> actualPartitions = actual.getPartitions(actualState);
+    FortranLinalg::DenseVector<int> levelPartitions = hierarchy.getPartitions(level);
+    FortranLinalg::DenseMatrix<int> crystals = expected.getCrystals(expectedState);
+    FortranLinalg::DenseMatrix<int> actualCrystals = actual.getCrystals(actualState);
+    FortranLinalg::DenseMatrix<int> levelCrystals = hierarchy.getCrystals(level);
+    for (unsigned int i = 0; i < partitions.N(); i++) {
+      ASSERT_EQ(partitions(i), actualPartitions(i)) << "level " << level << ", sample " << i;
+      ASSERT_EQ(partitions(i), levelPartitions(i)) << "level " << level << ", sample " << i;
+    }
+    ASSERT_EQ(crystals.N(), actualCrystals.N()) << "level " << level;
+    ASSERT_EQ(crystals.N(), levelCrystals.N()) << "level " << level;
+    for (unsigned int c = 0; c < crystals.N(); c++) {
+      EXPECT_EQ(crystals(0, c), actualCrystals(0, c));
+      EXPECT_EQ(crystals(1, c), actualCrystals(1, c));
+      EXPECT_EQ(crystals(0, c), levelCrystals(0, c));
+      EXPECT_EQ(crystals(1, c), levelCrystals(1, c));
+    }
+    partitions.deallocate();
+    actualPartitions.deallocate();
+    levelPartitions.deallocate();
+    crystals.deallocate();
+    actualCrystals.deallocate();
+    levelCrystals.deallocate();
+  }
+
+  // Going back to a lower level replays the merges.
+  actual.mergePersistence(persistence(0), actualState);
+  FortranLinalg::DenseVector<int> partitions = actual.getPartitions(actualState);
+  for (unsigned int i = 0; i < partitions.N(); i++) {
+    ASSERT_EQ(hierarchy.getCrystal(0, i), partitions(i));
+  }
+  partitions.deallocate();
+
+  // A hierarchy of the coarser levels only has the same crystals.
+  MSHierarchy coarse = actual.getHierarchy(persistence.N() / 2);
+  ASSERT_EQ(persistence.N(), coarse.getLevelCount());
+  EXPECT_FALSE(coarse.hasLevel(persistence.N() / 2 - 1));
+  for (unsigned int level = coarse.getFirstLevel(); level < coarse.getLevelCount(); level++) {
+    ASSERT_EQ(hierarchy.getCrystalCount(level), coarse.getCrystalCount(level));
+    for (unsigned int i = 0; i < coarse.getSampleCount(); i++) {
+      ASSERT_EQ(hierarchy.getCrystal(level, i), coarse.getCrystal(level, i));
+    }
+  }
+
+  // Extrema die at the levels their merges apply.
+  for (int e = 0; e < actual.getNAllExtrema(); e++) {
+    unsigned int death = hierarchy.getExtremumDeath(e);
+    if (death < hierarchy.getLevelCount()) {
+      EXPECT_GT(death, 0u);
+      EXPECT_NE(e, hierarchy.getExtremumParent(e));
+      EXPECT_GT(hierarchy.getExtremumDeath(hierarchy.getExtremumParent(e)), death);
+    }
+  }
+  expectedState.cleanup();
+  persistence.deallocate();
+  actualPersistence.deallocate();
+}
+
+//---------------------------------------------------------------------
+// Tests
+//---------------------------------------------------------------------
+
+/**
+ * The flat complex and its hierarchy have the persistence levels, partitions
+ * and crystals of the original complex at every level, with and without
+ * smoothing.
+ */
+TEST(FlatNNMSComplex, matchesNNMSComplex) {
+  for (unsigned int seed : {1u, 2u, 3u}) {
+    Samples samples(1500, 12, seed);
+    for (bool smooth : {false, true}) {
+      NNMSComplex<double> expected(samples.knn, samples.knnDists, samples.y, smooth, 0.01);
+      FlatNNMSComplex<double> actual(samples.knn, samples.knnDists, samples.y, smooth, 0.01);
+      EXPECT_COMPLEXES_EQ(expected, actual);
+      expected.cleanup();
+    }
+  }
+}
+
+/**
+ * Steepest neighbors and extrema computed on several threads give the same
+ * complex, with the same extremum and crystal numbers, as on one thread.
+ */
+TEST(FlatNNMSComplex, threadsGiveSameComplex) {
+  Samples samples(9000, 10, 4);
+  FlatNNMSComplex<double> serial(samples.knn, samples.knnDists, samples.y, false, 0, 1);
+  FlatNNMSComplex<double> parallel(samples.knn, samples.knnDists, samples.y, false, 0, 4);
+  ASSERT_EQ(serial.getNAllExtrema(), parallel.getNAllExtrema());
+  ASSERT_EQ(serial.getNBaseCrystals(), parallel.getNBaseCrystals());
+  MSHierarchy expected = serial.getHierarchy();
+  MSHierarchy actual = parallel.getHierarchy();
+  ASSERT_EQ(expected.getLevelCount(), actual.getLevelCount());
+  for (int e = 0; e < serial.getNAllExtrema(); e++) {
+    EXPECT_EQ(expected.getExtremumSample(e), actual.getExtremumSample(e));
+    EXPECT_EQ(expected.getExtremumDeath(e), actual.getExtremumDeath(e));
+  }
+  for (unsigned int level = 0; level < expected.getLevelCount(); level++) {
+    for (unsigned int i = 0; i < expected.getSampleCount(); i++) {
+      ASSERT_EQ(expected.getCrystal(level, i), actual.getCrystal(level, i));
+    }
+  }
+}
+
+/**
+ * Pairs keep the value they were first inserted with while the table grows.
+ */
+TEST(PairHashMap, insertAndFind) {
+  PairHashMap<int> map;
+  for (int i = 0; i < 1000; i++) {
+    std::pair<int*, bool> inserted = map.insert(i, 1000 - i, i);
+    EXPECT_TRUE(inserted.second);
+    EXPECT_FALSE(map.insert(i, 1000 - i, -1).second);
+  }
+  EXPECT_EQ(1000u, map.size());
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_NE(nullptr, map.find(i, 1000 - i));
+    EXPECT_EQ(i, *map.find(i, 1000 - i));
+    EXPECT_EQ(nullptr, map.find(1000 - i, i + 1));
+  }
+  int sum = 0;
+  map.forEach([&](int first, int second, int value) {
+    EXPECT_EQ(1000, first + second);
+    sum += value;
+  });
+  EXPECT_EQ(999 * 1000 / 2, sum);
+}
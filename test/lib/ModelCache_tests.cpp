@@ -0,0 +1,110 @@
+#include "gtest/gtest.h"
+#include "pmodels/ModelCache.h"
+#include "pmodels/MorseSmale.h"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+
+
+//---------------------------------------------------------------------
+// Declarations
+//---------------------------------------------------------------------
+
+// A model of n doubles, counting how often it is read.
+std::shared_ptr<dspacex::Model> readModel(unsigned n, std::atomic<int> &reads) {
+  reads++;
+  auto model = std::make_shared<dspacex::Model>();
+  model->setModel(Eigen::MatrixXd::Zero(n, 1), Eigen::MatrixXd(), Eigen::MatrixXd());
+  return model;
+}
+
+//---------------------------------------------------------------------
+// Tests
+//---------------------------------------------------------------------
+
+/**
+ * Models are read once, the least recently used ones are dropped once the
+ * budget is exceeded, and those still in use stay valid.
+ */
+TEST(ModelCache, evictsLeastRecentlyUsed) {
+  dspacex::ModelCache cache(3 * 100 * sizeof(double));
+  std::atomic<int> reads(0);
+  auto load = [&]() { return readModel(100, reads); };
+
+  auto first = cache.get("a", load);
+  cache.get("b", load);
+  cache.get("c", load);
+  EXPECT_EQ(first, cache.get("a", load));
+  EXPECT_EQ(3, reads);
+
+  cache.get("d", load);  // drops b, a was used more recently
+  dspacex::ModelCache::Stats stats = cache.getStats();
+  EXPECT_EQ(3u, stats.entries);
+  EXPECT_EQ(1u, stats.evictions);
+  EXPECT_EQ(3 * 100 * sizeof(double), stats.bytes);
+  EXPECT_EQ(first, cache.get("a", load));
+  EXPECT_EQ(4, reads);
+
+  cache.setBudget(0);  // keeps only the most recently used model
+  EXPECT_EQ(1u, cache.getStats().entries);
+  EXPECT_EQ(100u, first->byteSize() / sizeof(double));
+  cache.get("b", load);
+  EXPECT_EQ(5, reads);
+}
+
+/**
+ * A crystal's model is read when it is first asked for, and the models of
+ * the crystals sharing its samples at the adjacent persistence levels are
+ * read ahead of time, once.
+ */
+TEST(ModelCache, complexReadsModelsOnDemand) {
+  dspacex::ModelCache::instance().clear();
+  std::string field("field");
+  dspacex::MSComplex complex(field, 4, 3);
+  // shared with the reader, which may still be prefetching once the test is done
+  struct Reads {
+    std::map<std::string, int> counts;
+    std::mutex mutex;
+  };
+  auto shared = std::make_shared<Reads>();
+  std::map<std::string, int> &reads = shared->counts;
+  complex.setModelReader([shared](const std::string &path, dspacex::Model &model) {
+    std::lock_guard<std::mutex> lock(shared->mutex);
+    shared->counts[path]++;
+    model.setModel(Eigen::MatrixXd::Zero(4, 2), Eigen::MatrixXd::Zero(4, 1),
+                   Eigen::MatrixXd::Zero(4, 2));
+  });
+
+  // level 0 has a crystal per sample, they merge pairwise at level 1 and into one at level 2
+  Eigen::MatrixXi crystals[3] = { Eigen::MatrixXi(4, 1), Eigen::MatrixXi(4, 1), Eigen::MatrixXi(4, 1) };
+  crystals[0] << 0, 1, 2, 3;
+  crystals[1] << 0, 0, 1, 1;
+  crystals[2] << 0, 0, 0, 0;
+  for (unsigned p = 0; p < 3; p++) {
+    dspacex::MSPersistenceLevel &level = complex.getPersistenceLevel(p);
+    level.setNumCrystals(crystals[p].maxCoeff() + 1);
+    for (unsigned c = 0; c < level.numCrystals(); c++) {
+      level.getCrystal(c).setModelPath("models/p" + std::to_string(p) + "/c" + std::to_string(c));
+    }
+    level.setCrystalSamples(crystals[p]);
+  }
+  EXPECT_TRUE(reads.empty());
+
+  std::shared_ptr<const dspacex::Model> model = complex.getModel(1, 1).second;
+  EXPECT_EQ(2u, model->numSamples());
+  EXPECT_EQ("field", model->getFieldname());
+
+  // asking for the neighbors waits for their prefetching rather than reading them again
+  complex.getModel(0, 2);
+  complex.getModel(0, 3);
+  complex.getModel(2, 0);
+  std::lock_guard<std::mutex> lock(shared->mutex);
+  EXPECT_EQ(1, reads["models/p1/c1"]);
+  EXPECT_EQ(1, reads["models/p0/c2"]);
+  EXPECT_EQ(1, reads["models/p0/c3"]);
+  EXPECT_EQ(1, reads["models/p2/c0"]);
+  EXPECT_EQ(0, reads.count("models/p0/c0"));
+}
@@ -0,0 +1,81 @@
+#include "gtest/gtest.h"
+#include "lodepng.h"
+#include "pmodels/Models.h"
+
+#include <cstdlib>
+#include <vector>
+
+
+//---------------------------------------------------------------------
+// Tests
+//---------------------------------------------------------------------
+
+/**
+ * Evaluating a model at several latent space coordinates at once produces
+ * the images evaluating it at each of them does, up to rounding of the last
+ * bit of a pixel.
+ */
+TEST(ShapeOdds, batchMatchesSingleEvaluation) {
+  const unsigned w = 7, h = 5, latentDims = 3, numZ = 11;
+  Eigen::MatrixXd W = Eigen::MatrixXd::Random(w * h, latentDims) * 4.0;
+  Eigen::MatrixXd w0 = Eigen::MatrixXd::Random(w * h, 1);
+  Eigen::MatrixXd Z = Eigen::MatrixXd::Random(numZ, latentDims);
+  dspacex::Model model;
+  model.setModel(W, w0, Z);
+
+  std::vector<Image> images = dspacex::ShapeOdds::evaluateModelImages(model, Z, w, h);
+  ASSERT_EQ(numZ, images.size());
+  for (unsigned i = 0; i < numZ; i++) {
+    Eigen::MatrixXd I = dspacex::ShapeOdds::evaluateModel(model, model.getZCoord(i));
+    Eigen::MatrixXd expected = (I.array() * 255.0).matrix();
+    expected.resize(h, w);
+
+    const std::vector<char> &png = images[i].getConstRawData();
+    std::vector<unsigned char> pixels;
+    unsigned width, height;
+    ASSERT_EQ(0u, lodepng::decode(pixels, width, height,
+                                  reinterpret_cast<const unsigned char *>(png.data()), png.size(),
+                                  LCT_GREY, 8));
+    ASSERT_EQ(w, width);
+    ASSERT_EQ(h, height);
+    for (unsigned r = 0; r < h; r++) {
+      for (unsigned c = 0; c < w; c++) {
+        EXPECT_NEAR(unsigned(expected(r, c)), pixels[r * w + c], 1);
+      }
+    }
+  }
+}
+
+/**
+ * A cancelled batch stops before evaluating the model.
+ */
+TEST(ShapeOdds, batchStopsWhenCancelled) {
+  dspacex::Model model;
+  model.setModel(Eigen::MatrixXd::Zero(6, 2), Eigen::MatrixXd::Zero(6, 1), Eigen::MatrixXd::Zero(20, 2));
+  CancellationToken cancellation;
+  cancellation.cancel();
+  EXPECT_THROW(dspacex::ShapeOdds::evaluateModelImages(model, Eigen::MatrixXd::Zero(20, 2), 3, 2, &cancellation),
+               OperationCancelled);
+}
+
+/**
+ * The latent space coordinates regressed for several field values at once
+ * are those regressed for each of them.
+ */
+TEST(ShapeOdds, batchLatentSpaceValues) {
+  Eigen::MatrixXd Z = Eigen::MatrixXd::Random(6, 2);
+  dspacex::Model model;
+  model.setModel(Eigen::MatrixXd::Zero(4, 2), Eigen::MatrixXd::Zero(4, 1), Z);
+  for (unsigned i = 0; i < 6; i += 2) {
+    model.addSample(i);
+  }
+  Eigen::VectorXd values = Eigen::VectorXd::LinSpaced(6, 0.0, 1.0);
+  dspacex::BoundModel bound(model, Eigen::Map<Eigen::VectorXd>(values.data(), values.size()));
+
+  Eigen::VectorXd newValues = Eigen::VectorXd::LinSpaced(5, 0.0, 1.0);
+  Eigen::MatrixXd zs = bound.getNewLatentSpaceValues(newValues, 0.3);
+  ASSERT_EQ(5, zs.rows());
+  for (unsigned i = 0; i < 5; i++) {
+    EXPECT_TRUE(zs.row(i).isApprox(bound.getNewLatentSpaceValue(newValues(i), 0.3)));
+  }
+}